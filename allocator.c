@@ -0,0 +1,80 @@
+#include <string.h>
+#include "allocator.h"
+
+/**
+ * Allocates size bytes with the given allocator.
+ * @param alloc an allocator, NULL for malloc.
+ * @param size the number of bytes.
+ * @return the allocated memory, NULL if failed.
+ */
+void *allocator_alloc (const allocator *alloc, size_t size)
+{
+  if (alloc == NULL)
+    {
+      return malloc (size);
+    }
+  return alloc->alloc (size, alloc->ctx);
+}
+
+/**
+ * Allocates n zeroed elements of the given size with the given allocator.
+ * @param alloc an allocator, NULL for calloc.
+ * @param n the number of elements.
+ * @param size the size of an element.
+ * @return the allocated memory, NULL if failed.
+ */
+void *allocator_calloc (const allocator *alloc, size_t n, size_t size)
+{
+  if (alloc == NULL)
+    {
+      return calloc (n, size);
+    }
+  if (size != 0 && n > (size_t) -1 / size)
+    {
+      return NULL;
+    }
+  void *ptr = alloc->alloc (n * size, alloc->ctx);
+  if (ptr != NULL)
+    {
+      memset (ptr, 0, n * size);
+    }
+  return ptr;
+}
+
+/**
+ * Re-sizes memory allocated with the given allocator.
+ * @param alloc an allocator, NULL for realloc.
+ * @param ptr the memory to re-size.
+ * @param old_size the size ptr was allocated with.
+ * @param new_size the new size.
+ * @return the re-sized memory, NULL if failed (and then ptr is still valid).
+ */
+void *allocator_realloc (const allocator *alloc, void *ptr, size_t old_size,
+                         size_t new_size)
+{
+  if (alloc == NULL)
+    {
+      return realloc (ptr, new_size);
+    }
+  return alloc->realloc (ptr, old_size, new_size, alloc->ctx);
+}
+
+/**
+ * Frees memory allocated with the given allocator.
+ * @param alloc an allocator, NULL for free.
+ * @param ptr the memory to free (may be NULL).
+ * @param size the size ptr was allocated with.
+ */
+void allocator_free (const allocator *alloc, void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    {
+      return;
+    }
+  if (alloc == NULL)
+    {
+      free (ptr);
+      return;
+    }
+  alloc->free (ptr, size, alloc->ctx);
+}
@@ -0,0 +1,62 @@
+#ifndef ALLOCATOR_H_
+#define ALLOCATOR_H_
+
+#include <stdlib.h>
+
+/**
+ * @struct allocator
+ * The functions a hash map, a vector or a pair allocate their memory with
+ * (e.g. an arena, a bump allocator or an allocator that tracks the used
+ * memory). The sizes are passed to realloc and free too, so allocators
+ * that do not keep them can be used. A NULL allocator is malloc, realloc
+ * and free.
+ * @param alloc returns size bytes, NULL if failed.
+ * @param realloc re-sizes an allocation of old_size bytes to new_size bytes,
+ * returns NULL if failed (and then ptr is still valid).
+ * @param free frees an allocation of size bytes.
+ * @param ctx passed to all the functions.
+ */
+typedef struct allocator {
+    void *(*alloc) (size_t size, void *ctx);
+    void *(*realloc) (void *ptr, size_t old_size, size_t new_size, void *ctx);
+    void (*free) (void *ptr, size_t size, void *ctx);
+    void *ctx;
+} allocator;
+
+/**
+ * Allocates size bytes with the given allocator.
+ * @param alloc an allocator, NULL for malloc.
+ * @param size the number of bytes.
+ * @return the allocated memory, NULL if failed.
+ */
+void *allocator_alloc (const allocator *alloc, size_t size);
+
+/**
+ * Allocates n zeroed elements of the given size with the given allocator.
+ * @param alloc an allocator, NULL for calloc.
+ * @param n the number of elements.
+ * @param size the size of an element.
+ * @return the allocated memory, NULL if failed.
+ */
+void *allocator_calloc (const allocator *alloc, size_t n, size_t size);
+
+/**
+ * Re-sizes memory allocated with the given allocator.
+ * @param alloc an allocator, NULL for realloc.
+ * @param ptr the memory to re-size.
+ * @param old_size the size ptr was allocated with.
+ * @param new_size the new size.
+ * @return the re-sized memory, NULL if failed (and then ptr is still valid).
+ */
+void *allocator_realloc (const allocator *alloc, void *ptr, size_t old_size,
+                         size_t new_size);
+
+/**
+ * Frees memory allocated with the given allocator.
+ * @param alloc an allocator, NULL for free.
+ * @param ptr the memory to free (may be NULL).
+ * @param size the size ptr was allocated with.
+ */
+void allocator_free (const allocator *alloc, void *ptr, size_t size);
+
+#endif //ALLOCATOR_H_
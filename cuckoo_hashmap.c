@@ -0,0 +1,467 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include "cuckoo_hashmap.h"
+
+/**
+ * @def CACHE_LINE
+ * The alignment of the buckets array, so every bucket is one cache line.
+ */
+#define CACHE_LINE 64
+
+/**
+ * @def SECOND_HASH_SEED
+ * Mixed into the hash to derive the second bucket.
+ */
+#define SECOND_HASH_SEED 0x9E3779B97F4A7C15ULL
+
+/**
+ * @struct search_node
+ * A bucket visited while searching for a free slot.
+ * @param bucket the index of the bucket.
+ * @param parent the node of the bucket the pair moving here comes from,
+ * -1 for the two buckets of the inserted key.
+ * @param slot the slot of the moving pair in the parent bucket.
+ */
+typedef struct search_node {
+    size_t bucket;
+    int parent;
+    int slot;
+} search_node;
+
+/**
+ * finds the two buckets a key with the given hash can be in.
+ * The two buckets are always different.
+ */
+static void buckets_of (const cuckoo_hashmap *map, size_t hash, size_t *b1,
+                        size_t *b2)
+{
+  *b1 = hashmap_mix (hash ^ map->seed) & (map->capacity - 1);
+  *b2 = hashmap_mix (hash ^ map->seed ^ SECOND_HASH_SEED) & (map->capacity - 1);
+  if (*b2 == *b1)
+    {
+      *b2 = *b1 ^ 1;
+    }
+}
+
+/**
+ * @return the other bucket a key with the given hash, which is in bucket b,
+ * can be in.
+ */
+static size_t other_bucket (const cuckoo_hashmap *map, size_t hash, size_t b)
+{
+  size_t b1, b2;
+  buckets_of (map, hash, &b1, &b2);
+  return b == b1 ? b2 : b1;
+}
+
+/**
+ * allocates capacity empty buckets, aligned to a cache line.
+ * @return the buckets, NULL if failed.
+ */
+static cuckoo_bucket *alloc_buckets (size_t capacity)
+{
+  void *buckets = NULL;
+  if (posix_memalign (&buckets, CACHE_LINE,
+                      capacity * sizeof (cuckoo_bucket)) != 0)
+    {
+      return NULL;
+    }
+  memset (buckets, 0, capacity * sizeof (cuckoo_bucket));
+  return buckets;
+}
+
+/**
+ * finds the pair with the given key.
+ * @param bucket set to the bucket of the pair, or to capacity for the stash.
+ * @param slot set to the slot of the pair in the bucket (or the stash).
+ * @return 1 if found, 0 otherwise.
+ */
+static int find_slot (const cuckoo_hashmap *map, const_keyT key, size_t hash,
+                      size_t *bucket, int *slot)
+{
+  size_t b[2];
+  buckets_of (map, hash, &b[0], &b[1]);
+  for (int i = 0; i < 2; i++)
+    {
+      const cuckoo_bucket *cur = &map->buckets[b[i]];
+      for (int s = 0; s < CUCKOO_HASH_MAP_SLOTS; s++)
+        {
+          // compare the hash first, it is cheaper than key_cmp.
+          if (cur->pairs[s] != NULL && cur->hashes[s] == hash
+              && cur->pairs[s]->key_cmp (cur->pairs[s]->key, key))
+            {
+              *bucket = b[i];
+              *slot = s;
+              return 1;
+            }
+        }
+    }
+  for (size_t s = 0; s < map->stash_size; s++)
+    {
+      const cuckoo_slot *cur = &map->stash[s];
+      if (cur->hash == hash && cur->pair->key_cmp (cur->pair->key, key))
+        {
+          *bucket = map->capacity;
+          *slot = (int) s;
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/**
+ * moves the pairs along the path found by make_room, from the bucket with
+ * the free slot back to one of the buckets of the new key.
+ * Every move checks the pair still belongs to both buckets, so if the path
+ * crossed itself the moves stop and the map is still valid.
+ * @return 1 if all the moves were done, 0 otherwise.
+ */
+static int move_path (cuckoo_hashmap *map, const search_node *nodes, int last,
+                      int free_slot, size_t *bucket, int *slot)
+{
+  size_t to_b = nodes[last].bucket;
+  int to_s = free_slot;
+  for (int cur = last; nodes[cur].parent >= 0; cur = nodes[cur].parent)
+    {
+      size_t from_b = nodes[nodes[cur].parent].bucket;
+      int from_s = nodes[cur].slot;
+      cuckoo_bucket *from = &map->buckets[from_b];
+      cuckoo_bucket *to = &map->buckets[to_b];
+      if (to->pairs[to_s] != NULL || from->pairs[from_s] == NULL
+          || other_bucket (map, from->hashes[from_s], from_b) != to_b)
+        {
+          return 0;
+        }
+      to->pairs[to_s] = from->pairs[from_s];
+      to->hashes[to_s] = from->hashes[from_s];
+      from->pairs[from_s] = NULL;
+      to_b = from_b;
+      to_s = from_s;
+    }
+  *bucket = to_b;
+  *slot = to_s;
+  return 1;
+}
+
+/**
+ * searches (breadth first) for a chain of pairs that can each move to their
+ * other bucket, ending in a bucket with a free slot, and moves them.
+ * @param bucket set to the bucket (b1 or b2) that now has a free slot.
+ * @param slot set to the free slot in the bucket.
+ * @return 1 if a slot was freed, 0 otherwise.
+ */
+static int make_room (cuckoo_hashmap *map, size_t b1, size_t b2,
+                      size_t *bucket, int *slot)
+{
+  search_node nodes[CUCKOO_HASH_MAP_MAX_SEARCH];
+  nodes[0] = (search_node) {b1, -1, -1};
+  nodes[1] = (search_node) {b2, -1, -1};
+  int count = 2;
+  for (int head = 0; head < count; head++)
+    {
+      const cuckoo_bucket *cur = &map->buckets[nodes[head].bucket];
+      for (int s = 0; s < CUCKOO_HASH_MAP_SLOTS; s++)
+        {
+          if (cur->pairs[s] == NULL)
+            {
+              return move_path (map, nodes, head, s, bucket, slot);
+            }
+        }
+      for (int s = 0; s < CUCKOO_HASH_MAP_SLOTS
+                      && count < CUCKOO_HASH_MAP_MAX_SEARCH; s++)
+        {
+          size_t next = other_bucket (map, cur->hashes[s],
+                                      nodes[head].bucket);
+          nodes[count++] = (search_node) {next, head, s};
+        }
+    }
+  return 0;
+}
+
+/**
+ * @return 1 if the pair was put in a free slot of one of its buckets,
+ * 0 otherwise.
+ */
+static int place_direct (cuckoo_hashmap *map, size_t hash, pair *new_pair)
+{
+  size_t b[2];
+  buckets_of (map, hash, &b[0], &b[1]);
+  for (int i = 0; i < 2; i++)
+    {
+      cuckoo_bucket *cur = &map->buckets[b[i]];
+      for (int s = 0; s < CUCKOO_HASH_MAP_SLOTS; s++)
+        {
+          if (cur->pairs[s] == NULL)
+            {
+              cur->pairs[s] = new_pair;
+              cur->hashes[s] = hash;
+              return 1;
+            }
+        }
+    }
+  return 0;
+}
+
+/**
+ * places a pair (whose key is not in the map) in one of its buckets,
+ * moving other pairs if needed, or in the stash.
+ * @return 1 for success, 0 if there is no place for it.
+ */
+static int place (cuckoo_hashmap *map, size_t hash, pair *new_pair)
+{
+  if (place_direct (map, hash, new_pair))
+    {
+      return 1;
+    }
+  size_t b1, b2, bucket;
+  int slot;
+  buckets_of (map, hash, &b1, &b2);
+  if (make_room (map, b1, b2, &bucket, &slot))
+    {
+      map->buckets[bucket].pairs[slot] = new_pair;
+      map->buckets[bucket].hashes[slot] = hash;
+      return 1;
+    }
+  if (map->stash_size < CUCKOO_HASH_MAP_STASH_SIZE)
+    {
+      map->stash[map->stash_size++] = (cuckoo_slot) {hash, new_pair};
+      return 1;
+    }
+  return 0;
+}
+
+/**
+ * re-builds the map with the given number of buckets and a new seed,
+ * and places new_pair in it too (if not NULL).
+ * The pairs themselves are not copied, only moved to the new buckets.
+ * @return 1 for success, 0 otherwise (and then the map is not changed).
+ */
+static int rebuild (cuckoo_hashmap *map, size_t capacity, size_t hash,
+                    pair *new_pair)
+{
+  cuckoo_hashmap new_map = *map;
+  new_map.buckets = alloc_buckets (capacity);
+  if (new_map.buckets == NULL)
+    {
+      return 0;
+    }
+  new_map.capacity = capacity;
+  new_map.seed = hashmap_mix (map->seed + SECOND_HASH_SEED);
+  new_map.stash_size = 0;
+  int res = 1;
+  for (size_t b = 0; res && b < map->capacity; b++)
+    {
+      for (int s = 0; res && s < CUCKOO_HASH_MAP_SLOTS; s++)
+        {
+          if (map->buckets[b].pairs[s] != NULL)
+            {
+              res = place (&new_map, map->buckets[b].hashes[s],
+                           map->buckets[b].pairs[s]);
+            }
+        }
+    }
+  for (size_t s = 0; res && s < map->stash_size; s++)
+    {
+      res = place (&new_map, map->stash[s].hash, map->stash[s].pair);
+    }
+  if (res && new_pair != NULL)
+    {
+      res = place (&new_map, hash, new_pair);
+    }
+  if (!res)
+    {
+      free (new_map.buckets);
+      return 0;
+    }
+  free (map->buckets);
+  *map = new_map;
+  return 1;
+}
+
+/**
+ * Allocates dynamically new cuckoo hash map element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated cuckoo_hashmap.
+ * @if_fail return NULL.
+ */
+cuckoo_hashmap *cuckoo_hashmap_alloc (hash_func func)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  cuckoo_hashmap *map = malloc (sizeof *map);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->buckets = alloc_buckets (CUCKOO_HASH_MAP_INITIAL_CAP);
+  if (map->buckets == NULL)
+    {
+      free (map);
+      return NULL;
+    }
+  map->stash_size = 0;
+  map->size = 0;
+  map->capacity = CUCKOO_HASH_MAP_INITIAL_CAP;
+  map->seed = 0;
+  map->hash_func = func;
+  return map;
+}
+
+/**
+ * Frees a cuckoo hash map and the elements the map itself allocated.
+ * @param p_map pointer to dynamically allocated pointer to cuckoo_hashmap.
+ */
+void cuckoo_hashmap_free (cuckoo_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  cuckoo_hashmap *map = *p_map;
+  for (size_t b = 0; b < map->capacity; b++)
+    {
+      for (int s = 0; s < CUCKOO_HASH_MAP_SLOTS; s++)
+        {
+          pair_free ((void **) &map->buckets[b].pairs[s]);
+        }
+    }
+  for (size_t s = 0; s < map->stash_size; s++)
+    {
+      pair_free ((void **) &map->stash[s].pair);
+    }
+  free (map->buckets);
+  free (map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair to the cuckoo hash map.
+ * @param map the cuckoo hash map to be inserted with new element.
+ * @param in_pair a in_pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int cuckoo_hashmap_insert (cuckoo_hashmap *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = map->hash_func (in_pair->key);
+  size_t bucket;
+  int slot;
+  if (find_slot (map, in_pair->key, hash, &bucket, &slot))
+    {
+      return 0;
+    }
+  // grow before the buckets get too full to find free slots quickly.
+  if ((map->size + 1) / (double) (map->capacity * CUCKOO_HASH_MAP_SLOTS)
+      > CUCKOO_HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      rebuild (map, map->capacity * HASH_MAP_GROWTH_FACTOR, 0, NULL);
+    }
+  pair *new_pair = pair_copy (in_pair);
+  if (new_pair == NULL)
+    {
+      return 0;
+    }
+  int res = place (map, hash, new_pair);
+  size_t capacity = map->capacity;
+  for (int i = 0; !res && i < CUCKOO_HASH_MAP_MAX_REHASH; i++)
+    {
+      capacity *= HASH_MAP_GROWTH_FACTOR;
+      res = rebuild (map, capacity, hash, new_pair);
+    }
+  if (!res)
+    {
+      pair_free ((void **) &new_pair);
+      return 0;
+    }
+  map->size++;
+  return 1;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a cuckoo hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself, not a copy of it).
+ */
+valueT cuckoo_hashmap_at (const cuckoo_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  size_t bucket;
+  int slot;
+  if (!find_slot (map, key, map->hash_func (key), &bucket, &slot))
+    {
+      return NULL;
+    }
+  if (bucket == map->capacity)
+    {
+      return map->stash[slot].pair->value;
+    }
+  return map->buckets[bucket].pairs[slot]->value;
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a cuckoo hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int cuckoo_hashmap_erase (cuckoo_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  size_t bucket;
+  int slot;
+  if (!find_slot (map, key, map->hash_func (key), &bucket, &slot))
+    {
+      return 0;
+    }
+  if (bucket == map->capacity)
+    {
+      pair_free ((void **) &map->stash[slot].pair);
+      map->stash[slot] = map->stash[--map->stash_size];
+      map->size--;
+      return 1;
+    }
+  pair_free ((void **) &map->buckets[bucket].pairs[slot]);
+  map->size--;
+  // a slot was freed, so pairs in the stash may fit in their buckets now.
+  for (size_t s = 0; s < map->stash_size;)
+    {
+      if (place_direct (map, map->stash[s].hash, map->stash[s].pair))
+        {
+          map->stash[s] = map->stash[--map->stash_size];
+        }
+      else
+        {
+          s++;
+        }
+    }
+  return 1;
+}
+
+/**
+ * This function returns the load factor of the cuckoo hash map
+ * (the used part of the slots).
+ * @param map a cuckoo hash map.
+ * @return the map's load factor, -1 if the function failed.
+ */
+double cuckoo_hashmap_get_load_factor (const cuckoo_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return -1;
+    }
+  return map->size / (double) (map->capacity * CUCKOO_HASH_MAP_SLOTS);
+}
@@ -0,0 +1,139 @@
+#ifndef CUCKOO_HASHMAP_H_
+#define CUCKOO_HASHMAP_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @def CUCKOO_HASH_MAP_INITIAL_CAP
+ * The initial number of buckets of the cuckoo hash map.
+ */
+#define CUCKOO_HASH_MAP_INITIAL_CAP 4UL
+
+/**
+ * @def CUCKOO_HASH_MAP_SLOTS
+ * The number of slots in every bucket (a bucket is one 64 bytes cache line).
+ */
+#define CUCKOO_HASH_MAP_SLOTS 4
+
+/**
+ * @def CUCKOO_HASH_MAP_STASH_SIZE
+ * The number of pairs that can be kept outside of the buckets, when no
+ * place can be made for them.
+ */
+#define CUCKOO_HASH_MAP_STASH_SIZE 4
+
+/**
+ * @def CUCKOO_HASH_MAP_MAX_SEARCH
+ * The number of buckets the search for a free slot visits before the pair
+ * goes to the stash.
+ */
+#define CUCKOO_HASH_MAP_MAX_SEARCH 256
+
+/**
+ * @def CUCKOO_HASH_MAP_MAX_REHASH
+ * The number of times an insert re-builds the map (with a new seed and
+ * twice the buckets) before it fails.
+ */
+#define CUCKOO_HASH_MAP_MAX_REHASH 4
+
+/**
+ * @def CUCKOO_HASH_MAP_MAX_LOAD_FACTOR
+ * The maximal part of the slots that can be used, above it the map grows.
+ */
+#define CUCKOO_HASH_MAP_MAX_LOAD_FACTOR 0.9
+
+/**
+ * @struct cuckoo_slot
+ * @param hash the value hash_func returned for the key of the pair.
+ * @param pair the stored pair, NULL if the slot is empty.
+ */
+typedef struct cuckoo_slot {
+    size_t hash;
+    pair *pair;
+} cuckoo_slot;
+
+/**
+ * @struct cuckoo_bucket
+ * @param hashes the hashes of the pairs in the bucket.
+ * @param pairs the pairs in the bucket, NULL for empty slots.
+ */
+typedef struct cuckoo_bucket {
+    size_t hashes[CUCKOO_HASH_MAP_SLOTS];
+    pair *pairs[CUCKOO_HASH_MAP_SLOTS];
+} cuckoo_bucket;
+
+/**
+ * @struct cuckoo_hashmap
+ * A bucketized cuckoo hash map: every key can be in one of two buckets
+ * (chosen by two hashes derived from hash_func), or in the small stash.
+ * So a lookup reads at most two buckets, whatever the keys are.
+ * @param buckets array of capacity buckets.
+ * @param stash the pairs that did not fit in their buckets.
+ * @param stash_size the number of pairs in the stash.
+ * @param size the number of elements (pairs) stored in the map.
+ * @param capacity the number of buckets, a power of 2.
+ * @param seed the seed the two bucket hashes are derived with.
+ * @param hash_func a function which "hashes" keys.
+ */
+typedef struct cuckoo_hashmap {
+    cuckoo_bucket *buckets;
+    cuckoo_slot stash[CUCKOO_HASH_MAP_STASH_SIZE];
+    size_t stash_size;
+    size_t size;
+    size_t capacity;
+    size_t seed;
+    hash_func hash_func;
+} cuckoo_hashmap;
+
+/**
+ * Allocates dynamically new cuckoo hash map element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated cuckoo_hashmap.
+ * @if_fail return NULL.
+ */
+cuckoo_hashmap *cuckoo_hashmap_alloc (hash_func func);
+
+/**
+ * Frees a cuckoo hash map and the elements the map itself allocated.
+ * @param p_map pointer to dynamically allocated pointer to cuckoo_hashmap.
+ */
+void cuckoo_hashmap_free (cuckoo_hashmap **p_map);
+
+/**
+ * Inserts a copy of in_pair to the cuckoo hash map.
+ * If no place can be made for the pair (e.g. too many keys with the same
+ * hash), the map is re-built with a new seed and more buckets, and if that
+ * fails too the map is left unchanged.
+ * @param map the cuckoo hash map to be inserted with new element.
+ * @param in_pair a in_pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int cuckoo_hashmap_insert (cuckoo_hashmap *map, const pair *in_pair);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a cuckoo hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself, not a copy of it).
+ */
+valueT cuckoo_hashmap_at (const cuckoo_hashmap *map, const_keyT key);
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a cuckoo hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int cuckoo_hashmap_erase (cuckoo_hashmap *map, const_keyT key);
+
+/**
+ * This function returns the load factor of the cuckoo hash map
+ * (the used part of the slots).
+ * @param map a cuckoo hash map.
+ * @return the map's load factor, -1 if the function failed.
+ */
+double cuckoo_hashmap_get_load_factor (const cuckoo_hashmap *map);
+
+#endif //CUCKOO_HASHMAP_H_
@@ -0,0 +1,339 @@
+#include <string.h>
+#include "frozen_hashmap.h"
+
+/**
+ * @def DIRECT_SLOT
+ * Marks a displacement which is the slot itself.
+ */
+#define DIRECT_SLOT 0x80000000U
+
+/**
+ * @struct bucket_info
+ * @param size the number of keys in the bucket.
+ * @param ind the index of the bucket.
+ */
+typedef struct bucket_info {
+    size_t size;
+    size_t ind;
+} bucket_info;
+
+/**
+ * @return the displacement bucket of the given hash.
+ */
+static size_t bucket_of (size_t hash, size_t n_buckets)
+{
+  return hashmap_mix (hash) % n_buckets;
+}
+
+/**
+ * @return the slot of the given hash with the given displacement, two more
+ * hashes are derived from the hash: slot = (h1 + disp * h2) % size.
+ */
+static size_t displaced_slot (size_t hash, uint32_t disp, size_t size)
+{
+  uint64_t base = hashmap_mix (hash);
+  uint64_t h1 = hashmap_mix (base + 0x9E3779B97F4A7C15ULL);
+  uint64_t h2 = hashmap_mix (base + 2 * 0x9E3779B97F4A7C15ULL);
+  return (h1 + disp * h2) % size;
+}
+
+/**
+ * @return the slot of the given hash.
+ */
+static size_t slot_of (const frozen_hashmap *frozen, size_t hash)
+{
+  uint32_t disp = frozen->displacements[bucket_of (hash, frozen->n_buckets)];
+  if (disp & DIRECT_SLOT)
+    {
+      return disp & ~DIRECT_SLOT;
+    }
+  return displaced_slot (hash, disp, frozen->size);
+}
+
+/**
+ * orders buckets from the biggest to the smallest.
+ */
+static int bucket_info_cmp (const void *b1, const void *b2)
+{
+  const bucket_info *info1 = b1;
+  const bucket_info *info2 = b2;
+  if (info1->size != info2->size)
+    {
+      return info1->size < info2->size ? 1 : -1;
+    }
+  return info1->ind < info2->ind ? -1 : info1->ind > info2->ind;
+}
+
+/**
+ * copies a pair to a slot.
+ * @return 1 for success, 0 if a copy failed (and then the slot stays
+ * empty).
+ */
+static int copy_slot (frozen_slot *slot, const pair *in_pair, size_t hash)
+{
+  keyT key = in_pair->key_cpy (in_pair->key);
+  valueT value = in_pair->value_cpy (in_pair->value);
+  if (key == NULL || (value == NULL && in_pair->value != NULL))
+    {
+      if (key != NULL)
+        {
+          in_pair->key_free (&key);
+        }
+      if (value != NULL)
+        {
+          in_pair->value_free (&value);
+        }
+      return 0;
+    }
+  slot->hash = hash;
+  slot->key = key;
+  slot->value = value;
+  return 1;
+}
+
+/**
+ * tries to place all the pairs of one bucket with the given displacement.
+ * @param slots filled with the slots of the pairs.
+ * @return 1 if all the slots are free and distinct (and then takes them),
+ * 0 otherwise.
+ */
+static int try_displacement (const frozen_hashmap *frozen, size_t *hashes,
+                             size_t n, uint32_t disp, unsigned char *taken,
+                             size_t *slots)
+{
+  size_t i = 0;
+  for (; i < n; i++)
+    {
+      slots[i] = displaced_slot (hashes[i], disp, frozen->size);
+      if (taken[slots[i]])
+        {
+          break;
+        }
+      taken[slots[i]] = 1;
+    }
+  if (i < n)
+    {
+      // release the slots this displacement took.
+      for (size_t j = 0; j < i; j++)
+        {
+          taken[slots[j]] = 0;
+        }
+      return 0;
+    }
+  return 1;
+}
+
+/**
+ * places the pairs, grouped to buckets, in the slots of the frozen map.
+ * @param pairs the pairs, the pairs of each bucket are consecutive.
+ * @param hashes the hashes of the pairs.
+ * @param starts the index of the first pair of every bucket (n_buckets + 1).
+ * @return 1 for success, 0 otherwise (a bucket could not be placed or a copy
+ * failed, the slots copied so far are freed with the frozen map).
+ */
+static int place_buckets (frozen_hashmap *frozen, pair **pairs,
+                          size_t *hashes, const size_t *starts)
+{
+  bucket_info *order = malloc (frozen->n_buckets * sizeof (bucket_info));
+  unsigned char *taken = calloc (frozen->size, 1);
+  size_t *slots = malloc (frozen->size * sizeof (size_t));
+  int res = order != NULL && taken != NULL && slots != NULL;
+  for (size_t b = 0; res && b < frozen->n_buckets; b++)
+    {
+      order[b].size = starts[b + 1] - starts[b];
+      order[b].ind = b;
+    }
+  if (res)
+    {
+      // the big buckets are the hardest to place, so place them first.
+      qsort (order, frozen->n_buckets, sizeof (bucket_info), bucket_info_cmp);
+    }
+  size_t free_slot = 0;
+  for (size_t b = 0; res && b < frozen->n_buckets && order[b].size > 0; b++)
+    {
+      size_t first = starts[order[b].ind];
+      size_t n = order[b].size;
+      if (n == 1)
+        {
+          // a single key can take any free slot directly.
+          while (taken[free_slot])
+            {
+              free_slot++;
+            }
+          taken[free_slot] = 1;
+          frozen->displacements[order[b].ind] = DIRECT_SLOT | free_slot;
+          res = copy_slot (&frozen->slots[free_slot], pairs[first],
+                           hashes[first]);
+          continue;
+        }
+      uint32_t disp = 0;
+      while (disp < FROZEN_HASH_MAP_MAX_DISPLACEMENT
+             && !try_displacement (frozen, hashes + first, n, disp, taken,
+                                   slots))
+        {
+          disp++;
+        }
+      frozen->displacements[order[b].ind] = disp;
+      res = disp < FROZEN_HASH_MAP_MAX_DISPLACEMENT;
+      for (size_t i = 0; res && i < n; i++)
+        {
+          res = copy_slot (&frozen->slots[slots[i]], pairs[first + i],
+                           hashes[first + i]);
+        }
+    }
+  free (slots);
+  free (taken);
+  free (order);
+  return res;
+}
+
+/**
+ * groups the pairs of the hash map to buckets (counting sort by bucket).
+ * @param pairs array of size pairs to fill.
+ * @param hashes array of size hashes to fill.
+ * @param starts array of n_buckets + 1 indices to fill, the pairs of
+ * bucket b would be [starts[b], starts[b + 1]).
+ * @return 1 for success, 0 if two keys have the same hash.
+ */
+static int group_pairs (const hashmap *hash_map, frozen_hashmap *frozen,
+                        pair **pairs, size_t *hashes, size_t *starts)
+{
+  memset (starts, 0, (frozen->n_buckets + 1) * sizeof (size_t));
+  for (size_t i = 0; i < hash_map->capacity; i++)
+    {
+      for (const hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          starts[bucket_of (node->hash, frozen->n_buckets) + 1]++;
+        }
+    }
+  for (size_t b = 0; b < frozen->n_buckets; b++)
+    {
+      starts[b + 1] += starts[b];
+    }
+  // starts[b] is used as the next free position of bucket b, and then
+  // moved back.
+  for (size_t i = 0; i < hash_map->capacity; i++)
+    {
+      for (hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          size_t b = bucket_of (node->hash, frozen->n_buckets);
+          pairs[starts[b]] = &node->pair;
+          hashes[starts[b]] = node->hash;
+          starts[b]++;
+        }
+    }
+  memmove (starts + 1, starts, frozen->n_buckets * sizeof (size_t));
+  starts[0] = 0;
+  for (size_t b = 0; b < frozen->n_buckets; b++)
+    {
+      for (size_t i = starts[b]; i < starts[b + 1]; i++)
+        {
+          for (size_t k = starts[b]; k < i; k++)
+            {
+              if (hashes[k] == hashes[i])
+                {
+                  return 0;
+                }
+            }
+        }
+    }
+  return 1;
+}
+
+/**
+ * Creates a frozen copy of the hash map. The keys and values are copied
+ * with the copy functions of the stored pairs (all the pairs are expected
+ * to use the same functions), the hash map itself is not changed.
+ * @param hash_map a hash map.
+ * @return pointer to dynamically allocated frozen_hashmap.
+ * @if_fail return NULL (also if two keys have the same hash, since no
+ * perfect hash can tell them apart).
+ */
+frozen_hashmap *hashmap_freeze (const hashmap *hash_map)
+{
+  if (hash_map == NULL || hash_map->size >= DIRECT_SLOT)
+    {
+      return NULL;
+    }
+  frozen_hashmap *frozen = calloc (1, sizeof *frozen);
+  if (frozen == NULL)
+    {
+      return NULL;
+    }
+  frozen->size = hash_map->size;
+  frozen->n_buckets = hash_map->size / FROZEN_HASH_MAP_BUCKET_SIZE + 1;
+  frozen->hash_func = hash_map->hash_func;
+  frozen->slots = calloc (frozen->size + 1, sizeof (frozen_slot));
+  frozen->displacements = calloc (frozen->n_buckets, sizeof (uint32_t));
+  pair **pairs = malloc ((frozen->size + 1) * sizeof (pair *));
+  size_t *hashes = malloc ((frozen->size + 1) * sizeof (size_t));
+  size_t *starts = malloc ((frozen->n_buckets + 1) * sizeof (size_t));
+  int res = frozen->slots != NULL && frozen->displacements != NULL
+            && pairs != NULL && hashes != NULL && starts != NULL
+            && group_pairs (hash_map, frozen, pairs, hashes, starts);
+  if (res && frozen->size > 0)
+    {
+      frozen->key_cmp = pairs[0]->key_cmp;
+      frozen->key_free = pairs[0]->key_free;
+      frozen->value_free = pairs[0]->value_free;
+      res = place_buckets (frozen, pairs, hashes, starts);
+    }
+  free (starts);
+  free (hashes);
+  free (pairs);
+  if (!res)
+    {
+      frozen_hashmap_free (&frozen);
+    }
+  return frozen;
+}
+
+/**
+ * Frees a frozen hash map and the keys and values it copied.
+ * @param p_frozen pointer to dynamically allocated pointer to frozen_hashmap.
+ */
+void frozen_hashmap_free (frozen_hashmap **p_frozen)
+{
+  if (p_frozen == NULL || *p_frozen == NULL)
+    {
+      return;
+    }
+  frozen_hashmap *frozen = *p_frozen;
+  for (size_t i = 0; frozen->slots != NULL && i < frozen->size; i++)
+    {
+      if (frozen->slots[i].key != NULL)
+        {
+          frozen->key_free (&frozen->slots[i].key);
+          frozen->value_free (&frozen->slots[i].value);
+        }
+    }
+  free (frozen->slots);
+  free (frozen->displacements);
+  free (frozen);
+  *p_frozen = NULL;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param frozen a frozen hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself, not a copy of it).
+ */
+valueT frozen_hashmap_at (const frozen_hashmap *frozen, const_keyT key)
+{
+  if (frozen == NULL || key == NULL || frozen->size == 0)
+    {
+      return NULL;
+    }
+  size_t hash = frozen->hash_func (key);
+  const frozen_slot *slot = &frozen->slots[slot_of (frozen, hash)];
+  // a key which is not in the map lands on some other key's slot.
+  if (slot->hash != hash || !frozen->key_cmp (slot->key, key))
+    {
+      return NULL;
+    }
+  return slot->value;
+}
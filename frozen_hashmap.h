@@ -0,0 +1,85 @@
+#ifndef FROZEN_HASHMAP_H_
+#define FROZEN_HASHMAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/**
+ * @def FROZEN_HASH_MAP_BUCKET_SIZE
+ * The average number of keys in each displacement bucket.
+ * Bigger buckets means a smaller displacements array, but a slower freeze.
+ */
+#define FROZEN_HASH_MAP_BUCKET_SIZE 4UL
+
+/**
+ * @def FROZEN_HASH_MAP_MAX_DISPLACEMENT
+ * The number of displacements tried for a bucket before the freeze fails.
+ */
+#define FROZEN_HASH_MAP_MAX_DISPLACEMENT (1UL << 20)
+
+/**
+ * @struct frozen_slot
+ * @param hash the value hash_func returned for the key.
+ * @param key, value - copies of the key and value.
+ */
+typedef struct frozen_slot {
+    size_t hash;
+    keyT key;
+    valueT value;
+} frozen_slot;
+
+/**
+ * @struct frozen_hashmap
+ * An immutable hash map, built with a minimal perfect hash (CHD):
+ * the keys are split to buckets by one hash, and every bucket stores the
+ * displacement that sends all of its keys to distinct free slots.
+ * There is exactly one slot for every key, and every lookup reads
+ * one displacement and one slot.
+ * @param slots array of size slots.
+ * @param displacements the displacement of every bucket. A displacement
+ * with the top bit set is the slot itself (used for buckets with one key).
+ * @param size the number of elements (pairs) stored in the map.
+ * @param n_buckets the number of displacement buckets.
+ * @param hash_func a function which "hashes" keys.
+ * @param key_cmp compare function for the keys.
+ * @param key_free, value_free - free functions for key and value.
+ */
+typedef struct frozen_hashmap {
+    frozen_slot *slots;
+    uint32_t *displacements;
+    size_t size;
+    size_t n_buckets;
+    hash_func hash_func;
+    pair_key_cmp key_cmp;
+    pair_key_free key_free;
+    pair_value_free value_free;
+} frozen_hashmap;
+
+/**
+ * Creates a frozen copy of the hash map. The keys and values are copied
+ * with the copy functions of the stored pairs (all the pairs are expected
+ * to use the same functions), the hash map itself is not changed.
+ * @param hash_map a hash map.
+ * @return pointer to dynamically allocated frozen_hashmap.
+ * @if_fail return NULL (also if two keys have the same hash, since no
+ * perfect hash can tell them apart).
+ */
+frozen_hashmap *hashmap_freeze (const hashmap *hash_map);
+
+/**
+ * Frees a frozen hash map and the keys and values it copied.
+ * @param p_frozen pointer to dynamically allocated pointer to frozen_hashmap.
+ */
+void frozen_hashmap_free (frozen_hashmap **p_frozen);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param frozen a frozen hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself, not a copy of it).
+ */
+valueT frozen_hashmap_at (const frozen_hashmap *frozen, const_keyT key);
+
+#endif //FROZEN_HASHMAP_H_
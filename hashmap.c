@@ -1,245 +1,1631 @@
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include "hashmap.h"
 
+/**
+ * @struct rehash_worker
+ * The part of one thread in a parallel re-size. The old buckets are split
+ * to ranges, one for every worker, and so are the new buckets: a worker
+ * groups the nodes of its old range by the worker that owns their new
+ * bucket, and then builds its new buckets from the nodes all the workers
+ * grouped for it. The nodes are only re-linked, so nothing is copied.
+ * @param hash_map the re-sized map.
+ * @param new_buckets the buckets of the new capacity.
+ * @param new_capacity the new number of buckets.
+ * @param new_filter the filter of the new capacity (NULL if the map has no
+ * filter).
+ * @param workers all the workers of the re-size.
+ * @param n_workers the number of workers.
+ * @param ind the index of this worker.
+ * @param n the number of nodes in the old range.
+ * @param nodes the nodes of the old range, grouped by the worker that owns
+ * their new bucket.
+ * @param dests the new buckets of the nodes.
+ * @param starts n_workers + 1 indices, the nodes for worker w are
+ * [starts[w], starts[w + 1]).
+ * @param pos n_workers + 1 indices, where the next node for every worker
+ * goes while grouping.
+ * @param res 1 if the part of the worker succeeded, 0 otherwise.
+ */
+typedef struct rehash_worker {
+    hashmap *hash_map;
+    hashmap_node **new_buckets;
+    size_t new_capacity;
+    uint64_t *new_filter;
+    struct rehash_worker *workers;
+    size_t n_workers;
+    size_t ind;
+    size_t n;
+    hashmap_node **nodes;
+    size_t *dests;
+    size_t *starts;
+    size_t *pos;
+    int res;
+} rehash_worker;
+
 /**
  * Allocates dynamically new hash map element.
  * @param func a function which "hashes" keys.
  * @return pointer to dynamically allocated hashmap.
  * @if_fail return NULL.
  */
-hashmap *hashmap_alloc (hash_func func)
+hashmap *hashmap_alloc (hash_func func)
+{
+  return hashmap_alloc_with_allocator (func, NULL);
+}
+
+/**
+ * Allocates dynamically new hash map element, which allocates all its
+ * memory (the map, the buckets array and the nodes of the pairs) with the
+ * given allocator.
+ * @param func a function which "hashes" keys.
+ * @param alloc an allocator, NULL for malloc. It must live as long as the
+ * map.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_with_allocator (hash_func func, const allocator *alloc)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  hashmap *new_hashmap = allocator_alloc (alloc, sizeof *new_hashmap);
+  if (new_hashmap == NULL)
+    {
+      return NULL;
+    }
+  // initialize with calloc in order to set all buckets to NULL (empty).
+  new_hashmap->buckets = allocator_calloc (alloc, HASH_MAP_INITIAL_CAP,
+                                           sizeof (hashmap_node *));
+  if (new_hashmap->buckets == NULL)
+    {
+      allocator_free (alloc, new_hashmap, sizeof *new_hashmap);
+      return NULL;
+    }
+
+  new_hashmap->size = 0;
+  new_hashmap->capacity = HASH_MAP_INITIAL_CAP;
+  new_hashmap->hash_func = func;
+  new_hashmap->seed = 0;
+  new_hashmap->key_order = NULL;
+  new_hashmap->sorted = NULL;
+  new_hashmap->rehash_threads = 1;
+  new_hashmap->array_policy = (hashmap_array_policy) {NULL, NULL, NULL};
+  new_hashmap->allocator = alloc;
+  new_hashmap->filter = NULL;
+  new_hashmap->filter_blocks = 0;
+  new_hashmap->version = 0;
+  new_hashmap->node_extra = 0;
+
+  return new_hashmap;
+}
+
+/**
+ * The splitmix64 finalizer, spreads the bits of x over the whole word. The
+ * maps built on hashmap use it to spread the hashes of weak hash functions
+ * before taking some of their bits.
+ * @param x a hash (or any number).
+ * @return the mixed number.
+ */
+uint64_t hashmap_mix (uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * Allocates dynamically new hash map element, which is protected from keys
+ * crafted to collide: the hashes are mixed with a random seed before
+ * choosing the bucket, and buckets that still get more than
+ * HASH_MAP_SORTED_BUCKET_THRESHOLD pairs (keys with equal hashes) are
+ * indexed by key_order and binary searched.
+ * @param func a function which "hashes" keys.
+ * @param key_order a function which orders keys, NULL for seeding only.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_seeded (hash_func func, keyT_order key_order)
+{
+  static size_t counter = 0;
+  hashmap *new_hashmap = hashmap_alloc (func);
+  if (new_hashmap == NULL)
+    {
+      return NULL;
+    }
+  // the time, the address of the map (randomized by the OS) and a counter,
+  // so maps created at the same time get different seeds too. Maps may be
+  // allocated from several threads, so the counter is atomic.
+  size_t seed = hashmap_mix ((size_t) time (NULL) ^ (size_t) clock ());
+  seed = hashmap_mix (seed ^ (size_t) new_hashmap ^ (size_t) &counter);
+  seed = hashmap_mix (seed + __atomic_add_fetch (&counter, 1,
+                                                 __ATOMIC_RELAXED));
+  // 0 means not seeded.
+  new_hashmap->seed = seed == 0 ? 1 : seed;
+  if (key_order != NULL)
+    {
+      new_hashmap->sorted = allocator_calloc (new_hashmap->allocator,
+                                              HASH_MAP_INITIAL_CAP,
+                                              sizeof (hashmap_sorted_bucket *));
+      if (new_hashmap->sorted == NULL)
+        {
+          hashmap_free (&new_hashmap);
+          return NULL;
+        }
+    }
+  new_hashmap->key_order = key_order;
+  return new_hashmap;
+}
+
+/**
+ * Returns the bucket of a hash in a map with the given seed and capacity.
+ * @param hash the value hash_func returned for a key.
+ * @param seed the seed of the map (0 if not seeded).
+ * @param capacity the number of buckets of the map.
+ * @return the index of the bucket.
+ */
+size_t hashmap_bucket_index (size_t hash, size_t seed, size_t capacity)
+{
+  if (seed != 0)
+    {
+      hash = hashmap_mix (hash ^ seed);
+    }
+  return hash & (capacity - 1);
+}
+
+/**
+ * @return the number of filter blocks for a map with the given capacity,
+ * a power of 2.
+ */
+static size_t filter_blocks_for (size_t capacity)
+{
+  size_t blocks = capacity * HASH_MAP_FILTER_BITS_PER_BUCKET
+                  / (HASH_MAP_FILTER_BLOCK_WORDS * 64);
+  return blocks == 0 ? 1 : blocks;
+}
+
+/**
+ * allocates an empty filter of the given number of blocks.
+ * @return the filter, NULL if failed.
+ */
+static uint64_t *alloc_filter (const hashmap *hash_map, size_t blocks)
+{
+  return allocator_calloc (hash_map->allocator,
+                           blocks * HASH_MAP_FILTER_BLOCK_WORDS,
+                           sizeof (uint64_t));
+}
+
+/**
+ * frees a filter of the given number of blocks.
+ */
+static void free_filter (const hashmap *hash_map, uint64_t *filter,
+                         size_t blocks)
+{
+  allocator_free (hash_map->allocator, filter,
+                  blocks * HASH_MAP_FILTER_BLOCK_WORDS * sizeof (uint64_t));
+}
+
+/**
+ * adds a hash to a filter. The block is chosen by the low bits of the
+ * mixed hash and the bits in it by the high bits, so they do not follow
+ * the bucket index.
+ * @param shared 1 if other threads add to the filter at the same time.
+ */
+static void filter_add (uint64_t *filter, size_t blocks, size_t hash,
+                        int shared)
+{
+  uint64_t mixed = hashmap_mix (hash ^ 0x9E3779B97F4A7C15ULL);
+  uint64_t *block = filter + (mixed & (blocks - 1))
+                             * HASH_MAP_FILTER_BLOCK_WORDS;
+  for (int i = 0; i < HASH_MAP_FILTER_HASHES; i++)
+    {
+      unsigned pos = (unsigned) (mixed >> (28 + 9 * i)) & 511;
+      uint64_t bit = (uint64_t) 1 << (pos & 63);
+      if (shared)
+        {
+          __atomic_fetch_or (&block[pos >> 6], bit, __ATOMIC_RELAXED);
+        }
+      else
+        {
+          block[pos >> 6] |= bit;
+        }
+    }
+}
+
+/**
+ * @return 0 if the hash was never added to the filter, 1 if it may have
+ * been.
+ */
+static int filter_may_contain (const uint64_t *filter, size_t blocks,
+                               size_t hash)
+{
+  uint64_t mixed = hashmap_mix (hash ^ 0x9E3779B97F4A7C15ULL);
+  const uint64_t *block = filter + (mixed & (blocks - 1))
+                                   * HASH_MAP_FILTER_BLOCK_WORDS;
+  for (int i = 0; i < HASH_MAP_FILTER_HASHES; i++)
+    {
+      unsigned pos = (unsigned) (mixed >> (28 + 9 * i)) & 511;
+      if ((block[pos >> 6] & ((uint64_t) 1 << (pos & 63))) == 0)
+        {
+          return 0;
+        }
+    }
+  return 1;
+}
+
+/**
+ * allocates a node with copies of the key and the value of in_pair, with
+ * the allocator of the map.
+ * @param hash the value hash_func returned for the key of in_pair.
+ * @return the node, NULL if failed.
+ */
+static hashmap_node *node_alloc (const hashmap *hash_map,
+                                 const pair *in_pair, size_t hash)
+{
+  hashmap_node *node = allocator_alloc (hash_map->allocator,
+                                        sizeof *node + hash_map->node_extra);
+  if (node == NULL)
+    {
+      return NULL;
+    }
+  memset (node + 1, 0, hash_map->node_extra);
+  node->next = NULL;
+  node->hash = hash;
+  node->pair = *in_pair;
+  node->pair.key = in_pair->key_cpy (in_pair->key);
+  node->pair.value = in_pair->value_cpy (in_pair->value);
+  node->pair.allocator = hash_map->allocator;
+  if (node->pair.key == NULL
+      || (node->pair.value == NULL && in_pair->value != NULL))
+    {
+      if (node->pair.key != NULL)
+        {
+          node->pair.key_free (&node->pair.key);
+        }
+      if (node->pair.value != NULL)
+        {
+          node->pair.value_free (&node->pair.value);
+        }
+      allocator_free (hash_map->allocator, node,
+                      sizeof *node + hash_map->node_extra);
+      return NULL;
+    }
+  return node;
+}
+
+/**
+ * frees a node, and the key and the value in it.
+ */
+static void node_free (const hashmap *hash_map, hashmap_node *node)
+{
+  node->pair.key_free (&node->pair.key);
+  node->pair.value_free (&node->pair.value);
+  allocator_free (hash_map->allocator, node,
+                  sizeof *node + hash_map->node_extra);
+}
+
+/**
+ * links a node at the front of its bucket in the given buckets array (the
+ * indexes of the buckets are built after a re-size, see index_buckets).
+ * @param ind the index of the bucket of the node.
+ */
+static void link_node (hashmap_node **buckets, size_t ind, hashmap_node *node)
+{
+  node->next = buckets[ind];
+  buckets[ind] = node;
+}
+
+/**
+ * @return the size of a sorted bucket with room for capacity nodes.
+ */
+static size_t sorted_bucket_size (size_t capacity)
+{
+  return sizeof (hashmap_sorted_bucket) + capacity * sizeof (hashmap_node *);
+}
+
+/**
+ * frees the index of a bucket, the bucket is searched linearly again.
+ */
+static void free_sorted_bucket (hashmap *hash_map, size_t ind)
+{
+  hashmap_sorted_bucket *sorted = hash_map->sorted[ind];
+  if (sorted != NULL)
+    {
+      allocator_free (hash_map->allocator, sorted,
+                      sorted_bucket_size (sorted->capacity));
+      hash_map->sorted[ind] = NULL;
+    }
+}
+
+/**
+ * @return the position of the first node in a sorted bucket whose key is
+ * not smaller than key.
+ */
+static size_t sorted_lower_bound (const hashmap *hash_map,
+                                  const hashmap_sorted_bucket *sorted,
+                                  const_keyT key)
+{
+  size_t low = 0;
+  size_t high = sorted->count;
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+      if (hash_map->key_order (sorted->nodes[mid]->pair.key, key) < 0)
+        {
+          low = mid + 1;
+        }
+      else
+        {
+          high = mid;
+        }
+    }
+  return low;
+}
+
+/**
+ * sorts a list of count nodes by the key_order of the map (merge sort, so
+ * a bucket of many equal hashes is sorted in O(n log n) with no memory).
+ * @return the first node of the sorted list.
+ */
+static hashmap_node *sort_list (const hashmap *hash_map, hashmap_node *head,
+                                size_t count)
+{
+  if (count < 2)
+    {
+      return head;
+    }
+  hashmap_node *last = head;
+  for (size_t i = 1; i < count / 2; i++)
+    {
+      last = last->next;
+    }
+  hashmap_node *second = last->next;
+  last->next = NULL;
+  head = sort_list (hash_map, head, count / 2);
+  second = sort_list (hash_map, second, count - count / 2);
+  hashmap_node *merged = NULL;
+  hashmap_node **tail = &merged;
+  while (head != NULL && second != NULL)
+    {
+      hashmap_node *node;
+      if (hash_map->key_order (head->pair.key, second->pair.key) <= 0)
+        {
+          node = head;
+          head = head->next;
+        }
+      else
+        {
+          node = second;
+          second = second->next;
+        }
+      *tail = node;
+      tail = &node->next;
+    }
+  *tail = head != NULL ? head : second;
+  return merged;
+}
+
+/**
+ * indexes a bucket of the map if it has more than
+ * HASH_MAP_SORTED_BUCKET_THRESHOLD pairs and no index yet: its list is
+ * sorted and its nodes are put in a sorted bucket. If the index cannot be
+ * allocated the bucket stays linear, and a later insert tries again.
+ */
+static void index_bucket (hashmap *hash_map, size_t ind)
+{
+  size_t count = hashmap_bucket_size (hash_map, ind);
+  if (hash_map->sorted[ind] != NULL
+      || count <= HASH_MAP_SORTED_BUCKET_THRESHOLD)
+    {
+      return;
+    }
+  hashmap_sorted_bucket *sorted =
+      allocator_alloc (hash_map->allocator,
+                       sorted_bucket_size (count * HASH_MAP_GROWTH_FACTOR));
+  if (sorted == NULL)
+    {
+      return;
+    }
+  sorted->count = 0;
+  sorted->capacity = count * HASH_MAP_GROWTH_FACTOR;
+  hash_map->buckets[ind] = sort_list (hash_map, hash_map->buckets[ind],
+                                      count);
+  for (hashmap_node *node = hash_map->buckets[ind]; node != NULL;
+       node = node->next)
+    {
+      sorted->nodes[sorted->count++] = node;
+    }
+  hash_map->sorted[ind] = sorted;
+}
+
+/**
+ * indexes all the big buckets of a map with a key_order, after a re-size.
+ */
+static void index_buckets (hashmap *hash_map)
+{
+  for (size_t i = 0; hash_map->sorted != NULL && i < hash_map->capacity; i++)
+    {
+      index_bucket (hash_map, i);
+    }
+}
+
+/**
+ * links a new node into its bucket: at the front, or at its sorted place
+ * in the list and in the index of an indexed bucket.
+ * @param ind the index of the bucket of the node.
+ */
+static void link_new_node (hashmap *hash_map, size_t ind, hashmap_node *node)
+{
+  hashmap_sorted_bucket *sorted = hash_map->sorted == NULL
+                                  ? NULL : hash_map->sorted[ind];
+  if (sorted != NULL && sorted->count == sorted->capacity)
+    {
+      size_t new_capacity = sorted->capacity * HASH_MAP_GROWTH_FACTOR;
+      hashmap_sorted_bucket *grown =
+          allocator_realloc (hash_map->allocator, sorted,
+                             sorted_bucket_size (sorted->capacity),
+                             sorted_bucket_size (new_capacity));
+      if (grown == NULL)
+        {
+          // the bucket is searched linearly until it is indexed again.
+          free_sorted_bucket (hash_map, ind);
+          sorted = NULL;
+        }
+      else
+        {
+          grown->capacity = new_capacity;
+          hash_map->sorted[ind] = sorted = grown;
+        }
+    }
+  if (sorted == NULL)
+    {
+      link_node (hash_map->buckets, ind, node);
+      if (hash_map->sorted != NULL)
+        {
+          index_bucket (hash_map, ind);
+        }
+      return;
+    }
+  size_t pos = sorted_lower_bound (hash_map, sorted, node->pair.key);
+  hashmap_node **link = pos == 0 ? &hash_map->buckets[ind]
+                                 : &sorted->nodes[pos - 1]->next;
+  node->next = *link;
+  *link = node;
+  memmove (&sorted->nodes[pos + 1], &sorted->nodes[pos],
+           (sorted->count - pos) * sizeof (hashmap_node *));
+  sorted->nodes[pos] = node;
+  sorted->count++;
+}
+
+/**
+ * re-builds the index of a bucket after nodes were unlinked from it (the
+ * list is still sorted), and frees it if the bucket became small.
+ */
+static void reindex_bucket (hashmap *hash_map, size_t ind)
+{
+  hashmap_sorted_bucket *sorted = hash_map->sorted[ind];
+  sorted->count = 0;
+  for (hashmap_node *node = hash_map->buckets[ind]; node != NULL;
+       node = node->next)
+    {
+      sorted->nodes[sorted->count++] = node;
+    }
+  if (sorted->count <= HASH_MAP_SORTED_BUCKET_THRESHOLD)
+    {
+      free_sorted_bucket (hash_map, ind);
+    }
+}
+
+/**
+ * allocates an array of capacity empty buckets with the given policy (or
+ * with the allocator of the map, if the policy is the default one).
+ * @return the array, NULL if failed.
+ */
+static hashmap_node **alloc_buckets (const hashmap *hash_map,
+                                     const hashmap_array_policy *policy,
+                                     size_t capacity)
+{
+  if (policy->alloc != NULL)
+    {
+      return policy->alloc (capacity * sizeof (hashmap_node *), policy->ctx);
+    }
+  return allocator_calloc (hash_map->allocator, capacity,
+                           sizeof (hashmap_node *));
+}
+
+/**
+ * frees an array of capacity buckets allocated with the given policy.
+ */
+static void free_buckets (const hashmap *hash_map,
+                          const hashmap_array_policy *policy,
+                          hashmap_node **buckets, size_t capacity)
+{
+  if (policy->alloc != NULL)
+    {
+      policy->free (buckets, capacity * sizeof (hashmap_node *), policy->ctx);
+      return;
+    }
+  allocator_free (hash_map->allocator, buckets,
+                  capacity * sizeof (hashmap_node *));
+}
+
+/**
+ * frees all the nodes of the map, and leaves its buckets empty.
+ */
+static void free_nodes (hashmap *hash_map)
+{
+  for (size_t i = 0; i < hash_map->capacity; i++)
+    {
+      hashmap_node *node = hash_map->buckets[i];
+      while (node != NULL)
+        {
+          hashmap_node *next = node->next;
+          node_free (hash_map, node);
+          node = next;
+        }
+      hash_map->buckets[i] = NULL;
+      if (hash_map->sorted != NULL)
+        {
+          free_sorted_bucket (hash_map, i);
+        }
+    }
+}
+
+/**
+ * Frees a hash map and the elements the hash map itself allocated.
+ * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
+ */
+void hashmap_free (hashmap **p_hash_map)
+{
+  if (p_hash_map == NULL || *p_hash_map == NULL)
+    { return; }
+  const allocator *alloc = (*p_hash_map)->allocator;
+  if ((*p_hash_map)->buckets == NULL)
+    {
+      allocator_free (alloc, *p_hash_map, sizeof (hashmap));
+      *p_hash_map = NULL;
+      return;
+    }
+  free_nodes (*p_hash_map);
+  free_buckets (*p_hash_map, &(*p_hash_map)->array_policy,
+                (*p_hash_map)->buckets, (*p_hash_map)->capacity);
+  allocator_free (alloc, (*p_hash_map)->sorted,
+                  (*p_hash_map)->capacity * sizeof (hashmap_sorted_bucket *));
+  free_filter (*p_hash_map, (*p_hash_map)->filter,
+               (*p_hash_map)->filter_blocks);
+  allocator_free (alloc, *p_hash_map, sizeof (hashmap));
+  *p_hash_map = NULL;
+}
+
+/**
+ * Sets the number of threads the re-sizes of the map use, once the map has
+ * HASH_MAP_PARALLEL_REHASH_MIN_SIZE pairs: the old buckets are split
+ * between the threads, and every thread builds its own part of the new
+ * buckets. The map itself is still not safe to use from many threads.
+ * @param hash_map a hash map.
+ * @param n_threads the number of threads (0 or 1 for one thread).
+ */
+void hashmap_set_rehash_threads (hashmap *hash_map, size_t n_threads)
+{
+  if (hash_map != NULL)
+    {
+      hash_map->rehash_threads = n_threads == 0 ? 1 : n_threads;
+    }
+}
+
+/**
+ * Sets how the buckets array of the map is allocated from now on, the
+ * current array is moved to an array allocated by the new policy.
+ * @param hash_map a hash map.
+ * @param policy the new policy (copied), NULL for the allocator of the map.
+ * @return returns 1 for successful, 0 otherwise (and then the map keeps
+ * its policy).
+ */
+int hashmap_set_array_policy (hashmap *hash_map,
+                              const hashmap_array_policy *policy)
+{
+  if (hash_map == NULL
+      || (policy != NULL && (policy->alloc == NULL || policy->free == NULL)))
+    {
+      return 0;
+    }
+  hashmap_array_policy new_policy = {NULL, NULL, NULL};
+  if (policy != NULL)
+    {
+      new_policy = *policy;
+    }
+  hashmap_node **new_buckets = alloc_buckets (hash_map, &new_policy,
+                                              hash_map->capacity);
+  if (new_buckets == NULL)
+    {
+      return 0;
+    }
+  memcpy (new_buckets, hash_map->buckets,
+          hash_map->capacity * sizeof (hashmap_node *));
+  free_buckets (hash_map, &hash_map->array_policy, hash_map->buckets,
+                hash_map->capacity);
+  hash_map->buckets = new_buckets;
+  hash_map->array_policy = new_policy;
+  return 1;
+}
+
+/**
+ * Sets the number of extra bytes every node of the map has after its pair
+ * (see hashmap_entry_extra), so a structure built on the map keeps its
+ * state of a pair without allocating it separately.
+ * @param hash_map an empty hash map.
+ * @param extra the number of extra bytes (0 for none).
+ * @return returns 1 for successful, 0 otherwise (e.g. the map is not
+ * empty).
+ */
+int hashmap_set_node_extra (hashmap *hash_map, size_t extra)
+{
+  // the nodes are freed with the size they were allocated with.
+  if (hash_map == NULL || hash_map->size != 0
+      || extra > SIZE_MAX - sizeof (hashmap_node) - sizeof (void *))
+    {
+      return 0;
+    }
+  // rounded up, so the extra bytes of a node keep pointers aligned.
+  hash_map->node_extra = (extra + sizeof (void *) - 1)
+                         / sizeof (void *) * sizeof (void *);
+  return 1;
+}
+
+/**
+ * Adds a filter of the keys to the map (see the filter of hashmap), or
+ * removes it. The filter is worth its memory for maps that are looked up
+ * mostly for missing keys.
+ * @param hash_map a hash map.
+ * @param enable 1 for adding a filter, 0 for removing it.
+ * @return returns 1 for successful, 0 otherwise (and then the map keeps
+ * its filter, or its lack of one).
+ */
+int hashmap_set_filter (hashmap *hash_map, int enable)
+{
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  // the new filter is built first, so a failure leaves the old one.
+  uint64_t *filter = NULL;
+  size_t blocks = 0;
+  if (enable)
+    {
+      blocks = filter_blocks_for (hash_map->capacity);
+      filter = alloc_filter (hash_map, blocks);
+      if (filter == NULL)
+        {
+          return 0;
+        }
+      for (size_t i = 0; i < hash_map->capacity; i++)
+        {
+          for (const hashmap_node *node = hash_map->buckets[i]; node != NULL;
+               node = node->next)
+            {
+              filter_add (filter, blocks, node->hash, 0);
+            }
+        }
+    }
+  free_filter (hash_map, hash_map->filter, hash_map->filter_blocks);
+  hash_map->filter = filter;
+  hash_map->filter_blocks = blocks;
+  return 1;
+}
+
+/**
+ * @return the first old bucket of worker ind, the range of the worker ends
+ * where the range of worker ind + 1 starts.
+ */
+static size_t worker_first_bucket (const rehash_worker *worker, size_t ind)
+{
+  return worker->hash_map->capacity * ind / worker->n_workers;
+}
+
+/**
+ * @return the worker that owns a new bucket, the new buckets are split to
+ * equal ranges.
+ */
+static size_t worker_of_bucket (const rehash_worker *worker, size_t dest)
+{
+  size_t chunk = (worker->new_capacity + worker->n_workers - 1)
+                 / worker->n_workers;
+  return dest / chunk;
+}
+
+/**
+ * the first phase of a parallel re-size: counts the nodes in the old range
+ * of the worker, for every worker that owns their new bucket. It does not
+ * allocate, the arrays for the nodes are allocated by the calling thread
+ * (with the allocator of the map, which does not have to be thread safe).
+ */
+static void *rehash_count (void *arg)
+{
+  rehash_worker *worker = arg;
+  hashmap *hash_map = worker->hash_map;
+  size_t first = worker_first_bucket (worker, worker->ind);
+  size_t last = worker_first_bucket (worker, worker->ind + 1);
+  for (size_t i = first; i < last; i++)
+    {
+      for (const hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          size_t dest = hashmap_bucket_index (node->hash, hash_map->seed,
+                                              worker->new_capacity);
+          worker->starts[worker_of_bucket (worker, dest) + 1]++;
+          worker->n++;
+        }
+    }
+  worker->res = 1;
+  return NULL;
+}
+
+/**
+ * the second phase of a parallel re-size: finds the new buckets of the
+ * nodes in the old range of the worker, and groups them by the worker that
+ * owns their new bucket (counting sort, with the counts of rehash_count).
+ */
+static void *rehash_group (void *arg)
+{
+  rehash_worker *worker = arg;
+  hashmap *hash_map = worker->hash_map;
+  size_t first = worker_first_bucket (worker, worker->ind);
+  size_t last = worker_first_bucket (worker, worker->ind + 1);
+  for (size_t w = 0; w < worker->n_workers; w++)
+    {
+      worker->starts[w + 1] += worker->starts[w];
+      worker->pos[w] = worker->starts[w];
+    }
+  // the nodes keep their order, so every new bucket gets its nodes in the
+  // same order a re-size in one thread gives.
+  for (size_t i = first; i < last; i++)
+    {
+      for (hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          size_t dest = hashmap_bucket_index (node->hash, hash_map->seed,
+                                              worker->new_capacity);
+          size_t owner = worker_of_bucket (worker, dest);
+          worker->nodes[worker->pos[owner]] = node;
+          worker->dests[worker->pos[owner]] = dest;
+          worker->pos[owner]++;
+        }
+    }
+  worker->res = 1;
+  return NULL;
+}
+
+/**
+ * the third phase of a parallel re-size: links the nodes all the workers
+ * grouped for the worker into the new buckets it owns.
+ */
+static void *rehash_build (void *arg)
+{
+  rehash_worker *worker = arg;
+  for (size_t w = 0; w < worker->n_workers; w++)
+    {
+      const rehash_worker *from = &worker->workers[w];
+      for (size_t k = from->starts[worker->ind];
+           k < from->starts[worker->ind + 1]; k++)
+        {
+          link_node (worker->new_buckets, from->dests[k], from->nodes[k]);
+          if (worker->new_filter != NULL)
+            {
+              filter_add (worker->new_filter,
+                          filter_blocks_for (worker->new_capacity),
+                          from->nodes[k]->hash, 1);
+            }
+        }
+    }
+  worker->res = 1;
+  return NULL;
+}
+
+/**
+ * runs a phase of a parallel re-size, the first worker runs in the calling
+ * thread (and so does a worker whose thread could not be created).
+ * @param threads array of n_workers threads to use.
+ * @param started array of n_workers flags to use.
+ * @return 1 if the phase succeeded in all the workers, 0 otherwise.
+ */
+static int run_rehash_phase (rehash_worker *workers, size_t n_workers,
+                             void *(*phase) (void *), pthread_t *threads,
+                             int *started)
+{
+  for (size_t w = 1; w < n_workers; w++)
+    {
+      started[w] = pthread_create (&threads[w], NULL, phase,
+                                   &workers[w]) == 0;
+    }
+  phase (&workers[0]);
+  int res = workers[0].res;
+  for (size_t w = 1; w < n_workers; w++)
+    {
+      if (started[w])
+        {
+          pthread_join (threads[w], NULL);
+        }
+      else
+        {
+          phase (&workers[w]);
+        }
+      res = res && workers[w].res;
+    }
+  return res;
+}
+
+/**
+ * replaces the buckets (and the filter and the indexes) of the map by the
+ * re-sized ones, and indexes the big buckets.
+ */
+static void replace_buckets (hashmap *hashmap_p, hashmap_node **new_buckets,
+                             size_t new_capacity, uint64_t *new_filter,
+                             hashmap_sorted_bucket **new_sorted)
+{
+  free_buckets (hashmap_p, &hashmap_p->array_policy, hashmap_p->buckets,
+                hashmap_p->capacity);
+  if (new_filter != NULL)
+    {
+      free_filter (hashmap_p, hashmap_p->filter, hashmap_p->filter_blocks);
+      hashmap_p->filter = new_filter;
+      hashmap_p->filter_blocks = filter_blocks_for (new_capacity);
+    }
+  if (new_sorted != NULL)
+    {
+      for (size_t i = 0; i < hashmap_p->capacity; i++)
+        {
+          free_sorted_bucket (hashmap_p, i);
+        }
+      allocator_free (hashmap_p->allocator, hashmap_p->sorted,
+                      hashmap_p->capacity * sizeof (hashmap_sorted_bucket *));
+      hashmap_p->sorted = new_sorted;
+    }
+  hashmap_p->buckets = new_buckets;
+  hashmap_p->capacity = new_capacity;
+  index_buckets (hashmap_p);
+}
+
+/**
+ * frees the new buckets, filter and indexes of a failed re-size.
+ */
+static void free_resized (hashmap *hashmap_p, hashmap_node **new_buckets,
+                          size_t new_capacity, uint64_t *new_filter,
+                          hashmap_sorted_bucket **new_sorted)
+{
+  free_buckets (hashmap_p, &hashmap_p->array_policy, new_buckets,
+                new_capacity);
+  free_filter (hashmap_p, new_filter, filter_blocks_for (new_capacity));
+  allocator_free (hashmap_p->allocator, new_sorted,
+                  new_capacity * sizeof (hashmap_sorted_bucket *));
+}
+
+/**
+ * re-sizes the hash map with rehash_threads threads (see rehash_worker).
+ * The nodes are linked into the new buckets like in a re-size in one
+ * thread. All the memory is allocated with the allocator of the map, by
+ * the calling thread and before any node is re-linked, so the map is left
+ * untouched if it fails.
+ * @param new_buckets the new (empty) buckets.
+ * @param new_capacity the new number of buckets, a power of 2.
+ * @param new_filter the new (empty) filter, NULL if the map has no filter.
+ * @param new_sorted the new (empty) indexes, NULL if the map has no
+ * key_order.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+static int resize_map_parallel (hashmap *hashmap_p,
+                                hashmap_node **new_buckets,
+                                size_t new_capacity, uint64_t *new_filter,
+                                hashmap_sorted_bucket **new_sorted)
+{
+  size_t n_workers = hashmap_p->rehash_threads;
+  const allocator *alloc = hashmap_p->allocator;
+  size_t n_indices = 2 * (n_workers + 1);
+  rehash_worker *workers = allocator_calloc (alloc, n_workers,
+                                             sizeof (rehash_worker));
+  pthread_t *threads = allocator_alloc (alloc,
+                                        n_workers * sizeof (pthread_t));
+  int *started = allocator_calloc (alloc, n_workers, sizeof (int));
+  size_t *indices = allocator_calloc (alloc, n_workers * n_indices,
+                                      sizeof (size_t));
+  int res = workers != NULL && threads != NULL && started != NULL
+            && indices != NULL;
+  for (size_t w = 0; res && w < n_workers; w++)
+    {
+      size_t *starts = indices + w * n_indices;
+      workers[w] = (rehash_worker) {hashmap_p, new_buckets, new_capacity,
+                                    new_filter, workers, n_workers, w, 0,
+                                    NULL, NULL, starts,
+                                    starts + n_workers + 1, 0};
+    }
+  res = res && run_rehash_phase (workers, n_workers, rehash_count, threads,
+                                 started);
+  // only the calling thread allocates.
+  for (size_t w = 0; res && w < n_workers; w++)
+    {
+      workers[w].nodes = allocator_alloc (alloc, (workers[w].n + 1)
+                                                 * sizeof (hashmap_node *));
+      workers[w].dests = allocator_alloc (alloc, (workers[w].n + 1)
+                                                 * sizeof (size_t));
+      res = workers[w].nodes != NULL && workers[w].dests != NULL;
+    }
+  res = res && run_rehash_phase (workers, n_workers, rehash_group, threads,
+                                 started);
+  if (res)
+    {
+      run_rehash_phase (workers, n_workers, rehash_build, threads, started);
+      replace_buckets (hashmap_p, new_buckets, new_capacity, new_filter,
+                       new_sorted);
+    }
+  else
+    {
+      free_resized (hashmap_p, new_buckets, new_capacity, new_filter,
+                    new_sorted);
+    }
+  for (size_t w = 0; workers != NULL && w < n_workers; w++)
+    {
+      allocator_free (alloc, workers[w].nodes,
+                      (workers[w].n + 1) * sizeof (hashmap_node *));
+      allocator_free (alloc, workers[w].dests,
+                      (workers[w].n + 1) * sizeof (size_t));
+    }
+  allocator_free (alloc, indices, n_workers * n_indices * sizeof (size_t));
+  allocator_free (alloc, started, n_workers * sizeof (int));
+  allocator_free (alloc, threads, n_workers * sizeof (pthread_t));
+  allocator_free (alloc, workers, n_workers * sizeof (rehash_worker));
+  return res;
+}
+
+/**
+ * re-builds the hash map with the given number of buckets.
+ * The function creates new buckets list in the given capacity and moves
+ * the nodes to it, by their stored hashes (nothing is copied or hashed
+ * again). The filter, if any, is re-built, so erased keys leave it.
+ * @param hash_map the hash map to re-size.
+ * @param new_capacity the new number of buckets, a power of 2.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+int resize_map (hashmap *hashmap_p, size_t new_capacity)
+{
+  // allocate the new buckets first, so the map is left untouched on fail.
+  hashmap_node **new_buckets = alloc_buckets (hashmap_p,
+                                              &hashmap_p->array_policy,
+                                              new_capacity);
+  if (new_buckets == NULL)
+    {
+      return 0;
+    }
+  size_t new_blocks = filter_blocks_for (new_capacity);
+  uint64_t *new_filter = NULL;
+  hashmap_sorted_bucket **new_sorted = NULL;
+  if (hashmap_p->filter != NULL)
+    {
+      new_filter = alloc_filter (hashmap_p, new_blocks);
+    }
+  if (hashmap_p->sorted != NULL)
+    {
+      new_sorted = allocator_calloc (hashmap_p->allocator, new_capacity,
+                                     sizeof (hashmap_sorted_bucket *));
+    }
+  if ((hashmap_p->filter != NULL && new_filter == NULL)
+      || (hashmap_p->sorted != NULL && new_sorted == NULL))
+    {
+      free_resized (hashmap_p, new_buckets, new_capacity, new_filter,
+                    new_sorted);
+      return 0;
+    }
+  if (hashmap_p->rehash_threads > 1
+      && hashmap_p->size >= HASH_MAP_PARALLEL_REHASH_MIN_SIZE)
+    {
+      return resize_map_parallel (hashmap_p, new_buckets, new_capacity,
+                                  new_filter, new_sorted);
+    }
+  for (size_t i = 0; i < hashmap_p->capacity; i++)
+    {
+      hashmap_node *node = hashmap_p->buckets[i];
+      while (node != NULL)
+        {
+          hashmap_node *next = node->next;
+          link_node (new_buckets,
+                     hashmap_bucket_index (node->hash, hashmap_p->seed,
+                                           new_capacity), node);
+          if (new_filter != NULL)
+            {
+              filter_add (new_filter, new_blocks, node->hash, 0);
+            }
+          node = next;
+        }
+    }
+  replace_buckets (hashmap_p, new_buckets, new_capacity, new_filter,
+                   new_sorted);
+  return 1;
+}
+
+/**
+ * change the hash map according to the load factor after insertion or
+ * deleting.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param flag flag represents if we need to increase or decrease the map.
+ * 0 = increase, 1 = decrease.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+int change_map (hashmap *hashmap_p, int flag)
+{
+  if (flag == 0)
+    {
+      return resize_map (hashmap_p,
+                         hashmap_p->capacity * HASH_MAP_GROWTH_FACTOR);
+    }
+  return resize_map (hashmap_p, hashmap_p->capacity / HASH_MAP_GROWTH_FACTOR);
+}
+
+/**
+ * Makes room for n more pairs, so inserting them would not re-size the map.
+ * @param hash_map a hash map.
+ * @param n the number of pairs that are going to be inserted.
+ * @return returns 1 for successful, 0 otherwise (e.g. there is no capacity
+ * for so many pairs, and then the map is not changed).
+ */
+int hashmap_reserve (hashmap *hash_map, size_t n)
+{
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  size_t new_capacity = hash_map->capacity;
+  // in double, so a huge n does not wrap the sum around.
+  while ((hash_map->size + (double) n) / (double) new_capacity
+         > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      // the buckets array of the next capacity would not fit in size_t.
+      if (new_capacity > SIZE_MAX / (HASH_MAP_GROWTH_FACTOR
+                                     * sizeof (hashmap_node *)))
+        {
+          return 0;
+        }
+      new_capacity *= HASH_MAP_GROWTH_FACTOR;
+    }
+  if (new_capacity == hash_map->capacity)
+    {
+      return 1;
+    }
+  return resize_map (hash_map, new_capacity);
+}
+
+/**
+ * Re-sizes the map to the smallest capacity that holds its pairs, e.g.
+ * after a big erase (erasing shrinks the map only by one step at a time).
+ * @param hash_map a hash map.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+int hashmap_shrink (hashmap *hash_map)
+{
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  size_t new_capacity = HASH_MAP_INITIAL_CAP;
+  while (hash_map->size / (double) new_capacity > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      new_capacity *= HASH_MAP_GROWTH_FACTOR;
+    }
+  if (new_capacity >= hash_map->capacity)
+    {
+      return 1;
+    }
+  return resize_map (hash_map, new_capacity);
+}
+
+/**
+ * inserts a copy of in_pair, whose key is known not to be in the map.
+ * @param hash the value hash_func returned for the key of in_pair.
+ * @return the node of the copy, NULL if failed.
+ */
+static hashmap_node *insert_new (hashmap *hash_map, const pair *in_pair,
+                                 size_t hash)
+{
+  hashmap_node *node = node_alloc (hash_map, in_pair, hash);
+  if (node == NULL)
+    {
+      return NULL;
+    }
+  link_new_node (hash_map,
+                 hashmap_bucket_index (hash, hash_map->seed,
+                                       hash_map->capacity), node);
+  if (hash_map->filter != NULL)
+    {
+      filter_add (hash_map->filter, hash_map->filter_blocks, hash, 0);
+    }
+  hash_map->size++;
+  hash_map->version++;
+
+  // check if the load factor is too big, if it is, change the map.
+  if (hashmap_get_load_factor (hash_map) > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      change_map (hash_map, 0);
+    }
+  return node;
+}
+
+/**
+ * Inserts a new in_pair to the hash map.
+ * The function inserts *new*, *copied*, *dynamically allocated* in_pair,
+ * NOT the in_pair it receives as a parameter.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a in_pair the hash map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashmap_insert (hashmap *hash_map, const pair *in_pair)
+{
+  if (hash_map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  // check if the key is already in the map.
+  hashmap_entry entry = hashmap_find (hash_map, in_pair->key);
+  if (entry.pair != NULL)
+    { return 0; }
+  return insert_new (hash_map, in_pair, entry.hash) != NULL;
+}
+
+/**
+ * Inserts a copy of in_pair at the place a lookup of its key found empty,
+ * without looking the key up again.
+ * @param hash_map a hash map.
+ * @param entry the handle (with NULL pair) hashmap_find returned for the
+ * key of in_pair (the key must still not be in the map).
+ * @param in_pair a in_pair the hash map would contain.
+ * @return handle to the inserted copy, a handle with NULL pair if failed.
+ */
+hashmap_entry hashmap_entry_insert (hashmap *hash_map, hashmap_entry entry,
+                                    const pair *in_pair)
+{
+  hashmap_entry new_entry = {NULL, entry.hash};
+  if (hash_map == NULL || entry.pair != NULL || in_pair == NULL
+      || in_pair->key == NULL)
+    {
+      return new_entry;
+    }
+  hashmap_node *node = insert_new (hash_map, in_pair, entry.hash);
+  if (node != NULL)
+    {
+      new_entry.pair = &node->pair;
+    }
+  return new_entry;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself, not a copy of it).
+ */
+valueT hashmap_at (const hashmap *hash_map, const_keyT key)
 {
-  if (func == NULL)
+  hashmap_entry entry = hashmap_find (hash_map, key);
+  if (entry.pair == NULL)
+    { return NULL; }
+  return entry.pair->value;
+}
+
+/**
+ * The function returns a handle to the entry associated with the given key,
+ * so the key, the value and the hash can be used without another lookup.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return handle to the entry if exists, a handle with NULL pair otherwise.
+ */
+hashmap_entry hashmap_find (const hashmap *hash_map, const_keyT key)
+{
+  if (hash_map == NULL || key == NULL)
     {
-      return NULL;
+      hashmap_entry entry = {NULL, 0};
+      return entry;
     }
-  hashmap *new_hashmap = malloc (sizeof *new_hashmap);
-  if (new_hashmap == NULL)
+  return hashmap_find_hashed (hash_map, key, hash_map->hash_func (key));
+}
+
+/**
+ * The function returns a handle to the entry associated with the given key,
+ * whose hash was already computed (e.g. for partitioning the keys).
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @param hash the value the hash_func of the map returns for key.
+ * @return handle to the entry if exists, a handle with NULL pair otherwise.
+ */
+hashmap_entry hashmap_find_hashed (const hashmap *hash_map, const_keyT key,
+                                  size_t hash)
+{
+  hashmap_entry entry = {NULL, hash};
+  if (hash_map == NULL || key == NULL)
     {
-      return NULL;
+      return entry;
     }
-  // initialize with calloc in order to set all vectors to NULL.
-  new_hashmap->buckets = calloc (HASH_MAP_INITIAL_CAP, sizeof (vector *));
-  if (new_hashmap->buckets == NULL)
+  // most missing keys are not in the filter, and then the buckets are not
+  // read at all.
+  if (hash_map->filter != NULL
+      && !filter_may_contain (hash_map->filter, hash_map->filter_blocks,
+                              entry.hash))
     {
-      free (new_hashmap);
-      return NULL;
+      return entry;
+    }
+  size_t ind = hashmap_bucket_index (entry.hash, hash_map->seed,
+                                     hash_map->capacity);
+  if (hash_map->sorted != NULL && hash_map->sorted[ind] != NULL)
+    {
+      const hashmap_sorted_bucket *sorted = hash_map->sorted[ind];
+      size_t pos = sorted_lower_bound (hash_map, sorted, key);
+      if (pos < sorted->count && sorted->nodes[pos]->hash == entry.hash
+          && sorted->nodes[pos]->pair.key_cmp (sorted->nodes[pos]->pair.key,
+                                               key))
+        {
+          entry.pair = &sorted->nodes[pos]->pair;
+        }
+      return entry;
+    }
+  for (hashmap_node *node = hash_map->buckets[ind]; node != NULL;
+       node = node->next)
+    {
+      // the stored hashes skip most of the keys without calling key_cmp.
+      if (node->hash == entry.hash && node->pair.key_cmp (node->pair.key, key))
+        {
+          entry.pair = &node->pair;
+          return entry;
+        }
     }
+  return entry;
+}
 
-  new_hashmap->size = 0;
-  new_hashmap->capacity = HASH_MAP_INITIAL_CAP;
-  new_hashmap->hash_func = func;
+/**
+ * The function erases the entry the given handle refers to.
+ * @param hash_map a hash map.
+ * @param entry a valid handle returned by hashmap_find.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_entry_erase (hashmap *hash_map, hashmap_entry entry)
+{
+  if (hash_map == NULL || entry.pair == NULL)
+    {
+      return 0;
+    }
+  size_t ind = hashmap_bucket_index (entry.hash, hash_map->seed,
+                                     hash_map->capacity);
+  // the handle points to the stored pair, so compare addresses - no need
+  // to call key_cmp again.
+  hashmap_node **link = &hash_map->buckets[ind];
+  hashmap_sorted_bucket *sorted = hash_map->sorted == NULL
+                                  ? NULL : hash_map->sorted[ind];
+  if (sorted != NULL)
+    {
+      // the list is in the order of the index, so the node before it in
+      // the index links to it.
+      size_t pos = sorted_lower_bound (hash_map, sorted, entry.pair->key);
+      if (pos == sorted->count || &sorted->nodes[pos]->pair != entry.pair)
+        {
+          return 0;
+        }
+      if (pos > 0)
+        {
+          link = &sorted->nodes[pos - 1]->next;
+        }
+      memmove (&sorted->nodes[pos], &sorted->nodes[pos + 1],
+               (sorted->count - pos - 1) * sizeof (hashmap_node *));
+      if (--sorted->count <= HASH_MAP_SORTED_BUCKET_THRESHOLD)
+        {
+          free_sorted_bucket (hash_map, ind);
+        }
+    }
+  else
+    {
+      while (*link != NULL && &(*link)->pair != entry.pair)
+        {
+          link = &(*link)->next;
+        }
+      if (*link == NULL)
+        {
+          return 0;
+        }
+    }
+  hashmap_node *node = *link;
+  // unlinking the last node leaves the bucket NULL again.
+  *link = node->next;
+  node_free (hash_map, node);
+  hash_map->size--;
+  hash_map->version++;
+  // if the load factor is too small, change the map.
+  if (hashmap_get_load_factor (hash_map) < HASH_MAP_MIN_LOAD_FACTOR)
+    {
+      change_map (hash_map, 1);
+    }
+  return 1;
+}
 
-  return new_hashmap;
+/**
+ * Returns the extra bytes of the node of an entry (see
+ * hashmap_set_node_extra). They are zeroed when the pair is inserted, are
+ * aligned like a pointer, and live as long as the entry.
+ * @param entry a valid handle to an entry of a map with extra bytes.
+ * @return pointer to the extra bytes, NULL if entry has NULL pair.
+ */
+void *hashmap_entry_extra (hashmap_entry entry)
+{
+  if (entry.pair == NULL)
+    {
+      return NULL;
+    }
+  // the extra bytes follow the node the pair is stored in.
+  hashmap_node *node = (hashmap_node *) ((char *) entry.pair
+                                         - offsetof (hashmap_node, pair));
+  return node + 1;
 }
 
 /**
- * Frees a hash map and the elements the hash map itself allocated.
- * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
+ * The function erases the pair associated with key.
+ * @param hash_map a hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ * (if key not in map, considered fail).
  */
-void hashmap_free (hashmap **p_hash_map)
+int hashmap_erase (hashmap *hash_map, const_keyT key)
 {
-  if (p_hash_map == NULL)
-    { return; }
-  if ((*p_hash_map)->buckets == NULL)
+  return hashmap_entry_erase (hash_map, hashmap_find (hash_map, key));
+}
+
+/**
+ * @return 1 if the node fulfills key_cond (if not NULL) or pair_cond (if
+ * not NULL), or else if it was combined into merge_dst successfully.
+ */
+static int node_matches (const hashmap_node *node, keyT_func key_cond,
+                         pairT_func pair_cond, hashmap *merge_dst,
+                         valueT_combine combine)
+{
+  if (key_cond != NULL)
     {
-      free (*p_hash_map);
-      *p_hash_map = NULL;
-      return;
+      return key_cond (node->pair.key);
     }
-  for (size_t i = 0; i < (*p_hash_map)->capacity; i++)
+  if (pair_cond != NULL)
     {
-      vector *cur_vec = (*p_hash_map)->buckets[i];
-      vector_free (&cur_vec);
+      return pair_cond (node->pair.key, node->pair.value);
     }
-  free ((*p_hash_map)->buckets);
-  free (*p_hash_map);
-  *p_hash_map = NULL;
+  return hashmap_upsert (merge_dst, &node->pair, combine).pair != NULL;
 }
 
 /**
- * fill the pairs array with the original pairs from the map, and free the
- * vectors.
- * @param hash_map the hash map to re-size.
- * @param pairs dynamical array of pairs to fill.
+ * erases the pairs which match (see node_matches) in one pass, and then
+ * shrinks the map once if needed (not when merging, the merged map is
+ * filled again).
+ * @return the number of erased pairs.
  */
-void create_pairs (hashmap *hashmap_p, pair **pairs)
+static size_t erase_matching (hashmap *hash_map, keyT_func key_cond,
+                              pairT_func pair_cond, hashmap *merge_dst,
+                              valueT_combine combine)
 {
-  int k = 0;
-  for (size_t i = 0; i < hashmap_p->capacity; i++)
+  size_t erased = 0;
+  for (size_t i = 0; i < hash_map->capacity; i++)
     {
-      if (hashmap_p->buckets[i] != NULL)
+      hashmap_node **link = &hash_map->buckets[i];
+      while (*link != NULL)
         {
-          for (size_t j = 0; j < hashmap_p->buckets[i]->size; j++)
+          hashmap_node *node = *link;
+          if (node_matches (node, key_cond, pair_cond, merge_dst, combine))
+            {
+              *link = node->next;
+              node_free (hash_map, node);
+              erased++;
+            }
+          else
             {
-              pairs[k] = (pair *) pair_copy (hashmap_p->buckets[i]->data[j]);
-              k++;
+              link = &node->next;
             }
-          vector_free (&hashmap_p->buckets[i]);
         }
+      if (hash_map->sorted != NULL && hash_map->sorted[i] != NULL)
+        {
+          reindex_bucket (hash_map, i);
+        }
+    }
+  hash_map->size -= erased;
+  hash_map->version += erased;
+  if (merge_dst == NULL
+      && hashmap_get_load_factor (hash_map) < HASH_MAP_MIN_LOAD_FACTOR)
+    {
+      hashmap_shrink (hash_map);
     }
+  return erased;
 }
 
 /**
- * change the hash map according to the load factor after insertion or
- * deleting.
- * The function creates new buckets list iin the correct capacity and inserts
- * the pairs to it.
- * @param hash_map the hash map to be inserted with new element.
- * @param flag flag represents if we need to increase or decrease the map.
- * 0 = increase, 1 = decrease.
- * @return returns 1 for successful, 0 otherwise.
+ * Erases all the pairs whose keys fulfill a condition, in one pass over the
+ * buckets, and then re-sizes the map once if it became too sparse (instead
+ * of shrinking it step by step while erasing).
+ * @param hash_map a hash map.
+ * @param keyT_func a function that checks a condition on keyT and returns
+ * 1 if true, 0 else.
+ * @return the number of erased pairs.
  */
-int change_map (hashmap *hashmap_p, int flag)
+size_t hashmap_erase_if (hashmap *hash_map, keyT_func keyT_func)
 {
-  // create san array contains copies of the pairs in the map, in order to
-  // insert them later to new buckets.
-  pair **pairs = malloc (hashmap_p->size * sizeof (pair *));
-  if (pairs == NULL)
+  if (hash_map == NULL || keyT_func == NULL)
     {
       return 0;
     }
-  create_pairs (hashmap_p, pairs);
-  free (hashmap_p->buckets);
-  hashmap_p->buckets = NULL;
+  return erase_matching (hash_map, keyT_func, NULL, NULL, NULL);
+}
 
-  if (flag == 0)
+/**
+ * Erases all the pairs whose keys and values fulfill a condition, in one
+ * pass over the buckets, and then re-sizes the map once if it became too
+ * sparse.
+ * @param hash_map a hash map.
+ * @param pairT_func a function that checks a condition on a key and its
+ * value and returns 1 if true, 0 else.
+ * @return the number of erased pairs.
+ */
+size_t hashmap_erase_if_pair (hashmap *hash_map, pairT_func pairT_func)
+{
+  if (hash_map == NULL || pairT_func == NULL)
     {
-      hashmap_p->buckets = calloc (
-          hashmap_p->capacity * HASH_MAP_GROWTH_FACTOR, sizeof (vector *));
+      return 0;
     }
-  else
+  return erase_matching (hash_map, NULL, pairT_func, NULL, NULL);
+}
+
+/**
+ * Inserts a copy of in_pair, or if its key is already in the map, merges
+ * its value into the stored value in place - with a single lookup, and no
+ * erase and insert (which may shrink and grow the map).
+ * @param hash_map a hash map.
+ * @param in_pair a pair to be inserted or merged.
+ * @param merge a function which combines a value into the stored value,
+ * NULL for replacing the stored value by a copy of the value of in_pair.
+ * @return handle to the stored entry, a handle with NULL pair if failed.
+ */
+hashmap_entry hashmap_upsert (hashmap *hash_map, const pair *in_pair,
+                              valueT_combine merge)
+{
+  hashmap_entry entry = {NULL, 0};
+  if (hash_map == NULL || in_pair == NULL || in_pair->key == NULL)
     {
-      hashmap_p->buckets = calloc (
-          hashmap_p->capacity / HASH_MAP_GROWTH_FACTOR, sizeof (vector *));
+      return entry;
     }
-  if (hashmap_p->buckets == NULL)
+  entry = hashmap_find (hash_map, in_pair->key);
+  if (entry.pair == NULL)
     {
-      return 0;
+      return hashmap_entry_insert (hash_map, entry, in_pair);
     }
-  if (flag == 0)
-    { hashmap_p->capacity *= HASH_MAP_GROWTH_FACTOR; }
-  else
-    { hashmap_p->capacity /= HASH_MAP_GROWTH_FACTOR; }
+  if (merge != NULL)
+    {
+      merge (entry.pair->value, in_pair->value);
+      return entry;
+    }
+  // the stored functions copy and free the stored value, which is kept if
+  // the copy failed.
+  valueT value = entry.pair->value_cpy (in_pair->value);
+  if (value == NULL && in_pair->value != NULL)
+    {
+      return (hashmap_entry) {NULL, 0};
+    }
+  entry.pair->value_free (&entry.pair->value);
+  entry.pair->value = value;
+  return entry;
+}
 
-  // insert all pairs to new buckets. initialize the size to 0 before it.
-  size_t n = hashmap_p->size;
-  hashmap_p->size = 0;
-  for (size_t i = 0; i < n; i++)
+/**
+ * Changes the value associated with the given key in place.
+ * @param hash_map a hash map.
+ * @param key the key of the value.
+ * @param update a function which changes the value.
+ * @return 1 if the key is in the map (and its value was changed), 0
+ * otherwise.
+ */
+int hashmap_update (hashmap *hash_map, const_keyT key, valueT_func update)
+{
+  if (update == NULL)
     {
-      hashmap_insert (hashmap_p, pairs[i]);
-      pair_free ((void **) &pairs[i]);
+      return 0;
+    }
+  hashmap_entry entry = hashmap_find (hash_map, key);
+  if (entry.pair == NULL)
+    {
+      return 0;
     }
-  // free the pairs array.
-  free (pairs);
+  update (entry.pair->value);
   return 1;
 }
 
 /**
- * Inserts a new in_pair to the hash map.
- * The function inserts *new*, *copied*, *dynamically allocated* in_pair,
- * NOT the in_pair it receives as a parameter.
- * @param hash_map the hash map to be inserted with new element.
- * @param in_pair a in_pair the hash map would contain.
- * @return returns 1 for successful insertion, 0 otherwise.
+ * Merges all the pairs of src into dst, in one pass over src: keys which
+ * are not in dst are inserted (copied), and the values of keys which are
+ * in both maps are combined into the values in dst.
+ * @param dst the hash map to merge into.
+ * @param src the hash map to merge from, it is not changed.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged successfully, 0 otherwise.
  */
-int hashmap_insert (hashmap *hash_map, const pair *in_pair)
+int hashmap_merge (hashmap *dst, const hashmap *src, valueT_combine combine)
 {
-  if (hash_map == NULL || in_pair == NULL || in_pair->key == NULL)
+  if (dst == NULL || src == NULL || combine == NULL)
     {
       return 0;
     }
-  // check if the key is already in the map.
-  if (hashmap_at (hash_map, in_pair->key) != NULL)
-    { return 0; }
-
-  size_t ind = (hash_map->hash_func (in_pair->key)) & (hash_map->capacity - 1);
-  // if the dest vector is still null (empty) we alloc a new one.
-  if (hash_map->buckets[ind] == NULL)
+  int res = 1;
+  for (size_t i = 0; i < src->capacity; i++)
     {
-      hash_map->buckets[ind] = vector_alloc (pair_copy, pair_cmp, pair_free);
-      if (hash_map->buckets[ind] == NULL)
+      for (const hashmap_node *node = src->buckets[i]; node != NULL;
+           node = node->next)
         {
-          return 0;
+          if (hashmap_upsert (dst, &node->pair, combine).pair == NULL)
+            {
+              res = 0;
+            }
         }
     }
-  if (vector_push_back (hash_map->buckets[ind], in_pair) == 0)
-    {
-      return 0;
-    }
-  hash_map->size++;
+  return res;
+}
 
-  // check if the load factor is too big, if it is, change the map.
-  if (hashmap_get_load_factor (hash_map) > HASH_MAP_MAX_LOAD_FACTOR)
+/**
+ * Merges all the pairs of src into dst like hashmap_merge, and erases the
+ * merged pairs from src. If some pair fails, src keeps exactly the pairs
+ * that were not merged, so merging them again combines no pair twice.
+ * The capacity of src is kept, so it is filled again without re-sizing.
+ * @param dst the hash map to merge into.
+ * @param src the hash map to merge from.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged (and src is empty), 0 otherwise.
+ */
+int hashmap_merge_move (hashmap *dst, hashmap *src, valueT_combine combine)
+{
+  if (dst == NULL || src == NULL || dst == src || combine == NULL)
     {
-      change_map (hash_map, 0);
+      return 0;
     }
-  return 1;
+  erase_matching (src, NULL, NULL, dst, combine);
+  return src->size == 0;
 }
 
 /**
- * The function returns the value associated with the given key.
+ * Erases all the pairs in the hash map. The capacity is kept, so a map
+ * that is filled again to the same size is not re-sized.
  * @param hash_map a hash map.
- * @param key the key to be checked.
- * @return the value associated with key if exists, NULL otherwise
- * (the value itself, not a copy of it).
  */
-valueT hashmap_at (const hashmap *hash_map, const_keyT key)
+void hashmap_clear (hashmap *hash_map)
 {
-  if (hash_map == NULL || key == NULL)
+  if (hash_map == NULL)
     {
-      return NULL;
+      return;
     }
-  size_t ind = hash_map->hash_func (key) & (hash_map->capacity - 1);
-  vector *vec = hash_map->buckets[ind];
-  // if the dest vector is null, the key is not in the map - return NULL.
-  if (vec == NULL)
-    { return NULL; }
-  // if not null, check if it is one of it's pairs.
-  for (size_t j = 0; j < vec->size; j++)
+  free_nodes (hash_map);
+  hash_map->size = 0;
+  hash_map->version++;
+  if (hash_map->filter != NULL)
     {
-      pair *cur_pair = vec->data[j];
-      if (cur_pair->key_cmp (cur_pair->key, key))
-        {
-          return cur_pair->value;
-        }
+      memset (hash_map->filter, 0, hash_map->filter_blocks
+                                   * HASH_MAP_FILTER_BLOCK_WORDS
+                                   * sizeof (uint64_t));
     }
-  return NULL;
 }
 
 /**
- * The function erases the pair associated with key.
+ * Returns the number of pairs in a bucket of the map.
  * @param hash_map a hash map.
- * @param key a key of the pair to be erased.
- * @return 1 if the erasing was done successfully, 0 otherwise.
- * (if key not in map, considered fail).
+ * @param ind the index of the bucket.
+ * @return the number of pairs in the bucket, 0 if it does not exist.
  */
-int hashmap_erase (hashmap *hash_map, const_keyT key)
+size_t hashmap_bucket_size (const hashmap *hash_map, size_t ind)
 {
-  if (hash_map == NULL || key == NULL)
+  size_t size = 0;
+  if (hash_map == NULL || ind >= hash_map->capacity)
     {
       return 0;
     }
-  size_t ind = (hash_map->hash_func (key)) & (hash_map->capacity - 1);
-  // if the dest vector is null, the key is not in the map - return 0.
-  if (hash_map->buckets[ind] == NULL)
-    { return 0; }
-  for (size_t i = 0; i < hash_map->buckets[ind]->size; i++)
+  for (const hashmap_node *node = hash_map->buckets[ind]; node != NULL;
+       node = node->next)
     {
-      pair *pair = hash_map->buckets[ind]->data[i];
-      if (pair->key_cmp (key, pair->key))
-        {
-          vector_erase (hash_map->buckets[ind], i);
-          hash_map->size--;
-          // if the load factor is too small, change the map.
-          if (hashmap_get_load_factor (hash_map) < HASH_MAP_MIN_LOAD_FACTOR)
-            {
-              change_map (hash_map, 1);
-            }
-          return 1;
-        }
+      size++;
     }
-  // the key was not in the map, return 0.
-  return 0;
+  return size;
 }
 
 /**
@@ -286,21 +1672,182 @@ hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func,
     }
   for (size_t i = 0; i < hash_map->capacity; i++)
     {
-      if (hash_map->buckets[i] != NULL)
+      for (hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
         {
-          for (size_t j = 0; j < hash_map->buckets[i]->size; j++)
+          if (keyT_func (node->pair.key))
             {
-              pair *cur_pair = (hash_map->buckets[i])->data[j];
-              if (cur_pair != NULL)
-                {
-                  if (keyT_func (cur_pair->key))
-                    {
-                      valT_func (cur_pair->value);
-                      counter++;
-                    }
-                }
+              valT_func (node->pair.value);
+              counter++;
             }
         }
     }
   return counter;
 }
+
+/**
+ * Calls visit on every pair of the map, until it returns HASH_MAP_STOP.
+ * @param hash_map a hash map.
+ * @param visit a function which receives a key, its value (which it may
+ * change in place, but not the map) and ctx.
+ * @param ctx a context for visit (e.g. where to put its results).
+ * @return the number of pairs visit was called on.
+ */
+size_t hashmap_for_each (const hashmap *hash_map, pair_visit visit,
+                         void *ctx)
+{
+  size_t visited = 0;
+  if (hash_map == NULL || visit == NULL)
+    {
+      return 0;
+    }
+  for (size_t i = 0; i < hash_map->capacity; i++)
+    {
+      for (hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          visited++;
+          if (visit (node->pair.key, node->pair.value, ctx) == HASH_MAP_STOP)
+            {
+              return visited;
+            }
+        }
+    }
+  return visited;
+}
+
+/**
+ * @struct reduce_worker
+ * The part of a reduction one thread does.
+ * @param hash_map the reduced map.
+ * @param reduce the function which adds a pair to an accumulator.
+ * @param acc the accumulator of the thread.
+ * @param first, last the buckets [first, last) of the thread.
+ * @param stopped shared by all the threads, set once reduce stopped.
+ */
+typedef struct reduce_worker {
+    const hashmap *hash_map;
+    pair_reduce reduce;
+    void *acc;
+    size_t first;
+    size_t last;
+    int *stopped;
+} reduce_worker;
+
+/**
+ * reduces the buckets of a worker into its accumulator (a thread routine).
+ */
+static void *reduce_buckets (void *arg)
+{
+  reduce_worker *worker = arg;
+  for (size_t i = worker->first; i < worker->last; i++)
+    {
+      if (__atomic_load_n (worker->stopped, __ATOMIC_RELAXED))
+        {
+          return NULL;
+        }
+      for (const hashmap_node *node = worker->hash_map->buckets[i];
+           node != NULL; node = node->next)
+        {
+          if (worker->reduce (worker->acc, node->pair.key, node->pair.value)
+              == HASH_MAP_STOP)
+            {
+              __atomic_store_n (worker->stopped, 1, __ATOMIC_RELAXED);
+              return NULL;
+            }
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Reduces all the pairs of the map into an accumulator, until reduce
+ * returns HASH_MAP_STOP. With more than one thread, every thread reduces a
+ * part of the buckets into its own copy of the initial accumulator, and the
+ * copies are combined into acc in the order of their parts.
+ * @param hash_map a hash map, it must not be changed during the reduction.
+ * @param reduce a function which adds a key and its value to an
+ * accumulator.
+ * @param combine a function which combines an accumulator into another one
+ * (NULL for reducing in the calling thread only).
+ * @param acc the accumulator, holding the initial (empty) value.
+ * @param acc_size the number of bytes in the accumulator, it is copied with
+ * memcpy.
+ * @param threads the number of threads to use (0 or 1 for the calling
+ * thread only).
+ * @return 1 if all the pairs were reduced, 0 if reduce stopped or the
+ * function failed.
+ */
+int hashmap_reduce (const hashmap *hash_map, pair_reduce reduce,
+                    acc_combine combine, void *acc, size_t acc_size,
+                    size_t threads)
+{
+  if (hash_map == NULL || reduce == NULL || acc == NULL)
+    {
+      return 0;
+    }
+  int stopped = 0;
+  size_t n_workers = threads < hash_map->capacity ? threads
+                                                  : hash_map->capacity;
+  if (combine == NULL || acc_size == 0 || n_workers < 2)
+    {
+      n_workers = 1;
+    }
+  const allocator *alloc = hash_map->allocator;
+  reduce_worker *workers = allocator_alloc (alloc,
+                                            n_workers * sizeof *workers);
+  pthread_t *ids = allocator_alloc (alloc, n_workers * sizeof *ids);
+  int *started = allocator_calloc (alloc, n_workers, sizeof *started);
+  char *accs = allocator_alloc (alloc, n_workers * acc_size + 1);
+  if (workers == NULL || ids == NULL || started == NULL || accs == NULL)
+    {
+      allocator_free (alloc, workers, n_workers * sizeof *workers);
+      allocator_free (alloc, ids, n_workers * sizeof *ids);
+      allocator_free (alloc, started, n_workers * sizeof *started);
+      allocator_free (alloc, accs, n_workers * acc_size + 1);
+      // a reduction in the calling thread needs no memory.
+      reduce_worker worker = {hash_map, reduce, acc, 0, hash_map->capacity,
+                              &stopped};
+      reduce_buckets (&worker);
+      return !stopped;
+    }
+  size_t part = hash_map->capacity / n_workers;
+  for (size_t w = 0; w < n_workers; w++)
+    {
+      // the first worker reduces into acc itself, the others into copies
+      // of its initial value.
+      void *worker_acc = acc;
+      if (w > 0)
+        {
+          worker_acc = accs + w * acc_size;
+          memcpy (worker_acc, acc, acc_size);
+        }
+      workers[w] = (reduce_worker) {hash_map, reduce, worker_acc, w * part,
+                                    w + 1 == n_workers ? hash_map->capacity
+                                                       : (w + 1) * part,
+                                    &stopped};
+    }
+  for (size_t w = 1; w < n_workers; w++)
+    {
+      started[w] = pthread_create (&ids[w], NULL, reduce_buckets,
+                                   &workers[w]) == 0;
+    }
+  reduce_buckets (&workers[0]);
+  for (size_t w = 1; w < n_workers; w++)
+    {
+      if (started[w])
+        {
+          pthread_join (ids[w], NULL);
+        }
+      else
+        {
+          reduce_buckets (&workers[w]);
+        }
+      combine (acc, workers[w].acc);
+    }
+  allocator_free (alloc, workers, n_workers * sizeof *workers);
+  allocator_free (alloc, ids, n_workers * sizeof *ids);
+  allocator_free (alloc, started, n_workers * sizeof *started);
+  allocator_free (alloc, accs, n_workers * acc_size + 1);
+  return !stopped;
+}
@@ -2,13 +2,13 @@
 #define HASHMAP_H_
 
 #include <stdlib.h>
-#include "vector.h"
+#include <stdint.h>
 #include "pair.h"
 
 /**
  * @def HASH_MAP_INITIAL_CAP
  * The initial capacity of the hash map.
- * It means, the initial number of <b> vectors </b> the hash map has.
+ * It means, the initial number of <b> buckets </b> the hash map has.
  */
 #define HASH_MAP_INITIAL_CAP 16UL
 
@@ -27,7 +27,7 @@
  * Example: if the hash_map capacity is 16,
  * and it has 4 elements in it (size is 4),
  * if an element is erased, the load factor drops below 0.25,
- * so the hash map should be minimized (to 8 vectors).
+ * so the hash map should be minimized (to 8 buckets).
  */
 #define HASH_MAP_MIN_LOAD_FACTOR 0.25
 
@@ -37,10 +37,59 @@
  * Example: if the hash_map capacity is 16,
  * and it has 12 elements in it (size is 12),
  * if another element is added, the load factor goes above 0.75,
- * so the hash map should be extended (to 32 vectors).
+ * so the hash map should be extended (to 32 buckets).
  */
 #define HASH_MAP_MAX_LOAD_FACTOR 0.75
 
+/**
+ * @def HASH_MAP_SORTED_BUCKET_THRESHOLD
+ * Buckets with more pairs than this are indexed by key (when the map has a
+ * keyT_order function), so they are searched in O(log n) even when many
+ * keys have the same hash.
+ */
+#define HASH_MAP_SORTED_BUCKET_THRESHOLD 8UL
+
+/**
+ * @def HASH_MAP_PARALLEL_REHASH_MIN_SIZE
+ * The smallest number of pairs a map re-sizes with more than one thread,
+ * smaller maps are faster to re-size than to start threads for.
+ */
+#define HASH_MAP_PARALLEL_REHASH_MIN_SIZE 65536UL
+
+/**
+ * @def HASH_MAP_FILTER_BITS_PER_BUCKET
+ * The number of bits of the filter of a map for every bucket (about 11 bits
+ * for every key at the maximal load factor).
+ */
+#define HASH_MAP_FILTER_BITS_PER_BUCKET 8UL
+
+/**
+ * @def HASH_MAP_FILTER_BLOCK_WORDS
+ * The number of 64 bits words in a block of the filter (a 64 bytes cache
+ * line), all the bits of a key are in one block.
+ */
+#define HASH_MAP_FILTER_BLOCK_WORDS 8UL
+
+/**
+ * @def HASH_MAP_FILTER_HASHES
+ * The number of bits the filter sets for every key.
+ */
+#define HASH_MAP_FILTER_HASHES 4
+
+/**
+ * @def HASH_MAP_CONTINUE
+ * Returned by the functions hashmap_for_each and hashmap_reduce call, to go
+ * on to the next pair.
+ */
+#define HASH_MAP_CONTINUE 0
+
+/**
+ * @def HASH_MAP_STOP
+ * Returned by the functions hashmap_for_each and hashmap_reduce call, to
+ * stop before the next pair.
+ */
+#define HASH_MAP_STOP 1
+
 /**
  * @typedef hash_func
  * This type of function receives a keyT and returns
@@ -48,9 +97,18 @@
  * Example: lets say we have a pair ('Joe', 78) that we want to store in the hash map,
  * the key is 'Joe' so it determines the bucket in the hash map,
  * his index would be:  size_t ind = hash_func('Joe') & (capacity - 1);
+ * (for seeded maps, the hash is mixed with the seed first,
+ * see hashmap_bucket_index).
  */
 typedef size_t (*hash_func) (const_keyT);
 
+/**
+ * @typedef keyT_order
+ * A function that receives two keys and returns a negative number if the
+ * first is smaller, 0 if they are equal and a positive number otherwise.
+ */
+typedef int (*keyT_order) (const_keyT, const_keyT);
+
 
 /**
  * @typedef keyT_func
@@ -58,26 +116,156 @@ typedef size_t (*hash_func) (const_keyT);
  */
 typedef int (*keyT_func) (const_keyT);
 
+/**
+ * @typedef pairT_func
+ * A function that receives a key and its value, and returns 1 if they
+ * fulfill some condition, and 0 else.
+ */
+typedef int (*pairT_func) (const_keyT, const_valueT);
+
+/**
+ * @typedef pair_visit
+ * A function that receives a key, its value and a context, and returns
+ * HASH_MAP_STOP or HASH_MAP_CONTINUE.
+ */
+typedef int (*pair_visit) (const_keyT, valueT, void *);
+
+/**
+ * @typedef pair_reduce
+ * A function that adds a key and its value to an accumulator (the first
+ * argument), and returns HASH_MAP_STOP or HASH_MAP_CONTINUE.
+ */
+typedef int (*pair_reduce) (void *, const_keyT, const_valueT);
+
+/**
+ * @typedef acc_combine
+ * A function that combines the second accumulator into the first one.
+ */
+typedef void (*acc_combine) (void *, const void *);
+
 /**
  * @typedef valueT_func
  * A function that changes the value of a valueT, in-place
  */
 typedef void (*valueT_func) (valueT);
 
+/**
+ * @typedef valueT_combine
+ * A function that combines the second value into the first one, in-place
+ * (e.g. adds a count to a stored count).
+ */
+typedef void (*valueT_combine) (valueT, const_valueT);
+
+/**
+ * @struct hashmap_array_policy
+ * How the buckets array of a hash map is allocated (e.g. on huge pages or
+ * on some NUMA nodes, see hashmap_mmap.h). The default (alloc is NULL) is
+ * the allocator of the map.
+ * @param alloc returns size zeroed bytes, NULL if failed.
+ * @param free frees an array alloc returned, size is the size it was
+ * allocated with.
+ * @param ctx passed to alloc and free.
+ */
+typedef struct hashmap_array_policy {
+    void *(*alloc) (size_t size, void *ctx);
+    void (*free) (void *array, size_t size, void *ctx);
+    void *ctx;
+} hashmap_array_policy;
+
+/**
+ * @struct hashmap_node
+ * A pair stored in the hash map, linked into the list of its bucket. The
+ * node is the only allocation of a stored pair (besides its key and value),
+ * and an empty bucket is just a NULL pointer.
+ * @param next the next node in the bucket, NULL for the last one.
+ * @param hash the value hash_func returned for the key of the pair, so
+ * re-sizes and lookups do not hash the keys again.
+ * @param pair the stored pair, its key and value are copies.
+ */
+typedef struct hashmap_node {
+    struct hashmap_node *next;
+    size_t hash;
+    pair pair;
+} hashmap_node;
+
+/**
+ * @struct hashmap_sorted_bucket
+ * The index of a bucket with more than HASH_MAP_SORTED_BUCKET_THRESHOLD
+ * pairs: its nodes sorted by the key_order of the map, so the bucket is
+ * binary searched. The list of the bucket is kept in the same order, so a
+ * node is unlinked through the node before it in the index.
+ * @param count the number of nodes in the bucket.
+ * @param capacity the number of nodes the index has room for.
+ * @param nodes the nodes of the bucket, in the order of their keys.
+ */
+typedef struct hashmap_sorted_bucket {
+    size_t count;
+    size_t capacity;
+    hashmap_node *nodes[];
+} hashmap_sorted_bucket;
+
 /**
  * @struct hashmap
- * @param buckets dynamic array of vectors which stores the values.
+ * @param buckets dynamic array of lists of nodes which stores the values,
+ * NULL for empty buckets.
  * @param size the number of elements (pairs) stored in the hash map.
  * @param capacity the number of buckets in the hash map.
  * @param hash_func a function which "hashes" keys.
+ * @param seed a random number mixed into the hashes, 0 for not seeded maps.
+ * @param key_order a function which orders keys, used to index big buckets
+ * (NULL for not indexing them).
+ * @param sorted for maps with a key_order, one index for every bucket, NULL
+ * for the buckets with at most HASH_MAP_SORTED_BUCKET_THRESHOLD pairs (and
+ * for buckets whose index could not be allocated, they are searched
+ * linearly). NULL for maps without a key_order.
+ * @param rehash_threads the number of threads a re-size uses (1 for
+ * re-sizing in the calling thread only).
+ * @param array_policy how the buckets array is allocated.
+ * @param allocator the allocator of the map, its buckets array and its
+ * nodes (NULL for malloc).
+ * @param filter a blocked Bloom filter of the hashes of the keys, so most
+ * lookups of missing keys return without reading the buckets (NULL for no
+ * filter). Erased keys stay in it until the next re-size re-builds it.
+ * @param filter_blocks the number of blocks in filter.
+ * @param version the number of inserts and erases done in the map, so the
+ * structures built on its pairs (e.g. hashmap_index) know when they are
+ * out of date.
+ * @param node_extra the number of bytes every node has after its pair, for
+ * the structures built on the map to keep their state of the pair in (e.g.
+ * the eviction list of hashmap_cache), 0 for none.
  */
 typedef struct hashmap {
-    vector **buckets;
+    hashmap_node **buckets;
     size_t size;
     size_t capacity; // num of buckets
     hash_func hash_func;
+    size_t seed;
+    keyT_order key_order;
+    hashmap_sorted_bucket **sorted;
+    size_t rehash_threads;
+    hashmap_array_policy array_policy;
+    const allocator *allocator;
+    uint64_t *filter;
+    size_t filter_blocks;
+    size_t version;
+    size_t node_extra;
 } hashmap;
 
+/**
+ * @struct hashmap_entry
+ * A handle to a pair stored inside the hash map.
+ * The handle stays valid across inserts and erases of other keys, and
+ * across re-sizes (the nodes are not moved), as long as the entry itself is
+ * not erased.
+ * @param pair the stored pair (the pair itself, not a copy of it),
+ * NULL if there is no such entry.
+ * @param hash the value hash_func returned for the key of the pair.
+ */
+typedef struct hashmap_entry {
+    pair *pair;
+    size_t hash;
+} hashmap_entry;
+
 /**
  * Allocates dynamically new hash map element.
  * @param func a function which "hashes" keys.
@@ -86,12 +274,98 @@ typedef struct hashmap {
  */
 hashmap *hashmap_alloc (hash_func func);
 
+/**
+ * Allocates dynamically new hash map element, which allocates all its
+ * memory (the map, the buckets array and the nodes of the pairs) with the
+ * given allocator.
+ * @param func a function which "hashes" keys.
+ * @param alloc an allocator, NULL for malloc. It must live as long as the
+ * map.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_with_allocator (hash_func func, const allocator *alloc);
+
+/**
+ * Allocates dynamically new hash map element, which is protected from keys
+ * crafted to collide: the hashes are mixed with a random seed before
+ * choosing the bucket, and buckets that still get more than
+ * HASH_MAP_SORTED_BUCKET_THRESHOLD pairs (keys with equal hashes) are
+ * indexed by key_order and binary searched.
+ * @param func a function which "hashes" keys.
+ * @param key_order a function which orders keys, NULL for seeding only.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_seeded (hash_func func, keyT_order key_order);
+
+/**
+ * The splitmix64 finalizer, spreads the bits of x over the whole word. The
+ * maps built on hashmap use it to spread the hashes of weak hash functions
+ * before taking some of their bits.
+ * @param x a hash (or any number).
+ * @return the mixed number.
+ */
+uint64_t hashmap_mix (uint64_t x);
+
+/**
+ * Returns the bucket of a hash in a map with the given seed and capacity.
+ * @param hash the value hash_func returned for a key.
+ * @param seed the seed of the map (0 if not seeded).
+ * @param capacity the number of buckets of the map.
+ * @return the index of the bucket.
+ */
+size_t hashmap_bucket_index (size_t hash, size_t seed, size_t capacity);
+
 /**
  * Frees a hash map and the elements the hash map itself allocated.
  * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
  */
 void hashmap_free (hashmap **p_hash_map);
 
+/**
+ * Sets the number of threads the re-sizes of the map use, once the map has
+ * HASH_MAP_PARALLEL_REHASH_MIN_SIZE pairs: the old buckets are split
+ * between the threads, and every thread builds its own part of the new
+ * buckets. The map itself is still not safe to use from many threads.
+ * @param hash_map a hash map.
+ * @param n_threads the number of threads (0 or 1 for one thread).
+ */
+void hashmap_set_rehash_threads (hashmap *hash_map, size_t n_threads);
+
+/**
+ * Sets how the buckets array of the map is allocated from now on, the
+ * current array is moved to an array allocated by the new policy.
+ * @param hash_map a hash map.
+ * @param policy the new policy (copied), NULL for the allocator of the map.
+ * @return returns 1 for successful, 0 otherwise (and then the map keeps
+ * its policy).
+ */
+int hashmap_set_array_policy (hashmap *hash_map,
+                              const hashmap_array_policy *policy);
+
+/**
+ * Sets the number of extra bytes every node of the map has after its pair
+ * (see hashmap_entry_extra), so a structure built on the map keeps its
+ * state of a pair without allocating it separately.
+ * @param hash_map an empty hash map.
+ * @param extra the number of extra bytes (0 for none).
+ * @return returns 1 for successful, 0 otherwise (e.g. the map is not
+ * empty).
+ */
+int hashmap_set_node_extra (hashmap *hash_map, size_t extra);
+
+/**
+ * Adds a filter of the keys to the map (see the filter of hashmap), or
+ * removes it. The filter is worth its memory for maps that are looked up
+ * mostly for missing keys.
+ * @param hash_map a hash map.
+ * @param enable 1 for adding a filter, 0 for removing it.
+ * @return returns 1 for successful, 0 otherwise (and then the map keeps
+ * its filter, or its lack of one).
+ */
+int hashmap_set_filter (hashmap *hash_map, int enable);
+
 /**
  * Inserts a new in_pair to the hash map.
  * The function inserts *new*, *copied*, *dynamically allocated* in_pair,
@@ -102,6 +376,23 @@ void hashmap_free (hashmap **p_hash_map);
  */
 int hashmap_insert (hashmap *hash_map, const pair *in_pair);
 
+/**
+ * Makes room for n more pairs, so inserting them would not re-size the map.
+ * @param hash_map a hash map.
+ * @param n the number of pairs that are going to be inserted.
+ * @return returns 1 for successful, 0 otherwise (e.g. there is no capacity
+ * for so many pairs, and then the map is not changed).
+ */
+int hashmap_reserve (hashmap *hash_map, size_t n);
+
+/**
+ * Re-sizes the map to the smallest capacity that holds its pairs, e.g.
+ * after a big erase (erasing shrinks the map only by one step at a time).
+ * @param hash_map a hash map.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+int hashmap_shrink (hashmap *hash_map);
+
 /**
  * The function returns the value associated with the given key.
  * @param hash_map a hash map.
@@ -111,6 +402,55 @@ int hashmap_insert (hashmap *hash_map, const pair *in_pair);
  */
 valueT hashmap_at (const hashmap *hash_map, const_keyT key);
 
+/**
+ * The function returns a handle to the entry associated with the given key,
+ * so the key, the value and the hash can be used without another lookup.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return handle to the entry if exists, a handle with NULL pair otherwise.
+ */
+hashmap_entry hashmap_find (const hashmap *hash_map, const_keyT key);
+
+/**
+ * The function returns a handle to the entry associated with the given key,
+ * whose hash was already computed (e.g. for partitioning the keys).
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @param hash the value the hash_func of the map returns for key.
+ * @return handle to the entry if exists, a handle with NULL pair otherwise.
+ */
+hashmap_entry hashmap_find_hashed (const hashmap *hash_map, const_keyT key,
+                                  size_t hash);
+
+/**
+ * Inserts a copy of in_pair at the place a lookup of its key found empty,
+ * without looking the key up again.
+ * @param hash_map a hash map.
+ * @param entry the handle (with NULL pair) hashmap_find returned for the
+ * key of in_pair (the key must still not be in the map).
+ * @param in_pair a in_pair the hash map would contain.
+ * @return handle to the inserted copy, a handle with NULL pair if failed.
+ */
+hashmap_entry hashmap_entry_insert (hashmap *hash_map, hashmap_entry entry,
+                                    const pair *in_pair);
+
+/**
+ * The function erases the entry the given handle refers to.
+ * @param hash_map a hash map.
+ * @param entry a valid handle returned by hashmap_find.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_entry_erase (hashmap *hash_map, hashmap_entry entry);
+
+/**
+ * Returns the extra bytes of the node of an entry (see
+ * hashmap_set_node_extra). They are zeroed when the pair is inserted, are
+ * aligned like a pointer, and live as long as the entry.
+ * @param entry a valid handle to an entry of a map with extra bytes.
+ * @return pointer to the extra bytes, NULL if entry has NULL pair.
+ */
+void *hashmap_entry_extra (hashmap_entry entry);
+
 /**
  * The function erases the pair associated with key.
  * @param hash_map a hash map.
@@ -120,6 +460,89 @@ valueT hashmap_at (const hashmap *hash_map, const_keyT key);
  */
 int hashmap_erase (hashmap *hash_map, const_keyT key);
 
+/**
+ * Erases all the pairs whose keys fulfill a condition, in one pass over the
+ * buckets, and then re-sizes the map once if it became too sparse (instead
+ * of shrinking it step by step while erasing).
+ * @param hash_map a hash map.
+ * @param keyT_func a function that checks a condition on keyT and returns
+ * 1 if true, 0 else.
+ * @return the number of erased pairs.
+ */
+size_t hashmap_erase_if (hashmap *hash_map, keyT_func keyT_func);
+
+/**
+ * Erases all the pairs whose keys and values fulfill a condition, in one
+ * pass over the buckets, and then re-sizes the map once if it became too
+ * sparse.
+ * @param hash_map a hash map.
+ * @param pairT_func a function that checks a condition on a key and its
+ * value and returns 1 if true, 0 else.
+ * @return the number of erased pairs.
+ */
+size_t hashmap_erase_if_pair (hashmap *hash_map, pairT_func pairT_func);
+
+/**
+ * Inserts a copy of in_pair, or if its key is already in the map, merges
+ * its value into the stored value in place - with a single lookup, and no
+ * erase and insert (which may shrink and grow the map).
+ * @param hash_map a hash map.
+ * @param in_pair a pair to be inserted or merged.
+ * @param merge a function which combines a value into the stored value,
+ * NULL for replacing the stored value by a copy of the value of in_pair.
+ * @return handle to the stored entry, a handle with NULL pair if failed.
+ */
+hashmap_entry hashmap_upsert (hashmap *hash_map, const pair *in_pair,
+                              valueT_combine merge);
+
+/**
+ * Changes the value associated with the given key in place.
+ * @param hash_map a hash map.
+ * @param key the key of the value.
+ * @param update a function which changes the value.
+ * @return 1 if the key is in the map (and its value was changed), 0
+ * otherwise.
+ */
+int hashmap_update (hashmap *hash_map, const_keyT key, valueT_func update);
+
+/**
+ * Merges all the pairs of src into dst, in one pass over src: keys which
+ * are not in dst are inserted (copied), and the values of keys which are
+ * in both maps are combined into the values in dst.
+ * @param dst the hash map to merge into.
+ * @param src the hash map to merge from, it is not changed.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged successfully, 0 otherwise.
+ */
+int hashmap_merge (hashmap *dst, const hashmap *src, valueT_combine combine);
+
+/**
+ * Merges all the pairs of src into dst like hashmap_merge, and erases the
+ * merged pairs from src. If some pair fails, src keeps exactly the pairs
+ * that were not merged, so merging them again combines no pair twice.
+ * The capacity of src is kept, so it is filled again without re-sizing.
+ * @param dst the hash map to merge into.
+ * @param src the hash map to merge from.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged (and src is empty), 0 otherwise.
+ */
+int hashmap_merge_move (hashmap *dst, hashmap *src, valueT_combine combine);
+
+/**
+ * Erases all the pairs in the hash map. The capacity is kept, so a map
+ * that is filled again to the same size is not re-sized.
+ * @param hash_map a hash map.
+ */
+void hashmap_clear (hashmap *hash_map);
+
+/**
+ * Returns the number of pairs in a bucket of the map.
+ * @param hash_map a hash map.
+ * @param ind the index of the bucket.
+ * @return the number of pairs in the bucket, 0 if it does not exist.
+ */
+size_t hashmap_bucket_size (const hashmap *hash_map, size_t ind);
+
 /**
  * This function returns the load factor of the hash map.
  * @param hash_map a hash map.
@@ -141,4 +564,37 @@ double hashmap_get_load_factor (const hashmap *hash_map);
  * @return number of changed values
  */
 int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func, valueT_func valT_func);//const
+
+/**
+ * Calls visit on every pair of the map, until it returns HASH_MAP_STOP.
+ * @param hash_map a hash map.
+ * @param visit a function which receives a key, its value (which it may
+ * change in place, but not the map) and ctx.
+ * @param ctx a context for visit (e.g. where to put its results).
+ * @return the number of pairs visit was called on.
+ */
+size_t hashmap_for_each (const hashmap *hash_map, pair_visit visit,
+                         void *ctx);
+
+/**
+ * Reduces all the pairs of the map into an accumulator, until reduce
+ * returns HASH_MAP_STOP. With more than one thread, every thread reduces a
+ * part of the buckets into its own copy of the initial accumulator, and the
+ * copies are combined into acc in the order of their parts.
+ * @param hash_map a hash map, it must not be changed during the reduction.
+ * @param reduce a function which adds a key and its value to an
+ * accumulator.
+ * @param combine a function which combines an accumulator into another one
+ * (NULL for reducing in the calling thread only).
+ * @param acc the accumulator, holding the initial (empty) value.
+ * @param acc_size the number of bytes in the accumulator, it is copied with
+ * memcpy.
+ * @param threads the number of threads to use (0 or 1 for the calling
+ * thread only).
+ * @return 1 if all the pairs were reduced, 0 if reduce stopped or the
+ * function failed.
+ */
+int hashmap_reduce (const hashmap *hash_map, pair_reduce reduce,
+                    acc_combine combine, void *acc, size_t acc_size,
+                    size_t threads);
 #endif //HASHMAP_H_
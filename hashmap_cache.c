@@ -0,0 +1,271 @@
+#include "hashmap_cache.h"
+
+/**
+ * Allocates dynamically new cache.
+ * @param func a function which "hashes" keys.
+ * @param policy HASH_MAP_CACHE_LRU or HASH_MAP_CACHE_CLOCK.
+ * @param max_entries the maximal number of entries (0 for no limit).
+ * @param max_bytes the maximal number of charged bytes (0 for no limit).
+ * @param charge a function that returns the charge of a value (NULL for
+ * charging nothing).
+ * @return pointer to dynamically allocated hashmap_cache.
+ * @if_fail return NULL.
+ */
+hashmap_cache *hashmap_cache_alloc (hash_func func, int policy,
+                                    size_t max_entries, size_t max_bytes,
+                                    valueT_charge charge)
+{
+  if (policy != HASH_MAP_CACHE_LRU && policy != HASH_MAP_CACHE_CLOCK)
+    {
+      return NULL;
+    }
+  hashmap_cache *cache = calloc (1, sizeof *cache);
+  if (cache == NULL)
+    {
+      return NULL;
+    }
+  cache->map = hashmap_alloc (func);
+  if (cache->map == NULL
+      || !hashmap_set_node_extra (cache->map, sizeof (hashmap_cache_entry)))
+    {
+      hashmap_free (&cache->map);
+      free (cache);
+      return NULL;
+    }
+  cache->policy = policy;
+  cache->max_entries = max_entries;
+  cache->max_bytes = max_bytes;
+  cache->charge = charge;
+  return cache;
+}
+
+/**
+ * Frees a cache and all the entries in it.
+ * @param p_cache pointer to dynamically allocated pointer to hashmap_cache.
+ */
+void hashmap_cache_free (hashmap_cache **p_cache)
+{
+  if (p_cache == NULL || *p_cache == NULL)
+    {
+      return;
+    }
+  hashmap_free (&(*p_cache)->map);
+  free (*p_cache);
+  *p_cache = NULL;
+}
+
+/**
+ * links an entry just before the hand: for LRU it becomes the most
+ * recently used entry, and for CLOCK the last one the hand checks.
+ */
+static void link_entry (hashmap_cache *cache, hashmap_cache_entry *entry)
+{
+  if (cache->hand == NULL)
+    {
+      entry->prev = entry;
+      entry->next = entry;
+      cache->hand = entry;
+      return;
+    }
+  entry->next = cache->hand;
+  entry->prev = cache->hand->prev;
+  entry->prev->next = entry;
+  cache->hand->prev = entry;
+  if (cache->policy == HASH_MAP_CACHE_LRU)
+    {
+      cache->hand = entry;
+    }
+}
+
+/**
+ * unlinks an entry from the eviction list.
+ */
+static void unlink_entry (hashmap_cache *cache, hashmap_cache_entry *entry)
+{
+  if (entry->next == entry)
+    {
+      cache->hand = NULL;
+      return;
+    }
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+  if (cache->hand == entry)
+    {
+      cache->hand = entry->next;
+    }
+}
+
+/**
+ * marks an entry as used.
+ */
+static void touch_entry (hashmap_cache *cache, hashmap_cache_entry *entry)
+{
+  if (cache->policy == HASH_MAP_CACHE_CLOCK)
+    {
+      entry->referenced = 1;
+    }
+  else if (cache->hand != entry)
+    {
+      unlink_entry (cache, entry);
+      link_entry (cache, entry);
+    }
+}
+
+/**
+ * @return the entry the policy evicts next, but never keep (NULL if keep
+ * is the only entry).
+ */
+static hashmap_cache_entry *pick_victim (hashmap_cache *cache,
+                                         const hashmap_cache_entry *keep)
+{
+  if (cache->map->size <= 1)
+    {
+      return NULL;
+    }
+  if (cache->policy == HASH_MAP_CACHE_LRU)
+    {
+      return cache->hand->prev;
+    }
+  // give the used entries a second chance, a full round clears all the
+  // flags, so this ends.
+  while (cache->hand->referenced || cache->hand == keep)
+    {
+      cache->hand->referenced = 0;
+      cache->hand = cache->hand->next;
+    }
+  return cache->hand;
+}
+
+/**
+ * erases an entry from the cache, with its pair (the entry is freed with
+ * the node of the pair).
+ */
+static void erase_entry (hashmap_cache *cache, hashmap_cache_entry *entry)
+{
+  unlink_entry (cache, entry);
+  cache->bytes -= entry->charge;
+  hashmap_entry_erase (cache->map, entry->entry);
+}
+
+/**
+ * @return 1 if the cache has more entries or bytes than it may have.
+ */
+static int over_limit (const hashmap_cache *cache)
+{
+  return (cache->max_entries != 0 && cache->map->size > cache->max_entries)
+         || (cache->max_bytes != 0 && cache->bytes > cache->max_bytes);
+}
+
+/**
+ * Inserts a copy of in_pair to the cache, or replaces the value of its key
+ * with a copy of its value. Entries are evicted (with their value_free)
+ * until the cache is within its limits again, the new entry is never
+ * evicted by its own insert.
+ * @param cache a cache.
+ * @param in_pair a in_pair the cache would contain.
+ * @return returns 1 for successful insertion, 0 otherwise (e.g. the value
+ * alone is charged more than max_bytes).
+ */
+int hashmap_cache_put (hashmap_cache *cache, const pair *in_pair)
+{
+  if (cache == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  size_t charge = cache->charge == NULL ? 0 : cache->charge (in_pair->value);
+  if (cache->max_bytes != 0 && charge > cache->max_bytes)
+    {
+      return 0;
+    }
+  hashmap_entry found = hashmap_find (cache->map, in_pair->key);
+  hashmap_cache_entry *entry;
+  if (found.pair != NULL)
+    {
+      // copied before the old value is freed, in_pair may hold the value
+      // hashmap_cache_get returned.
+      valueT value = in_pair->value_cpy (in_pair->value);
+      if (value == NULL)
+        {
+          return 0;
+        }
+      found.pair->value_free (&found.pair->value);
+      found.pair->value = value;
+      found.pair->value_cpy = in_pair->value_cpy;
+      found.pair->value_cmp = in_pair->value_cmp;
+      found.pair->value_free = in_pair->value_free;
+      entry = hashmap_entry_extra (found);
+      cache->bytes = cache->bytes - entry->charge + charge;
+      entry->charge = charge;
+      touch_entry (cache, entry);
+    }
+  else
+    {
+      found = hashmap_entry_insert (cache->map, found, in_pair);
+      if (found.pair == NULL)
+        {
+          return 0;
+        }
+      // the extra bytes of the new node are zeroed, so it is not
+      // referenced yet.
+      entry = hashmap_entry_extra (found);
+      entry->entry = found;
+      entry->charge = charge;
+      link_entry (cache, entry);
+      cache->bytes += charge;
+    }
+  while (over_limit (cache))
+    {
+      hashmap_cache_entry *victim = pick_victim (cache, entry);
+      if (victim == NULL)
+        {
+          break;
+        }
+      erase_entry (cache, victim);
+      cache->evictions++;
+    }
+  return 1;
+}
+
+/**
+ * Returns the value associated with the given key, and marks the entry as
+ * used.
+ * @param cache a cache.
+ * @param key the key to be checked.
+ * @return the value associated with key if cached, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_cache_get (hashmap_cache *cache, const_keyT key)
+{
+  if (cache == NULL)
+    {
+      return NULL;
+    }
+  hashmap_entry found = hashmap_find (cache->map, key);
+  if (found.pair == NULL)
+    {
+      return NULL;
+    }
+  touch_entry (cache, hashmap_entry_extra (found));
+  return found.pair->value;
+}
+
+/**
+ * The function erases the entry associated with key.
+ * @param cache a cache.
+ * @param key a key of the entry to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_cache_erase (hashmap_cache *cache, const_keyT key)
+{
+  if (cache == NULL)
+    {
+      return 0;
+    }
+  hashmap_entry found = hashmap_find (cache->map, key);
+  if (found.pair == NULL)
+    {
+      return 0;
+    }
+  erase_entry (cache, hashmap_entry_extra (found));
+  return 1;
+}
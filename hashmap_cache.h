@@ -0,0 +1,129 @@
+#ifndef HASHMAP_CACHE_H_
+#define HASHMAP_CACHE_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_CACHE_LRU
+ * Evict the least recently used entry. A hit moves the entry to the front
+ * of the recency list.
+ */
+#define HASH_MAP_CACHE_LRU 0
+
+/**
+ * @def HASH_MAP_CACHE_CLOCK
+ * Evict with the CLOCK (second chance) algorithm, an approximation of LRU.
+ * A hit only sets a flag in the entry, so hits write no links.
+ */
+#define HASH_MAP_CACHE_CLOCK 1
+
+/**
+ * @typedef valueT_charge
+ * A function that receives a value and returns the number of bytes it is
+ * charged in the cache.
+ */
+typedef size_t (*valueT_charge) (const_valueT);
+
+/**
+ * @struct hashmap_cache_entry
+ * The place of a cached pair in the eviction order. It is kept in the
+ * extra bytes of the node of the pair in the map of the cache (see
+ * hashmap_set_node_extra), so a cached pair is one allocation.
+ * @param prev, next the neighbours of the entry in the circular eviction
+ * list.
+ * @param entry handle to the pair of the entry in the map, so an eviction
+ * needs no lookup.
+ * @param charge the number of bytes the value of the pair is charged.
+ * @param referenced 1 if the entry was used since the clock hand passed it
+ * (CLOCK only).
+ */
+typedef struct hashmap_cache_entry {
+    struct hashmap_cache_entry *prev;
+    struct hashmap_cache_entry *next;
+    hashmap_entry entry;
+    size_t charge;
+    int referenced;
+} hashmap_cache_entry;
+
+/**
+ * @struct hashmap_cache
+ * A bounded hash map: once it has more than max_entries entries, or they
+ * are charged more than max_bytes, entries are evicted by the policy.
+ * A hit and an eviction take one lookup and no allocation.
+ * @param map the hash map of the cached pairs, its nodes have a
+ * hashmap_cache_entry as their extra bytes.
+ * @param hand for LRU the most recently used entry, and its prev is the
+ * least recently used one. for CLOCK the next entry the clock hand checks.
+ * NULL if the cache is empty.
+ * @param policy HASH_MAP_CACHE_LRU or HASH_MAP_CACHE_CLOCK.
+ * @param max_entries the maximal number of entries (0 for no limit).
+ * @param max_bytes the maximal number of charged bytes (0 for no limit).
+ * @param bytes the number of bytes the entries are charged.
+ * @param charge a function that returns the charge of a value (NULL for
+ * charging nothing).
+ * @param evictions the number of entries evicted so far.
+ */
+typedef struct hashmap_cache {
+    hashmap *map;
+    hashmap_cache_entry *hand;
+    int policy;
+    size_t max_entries;
+    size_t max_bytes;
+    size_t bytes;
+    valueT_charge charge;
+    size_t evictions;
+} hashmap_cache;
+
+/**
+ * Allocates dynamically new cache.
+ * @param func a function which "hashes" keys.
+ * @param policy HASH_MAP_CACHE_LRU or HASH_MAP_CACHE_CLOCK.
+ * @param max_entries the maximal number of entries (0 for no limit).
+ * @param max_bytes the maximal number of charged bytes (0 for no limit).
+ * @param charge a function that returns the charge of a value (NULL for
+ * charging nothing).
+ * @return pointer to dynamically allocated hashmap_cache.
+ * @if_fail return NULL.
+ */
+hashmap_cache *hashmap_cache_alloc (hash_func func, int policy,
+                                    size_t max_entries, size_t max_bytes,
+                                    valueT_charge charge);
+
+/**
+ * Frees a cache and all the entries in it.
+ * @param p_cache pointer to dynamically allocated pointer to hashmap_cache.
+ */
+void hashmap_cache_free (hashmap_cache **p_cache);
+
+/**
+ * Inserts a copy of in_pair to the cache, or replaces the value of its key
+ * with a copy of its value. Entries are evicted (with their value_free)
+ * until the cache is within its limits again, the new entry is never
+ * evicted by its own insert.
+ * @param cache a cache.
+ * @param in_pair a in_pair the cache would contain.
+ * @return returns 1 for successful insertion, 0 otherwise (e.g. the value
+ * alone is charged more than max_bytes).
+ */
+int hashmap_cache_put (hashmap_cache *cache, const pair *in_pair);
+
+/**
+ * Returns the value associated with the given key, and marks the entry as
+ * used.
+ * @param cache a cache.
+ * @param key the key to be checked.
+ * @return the value associated with key if cached, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_cache_get (hashmap_cache *cache, const_keyT key);
+
+/**
+ * The function erases the entry associated with key.
+ * @param cache a cache.
+ * @param key a key of the entry to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_cache_erase (hashmap_cache *cache, const_keyT key);
+
+#endif //HASHMAP_CACHE_H_
@@ -0,0 +1,720 @@
+#include <string.h>
+#include "hashmap_cow.h"
+
+/**
+ * @return the number of buckets in a page of a table of the given capacity.
+ */
+static size_t page_buckets (size_t capacity)
+{
+  return capacity < HASH_MAP_COW_PAGE ? capacity : HASH_MAP_COW_PAGE;
+}
+
+/**
+ * @return the number of pages of a table of the given capacity.
+ */
+static size_t page_count (size_t capacity)
+{
+  return capacity / page_buckets (capacity);
+}
+
+/**
+ * adds a reference to a node, a page or a table.
+ */
+static void ref (size_t *refs)
+{
+  __atomic_add_fetch (refs, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * drops a reference to a node, a page or a table.
+ * @return 1 if it was the last one, 0 otherwise.
+ */
+static int unref (size_t *refs)
+{
+  return __atomic_sub_fetch (refs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+/**
+ * @return 1 if a node, a page or a table has more than one reference, so
+ * it must not be changed.
+ */
+static int is_shared (size_t *refs)
+{
+  return __atomic_load_n (refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+/**
+ * allocates a node with copies of the key and the value of in_pair.
+ * @return the node, NULL if failed.
+ */
+static hashmap_cow_node *node_alloc (const pair *in_pair, size_t hash)
+{
+  hashmap_cow_node *node = malloc (sizeof *node);
+  if (node == NULL)
+    {
+      return NULL;
+    }
+  node->next = NULL;
+  node->hash = hash;
+  node->refs = 1;
+  node->pair = *in_pair;
+  node->pair.key = in_pair->key_cpy (in_pair->key);
+  node->pair.value = in_pair->value_cpy (in_pair->value);
+  node->pair.allocator = NULL;
+  if (node->pair.key == NULL
+      || (node->pair.value == NULL && in_pair->value != NULL))
+    {
+      if (node->pair.key != NULL)
+        {
+          node->pair.key_free (&node->pair.key);
+        }
+      if (node->pair.value != NULL)
+        {
+          node->pair.value_free (&node->pair.value);
+        }
+      free (node);
+      return NULL;
+    }
+  return node;
+}
+
+/**
+ * drops a link to a node, and frees it (and drops its link to the next
+ * node) if it was the last one.
+ */
+static void node_release (hashmap_cow_node *node)
+{
+  while (node != NULL && unref (&node->refs))
+    {
+      hashmap_cow_node *next = node->next;
+      node->pair.key_free (&node->pair.key);
+      node->pair.value_free (&node->pair.value);
+      free (node);
+      node = next;
+    }
+}
+
+/**
+ * drops a reference to a page of the given number of buckets, and frees it
+ * if it was the last one.
+ */
+static void page_release (hashmap_cow_page *page, size_t buckets)
+{
+  if (!unref (&page->refs))
+    {
+      return;
+    }
+  for (size_t i = 0; i < buckets; i++)
+    {
+      node_release (page->heads[i]);
+    }
+  free (page);
+}
+
+/**
+ * drops a reference to a table, and frees it if it was the last one.
+ */
+static void table_release (hashmap_cow_table *table)
+{
+  if (!unref (&table->refs))
+    {
+      return;
+    }
+  size_t buckets = page_buckets (table->capacity);
+  for (size_t p = 0; p < page_count (table->capacity); p++)
+    {
+      page_release (table->pages[p], buckets);
+    }
+  free (table);
+}
+
+/**
+ * allocates an empty table of the given capacity.
+ * @return the table, NULL if failed.
+ */
+static hashmap_cow_table *table_alloc (size_t capacity)
+{
+  size_t count = page_count (capacity);
+  hashmap_cow_table *table =
+      malloc (sizeof *table + count * sizeof (hashmap_cow_page *));
+  if (table == NULL)
+    {
+      return NULL;
+    }
+  for (size_t p = 0; p < count; p++)
+    {
+      table->pages[p] = calloc (1, sizeof (hashmap_cow_page)
+                                   + page_buckets (capacity)
+                                     * sizeof (hashmap_cow_node *));
+      if (table->pages[p] == NULL)
+        {
+          while (p-- > 0)
+            {
+              free (table->pages[p]);
+            }
+          free (table);
+          return NULL;
+        }
+      table->pages[p]->refs = 1;
+    }
+  table->refs = 1;
+  table->size = 0;
+  table->capacity = capacity;
+  return table;
+}
+
+/**
+ * @return the link to the head of the bucket of hash in a table.
+ */
+static hashmap_cow_node **bucket_of (const hashmap_cow_table *table,
+                                     size_t hash)
+{
+  size_t buckets = page_buckets (table->capacity);
+  size_t ind = hashmap_bucket_index (hash, 0, table->capacity);
+  return &table->pages[ind / buckets]->heads[ind % buckets];
+}
+
+/**
+ * @return the node of key in a table, NULL if it is not there.
+ */
+static hashmap_cow_node *find_node (const hashmap_cow_table *table,
+                                    const_keyT key, size_t hash)
+{
+  for (hashmap_cow_node *node = *bucket_of (table, hash); node != NULL;
+       node = node->next)
+    {
+      if (node->hash == hash && node->pair.key_cmp (node->pair.key, key))
+        {
+          return node;
+        }
+    }
+  return NULL;
+}
+
+/**
+ * makes the table of the map, and the page of the bucket of hash, the
+ * map's own: a shared table is replaced by a copy of its directory of
+ * pages, and a shared page by a copy of its heads.
+ * @return the link to the head of the bucket, NULL if failed.
+ */
+static hashmap_cow_node **own_bucket (hashmap_cow *map, size_t hash)
+{
+  hashmap_cow_table *table = map->table;
+  size_t count = page_count (table->capacity);
+  if (is_shared (&table->refs))
+    {
+      hashmap_cow_table *copy =
+          malloc (sizeof *copy + count * sizeof (hashmap_cow_page *));
+      if (copy == NULL)
+        {
+          return NULL;
+        }
+      copy->refs = 1;
+      copy->size = table->size;
+      copy->capacity = table->capacity;
+      for (size_t p = 0; p < count; p++)
+        {
+          copy->pages[p] = table->pages[p];
+          ref (&copy->pages[p]->refs);
+        }
+      table_release (table);
+      map->table = table = copy;
+    }
+  size_t buckets = page_buckets (table->capacity);
+  size_t ind = hashmap_bucket_index (hash, 0, table->capacity);
+  hashmap_cow_page *page = table->pages[ind / buckets];
+  if (is_shared (&page->refs))
+    {
+      hashmap_cow_page *copy =
+          malloc (sizeof *copy + buckets * sizeof (hashmap_cow_node *));
+      if (copy == NULL)
+        {
+          return NULL;
+        }
+      copy->refs = 1;
+      for (size_t i = 0; i < buckets; i++)
+        {
+          copy->heads[i] = page->heads[i];
+          if (copy->heads[i] != NULL)
+            {
+              ref (&copy->heads[i]->refs);
+            }
+        }
+      page_release (page, buckets);
+      table->pages[ind / buckets] = page = copy;
+    }
+  return &page->heads[ind % buckets];
+}
+
+/**
+ * makes the nodes from an own head link to target (which is in its list)
+ * the map's own, by copying the shared ones - and target too if
+ * own_target is 1.
+ * @return the link to target (or to its copy), NULL if failed.
+ */
+static hashmap_cow_node **own_path (hashmap_cow_node **link,
+                                    const hashmap_cow_node *target,
+                                    int own_target)
+{
+  for (;;)
+    {
+      hashmap_cow_node *node = *link;
+      int is_target = node == target;
+      if ((!is_target || own_target) && is_shared (&node->refs))
+        {
+          hashmap_cow_node *copy = node_alloc (&node->pair, node->hash);
+          if (copy == NULL)
+            {
+              return NULL;
+            }
+          // the copy links to the rest of the list, which is shared now.
+          copy->next = node->next;
+          if (copy->next != NULL)
+            {
+              ref (&copy->next->refs);
+            }
+          *link = copy;
+          node_release (node);
+          node = copy;
+        }
+      if (is_target)
+        {
+          return link;
+        }
+      link = &node->next;
+    }
+}
+
+/**
+ * @struct resize_state
+ * The decisions of the first pass of resize_map, for its second pass
+ * (other threads may release snapshots between the passes, so the nodes are
+ * not checked again).
+ * @param origins the shared nodes, in the order of the passes.
+ * @param copies the copies of the shared nodes.
+ * @param count the number of copies.
+ * @param page_shared for every old page, 1 if it was shared.
+ */
+typedef struct resize_state {
+    hashmap_cow_node **origins;
+    hashmap_cow_node **copies;
+    size_t count;
+    char *page_shared;
+} resize_state;
+
+/**
+ * frees the arrays of a resize_state, and the copies if failed.
+ */
+static void free_resize_state (resize_state *state, int failed)
+{
+  for (size_t i = 0; failed && i < state->count; i++)
+    {
+      node_release (state->copies[i]);
+    }
+  free (state->origins);
+  free (state->copies);
+  free (state->page_shared);
+}
+
+/**
+ * the first pass of resize_map: copies the nodes the map shares.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int copy_shared (const hashmap_cow_table *old, int table_shared,
+                        resize_state *state)
+{
+  size_t buckets = page_buckets (old->capacity);
+  for (size_t p = 0; p < page_count (old->capacity); p++)
+    {
+      hashmap_cow_page *page = old->pages[p];
+      state->page_shared[p] = (char) (table_shared
+                                      || is_shared (&page->refs));
+      for (size_t i = 0; i < buckets; i++)
+        {
+          int shared = state->page_shared[p];
+          for (hashmap_cow_node *node = page->heads[i]; node != NULL;
+               node = node->next)
+            {
+              // the nodes after a shared node are shared through it.
+              shared = shared || is_shared (&node->refs);
+              if (!shared)
+                {
+                  continue;
+                }
+              hashmap_cow_node *copy = node_alloc (&node->pair, node->hash);
+              if (copy == NULL)
+                {
+                  return 0;
+                }
+              state->origins[state->count] = node;
+              state->copies[state->count++] = copy;
+            }
+        }
+    }
+  return 1;
+}
+
+/**
+ * re-links the pairs of the map into a new table of new_capacity buckets:
+ * the nodes only the map sees are moved, and the shared nodes are copied.
+ * All the copies are made first, so a failure leaves the map as it was.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+static int resize_map (hashmap_cow *map, size_t new_capacity)
+{
+  hashmap_cow_table *old = map->table;
+  size_t count = page_count (old->capacity);
+  size_t buckets = page_buckets (old->capacity);
+  int table_shared = is_shared (&old->refs);
+  resize_state state = {malloc ((old->size + 1) * sizeof (hashmap_cow_node *)),
+                        malloc ((old->size + 1) * sizeof (hashmap_cow_node *)),
+                        0, malloc (count)};
+  // the links to the first shared node of every chain, dropped at the end.
+  hashmap_cow_node **drops = malloc ((old->capacity + 1)
+                                     * sizeof (hashmap_cow_node *));
+  hashmap_cow_table *table = table_alloc (new_capacity);
+  if (state.origins == NULL || state.copies == NULL
+      || state.page_shared == NULL || drops == NULL || table == NULL
+      || !copy_shared (old, table_shared, &state))
+    {
+      free_resize_state (&state, 1);
+      free (drops);
+      if (table != NULL)
+        {
+          table_release (table);
+        }
+      return 0;
+    }
+  size_t n_drops = 0;
+  size_t n_copies = 0;
+  for (size_t p = 0; p < count; p++)
+    {
+      for (size_t i = 0; i < buckets; i++)
+        {
+          hashmap_cow_node *node = old->pages[p]->heads[i];
+          int shared = 0;
+          while (node != NULL)
+            {
+              hashmap_cow_node *next = node->next;
+              hashmap_cow_node *moved = node;
+              if (n_copies < state.count && state.origins[n_copies] == node)
+                {
+                  if (!shared && !state.page_shared[p])
+                    {
+                      drops[n_drops++] = node;
+                    }
+                  shared = 1;
+                  moved = state.copies[n_copies++];
+                }
+              hashmap_cow_node **head = bucket_of (table, moved->hash);
+              moved->next = *head;
+              *head = moved;
+              node = next;
+            }
+        }
+    }
+  table->size = old->size;
+  map->table = table;
+  for (size_t d = 0; d < n_drops; d++)
+    {
+      node_release (drops[d]);
+    }
+  if (table_shared)
+    {
+      table_release (old);
+    }
+  else
+    {
+      // the nodes of the own pages were moved or dropped.
+      for (size_t p = 0; p < count; p++)
+        {
+          if (state.page_shared[p])
+            {
+              page_release (old->pages[p], buckets);
+            }
+          else
+            {
+              free (old->pages[p]);
+            }
+        }
+      free (old);
+    }
+  free_resize_state (&state, 0);
+  free (drops);
+  return 1;
+}
+
+/**
+ * Allocates dynamically new copy-on-write hash map element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated hashmap_cow.
+ * @if_fail return NULL.
+ */
+hashmap_cow *hashmap_cow_alloc (hash_func func)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  hashmap_cow *map = malloc (sizeof *map);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->table = table_alloc (HASH_MAP_INITIAL_CAP);
+  if (map->table == NULL)
+    {
+      free (map);
+      return NULL;
+    }
+  map->hash_func = func;
+  return map;
+}
+
+/**
+ * Frees a copy-on-write hash map, and the pairs no snapshot sees.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_cow.
+ */
+void hashmap_cow_free (hashmap_cow **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  table_release ((*p_map)->table);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair to the map.
+ * @param map a copy-on-write hash map.
+ * @param in_pair a in_pair the hash map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise (e.g. the key is
+ * in the map).
+ */
+int hashmap_cow_insert (hashmap_cow *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = map->hash_func (in_pair->key);
+  if (find_node (map->table, in_pair->key, hash) != NULL)
+    {
+      return 0;
+    }
+  hashmap_cow_node **head = own_bucket (map, hash);
+  if (head == NULL)
+    {
+      return 0;
+    }
+  hashmap_cow_node *node = node_alloc (in_pair, hash);
+  if (node == NULL)
+    {
+      return 0;
+    }
+  // the link to the old head moves to the new node.
+  node->next = *head;
+  *head = node;
+  hashmap_cow_table *table = map->table;
+  table->size++;
+  if (table->size / (double) table->capacity > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      resize_map (map, table->capacity * HASH_MAP_GROWTH_FACTOR);
+    }
+  return 1;
+}
+
+/**
+ * Inserts a copy of in_pair to the map, or if its key is in the map,
+ * replaces the stored value by a copy of its value.
+ * @param map a copy-on-write hash map.
+ * @param in_pair a in_pair the hash map would contain.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+int hashmap_cow_replace (hashmap_cow *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = map->hash_func (in_pair->key);
+  hashmap_cow_node *target = find_node (map->table, in_pair->key, hash);
+  if (target == NULL)
+    {
+      return hashmap_cow_insert (map, in_pair);
+    }
+  hashmap_cow_node **head = own_bucket (map, hash);
+  hashmap_cow_node **link = head == NULL ? NULL : own_path (head, target, 1);
+  if (link == NULL)
+    {
+      return 0;
+    }
+  hashmap_cow_node *node = *link;
+  // the stored value is kept if the copy failed.
+  valueT value = node->pair.value_cpy (in_pair->value);
+  if (value == NULL && in_pair->value != NULL)
+    {
+      return 0;
+    }
+  node->pair.value_free (&node->pair.value);
+  node->pair.value = value;
+  return 1;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a copy-on-write hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, it may be shared with snapshots, so it must not be changed;
+ * see hashmap_cow_replace).
+ */
+valueT hashmap_cow_at (const hashmap_cow *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  hashmap_cow_node *node = find_node (map->table, key, map->hash_func (key));
+  return node == NULL ? NULL : node->pair.value;
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a copy-on-write hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_cow_erase (hashmap_cow *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = map->hash_func (key);
+  hashmap_cow_node *target = find_node (map->table, key, hash);
+  if (target == NULL)
+    {
+      return 0;
+    }
+  hashmap_cow_node **head = own_bucket (map, hash);
+  hashmap_cow_node **link = head == NULL ? NULL : own_path (head, target, 0);
+  if (link == NULL)
+    {
+      return 0;
+    }
+  // the link to target moves to the node after it.
+  *link = target->next;
+  if (target->next != NULL)
+    {
+      ref (&target->next->refs);
+    }
+  node_release (target);
+  hashmap_cow_table *table = map->table;
+  table->size--;
+  if (table->size / (double) table->capacity < HASH_MAP_MIN_LOAD_FACTOR
+      && table->capacity > HASH_MAP_INITIAL_CAP)
+    {
+      resize_map (map, table->capacity / HASH_MAP_GROWTH_FACTOR);
+    }
+  return 1;
+}
+
+/**
+ * Takes a read-only snapshot of the map, in O(1).
+ * @param map a copy-on-write hash map.
+ * @return pointer to dynamically allocated hashmap_snapshot, valid until it
+ * is released (also after the map is freed).
+ * @if_fail return NULL.
+ */
+hashmap_snapshot *hashmap_cow_snapshot (hashmap_cow *map)
+{
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  hashmap_snapshot *snapshot = malloc (sizeof *snapshot);
+  if (snapshot == NULL)
+    {
+      return NULL;
+    }
+  snapshot->table = map->table;
+  snapshot->hash_func = map->hash_func;
+  ref (&snapshot->table->refs);
+  return snapshot;
+}
+
+/**
+ * Releases a snapshot, and frees the pairs only it saw.
+ * @param p_snapshot pointer to dynamically allocated pointer to
+ * hashmap_snapshot.
+ */
+void hashmap_snapshot_release (hashmap_snapshot **p_snapshot)
+{
+  if (p_snapshot == NULL || *p_snapshot == NULL)
+    {
+      return;
+    }
+  table_release ((*p_snapshot)->table);
+  free (*p_snapshot);
+  *p_snapshot = NULL;
+}
+
+/**
+ * The function returns the value the given key had when the snapshot was
+ * taken.
+ * @param snapshot a snapshot.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_snapshot_at (const hashmap_snapshot *snapshot, const_keyT key)
+{
+  if (snapshot == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  hashmap_cow_node *node = find_node (snapshot->table, key,
+                                      snapshot->hash_func (key));
+  return node == NULL ? NULL : node->pair.value;
+}
+
+/**
+ * Calls visit on every pair of the snapshot, until it returns
+ * HASH_MAP_STOP.
+ * @param snapshot a snapshot.
+ * @param visit a function which receives a key, its value (which it must
+ * not change) and ctx.
+ * @param ctx a context for visit.
+ * @return the number of pairs visit was called on.
+ */
+size_t hashmap_snapshot_for_each (const hashmap_snapshot *snapshot,
+                                  pair_visit visit, void *ctx)
+{
+  size_t visited = 0;
+  if (snapshot == NULL || visit == NULL)
+    {
+      return 0;
+    }
+  const hashmap_cow_table *table = snapshot->table;
+  size_t buckets = page_buckets (table->capacity);
+  for (size_t p = 0; p < page_count (table->capacity); p++)
+    {
+      for (size_t i = 0; i < buckets; i++)
+        {
+          for (hashmap_cow_node *node = table->pages[p]->heads[i];
+               node != NULL; node = node->next)
+            {
+              visited++;
+              if (visit (node->pair.key, node->pair.value, ctx)
+                  == HASH_MAP_STOP)
+                {
+                  return visited;
+                }
+            }
+        }
+    }
+  return visited;
+}
@@ -0,0 +1,176 @@
+#ifndef HASHMAP_COW_H_
+#define HASHMAP_COW_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_COW_PAGE
+ * The number of buckets in a page, the unit a write copies from a table
+ * that is shared with a snapshot.
+ */
+#define HASH_MAP_COW_PAGE 256UL
+
+/**
+ * @struct hashmap_cow_node
+ * A pair stored in the map, linked into the list of its bucket. A node is
+ * never changed while it is shared: a write copies it (and the nodes before
+ * it in the list) instead, so the lists of two tables may share their
+ * tails.
+ * @param next the next node in the bucket, NULL for the last one.
+ * @param hash the value hash_func returned for the key.
+ * @param refs the number of links to the node, from pages and nodes.
+ * @param pair the stored pair (a copy), owned by the node.
+ */
+typedef struct hashmap_cow_node {
+    struct hashmap_cow_node *next;
+    size_t hash;
+    size_t refs;
+    pair pair;
+} hashmap_cow_node;
+
+/**
+ * @struct hashmap_cow_page
+ * HASH_MAP_COW_PAGE following buckets (or all of them, in a smaller table).
+ * @param refs the number of tables with the page.
+ * @param heads the first nodes of the buckets, NULL for empty buckets.
+ */
+typedef struct hashmap_cow_page {
+    size_t refs;
+    hashmap_cow_node *heads[];
+} hashmap_cow_page;
+
+/**
+ * @struct hashmap_cow_table
+ * The buckets of a map at some moment, shared by the map and its snapshots
+ * of that moment until the map writes to it.
+ * @param refs the number of holders of the table (the map and snapshots).
+ * @param size the number of pairs in the table.
+ * @param capacity the number of buckets, a power of 2.
+ * @param pages the pages of the buckets.
+ */
+typedef struct hashmap_cow_table {
+    size_t refs;
+    size_t size;
+    size_t capacity;
+    hashmap_cow_page *pages[];
+} hashmap_cow_table;
+
+/**
+ * @struct hashmap_cow
+ * A hash map with O(1) read-only snapshots: a snapshot takes a reference to
+ * the table of the map, and the next writes copy the parts of it they
+ * change (the directory of pages once, a page on its first write, and the
+ * nodes before a changed node in its bucket), so the snapshot keeps seeing
+ * the pairs as they were. Writes to a map without snapshots change it in
+ * place.
+ * The map is written by one thread at a time (which takes the snapshots),
+ * and the snapshots may be read and released in other threads.
+ * @param table the current table.
+ * @param hash_func a function which "hashes" keys.
+ */
+typedef struct hashmap_cow {
+    hashmap_cow_table *table;
+    hash_func hash_func;
+} hashmap_cow;
+
+/**
+ * @struct hashmap_snapshot
+ * A read-only view of a hashmap_cow at the moment it was taken.
+ * @param table the table of the map at that moment.
+ * @param hash_func a function which "hashes" keys.
+ */
+typedef struct hashmap_snapshot {
+    hashmap_cow_table *table;
+    hash_func hash_func;
+} hashmap_snapshot;
+
+/**
+ * Allocates dynamically new copy-on-write hash map element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated hashmap_cow.
+ * @if_fail return NULL.
+ */
+hashmap_cow *hashmap_cow_alloc (hash_func func);
+
+/**
+ * Frees a copy-on-write hash map, and the pairs no snapshot sees.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_cow.
+ */
+void hashmap_cow_free (hashmap_cow **p_map);
+
+/**
+ * Inserts a copy of in_pair to the map.
+ * @param map a copy-on-write hash map.
+ * @param in_pair a in_pair the hash map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise (e.g. the key is
+ * in the map).
+ */
+int hashmap_cow_insert (hashmap_cow *map, const pair *in_pair);
+
+/**
+ * Inserts a copy of in_pair to the map, or if its key is in the map,
+ * replaces the stored value by a copy of its value.
+ * @param map a copy-on-write hash map.
+ * @param in_pair a in_pair the hash map would contain.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+int hashmap_cow_replace (hashmap_cow *map, const pair *in_pair);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a copy-on-write hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, it may be shared with snapshots, so it must not be changed;
+ * see hashmap_cow_replace).
+ */
+valueT hashmap_cow_at (const hashmap_cow *map, const_keyT key);
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a copy-on-write hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_cow_erase (hashmap_cow *map, const_keyT key);
+
+/**
+ * Takes a read-only snapshot of the map, in O(1).
+ * @param map a copy-on-write hash map.
+ * @return pointer to dynamically allocated hashmap_snapshot, valid until it
+ * is released (also after the map is freed).
+ * @if_fail return NULL.
+ */
+hashmap_snapshot *hashmap_cow_snapshot (hashmap_cow *map);
+
+/**
+ * Releases a snapshot, and frees the pairs only it saw.
+ * @param p_snapshot pointer to dynamically allocated pointer to
+ * hashmap_snapshot.
+ */
+void hashmap_snapshot_release (hashmap_snapshot **p_snapshot);
+
+/**
+ * The function returns the value the given key had when the snapshot was
+ * taken.
+ * @param snapshot a snapshot.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_snapshot_at (const hashmap_snapshot *snapshot, const_keyT key);
+
+/**
+ * Calls visit on every pair of the snapshot, until it returns
+ * HASH_MAP_STOP.
+ * @param snapshot a snapshot.
+ * @param visit a function which receives a key, its value (which it must
+ * not change) and ctx.
+ * @param ctx a context for visit.
+ * @return the number of pairs visit was called on.
+ */
+size_t hashmap_snapshot_for_each (const hashmap_snapshot *snapshot,
+                                  pair_visit visit, void *ctx);
+
+#endif //HASHMAP_COW_H_
@@ -0,0 +1,619 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashmap_file.h"
+
+/**
+ * @def HEADER_SIZE
+ * magic + size + capacity + seed.
+ */
+#define HEADER_SIZE (4 * sizeof (uint64_t))
+
+/**
+ * @def RECORD_HEADER_SIZE
+ * hash + key length + value length.
+ */
+#define RECORD_HEADER_SIZE (sizeof (uint64_t) + 2 * sizeof (uint32_t))
+
+/**
+ * rounds n up to HASH_MAP_FILE_ALIGN.
+ */
+static size_t align_up (size_t n)
+{
+  return (n + HASH_MAP_FILE_ALIGN - 1) & ~(HASH_MAP_FILE_ALIGN - 1);
+}
+
+/**
+ * @return the number of bytes the record of cur_pair takes in the file,
+ * 0 if the key or the value is too long.
+ */
+static size_t record_size (const pair *cur_pair, elem_size_func key_size,
+                           elem_size_func value_size)
+{
+  size_t k_size = key_size (cur_pair->key);
+  size_t v_size = value_size (cur_pair->value);
+  if (k_size > UINT32_MAX || v_size > UINT32_MAX)
+    {
+      return 0;
+    }
+  return RECORD_HEADER_SIZE + align_up (k_size) + align_up (v_size);
+}
+
+/**
+ * writes the bucket offsets of the map to the file.
+ * @return 1 for success, 0 otherwise.
+ */
+static int write_offsets (const hashmap *hash_map, FILE *file,
+                          elem_size_func key_size, elem_size_func value_size)
+{
+  uint64_t offset = 0;
+  for (size_t i = 0; i < hash_map->capacity; i++)
+    {
+      if (fwrite (&offset, sizeof offset, 1, file) != 1)
+        {
+          return 0;
+        }
+      for (const hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          size_t size = record_size (&node->pair, key_size, value_size);
+          if (size == 0)
+            {
+              return 0;
+            }
+          offset += size;
+        }
+    }
+  return fwrite (&offset, sizeof offset, 1, file) == 1;
+}
+
+/**
+ * writes elem_size bytes of elem and pads them to HASH_MAP_FILE_ALIGN.
+ * @return 1 for success, 0 otherwise.
+ */
+static int write_padded (const void *elem, size_t elem_size, FILE *file)
+{
+  static const unsigned char padding[HASH_MAP_FILE_ALIGN] = {0};
+  size_t pad = align_up (elem_size) - elem_size;
+  if (elem_size != 0 && fwrite (elem, elem_size, 1, file) != 1)
+    {
+      return 0;
+    }
+  return pad == 0 || fwrite (padding, pad, 1, file) == 1;
+}
+
+/**
+ * writes the records of the map to the file, bucket after bucket.
+ * @return 1 for success, 0 otherwise.
+ */
+static int write_records (const hashmap *hash_map, FILE *file,
+                          elem_size_func key_size, elem_size_func value_size)
+{
+  for (size_t i = 0; i < hash_map->capacity; i++)
+    {
+      for (const hashmap_node *node = hash_map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          const pair *cur_pair = &node->pair;
+          uint64_t hash = node->hash;
+          uint32_t lengths[2] = {(uint32_t) key_size (cur_pair->key),
+                                 (uint32_t) value_size (cur_pair->value)};
+          if (fwrite (&hash, sizeof hash, 1, file) != 1
+              || fwrite (lengths, sizeof lengths, 1, file) != 1
+              || !write_padded (cur_pair->key, lengths[0], file)
+              || !write_padded (cur_pair->value, lengths[1], file))
+            {
+              return 0;
+            }
+        }
+    }
+  return 1;
+}
+
+/**
+ * Writes a snapshot of the hash map to a file, in the format described in
+ * hashmap_view.
+ * @param hash_map a hash map.
+ * @param path the path of the file to be created (or truncated).
+ * @param key_size a function which returns the number of bytes of a key.
+ * @param value_size a function which returns the number of bytes of a value.
+ * @return 1 if the snapshot was written successfully, 0 otherwise.
+ */
+int hashmap_save (const hashmap *hash_map, const char *path,
+                  elem_size_func key_size, elem_size_func value_size)
+{
+  if (hash_map == NULL || path == NULL || key_size == NULL
+      || value_size == NULL)
+    {
+      return 0;
+    }
+  FILE *file = fopen (path, "wb");
+  if (file == NULL)
+    {
+      return 0;
+    }
+  uint64_t header[3] = {hash_map->size, hash_map->capacity, hash_map->seed};
+  int res = fwrite (HASH_MAP_FILE_MAGIC, sizeof (uint64_t), 1, file) == 1
+            && fwrite (header, sizeof header, 1, file) == 1
+            && write_offsets (hash_map, file, key_size, value_size)
+            && write_records (hash_map, file, key_size, value_size);
+  if (fclose (file) != 0)
+    {
+      res = 0;
+    }
+  return res;
+}
+
+/**
+ * checks the header and the offsets of a mapped snapshot and fills the view.
+ * @return 1 if the snapshot is valid, 0 otherwise.
+ */
+static int parse_view (hashmap_view *view)
+{
+  if (view->length < HEADER_SIZE
+      || memcmp (view->data, HASH_MAP_FILE_MAGIC, sizeof (uint64_t)) != 0)
+    {
+      return 0;
+    }
+  const uint64_t *header = (const uint64_t *) view->data;
+  view->size = header[1];
+  view->capacity = header[2];
+  view->seed = header[3];
+  // the capacity must be a power of 2, like in the hash map.
+  if (view->capacity == 0 || (view->capacity & (view->capacity - 1)) != 0
+      || view->capacity > (view->length - HEADER_SIZE) / sizeof (uint64_t)
+                          - 1)
+    {
+      return 0;
+    }
+  view->offsets = header + 4;
+  view->records = (const unsigned char *) (view->offsets + view->capacity
+                                           + 1);
+  size_t records_length = view->length - (view->records - view->data);
+  for (size_t i = 0; i < view->capacity; i++)
+    {
+      if (view->offsets[i] > view->offsets[i + 1])
+        {
+          return 0;
+        }
+    }
+  return view->offsets[view->capacity] <= records_length;
+}
+
+/**
+ * Maps a snapshot file written by hashmap_save, read-only.
+ * Nothing is copied or deserialized, lookups read the mapped file directly.
+ * @param path the path of the snapshot file.
+ * @param func the function which "hashes" keys, must be the one the saved
+ * map used.
+ * @param key_cmp compare function for the keys.
+ * @return pointer to dynamically allocated hashmap_view.
+ * @if_fail return NULL.
+ */
+hashmap_view *hashmap_view_open (const char *path, hash_func func,
+                                 pair_key_cmp key_cmp)
+{
+  if (path == NULL || func == NULL || key_cmp == NULL)
+    {
+      return NULL;
+    }
+  int fd = open (path, O_RDONLY);
+  if (fd < 0)
+    {
+      return NULL;
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < HEADER_SIZE)
+    {
+      close (fd);
+      return NULL;
+    }
+  void *data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the file is closed.
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      return NULL;
+    }
+  hashmap_view *view = malloc (sizeof *view);
+  if (view == NULL)
+    {
+      munmap (data, st.st_size);
+      return NULL;
+    }
+  view->data = data;
+  view->length = st.st_size;
+  view->hash_func = func;
+  view->key_cmp = key_cmp;
+  if (!parse_view (view))
+    {
+      hashmap_view_close (&view);
+      return NULL;
+    }
+  return view;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param view a hash map view.
+ * @param key the key to be checked.
+ * @return pointer to the value inside the mapped file if exists,
+ * NULL otherwise. Valid until the view is closed.
+ */
+const_valueT hashmap_view_at (const hashmap_view *view, const_keyT key)
+{
+  if (view == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  uint64_t hash = view->hash_func (key);
+  size_t ind = hashmap_bucket_index (hash, view->seed, view->capacity);
+  const unsigned char *cur = view->records + view->offsets[ind];
+  const unsigned char *end = view->records + view->offsets[ind + 1];
+  while (cur + RECORD_HEADER_SIZE <= end)
+    {
+      const uint32_t *lengths = (const uint32_t *) (cur + sizeof (uint64_t));
+      const unsigned char *rec_key = cur + RECORD_HEADER_SIZE;
+      const unsigned char *rec_value = rec_key + align_up (lengths[0]);
+      const unsigned char *next = rec_value + align_up (lengths[1]);
+      if (next > end)
+        {
+          return NULL;
+        }
+      // compare the stored hash first, it is cheaper than key_cmp.
+      if (*(const uint64_t *) cur == hash && view->key_cmp (rec_key, key))
+        {
+          return rec_value;
+        }
+      cur = next;
+    }
+  return NULL;
+}
+
+/**
+ * Unmaps the snapshot file and frees the view.
+ * @param p_view pointer to dynamically allocated pointer to hashmap_view.
+ */
+void hashmap_view_close (hashmap_view **p_view)
+{
+  if (p_view == NULL || *p_view == NULL)
+    {
+      return;
+    }
+  munmap ((void *) (*p_view)->data, (*p_view)->length);
+  free (*p_view);
+  *p_view = NULL;
+}
+
+/**
+ * @def CHUNK_HEADER_SIZE
+ * payload length + number of records.
+ */
+#define CHUNK_HEADER_SIZE (2 * sizeof (uint32_t))
+
+/**
+ * @def DUMP_RECORD_HEADER_SIZE
+ * key length + value length.
+ */
+#define DUMP_RECORD_HEADER_SIZE (2 * sizeof (uint32_t))
+
+/**
+ * @struct dump_buffer
+ * The chunk hashmap_dump is currently filling.
+ * @param data the buffered records (8 bytes of chunk header first).
+ * @param length the number of used bytes (including the chunk header).
+ * @param capacity the number of allocated bytes.
+ * @param count the number of buffered records.
+ */
+typedef struct dump_buffer {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    uint32_t count;
+} dump_buffer;
+
+/**
+ * FNV-1a checksum of the given bytes.
+ */
+static uint32_t checksum (const unsigned char *data, size_t length)
+{
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < length; i++)
+    {
+      hash ^= data[i];
+      hash *= 16777619U;
+    }
+  return hash;
+}
+
+/**
+ * writes exactly length bytes to fd.
+ * @return 1 for success, 0 otherwise.
+ */
+static int write_all (int fd, const void *data, size_t length)
+{
+  const unsigned char *cur = data;
+  while (length > 0)
+    {
+      ssize_t n = write (fd, cur, length);
+      if (n <= 0)
+        {
+          return 0;
+        }
+      cur += n;
+      length -= n;
+    }
+  return 1;
+}
+
+/**
+ * reads exactly length bytes from fd.
+ * @return 1 for success, 0 otherwise (including end of file).
+ */
+static int read_all (int fd, void *data, size_t length)
+{
+  unsigned char *cur = data;
+  while (length > 0)
+    {
+      ssize_t n = read (fd, cur, length);
+      if (n <= 0)
+        {
+          return 0;
+        }
+      cur += n;
+      length -= n;
+    }
+  return 1;
+}
+
+/**
+ * writes the buffered records as one chunk, and empties the buffer.
+ * @return 1 for success, 0 otherwise.
+ */
+static int flush_chunk (dump_buffer *buf, int fd)
+{
+  uint32_t payload_length = buf->length - CHUNK_HEADER_SIZE;
+  uint32_t sum = checksum (buf->data + CHUNK_HEADER_SIZE, payload_length);
+  memcpy (buf->data, &payload_length, sizeof payload_length);
+  memcpy (buf->data + sizeof payload_length, &buf->count, sizeof buf->count);
+  if (!write_all (fd, buf->data, buf->length)
+      || !write_all (fd, &sum, sizeof sum))
+    {
+      return 0;
+    }
+  buf->length = CHUNK_HEADER_SIZE;
+  buf->count = 0;
+  return 1;
+}
+
+/**
+ * appends the record of cur_pair to the buffer, flushing it first if the
+ * record does not fit.
+ * @return 1 for success, 0 otherwise.
+ */
+static int buffer_record (dump_buffer *buf, int fd, const pair *cur_pair,
+                          elem_size_func key_size, elem_size_func value_size)
+{
+  size_t k_size = key_size (cur_pair->key);
+  size_t v_size = value_size (cur_pair->value);
+  size_t size = DUMP_RECORD_HEADER_SIZE + align_up (k_size)
+                + align_up (v_size);
+  // keep the length of the chunk in uint32.
+  if (k_size > UINT32_MAX / 4 || v_size > UINT32_MAX / 4)
+    {
+      return 0;
+    }
+  if (buf->length + size > buf->capacity && buf->count > 0
+      && !flush_chunk (buf, fd))
+    {
+      return 0;
+    }
+  if (buf->length + size > buf->capacity)
+    {
+      // a single record bigger than a whole chunk.
+      unsigned char *tmp = realloc (buf->data, buf->length + size);
+      if (tmp == NULL)
+        {
+          return 0;
+        }
+      buf->data = tmp;
+      buf->capacity = buf->length + size;
+    }
+  unsigned char *cur = buf->data + buf->length;
+  uint32_t lengths[2] = {(uint32_t) k_size, (uint32_t) v_size};
+  memset (cur, 0, size);
+  memcpy (cur, lengths, sizeof lengths);
+  memcpy (cur + DUMP_RECORD_HEADER_SIZE, cur_pair->key, k_size);
+  memcpy (cur + DUMP_RECORD_HEADER_SIZE + align_up (k_size), cur_pair->value,
+          v_size);
+  buf->length += size;
+  buf->count++;
+  return 1;
+}
+
+/**
+ * Writes all the pairs of the hash map to a file descriptor, as a stream.
+ * @param hash_map a hash map.
+ * @param fd a file descriptor opened for writing.
+ * @param key_size a function which returns the number of bytes of a key.
+ * @param value_size a function which returns the number of bytes of a value.
+ * @return 1 if the map was written successfully, 0 otherwise.
+ */
+int hashmap_dump (const hashmap *hash_map, int fd,
+                  elem_size_func key_size, elem_size_func value_size)
+{
+  if (hash_map == NULL || fd < 0 || key_size == NULL || value_size == NULL)
+    {
+      return 0;
+    }
+  uint64_t count = hash_map->size;
+  if (!write_all (fd, HASH_MAP_DUMP_MAGIC, sizeof (uint64_t))
+      || !write_all (fd, &count, sizeof count))
+    {
+      return 0;
+    }
+  dump_buffer buf = {malloc (HASH_MAP_DUMP_CHUNK_SIZE), CHUNK_HEADER_SIZE,
+                     HASH_MAP_DUMP_CHUNK_SIZE, 0};
+  if (buf.data == NULL)
+    {
+      return 0;
+    }
+  int res = 1;
+  for (size_t i = 0; res && i < hash_map->capacity; i++)
+    {
+      for (const hashmap_node *node = hash_map->buckets[i];
+           res && node != NULL; node = node->next)
+        {
+          res = buffer_record (&buf, fd, &node->pair, key_size, value_size);
+        }
+    }
+  // flush the last records, and then the empty end chunk.
+  if (res && buf.count > 0)
+    {
+      res = flush_chunk (&buf, fd);
+    }
+  res = res && flush_chunk (&buf, fd);
+  free (buf.data);
+  return res;
+}
+
+/**
+ * inserts the records of one chunk payload to the map.
+ * @return 1 for success, 0 if the payload is malformed or an insert failed.
+ */
+static int load_chunk (hashmap *hash_map, const unsigned char *payload,
+                       size_t length, uint32_t count, const pair *proto)
+{
+  const unsigned char *cur = payload;
+  const unsigned char *end = payload + length;
+  for (uint32_t i = 0; i < count; i++)
+    {
+      uint32_t lengths[2];
+      if ((size_t) (end - cur) < DUMP_RECORD_HEADER_SIZE)
+        {
+          return 0;
+        }
+      memcpy (lengths, cur, sizeof lengths);
+      const unsigned char *key = cur + DUMP_RECORD_HEADER_SIZE;
+      if ((size_t) (end - key) < align_up (lengths[0]))
+        {
+          return 0;
+        }
+      const unsigned char *value = key + align_up (lengths[0]);
+      if ((size_t) (end - value) < align_up (lengths[1]))
+        {
+          return 0;
+        }
+      cur = value + align_up (lengths[1]);
+      // a pair which points into the buffer, hashmap_insert copies it.
+      pair in_pair = *proto;
+      in_pair.key = (keyT) key;
+      in_pair.value = (valueT) value;
+      // a duplicate key is skipped, a failed insert aborts (a stored value
+      // may be NULL, so the pair is looked up, not the value).
+      if (!hashmap_insert (hash_map, &in_pair)
+          && hashmap_find (hash_map, key).pair == NULL)
+        {
+          return 0;
+        }
+    }
+  return cur == end;
+}
+
+/**
+ * @return the number of pairs to reserve room for in hashmap_load: count if
+ * the rest of the stream can hold it, 0 if it surely cannot (fd is a
+ * regular file with fewer bytes left), and at most
+ * HASH_MAP_LOAD_MAX_RESERVE if the size of the stream is unknown.
+ */
+static uint64_t load_reserve (int fd, uint64_t count)
+{
+  struct stat st;
+  off_t pos = lseek (fd, 0, SEEK_CUR);
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || pos < 0)
+    {
+      return count < HASH_MAP_LOAD_MAX_RESERVE ? count
+                                               : HASH_MAP_LOAD_MAX_RESERVE;
+    }
+  // every record takes at least its header.
+  uint64_t left = pos < st.st_size ? (uint64_t) (st.st_size - pos) : 0;
+  return count <= left / DUMP_RECORD_HEADER_SIZE ? count : 0;
+}
+
+/**
+ * Reads pairs written by hashmap_dump and inserts them to the hash map.
+ * @param hash_map a hash map.
+ * @param fd a file descriptor opened for reading.
+ * @param proto a pair whose copy, compare and free functions the loaded
+ * pairs use, its key and value are ignored.
+ * @return 1 if the whole stream was loaded successfully, 0 otherwise
+ * (on fail, the pairs read before the error stay in the map).
+ */
+int hashmap_load (hashmap *hash_map, int fd, const pair *proto)
+{
+  if (hash_map == NULL || fd < 0 || proto == NULL)
+    {
+      return 0;
+    }
+  char magic[sizeof (uint64_t)];
+  uint64_t count;
+  if (!read_all (fd, magic, sizeof magic)
+      || memcmp (magic, HASH_MAP_DUMP_MAGIC, sizeof magic) != 0
+      || !read_all (fd, &count, sizeof count))
+    {
+      return 0;
+    }
+  // pre-size the table once, instead of growing it while inserting.
+  uint64_t reserve = load_reserve (fd, count);
+  if ((reserve == 0 && count > 0) || reserve > SIZE_MAX
+      || !hashmap_reserve (hash_map, (size_t) reserve))
+    {
+      return 0;
+    }
+  unsigned char *payload = NULL;
+  size_t capacity = 0;
+  uint64_t loaded = 0;
+  int res = 0;
+  for (;;)
+    {
+      uint32_t header[2];
+      uint32_t sum;
+      if (!read_all (fd, header, sizeof header))
+        {
+          break;
+        }
+      if (header[1] == 0)
+        {
+          // the end chunk.
+          res = header[0] == 0 && read_all (fd, &sum, sizeof sum)
+                && sum == checksum (NULL, 0) && loaded == count;
+          break;
+        }
+      if (header[0] > capacity)
+        {
+          // the records are padded and malloc memory is aligned, so the
+          // keys and values passed to the copy functions are aligned too.
+          unsigned char *tmp = realloc (payload, align_up (header[0]));
+          if (tmp == NULL)
+            {
+              break;
+            }
+          payload = tmp;
+          capacity = align_up (header[0]);
+        }
+      if (!read_all (fd, payload, header[0]) || !read_all (fd, &sum, sizeof sum)
+          || sum != checksum (payload, header[0])
+          || !load_chunk (hash_map, payload, header[0], header[1], proto))
+        {
+          break;
+        }
+      loaded += header[1];
+    }
+  free (payload);
+  return res;
+}
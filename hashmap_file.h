@@ -0,0 +1,158 @@
+#ifndef HASHMAP_FILE_H_
+#define HASHMAP_FILE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_FILE_MAGIC
+ * The first 8 bytes of every hash map snapshot file.
+ */
+#define HASH_MAP_FILE_MAGIC "HMAPSNP1"
+
+/**
+ * @def HASH_MAP_FILE_ALIGN
+ * Keys and values in a snapshot file start on this alignment, so they can
+ * be used directly from the mapped memory.
+ */
+#define HASH_MAP_FILE_ALIGN 8UL
+
+/**
+ * @def HASH_MAP_DUMP_MAGIC
+ * The first 8 bytes of every hash map dump stream.
+ */
+#define HASH_MAP_DUMP_MAGIC "HMAPDMP1"
+
+/**
+ * @def HASH_MAP_DUMP_CHUNK_SIZE
+ * The number of bytes of records hashmap_dump buffers before writing a
+ * chunk (a chunk grows beyond it only for a single bigger record).
+ */
+#define HASH_MAP_DUMP_CHUNK_SIZE 65536UL
+
+/**
+ * @def HASH_MAP_LOAD_MAX_RESERVE
+ * The most pairs hashmap_load makes room for ahead when the size of the
+ * stream is unknown (e.g. a pipe), since the count in the header is not
+ * covered by the checksums. Bigger streams grow the map while loading.
+ */
+#define HASH_MAP_LOAD_MAX_RESERVE 1048576UL
+
+/**
+ * @typedef elem_size_func
+ * A function that receives a key (or a value) and returns the number of
+ * bytes representing it. For fixed-size types it returns a constant
+ * (e.g. sizeof (int)), for variable length types the length of the element
+ * (e.g. strlen (str) + 1).
+ */
+typedef size_t (*elem_size_func) (const void *);
+
+/**
+ * @struct hashmap_view
+ * A read-only hash map served directly from a mapped snapshot file.
+ * Snapshot layout (all numbers are in the byte order of the writing host):
+ * header   - magic, size, capacity, seed (uint64 each).
+ * offsets  - capacity + 1 uint64 offsets of the buckets, relative to the
+ *            first record, bucket i is [offsets[i], offsets[i + 1]).
+ * records  - uint64 hash, uint32 key length, uint32 value length,
+ *            key bytes, value bytes (each padded to HASH_MAP_FILE_ALIGN).
+ * @param data the mapped file.
+ * @param length the length of the mapped file.
+ * @param size the number of elements (pairs) stored in the snapshot.
+ * @param capacity the number of buckets in the snapshot.
+ * @param seed the seed of the saved map.
+ * @param offsets the bucket offsets inside the mapped file.
+ * @param records the first record inside the mapped file.
+ * @param hash_func the function which "hashes" keys (the same one the
+ * saved map used).
+ * @param key_cmp compare function for the keys.
+ */
+typedef struct hashmap_view {
+    const unsigned char *data;
+    size_t length;
+    size_t size;
+    size_t capacity;
+    size_t seed;
+    const uint64_t *offsets;
+    const unsigned char *records;
+    hash_func hash_func;
+    pair_key_cmp key_cmp;
+} hashmap_view;
+
+/**
+ * Writes a snapshot of the hash map to a file, in the format described in
+ * hashmap_view.
+ * @param hash_map a hash map.
+ * @param path the path of the file to be created (or truncated).
+ * @param key_size a function which returns the number of bytes of a key.
+ * @param value_size a function which returns the number of bytes of a value.
+ * @return 1 if the snapshot was written successfully, 0 otherwise.
+ */
+int hashmap_save (const hashmap *hash_map, const char *path,
+                  elem_size_func key_size, elem_size_func value_size);
+
+/**
+ * Maps a snapshot file written by hashmap_save, read-only.
+ * Nothing is copied or deserialized, lookups read the mapped file directly.
+ * @param path the path of the snapshot file.
+ * @param func the function which "hashes" keys, must be the one the saved
+ * map used.
+ * @param key_cmp compare function for the keys.
+ * @return pointer to dynamically allocated hashmap_view.
+ * @if_fail return NULL.
+ */
+hashmap_view *hashmap_view_open (const char *path, hash_func func,
+                                 pair_key_cmp key_cmp);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param view a hash map view.
+ * @param key the key to be checked.
+ * @return pointer to the value inside the mapped file if exists,
+ * NULL otherwise. Valid until the view is closed.
+ */
+const_valueT hashmap_view_at (const hashmap_view *view, const_keyT key);
+
+/**
+ * Unmaps the snapshot file and frees the view.
+ * @param p_view pointer to dynamically allocated pointer to hashmap_view.
+ */
+void hashmap_view_close (hashmap_view **p_view);
+
+/**
+ * Writes all the pairs of the hash map to a file descriptor, as a stream.
+ * Stream layout (all numbers are in the byte order of the writing host):
+ * header  - magic, number of pairs (uint64 each).
+ * chunks  - uint32 payload length, uint32 number of records, payload,
+ *           uint32 checksum of the payload (FNV-1a).
+ *           a record is uint32 key length, uint32 value length, key bytes,
+ *           value bytes (each padded to HASH_MAP_FILE_ALIGN).
+ * end     - a chunk with no records.
+ * Only one chunk is buffered at a time, so the map is never copied.
+ * @param hash_map a hash map.
+ * @param fd a file descriptor opened for writing.
+ * @param key_size a function which returns the number of bytes of a key.
+ * @param value_size a function which returns the number of bytes of a value.
+ * @return 1 if the map was written successfully, 0 otherwise.
+ */
+int hashmap_dump (const hashmap *hash_map, int fd,
+                  elem_size_func key_size, elem_size_func value_size);
+
+/**
+ * Reads pairs written by hashmap_dump and inserts them to the hash map.
+ * The map is re-sized once according to the number of pairs in the header
+ * (a count that the rest of a regular file cannot hold fails the load, and
+ * in other streams at most HASH_MAP_LOAD_MAX_RESERVE pairs are reserved).
+ * Each key and value is created by the copy functions of proto from the
+ * bytes in the stream (pairs with keys already in the map are skipped).
+ * @param hash_map a hash map.
+ * @param fd a file descriptor opened for reading.
+ * @param proto a pair whose copy, compare and free functions the loaded
+ * pairs use, its key and value are ignored.
+ * @return 1 if the whole stream was loaded successfully, 0 otherwise
+ * (on fail, the pairs read before the error stay in the map).
+ */
+int hashmap_load (hashmap *hash_map, int fd, const pair *proto);
+
+#endif //HASHMAP_FILE_H_
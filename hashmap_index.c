@@ -0,0 +1,211 @@
+#include <string.h>
+#include "hashmap_index.h"
+
+/**
+ * Allocates dynamically an ordered index of a map. It is sorted by the
+ * first query.
+ * @param map the map to index.
+ * @param key_order a function which orders keys, NULL for the key_order of
+ * the map.
+ * @return pointer to dynamically allocated hashmap_index.
+ * @if_fail return NULL (e.g. there is no function which orders the keys).
+ */
+hashmap_index *hashmap_index_alloc (const hashmap *map, keyT_order key_order)
+{
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  if (key_order == NULL)
+    {
+      key_order = map->key_order;
+    }
+  if (key_order == NULL)
+    {
+      return NULL;
+    }
+  hashmap_index *index = malloc (sizeof *index);
+  if (index == NULL)
+    {
+      return NULL;
+    }
+  index->map = map;
+  index->key_order = key_order;
+  index->nodes = NULL;
+  index->count = 0;
+  index->capacity = 0;
+  // not the version of the map, so the first query sorts.
+  index->version = map->version - 1;
+  return index;
+}
+
+/**
+ * Frees an ordered index (the map is not changed).
+ * @param p_index pointer to dynamically allocated pointer to hashmap_index.
+ */
+void hashmap_index_free (hashmap_index **p_index)
+{
+  if (p_index == NULL || *p_index == NULL)
+    {
+      return;
+    }
+  free ((*p_index)->nodes);
+  free (*p_index);
+  *p_index = NULL;
+}
+
+/**
+ * sorts nodes[0, count) by the key order, with tmp as room for count
+ * nodes. A bottom-up merge sort, merging two runs which are in order
+ * already is skipped.
+ */
+static void sort_nodes (hashmap_node **nodes, hashmap_node **tmp, size_t count,
+                        keyT_order key_order)
+{
+  for (size_t width = 1; width < count; width *= 2)
+    {
+      for (size_t left = 0; left + width < count; left += 2 * width)
+        {
+          size_t mid = left + width;
+          size_t right = mid + width < count ? mid + width : count;
+          if (key_order (nodes[mid - 1]->pair.key,
+                         nodes[mid]->pair.key) <= 0)
+            {
+              continue;
+            }
+          memcpy (tmp + left, nodes + left, (mid - left) * sizeof *nodes);
+          size_t i = left;
+          size_t j = mid;
+          size_t k = left;
+          while (i < mid && j < right)
+            {
+              // <= keeps equal keys in their order.
+              if (key_order (tmp[i]->pair.key, nodes[j]->pair.key) <= 0)
+                {
+                  nodes[k++] = tmp[i++];
+                }
+              else
+                {
+                  nodes[k++] = nodes[j++];
+                }
+            }
+          while (i < mid)
+            {
+              nodes[k++] = tmp[i++];
+            }
+        }
+    }
+}
+
+/**
+ * Sorts the index again if the map changed since it was sorted.
+ * @param index an ordered index.
+ * @return 1 if the index is up to date, 0 otherwise.
+ */
+int hashmap_index_refresh (hashmap_index *index)
+{
+  if (index == NULL)
+    {
+      return 0;
+    }
+  const hashmap *map = index->map;
+  if (index->version == map->version)
+    {
+      return 1;
+    }
+  if (map->size > index->capacity)
+    {
+      hashmap_node **nodes = realloc (index->nodes,
+                                      map->size * sizeof (hashmap_node *));
+      if (nodes == NULL)
+        {
+          return 0;
+        }
+      index->nodes = nodes;
+      index->capacity = map->size;
+    }
+  hashmap_node **tmp = malloc ((map->size + 1) * sizeof (hashmap_node *));
+  if (tmp == NULL)
+    {
+      return 0;
+    }
+  size_t count = 0;
+  for (size_t i = 0; i < map->capacity; i++)
+    {
+      for (hashmap_node *node = map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          index->nodes[count++] = node;
+        }
+    }
+  sort_nodes (index->nodes, tmp, count, index->key_order);
+  free (tmp);
+  index->count = count;
+  index->version = map->version;
+  return 1;
+}
+
+/**
+ * @return the position of the first key which is not smaller than key in
+ * the sorted index.
+ */
+static size_t bound (const hashmap_index *index, const_keyT key)
+{
+  size_t low = 0;
+  size_t high = index->count;
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+      if (index->key_order (index->nodes[mid]->pair.key, key) < 0)
+        {
+          low = mid + 1;
+        }
+      else
+        {
+          high = mid;
+        }
+    }
+  return low;
+}
+
+/**
+ * Finds the position of the first key which is not smaller than key.
+ * @param index an ordered index.
+ * @param key the key to look for.
+ * @return the position, the count of the index if all the keys are
+ * smaller (or if failed).
+ */
+size_t hashmap_index_lower_bound (hashmap_index *index, const_keyT key)
+{
+  if (!hashmap_index_refresh (index))
+    {
+      return index == NULL ? 0 : index->count;
+    }
+  return bound (index, key);
+}
+
+/**
+ * Returns the pairs whose keys are in [low, high), in the order of their
+ * keys.
+ * @param index an ordered index.
+ * @param low the smallest key of the range, NULL for the first key.
+ * @param high the first key after the range, NULL for after the last key.
+ * @return the pairs of the range, an empty range if failed.
+ */
+hashmap_index_range hashmap_index_range_of (hashmap_index *index,
+                                            const_keyT low, const_keyT high)
+{
+  hashmap_index_range range = {NULL, 0};
+  if (!hashmap_index_refresh (index))
+    {
+      return range;
+    }
+  size_t first = low == NULL ? 0 : bound (index, low);
+  size_t last = high == NULL ? index->count : bound (index, high);
+  if (first < last)
+    {
+      range.nodes = index->nodes + first;
+      range.count = last - first;
+    }
+  return range;
+}
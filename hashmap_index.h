@@ -0,0 +1,86 @@
+#ifndef HASHMAP_INDEX_H_
+#define HASHMAP_INDEX_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @struct hashmap_index
+ * An ordered index of the pairs of a hash map: an array of the nodes of the
+ * map sorted by key. The index is not updated by every insert and erase,
+ * it is re-sorted lazily by the first query after the map changed (see the
+ * version of hashmap), so a map that is changed and then reported on pays
+ * for one sort per report.
+ * @param map the indexed map, it has to outlive the index.
+ * @param key_order a function which orders the keys.
+ * @param nodes the nodes of the map, sorted by key_order.
+ * @param count the number of nodes in nodes.
+ * @param capacity the number of nodes nodes has room for.
+ * @param version the version of the map the nodes were sorted at.
+ */
+typedef struct hashmap_index {
+    const hashmap *map;
+    keyT_order key_order;
+    hashmap_node **nodes;
+    size_t count;
+    size_t capacity;
+    size_t version;
+} hashmap_index;
+
+/**
+ * @struct hashmap_index_range
+ * Following pairs of an index, in the order of their keys.
+ * @param nodes the first node, the pair of node i is nodes[i]->pair. They
+ * are valid until the map is changed.
+ * @param count the number of nodes.
+ */
+typedef struct hashmap_index_range {
+    hashmap_node *const *nodes;
+    size_t count;
+} hashmap_index_range;
+
+/**
+ * Allocates dynamically an ordered index of a map. It is sorted by the
+ * first query.
+ * @param map the map to index.
+ * @param key_order a function which orders keys, NULL for the key_order of
+ * the map.
+ * @return pointer to dynamically allocated hashmap_index.
+ * @if_fail return NULL (e.g. there is no function which orders the keys).
+ */
+hashmap_index *hashmap_index_alloc (const hashmap *map, keyT_order key_order);
+
+/**
+ * Frees an ordered index (the map is not changed).
+ * @param p_index pointer to dynamically allocated pointer to hashmap_index.
+ */
+void hashmap_index_free (hashmap_index **p_index);
+
+/**
+ * Sorts the index again if the map changed since it was sorted.
+ * @param index an ordered index.
+ * @return 1 if the index is up to date, 0 otherwise.
+ */
+int hashmap_index_refresh (hashmap_index *index);
+
+/**
+ * Finds the position of the first key which is not smaller than key.
+ * @param index an ordered index.
+ * @param key the key to look for.
+ * @return the position, the count of the index if all the keys are
+ * smaller (or if failed).
+ */
+size_t hashmap_index_lower_bound (hashmap_index *index, const_keyT key);
+
+/**
+ * Returns the pairs whose keys are in [low, high), in the order of their
+ * keys.
+ * @param index an ordered index.
+ * @param low the smallest key of the range, NULL for the first key.
+ * @param high the first key after the range, NULL for after the last key.
+ * @return the pairs of the range, an empty range if failed.
+ */
+hashmap_index_range hashmap_index_range_of (hashmap_index *index,
+                                            const_keyT low, const_keyT high);
+
+#endif //HASHMAP_INDEX_H_
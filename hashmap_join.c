@@ -0,0 +1,584 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "hashmap_join.h"
+
+/**
+ * @def NO_ROW
+ * The end of a chain of build rows.
+ */
+#define NO_ROW SIZE_MAX
+
+/**
+ * @struct partitioning
+ * Rows grouped by the partition of their hashes.
+ * @param bits the number of hash bits the rows are partitioned by.
+ * @param hashes the hash of every row.
+ * @param rows the indices of the rows, the rows of partition p are in
+ * [starts[p], starts[p + 1]).
+ * @param starts the first index in rows of every partition, and the number
+ * of rows at the end.
+ */
+typedef struct partitioning {
+    unsigned bits;
+    size_t *hashes;
+    size_t *rows;
+    size_t *starts;
+} partitioning;
+
+/**
+ * @struct radix_task
+ * The partitions of a join or a group-by, the threads take the next
+ * partition until there are none.
+ * @param run_partition the work on one partition, returns 0 if failed.
+ * @param n_parts the number of partitions.
+ * @param next_part the next partition to take.
+ * @param failed 1 if the work on some partition failed.
+ * @param func a function which "hashes" keys.
+ * @param build, build_parts the build rows of a join, or the rows of a
+ * group-by, and their partitioning.
+ * @param probe, probe_parts the probe rows of a join and their partitioning.
+ * @param next for every build row of a join, the next build row with the
+ * same key.
+ * @param out, out_counts the matches of every partition of a join.
+ * @param combine combines the values of a group-by.
+ * @param maps the maps of the partitions of a group-by.
+ */
+typedef struct radix_task {
+    int (*run_partition) (struct radix_task *, size_t);
+    size_t n_parts;
+    size_t next_part;
+    int failed;
+    hash_func func;
+    const pair *build;
+    partitioning build_parts;
+    const pair *probe;
+    partitioning probe_parts;
+    size_t *next;
+    hashmap_join_match **out;
+    size_t *out_counts;
+    valueT_combine combine;
+    hashmap **maps;
+} radix_task;
+
+/**
+ * @return the partition of a hash, by the high bits of the mixed hash (the
+ * maps of the partitions choose buckets by the low bits).
+ */
+static size_t partition_of (size_t hash, unsigned bits)
+{
+  return bits == 0 ? 0 : (size_t) (hashmap_mix (hash) >> (64 - bits));
+}
+
+/**
+ * @return the number of bits to partition n_rows rows by.
+ */
+static unsigned radix_bits_for (size_t n_rows)
+{
+  unsigned bits = 0;
+  while ((n_rows >> bits) > HASH_MAP_JOIN_PARTITION_ROWS
+         && bits < HASH_MAP_JOIN_MAX_RADIX_BITS)
+    {
+      bits++;
+    }
+  return bits;
+}
+
+/**
+ * frees the arrays of a partitioning.
+ */
+static void free_partitioning (partitioning *parts)
+{
+  free (parts->hashes);
+  free (parts->rows);
+  free (parts->starts);
+}
+
+/**
+ * hashes the rows and groups them by partition: counts the rows of every
+ * partition, and then scatters them to their places.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int partition_rows (const pair *rows, size_t n_rows, hash_func func,
+                           unsigned bits, partitioning *parts)
+{
+  size_t n_parts = (size_t) 1 << bits;
+  parts->bits = bits;
+  parts->hashes = malloc ((n_rows + 1) * sizeof (size_t));
+  parts->rows = malloc ((n_rows + 1) * sizeof (size_t));
+  parts->starts = calloc (n_parts + 1, sizeof (size_t));
+  if (parts->hashes == NULL || parts->rows == NULL || parts->starts == NULL)
+    {
+      free_partitioning (parts);
+      return 0;
+    }
+  for (size_t i = 0; i < n_rows; i++)
+    {
+      parts->hashes[i] = func (rows[i].key);
+      parts->starts[partition_of (parts->hashes[i], bits) + 1]++;
+    }
+  for (size_t p = 0; p < n_parts; p++)
+    {
+      parts->starts[p + 1] += parts->starts[p];
+    }
+  // starts[p] runs to the end of partition p, then it is moved back.
+  for (size_t i = 0; i < n_rows; i++)
+    {
+      parts->rows[parts->starts[partition_of (parts->hashes[i], bits)]++] = i;
+    }
+  for (size_t p = n_parts; p > 0; p--)
+    {
+      parts->starts[p] = parts->starts[p - 1];
+    }
+  parts->starts[0] = 0;
+  return 1;
+}
+
+/**
+ * fetches the buckets of rows [first, first + count) of a partitioning into
+ * the cache, so the lookups of a batch wait for one miss instead of one
+ * after the other.
+ */
+static void prefetch_batch (const hashmap *map, const partitioning *parts,
+                            size_t first, size_t count)
+{
+  size_t inds[HASH_MAP_JOIN_BATCH];
+  for (size_t b = 0; b < count; b++)
+    {
+      inds[b] = hashmap_bucket_index (parts->hashes[parts->rows[first + b]],
+                                      map->seed, map->capacity);
+      __builtin_prefetch (&map->buckets[inds[b]]);
+    }
+  for (size_t b = 0; b < count; b++)
+    {
+      const hashmap_node *head = map->buckets[inds[b]];
+      if (head != NULL)
+        {
+          __builtin_prefetch (head);
+        }
+    }
+}
+
+/**
+ * the key_free and value_free of the build maps: the maps point to the rows
+ * (their key_cpy and value_cpy are pair_value_keep), which are not theirs.
+ */
+static void drop (void **p_elem)
+{
+  *p_elem = NULL;
+}
+
+/**
+ * adds a match to the matches of a partition.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int push_match (hashmap_join_match **matches, size_t *count,
+                       size_t *capacity, const pair *build, const pair *probe)
+{
+  if (*count == *capacity)
+    {
+      size_t new_capacity = *capacity * HASH_MAP_GROWTH_FACTOR;
+      hashmap_join_match *new_matches =
+          realloc (*matches, new_capacity * sizeof **matches);
+      if (new_matches == NULL)
+        {
+          return 0;
+        }
+      *matches = new_matches;
+      *capacity = new_capacity;
+    }
+  (*matches)[(*count)++] = (hashmap_join_match) {build, probe};
+  return 1;
+}
+
+/**
+ * builds the map of the build rows of a partition, the value of a key is
+ * its first build row, and the other rows are chained to it by next.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int build_partition (radix_task *task, hashmap *map, size_t part)
+{
+  const partitioning *parts = &task->build_parts;
+  for (size_t k = parts->starts[part]; k < parts->starts[part + 1]; k++)
+    {
+      size_t row = parts->rows[k];
+      const pair *in = &task->build[row];
+      hashmap_entry entry = hashmap_find_hashed (map, in->key,
+                                                 parts->hashes[row]);
+      if (entry.pair != NULL)
+        {
+          size_t head = (size_t) ((const pair *) entry.pair->value
+                                  - task->build);
+          task->next[row] = task->next[head];
+          task->next[head] = row;
+          continue;
+        }
+      task->next[row] = NO_ROW;
+      pair build_pair = {in->key, (valueT) in, pair_value_keep,
+                         pair_value_keep, in->key_cmp, pair_value_same, drop,
+                         drop, NULL};
+      if (hashmap_entry_insert (map, entry, &build_pair).pair == NULL)
+        {
+          return 0;
+        }
+    }
+  return 1;
+}
+
+/**
+ * joins the rows of a partition: builds a map of its build rows and looks
+ * its probe rows up in it.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int join_partition (radix_task *task, size_t part)
+{
+  const partitioning *parts = &task->probe_parts;
+  size_t first = parts->starts[part];
+  size_t last = parts->starts[part + 1];
+  size_t n_build = task->build_parts.starts[part + 1]
+                   - task->build_parts.starts[part];
+  if (first == last || n_build == 0)
+    {
+      return 1;
+    }
+  hashmap *map = hashmap_alloc (task->func);
+  size_t capacity = last - first;
+  hashmap_join_match *matches = malloc (capacity * sizeof *matches);
+  size_t count = 0;
+  int res = map != NULL && matches != NULL && hashmap_reserve (map, n_build)
+            && build_partition (task, map, part);
+  for (size_t k = first; res && k < last; k += HASH_MAP_JOIN_BATCH)
+    {
+      size_t batch = last - k < HASH_MAP_JOIN_BATCH ? last - k
+                                                    : HASH_MAP_JOIN_BATCH;
+      prefetch_batch (map, parts, k, batch);
+      for (size_t b = 0; res && b < batch; b++)
+        {
+          size_t row = parts->rows[k + b];
+          const pair *in = &task->probe[row];
+          hashmap_entry entry = hashmap_find_hashed (map, in->key,
+                                                     parts->hashes[row]);
+          if (entry.pair == NULL)
+            {
+              continue;
+            }
+          for (size_t build = (size_t) ((const pair *) entry.pair->value
+                                        - task->build);
+               res && build != NO_ROW; build = task->next[build])
+            {
+              res = push_match (&matches, &count, &capacity,
+                                &task->build[build], in);
+            }
+        }
+    }
+  hashmap_free (&map);
+  if (!res)
+    {
+      free (matches);
+      return 0;
+    }
+  task->out[part] = matches;
+  task->out_counts[part] = count;
+  return 1;
+}
+
+/**
+ * groups the rows of a partition in its map.
+ * @return 1 if successful, 0 otherwise.
+ */
+static int group_partition (radix_task *task, size_t part)
+{
+  const partitioning *parts = &task->build_parts;
+  hashmap *map = hashmap_alloc (task->func);
+  task->maps[part] = map;
+  if (map == NULL)
+    {
+      return 0;
+    }
+  size_t last = parts->starts[part + 1];
+  for (size_t k = parts->starts[part]; k < last; k += HASH_MAP_JOIN_BATCH)
+    {
+      size_t batch = last - k < HASH_MAP_JOIN_BATCH ? last - k
+                                                    : HASH_MAP_JOIN_BATCH;
+      prefetch_batch (map, parts, k, batch);
+      // a key may be twice in a batch, so every row is looked up after the
+      // previous one was inserted.
+      for (size_t b = 0; b < batch; b++)
+        {
+          size_t row = parts->rows[k + b];
+          const pair *in = &task->build[row];
+          hashmap_entry entry = hashmap_find_hashed (map, in->key,
+                                                     parts->hashes[row]);
+          if (entry.pair != NULL)
+            {
+              task->combine (entry.pair->value, in->value);
+            }
+          else if (hashmap_entry_insert (map, entry, in).pair == NULL)
+            {
+              return 0;
+            }
+        }
+    }
+  return 1;
+}
+
+/**
+ * the work of a thread: takes the next partition until there are none.
+ */
+static void *partition_worker (void *arg)
+{
+  radix_task *task = arg;
+  size_t part;
+  while ((part = __atomic_fetch_add (&task->next_part, 1, __ATOMIC_RELAXED))
+         < task->n_parts)
+    {
+      if (!task->run_partition (task, part))
+        {
+          __atomic_store_n (&task->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+  return NULL;
+}
+
+/**
+ * runs the work on all the partitions of a task in threads threads, one of
+ * them is the calling thread (which takes the partitions of threads that
+ * could not be created).
+ * @return 1 if the work on all the partitions succeeded, 0 otherwise.
+ */
+static int run_partitions (radix_task *task, size_t threads)
+{
+  size_t n_threads = threads < task->n_parts ? threads : task->n_parts;
+  pthread_t *ids = n_threads > 1 ? malloc (n_threads * sizeof *ids) : NULL;
+  int *started = n_threads > 1 ? calloc (n_threads, sizeof *started) : NULL;
+  if (ids == NULL || started == NULL)
+    {
+      n_threads = 1;
+    }
+  for (size_t t = 1; t < n_threads; t++)
+    {
+      started[t] = pthread_create (&ids[t], NULL, partition_worker,
+                                   task) == 0;
+    }
+  partition_worker (task);
+  for (size_t t = 1; t < n_threads; t++)
+    {
+      if (started[t])
+        {
+          pthread_join (ids[t], NULL);
+        }
+    }
+  free (ids);
+  free (started);
+  return !task->failed;
+}
+
+/**
+ * Joins two arrays of rows on their keys: the rows are radix partitioned by
+ * their hashes (each key is hashed once), and then for every partition, in
+ * threads threads, a map of its build rows is built and its probe rows are
+ * looked up in it, in batches. The rows are not copied.
+ * @param build the build rows (usually the smaller side), their keys do not
+ * have to be unique.
+ * @param n_build the number of build rows.
+ * @param probe the probe rows.
+ * @param n_probe the number of probe rows.
+ * @param func a function which "hashes" keys.
+ * @param threads the number of threads to use (0 or 1 for the calling
+ * thread only).
+ * @return pointer to dynamically allocated hashmap_join_result, its matches
+ * point to the given rows.
+ * @if_fail return NULL.
+ */
+hashmap_join_result *hashmap_join (const pair *build, size_t n_build,
+                                   const pair *probe, size_t n_probe,
+                                   hash_func func, size_t threads)
+{
+  if ((build == NULL && n_build > 0) || (probe == NULL && n_probe > 0)
+      || func == NULL)
+    {
+      return NULL;
+    }
+  hashmap_join_result *result = malloc (sizeof *result);
+  if (result == NULL)
+    {
+      return NULL;
+    }
+  radix_task task;
+  memset (&task, 0, sizeof task);
+  unsigned bits = radix_bits_for (n_build);
+  task.run_partition = join_partition;
+  task.n_parts = (size_t) 1 << bits;
+  task.func = func;
+  task.build = build;
+  task.probe = probe;
+  task.next = malloc ((n_build + 1) * sizeof (size_t));
+  task.out = calloc (task.n_parts, sizeof (hashmap_join_match *));
+  task.out_counts = calloc (task.n_parts, sizeof (size_t));
+  int build_ok = 0;
+  int probe_ok = 0;
+  int res = task.next != NULL && task.out != NULL && task.out_counts != NULL
+            && (build_ok = partition_rows (build, n_build, func, bits,
+                                           &task.build_parts))
+            && (probe_ok = partition_rows (probe, n_probe, func, bits,
+                                           &task.probe_parts))
+            && run_partitions (&task, threads);
+  result->count = 0;
+  for (size_t p = 0; res && p < task.n_parts; p++)
+    {
+      result->count += task.out_counts[p];
+    }
+  result->matches = res ? malloc ((result->count + 1)
+                                  * sizeof (hashmap_join_match)) : NULL;
+  if (result->matches == NULL)
+    {
+      res = 0;
+    }
+  size_t count = 0;
+  for (size_t p = 0; task.out != NULL && p < task.n_parts; p++)
+    {
+      if (res && task.out_counts[p] > 0)
+        {
+          memcpy (result->matches + count, task.out[p],
+                  task.out_counts[p] * sizeof (hashmap_join_match));
+          count += task.out_counts[p];
+        }
+      free (task.out[p]);
+    }
+  if (build_ok)
+    {
+      free_partitioning (&task.build_parts);
+    }
+  if (probe_ok)
+    {
+      free_partitioning (&task.probe_parts);
+    }
+  free (task.next);
+  free (task.out);
+  free (task.out_counts);
+  if (!res)
+    {
+      hashmap_join_result_free (&result);
+    }
+  return result;
+}
+
+/**
+ * Frees the result of a join (the rows are not changed).
+ * @param p_result pointer to dynamically allocated pointer to
+ * hashmap_join_result.
+ */
+void hashmap_join_result_free (hashmap_join_result **p_result)
+{
+  if (p_result == NULL || *p_result == NULL)
+    {
+      return;
+    }
+  free ((*p_result)->matches);
+  free (*p_result);
+  *p_result = NULL;
+}
+
+/**
+ * Groups rows by their keys and combines the values of every group: the
+ * rows are radix partitioned by their hashes (each key is hashed once), and
+ * the map of every partition is built in one of threads threads.
+ * @param rows the rows.
+ * @param n_rows the number of rows.
+ * @param func a function which "hashes" keys.
+ * @param combine combines the value of a row into the value of its group
+ * (the first row of a group is copied).
+ * @param threads the number of threads to use (0 or 1 for the calling
+ * thread only).
+ * @return pointer to dynamically allocated hashmap_groups.
+ * @if_fail return NULL.
+ */
+hashmap_groups *hashmap_group_by (const pair *rows, size_t n_rows,
+                                  hash_func func, valueT_combine combine,
+                                  size_t threads)
+{
+  if ((rows == NULL && n_rows > 0) || func == NULL || combine == NULL)
+    {
+      return NULL;
+    }
+  hashmap_groups *groups = malloc (sizeof *groups);
+  if (groups == NULL)
+    {
+      return NULL;
+    }
+  unsigned bits = radix_bits_for (n_rows);
+  groups->radix_bits = bits;
+  groups->n_maps = (size_t) 1 << bits;
+  groups->hash_func = func;
+  groups->size = 0;
+  groups->maps = calloc (groups->n_maps, sizeof (hashmap *));
+  if (groups->maps == NULL)
+    {
+      free (groups);
+      return NULL;
+    }
+  radix_task task;
+  memset (&task, 0, sizeof task);
+  task.run_partition = group_partition;
+  task.n_parts = groups->n_maps;
+  task.func = func;
+  task.build = rows;
+  task.combine = combine;
+  task.maps = groups->maps;
+  if (!partition_rows (rows, n_rows, func, bits, &task.build_parts))
+    {
+      hashmap_groups_free (&groups);
+      return NULL;
+    }
+  int res = run_partitions (&task, threads);
+  free_partitioning (&task.build_parts);
+  if (!res)
+    {
+      hashmap_groups_free (&groups);
+      return NULL;
+    }
+  for (size_t p = 0; p < groups->n_maps; p++)
+    {
+      groups->size += groups->maps[p]->size;
+    }
+  return groups;
+}
+
+/**
+ * The function returns the value of the group of the given key.
+ * @param groups the groups of a group-by.
+ * @param key the key to be checked.
+ * @return the value of the group if exists, NULL otherwise (the value
+ * itself, not a copy of it).
+ */
+valueT hashmap_groups_at (const hashmap_groups *groups, const_keyT key)
+{
+  if (groups == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  size_t hash = groups->hash_func (key);
+  hashmap_entry entry = hashmap_find_hashed (
+      groups->maps[partition_of (hash, groups->radix_bits)], key, hash);
+  return entry.pair == NULL ? NULL : entry.pair->value;
+}
+
+/**
+ * Frees the groups of a group-by, and all the keys and values in them.
+ * @param p_groups pointer to dynamically allocated pointer to
+ * hashmap_groups.
+ */
+void hashmap_groups_free (hashmap_groups **p_groups)
+{
+  if (p_groups == NULL || *p_groups == NULL)
+    {
+      return;
+    }
+  for (size_t p = 0; p < (*p_groups)->n_maps; p++)
+    {
+      hashmap_free (&(*p_groups)->maps[p]);
+    }
+  free ((*p_groups)->maps);
+  free (*p_groups);
+  *p_groups = NULL;
+}
@@ -0,0 +1,130 @@
+#ifndef HASHMAP_JOIN_H_
+#define HASHMAP_JOIN_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_JOIN_PARTITION_ROWS
+ * The number of rows a partition is aimed at, so the map of a partition
+ * stays in the cache while it is built and probed.
+ */
+#define HASH_MAP_JOIN_PARTITION_ROWS 4096UL
+
+/**
+ * @def HASH_MAP_JOIN_MAX_RADIX_BITS
+ * The maximal number of hash bits the rows are partitioned by (so there are
+ * at most 2^HASH_MAP_JOIN_MAX_RADIX_BITS partitions).
+ */
+#define HASH_MAP_JOIN_MAX_RADIX_BITS 10
+
+/**
+ * @def HASH_MAP_JOIN_BATCH
+ * The number of rows whose buckets are fetched together before they are
+ * looked up.
+ */
+#define HASH_MAP_JOIN_BATCH 16
+
+/**
+ * @struct hashmap_join_match
+ * A build row and a probe row with equal keys.
+ * @param build the build row.
+ * @param probe the probe row.
+ */
+typedef struct hashmap_join_match {
+    const pair *build;
+    const pair *probe;
+} hashmap_join_match;
+
+/**
+ * @struct hashmap_join_result
+ * The matches of a join, grouped by partition (so in no particular order of
+ * the rows).
+ * @param matches dynamic array of the matches.
+ * @param count the number of matches.
+ */
+typedef struct hashmap_join_result {
+    hashmap_join_match *matches;
+    size_t count;
+} hashmap_join_result;
+
+/**
+ * @struct hashmap_groups
+ * The groups of a group-by, in one map for every partition of the rows.
+ * @param maps the maps of the partitions, n_maps of them.
+ * @param n_maps the number of partitions, a power of 2.
+ * @param radix_bits log2 of n_maps.
+ * @param hash_func the function which "hashed" the keys.
+ * @param size the number of groups in all the maps.
+ */
+typedef struct hashmap_groups {
+    hashmap **maps;
+    size_t n_maps;
+    unsigned radix_bits;
+    hash_func hash_func;
+    size_t size;
+} hashmap_groups;
+
+/**
+ * Joins two arrays of rows on their keys: the rows are radix partitioned by
+ * their hashes (each key is hashed once), and then for every partition, in
+ * threads threads, a map of its build rows is built and its probe rows are
+ * looked up in it, in batches. The rows are not copied.
+ * @param build the build rows (usually the smaller side), their keys do not
+ * have to be unique.
+ * @param n_build the number of build rows.
+ * @param probe the probe rows.
+ * @param n_probe the number of probe rows.
+ * @param func a function which "hashes" keys.
+ * @param threads the number of threads to use (0 or 1 for the calling
+ * thread only).
+ * @return pointer to dynamically allocated hashmap_join_result, its matches
+ * point to the given rows.
+ * @if_fail return NULL.
+ */
+hashmap_join_result *hashmap_join (const pair *build, size_t n_build,
+                                   const pair *probe, size_t n_probe,
+                                   hash_func func, size_t threads);
+
+/**
+ * Frees the result of a join (the rows are not changed).
+ * @param p_result pointer to dynamically allocated pointer to
+ * hashmap_join_result.
+ */
+void hashmap_join_result_free (hashmap_join_result **p_result);
+
+/**
+ * Groups rows by their keys and combines the values of every group: the
+ * rows are radix partitioned by their hashes (each key is hashed once), and
+ * the map of every partition is built in one of threads threads.
+ * @param rows the rows.
+ * @param n_rows the number of rows.
+ * @param func a function which "hashes" keys.
+ * @param combine combines the value of a row into the value of its group
+ * (the first row of a group is copied).
+ * @param threads the number of threads to use (0 or 1 for the calling
+ * thread only).
+ * @return pointer to dynamically allocated hashmap_groups.
+ * @if_fail return NULL.
+ */
+hashmap_groups *hashmap_group_by (const pair *rows, size_t n_rows,
+                                  hash_func func, valueT_combine combine,
+                                  size_t threads);
+
+/**
+ * The function returns the value of the group of the given key.
+ * @param groups the groups of a group-by.
+ * @param key the key to be checked.
+ * @return the value of the group if exists, NULL otherwise (the value
+ * itself, not a copy of it).
+ */
+valueT hashmap_groups_at (const hashmap_groups *groups, const_keyT key);
+
+/**
+ * Frees the groups of a group-by, and all the keys and values in them.
+ * @param p_groups pointer to dynamically allocated pointer to
+ * hashmap_groups.
+ */
+void hashmap_groups_free (hashmap_groups **p_groups);
+
+#endif //HASHMAP_JOIN_H_
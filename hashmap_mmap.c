@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "hashmap_mmap.h"
+
+/**
+ * @return the size of the mapping of an array of the given size.
+ */
+static size_t mapping_size (const hashmap_mmap_options *options, size_t size)
+{
+  size_t page = options->huge_pages == HASH_MAP_NO_HUGE_PAGES
+                ? (size_t) sysconf (_SC_PAGESIZE) : HASH_MAP_HUGE_PAGE_SIZE;
+  return (size + page - 1) / page * page;
+}
+
+/**
+ * allocates size zeroed bytes, see hashmap_mmap_options.
+ * @return the array, NULL if failed.
+ */
+static void *mmap_alloc (size_t size, void *ctx)
+{
+  const hashmap_mmap_options *options = ctx;
+  if (size < HASH_MAP_MMAP_MIN_SIZE)
+    {
+      return allocator_calloc (options->allocator, 1, size);
+    }
+  size_t length = mapping_size (options, size);
+  void *array = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (options->huge_pages == HASH_MAP_EXPLICIT_HUGE_PAGES)
+    {
+      array = mmap (NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+  if (array == MAP_FAILED)
+    {
+      array = mmap (NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (array == MAP_FAILED)
+        {
+          return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+      if (options->huge_pages != HASH_MAP_NO_HUGE_PAGES)
+        {
+          madvise (array, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+#ifdef SYS_mbind
+  // the pages are not touched yet, so they are allocated on the nodes of
+  // the policy when they are first used. mbind is called directly, so
+  // libnuma is not needed. The kernel reads maxnode - 1 bits of the mask,
+  // so maxnode is one more than the bits of node_mask.
+  if (options->numa_mode != HASH_MAP_NUMA_DEFAULT)
+    {
+      unsigned long node_mask = options->node_mask;
+      syscall (SYS_mbind, array, length, options->numa_mode, &node_mask,
+               sizeof (node_mask) * 8 + 1, 0);
+    }
+#endif
+  return array;
+}
+
+/**
+ * frees an array mmap_alloc returned.
+ */
+static void mmap_free (void *array, size_t size, void *ctx)
+{
+  if (size < HASH_MAP_MMAP_MIN_SIZE)
+    {
+      allocator_free (((const hashmap_mmap_options *) ctx)->allocator, array,
+                      size);
+      return;
+    }
+  munmap (array, mapping_size (ctx, size));
+}
+
+/**
+ * Returns an array policy which allocates the buckets arrays with mmap,
+ * on huge pages and NUMA nodes as the options say. The huge pages and the
+ * NUMA nodes are a hint: when the system does not support them, the
+ * arrays are still allocated on normal pages.
+ * Use it with hashmap_set_array_policy.
+ * @param options the options of the policy, they are used by the policy
+ * and so must live as long as the maps that use it.
+ * @return the policy.
+ */
+hashmap_array_policy hashmap_mmap_policy (const hashmap_mmap_options *options)
+{
+  hashmap_array_policy policy = {mmap_alloc, mmap_free, (void *) options};
+  return policy;
+}
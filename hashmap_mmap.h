@@ -0,0 +1,88 @@
+#ifndef HASHMAP_MMAP_H_
+#define HASHMAP_MMAP_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_MMAP_MIN_SIZE
+ * Arrays smaller than this (in bytes) are allocated by the allocator of the
+ * options, they do not fill a huge page anyway.
+ */
+#define HASH_MAP_MMAP_MIN_SIZE (1UL << 20)
+
+/**
+ * @def HASH_MAP_HUGE_PAGE_SIZE
+ * The size of a huge page, the arrays are rounded up to it.
+ */
+#define HASH_MAP_HUGE_PAGE_SIZE (2UL << 20)
+
+/**
+ * @def HASH_MAP_NO_HUGE_PAGES
+ * Allocate the arrays on normal pages.
+ */
+#define HASH_MAP_NO_HUGE_PAGES 0
+
+/**
+ * @def HASH_MAP_TRANSPARENT_HUGE_PAGES
+ * Ask the kernel to back the arrays with transparent huge pages
+ * (madvise MADV_HUGEPAGE).
+ */
+#define HASH_MAP_TRANSPARENT_HUGE_PAGES 1
+
+/**
+ * @def HASH_MAP_EXPLICIT_HUGE_PAGES
+ * Allocate the arrays from the reserved huge pages (MAP_HUGETLB), or from
+ * transparent huge pages when none are left.
+ */
+#define HASH_MAP_EXPLICIT_HUGE_PAGES 2
+
+/**
+ * @def HASH_MAP_NUMA_DEFAULT
+ * Keep the NUMA policy of the thread (the memory of the node that touches
+ * it first).
+ */
+#define HASH_MAP_NUMA_DEFAULT 0
+
+/**
+ * @def HASH_MAP_NUMA_BIND
+ * Allocate the arrays on the nodes of node_mask only.
+ */
+#define HASH_MAP_NUMA_BIND 2
+
+/**
+ * @def HASH_MAP_NUMA_INTERLEAVE
+ * Spread the pages of the arrays over the nodes of node_mask.
+ */
+#define HASH_MAP_NUMA_INTERLEAVE 3
+
+/**
+ * @struct hashmap_mmap_options
+ * The options of the mmap array policy.
+ * @param huge_pages one of the HASH_MAP_*_HUGE_PAGES values.
+ * @param numa_mode one of the HASH_MAP_NUMA_* values.
+ * @param node_mask the NUMA nodes to use (bit i for node i).
+ * @param allocator the allocator of the arrays smaller than
+ * HASH_MAP_MMAP_MIN_SIZE, NULL for malloc (usually the allocator of the
+ * map).
+ */
+typedef struct hashmap_mmap_options {
+    int huge_pages;
+    int numa_mode;
+    unsigned long node_mask;
+    const allocator *allocator;
+} hashmap_mmap_options;
+
+/**
+ * Returns an array policy which allocates the buckets arrays with mmap,
+ * on huge pages and NUMA nodes as the options say. The huge pages and the
+ * NUMA nodes are a hint: when the system does not support them, the
+ * arrays are still allocated on normal pages.
+ * Use it with hashmap_set_array_policy.
+ * @param options the options of the policy, they are used by the policy
+ * and so must live as long as the maps that use it.
+ * @return the policy.
+ */
+hashmap_array_policy hashmap_mmap_policy (const hashmap_mmap_options *options);
+
+#endif //HASHMAP_MMAP_H_
@@ -0,0 +1,197 @@
+#include "hashmap_multi.h"
+
+/**
+ * the value_free of the pairs in the map: frees the values and the run.
+ */
+static void free_run (valueT *p_run)
+{
+  if (p_run == NULL || *p_run == NULL)
+    {
+      return;
+    }
+  hashmap_multi_run *run = *p_run;
+  for (size_t i = 0; i < run->count; i++)
+    {
+      run->value_free (&run->values[i]);
+    }
+  free (run);
+  *p_run = NULL;
+}
+
+/**
+ * Allocates dynamically new multimap element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated hashmap_multi.
+ * @if_fail return NULL.
+ */
+hashmap_multi *hashmap_multi_alloc (hash_func func)
+{
+  hashmap_multi *map = malloc (sizeof *map);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->map = hashmap_alloc (func);
+  if (map->map == NULL)
+    {
+      free (map);
+      return NULL;
+    }
+  map->size = 0;
+  return map;
+}
+
+/**
+ * Frees a multimap and all the keys and values in it.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_multi.
+ */
+void hashmap_multi_free (hashmap_multi **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  hashmap_free (&(*p_map)->map);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Adds a copy of the value of in_pair to the values of its key (the key is
+ * copied if it is new). The value functions of the first pair of a key are
+ * used for all its values.
+ * @param map a multimap.
+ * @param in_pair a pair to be added.
+ * @return handle to the entry of the key, for appending more values
+ * without looking the key up again. A handle with NULL pair if failed.
+ */
+hashmap_entry hashmap_multi_insert (hashmap_multi *map, const pair *in_pair)
+{
+  hashmap_entry entry = {NULL, 0};
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return entry;
+    }
+  entry = hashmap_find (map->map, in_pair->key);
+  if (entry.pair != NULL)
+    {
+      if (!hashmap_multi_append (map, entry, in_pair->value))
+        {
+          entry.pair = NULL;
+        }
+      return entry;
+    }
+  hashmap_multi_run *run =
+      malloc (sizeof *run + HASH_MAP_MULTI_INITIAL_RUN * sizeof (valueT));
+  if (run == NULL)
+    {
+      return entry;
+    }
+  run->count = 1;
+  run->capacity = HASH_MAP_MULTI_INITIAL_RUN;
+  run->value_cpy = in_pair->value_cpy;
+  run->value_free = in_pair->value_free;
+  run->values[0] = in_pair->value_cpy (in_pair->value);
+  // the map copies the key, and keeps the run itself as the value.
+  pair map_pair = {in_pair->key, run, in_pair->key_cpy, pair_value_keep,
+                   in_pair->key_cmp, pair_value_same, in_pair->key_free,
+                   free_run, NULL};
+  entry = hashmap_entry_insert (map->map, entry, &map_pair);
+  if (entry.pair == NULL)
+    {
+      free_run ((valueT *) &run);
+      return entry;
+    }
+  map->size++;
+  return entry;
+}
+
+/**
+ * Adds a copy of value to the values of a key, without looking it up.
+ * @param map a multimap.
+ * @param entry a valid handle returned by hashmap_multi_insert or
+ * hashmap_multi_find.
+ * @param value the value to be added.
+ * @return 1 if the value was added, 0 otherwise.
+ */
+int hashmap_multi_append (hashmap_multi *map, hashmap_entry entry,
+                          const_valueT value)
+{
+  if (map == NULL || entry.pair == NULL)
+    {
+      return 0;
+    }
+  hashmap_multi_run *run = entry.pair->value;
+  if (run->count == run->capacity)
+    {
+      size_t new_capacity = run->capacity * HASH_MAP_GROWTH_FACTOR;
+      hashmap_multi_run *new_run =
+          realloc (run, sizeof *run + new_capacity * sizeof (valueT));
+      if (new_run == NULL)
+        {
+          return 0;
+        }
+      new_run->capacity = new_capacity;
+      run = new_run;
+      entry.pair->value = run;
+    }
+  run->values[run->count++] = run->value_cpy (value);
+  map->size++;
+  return 1;
+}
+
+/**
+ * Returns a handle to the entry of a key.
+ * @param map a multimap.
+ * @param key the key to be checked.
+ * @return handle to the entry if exists, a handle with NULL pair otherwise.
+ */
+hashmap_entry hashmap_multi_find (const hashmap_multi *map, const_keyT key)
+{
+  hashmap_entry entry = {NULL, 0};
+  if (map == NULL)
+    {
+      return entry;
+    }
+  return hashmap_find (map->map, key);
+}
+
+/**
+ * Returns the values of a key.
+ * @param map a multimap.
+ * @param key the key to be checked.
+ * @return the values of the key (the values themselves, not copies), an
+ * empty range if the key is not in the map.
+ */
+hashmap_multi_range hashmap_multi_equal_range (const hashmap_multi *map,
+                                               const_keyT key)
+{
+  hashmap_multi_range range = {NULL, 0};
+  hashmap_entry entry = hashmap_multi_find (map, key);
+  if (entry.pair != NULL)
+    {
+      hashmap_multi_run *run = entry.pair->value;
+      range.values = run->values;
+      range.count = run->count;
+    }
+  return range;
+}
+
+/**
+ * The function erases a key and all its values.
+ * @param map a multimap.
+ * @param key the key to be erased.
+ * @return the number of erased values.
+ */
+size_t hashmap_multi_erase (hashmap_multi *map, const_keyT key)
+{
+  hashmap_entry entry = hashmap_multi_find (map, key);
+  if (entry.pair == NULL)
+    {
+      return 0;
+    }
+  size_t count = ((hashmap_multi_run *) entry.pair->value)->count;
+  hashmap_entry_erase (map->map, entry);
+  map->size -= count;
+  return count;
+}
@@ -0,0 +1,117 @@
+#ifndef HASHMAP_MULTI_H_
+#define HASHMAP_MULTI_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_MULTI_INITIAL_RUN
+ * The number of values the run of a new key has room for.
+ */
+#define HASH_MAP_MULTI_INITIAL_RUN 2UL
+
+/**
+ * @struct hashmap_multi_run
+ * The values of one key, in one contiguous array (in the order they were
+ * inserted).
+ * @param count the number of values.
+ * @param capacity the number of values the run has room for.
+ * @param value_cpy, value_free copy and free functions for the values.
+ * @param values the values.
+ */
+typedef struct hashmap_multi_run {
+    size_t count;
+    size_t capacity;
+    pair_value_cpy value_cpy;
+    pair_value_free value_free;
+    valueT values[];
+} hashmap_multi_run;
+
+/**
+ * @struct hashmap_multi
+ * A hash map with many values for every key: each key is stored once, with
+ * a run of its values as its value, so there is no vector (and no second
+ * allocation) per key, and the values of a key are read from one array.
+ * @param map the hash map of the keys, its values are hashmap_multi_run.
+ * @param size the number of values in all the runs.
+ */
+typedef struct hashmap_multi {
+    hashmap *map;
+    size_t size;
+} hashmap_multi;
+
+/**
+ * @struct hashmap_multi_range
+ * The values of a key.
+ * @param values the first value, the values are contiguous. They are valid
+ * until the next insert or append to the key.
+ * @param count the number of values, 0 if the key is not in the map.
+ */
+typedef struct hashmap_multi_range {
+    valueT *values;
+    size_t count;
+} hashmap_multi_range;
+
+/**
+ * Allocates dynamically new multimap element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated hashmap_multi.
+ * @if_fail return NULL.
+ */
+hashmap_multi *hashmap_multi_alloc (hash_func func);
+
+/**
+ * Frees a multimap and all the keys and values in it.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_multi.
+ */
+void hashmap_multi_free (hashmap_multi **p_map);
+
+/**
+ * Adds a copy of the value of in_pair to the values of its key (the key is
+ * copied if it is new). The value functions of the first pair of a key are
+ * used for all its values.
+ * @param map a multimap.
+ * @param in_pair a pair to be added.
+ * @return handle to the entry of the key, for appending more values
+ * without looking the key up again. A handle with NULL pair if failed.
+ */
+hashmap_entry hashmap_multi_insert (hashmap_multi *map, const pair *in_pair);
+
+/**
+ * Adds a copy of value to the values of a key, without looking it up.
+ * @param map a multimap.
+ * @param entry a valid handle returned by hashmap_multi_insert or
+ * hashmap_multi_find.
+ * @param value the value to be added.
+ * @return 1 if the value was added, 0 otherwise.
+ */
+int hashmap_multi_append (hashmap_multi *map, hashmap_entry entry,
+                          const_valueT value);
+
+/**
+ * Returns a handle to the entry of a key.
+ * @param map a multimap.
+ * @param key the key to be checked.
+ * @return handle to the entry if exists, a handle with NULL pair otherwise.
+ */
+hashmap_entry hashmap_multi_find (const hashmap_multi *map, const_keyT key);
+
+/**
+ * Returns the values of a key.
+ * @param map a multimap.
+ * @param key the key to be checked.
+ * @return the values of the key (the values themselves, not copies), an
+ * empty range if the key is not in the map.
+ */
+hashmap_multi_range hashmap_multi_equal_range (const hashmap_multi *map,
+                                               const_keyT key);
+
+/**
+ * The function erases a key and all its values.
+ * @param map a multimap.
+ * @param key the key to be erased.
+ * @return the number of erased values.
+ */
+size_t hashmap_multi_erase (hashmap_multi *map, const_keyT key);
+
+#endif //HASHMAP_MULTI_H_
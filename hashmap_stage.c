@@ -0,0 +1,161 @@
+#include "hashmap_stage.h"
+
+/**
+ * allocates a stage with an empty local map.
+ * @return pointer to dynamically allocated hashmap_stage, NULL if failed.
+ */
+static hashmap_stage *stage_alloc (hash_func func, valueT_combine combine,
+                                   size_t max_size)
+{
+  if (combine == NULL)
+    {
+      return NULL;
+    }
+  hashmap_stage *stage = calloc (1, sizeof *stage);
+  if (stage == NULL)
+    {
+      return NULL;
+    }
+  stage->local = hashmap_alloc (func);
+  if (stage->local == NULL)
+    {
+      free (stage);
+      return NULL;
+    }
+  stage->combine = combine;
+  stage->max_size = max_size == 0 ? HASH_MAP_STAGE_DEFAULT_MAX_SIZE
+                                  : max_size;
+  return stage;
+}
+
+/**
+ * Allocates dynamically new stage for a shared hash map.
+ * @param shared the shared hash map to merge into.
+ * @param shared_lock the lock which protects shared.
+ * @param combine a function which combines a value into a stored value.
+ * @param max_size the number of pairs that triggers a merge
+ * (0 for HASH_MAP_STAGE_DEFAULT_MAX_SIZE).
+ * @return pointer to dynamically allocated hashmap_stage.
+ * @if_fail return NULL.
+ */
+hashmap_stage *hashmap_stage_alloc (hashmap *shared,
+                                    pthread_mutex_t *shared_lock,
+                                    valueT_combine combine, size_t max_size)
+{
+  if (shared == NULL || shared_lock == NULL)
+    {
+      return NULL;
+    }
+  hashmap_stage *stage = stage_alloc (shared->hash_func, combine, max_size);
+  if (stage != NULL)
+    {
+      stage->shared = shared;
+      stage->shared_lock = shared_lock;
+    }
+  return stage;
+}
+
+/**
+ * Allocates dynamically new stage for a sharded hash map.
+ * @param sharded the sharded hash map to merge into.
+ * @param combine a function which combines a value into a stored value.
+ * @param max_size the number of pairs that triggers a merge
+ * (0 for HASH_MAP_STAGE_DEFAULT_MAX_SIZE).
+ * @return pointer to dynamically allocated hashmap_stage.
+ * @if_fail return NULL.
+ */
+hashmap_stage *hashmap_stage_alloc_sharded (sharded_hashmap *sharded,
+                                            valueT_combine combine,
+                                            size_t max_size)
+{
+  if (sharded == NULL)
+    {
+      return NULL;
+    }
+  hashmap_stage *stage = stage_alloc (sharded->hash_func, combine, max_size);
+  if (stage != NULL)
+    {
+      stage->sharded = sharded;
+    }
+  return stage;
+}
+
+/**
+ * Merges the stage into the shared map (if not flushed already) and frees
+ * it. The staged pairs a failed merge left are freed with the stage (they
+ * are lost), and that is reported.
+ * @param p_stage pointer to dynamically allocated pointer to hashmap_stage.
+ * @return 1 if all the staged pairs were merged, 0 otherwise (some were
+ * lost, or p_stage was NULL).
+ */
+int hashmap_stage_free (hashmap_stage **p_stage)
+{
+  if (p_stage == NULL || *p_stage == NULL)
+    {
+      return 0;
+    }
+  int res = hashmap_stage_flush (*p_stage);
+  hashmap_free (&(*p_stage)->local);
+  free (*p_stage);
+  *p_stage = NULL;
+  return res;
+}
+
+/**
+ * Adds a pair to the stage: inserts a copy of it, or combines its value
+ * into the staged value of the same key. When the stage gets to max_size
+ * pairs, it is merged into the shared map. If that merge fails, the pairs
+ * stay staged and the next hashmap_stage_flush or hashmap_stage_free
+ * reports it: the pair was staged all the same, so it must not be added
+ * again.
+ * @param stage a stage.
+ * @param in_pair a pair to be inserted or combined.
+ * @return 1 if the pair was staged, 0 otherwise.
+ */
+int hashmap_stage_insert (hashmap_stage *stage, const pair *in_pair)
+{
+  if (stage == NULL
+      || hashmap_upsert (stage->local, in_pair, stage->combine).pair == NULL)
+    {
+      return 0;
+    }
+  if (stage->local->size >= stage->max_size)
+    {
+      hashmap_stage_flush (stage);
+    }
+  return 1;
+}
+
+/**
+ * Merges all the staged pairs into the shared map (taking its lock once),
+ * and empties the stage. If the merge fails, the stage keeps the pairs
+ * that were not merged, and they are merged by the next flush.
+ * @param stage a stage.
+ * @return 1 for success, 0 otherwise.
+ */
+int hashmap_stage_flush (hashmap_stage *stage)
+{
+  if (stage == NULL)
+    {
+      return 0;
+    }
+  if (stage->local->size == 0)
+    {
+      return 1;
+    }
+  // the merged pairs are erased from the local map (its capacity is kept,
+  // it is filled again to the same size), and only them.
+  int res;
+  if (stage->sharded != NULL)
+    {
+      res = sharded_hashmap_merge_move (stage->sharded, stage->local,
+                                        stage->combine);
+    }
+  else
+    {
+      pthread_mutex_lock (stage->shared_lock);
+      res = hashmap_merge_move (stage->shared, stage->local, stage->combine);
+      pthread_mutex_unlock (stage->shared_lock);
+    }
+  return res;
+}
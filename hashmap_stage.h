@@ -0,0 +1,97 @@
+#ifndef HASHMAP_STAGE_H_
+#define HASHMAP_STAGE_H_
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "hashmap.h"
+#include "sharded_hashmap.h"
+
+/**
+ * @def HASH_MAP_STAGE_DEFAULT_MAX_SIZE
+ * The number of pairs a stage holds before it merges them, when 0 is given.
+ */
+#define HASH_MAP_STAGE_DEFAULT_MAX_SIZE 4096UL
+
+/**
+ * @struct hashmap_stage
+ * A private (per thread) hash map that collects inserts and updates, and
+ * merges them into a shared map in one bulk pass, instead of taking the
+ * lock of the shared map for every single update. Updates of the same key
+ * are combined in the stage first, so each key is merged once per flush.
+ * @param local the private map the updates are collected in.
+ * @param shared the shared hash map to merge into (NULL if sharded is used).
+ * @param shared_lock the lock which protects shared.
+ * @param sharded the shared sharded hash map to merge into (NULL if shared
+ * is used).
+ * @param combine a function which combines a value into a stored value.
+ * @param max_size the number of pairs in local that triggers a merge.
+ */
+typedef struct hashmap_stage {
+    hashmap *local;
+    hashmap *shared;
+    pthread_mutex_t *shared_lock;
+    sharded_hashmap *sharded;
+    valueT_combine combine;
+    size_t max_size;
+} hashmap_stage;
+
+/**
+ * Allocates dynamically new stage for a shared hash map.
+ * @param shared the shared hash map to merge into.
+ * @param shared_lock the lock which protects shared.
+ * @param combine a function which combines a value into a stored value.
+ * @param max_size the number of pairs that triggers a merge
+ * (0 for HASH_MAP_STAGE_DEFAULT_MAX_SIZE).
+ * @return pointer to dynamically allocated hashmap_stage.
+ * @if_fail return NULL.
+ */
+hashmap_stage *hashmap_stage_alloc (hashmap *shared,
+                                    pthread_mutex_t *shared_lock,
+                                    valueT_combine combine, size_t max_size);
+
+/**
+ * Allocates dynamically new stage for a sharded hash map.
+ * @param sharded the sharded hash map to merge into.
+ * @param combine a function which combines a value into a stored value.
+ * @param max_size the number of pairs that triggers a merge
+ * (0 for HASH_MAP_STAGE_DEFAULT_MAX_SIZE).
+ * @return pointer to dynamically allocated hashmap_stage.
+ * @if_fail return NULL.
+ */
+hashmap_stage *hashmap_stage_alloc_sharded (sharded_hashmap *sharded,
+                                            valueT_combine combine,
+                                            size_t max_size);
+
+/**
+ * Merges the stage into the shared map (if not flushed already) and frees
+ * it. The staged pairs a failed merge left are freed with the stage (they
+ * are lost), and that is reported.
+ * @param p_stage pointer to dynamically allocated pointer to hashmap_stage.
+ * @return 1 if all the staged pairs were merged, 0 otherwise (some were
+ * lost, or p_stage was NULL).
+ */
+int hashmap_stage_free (hashmap_stage **p_stage);
+
+/**
+ * Adds a pair to the stage: inserts a copy of it, or combines its value
+ * into the staged value of the same key. When the stage gets to max_size
+ * pairs, it is merged into the shared map. If that merge fails, the pairs
+ * stay staged and the next hashmap_stage_flush or hashmap_stage_free
+ * reports it: the pair was staged all the same, so it must not be added
+ * again.
+ * @param stage a stage.
+ * @param in_pair a pair to be inserted or combined.
+ * @return 1 if the pair was staged, 0 otherwise.
+ */
+int hashmap_stage_insert (hashmap_stage *stage, const pair *in_pair);
+
+/**
+ * Merges all the staged pairs into the shared map (taking its lock once),
+ * and empties the stage. If the merge fails, the stage keeps the pairs
+ * that were not merged, and they are merged by the next flush.
+ * @param stage a stage.
+ * @return 1 for success, 0 otherwise.
+ */
+int hashmap_stage_flush (hashmap_stage *stage);
+
+#endif //HASHMAP_STAGE_H_
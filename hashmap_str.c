@@ -0,0 +1,475 @@
+#include <string.h>
+#include <stdint.h>
+#include "hashmap_str.h"
+
+/**
+ * Hashes a byte string, the hash hashmap_str uses for its keys.
+ * @param bytes the bytes of the string.
+ * @param len the number of bytes.
+ * @return the hash.
+ */
+size_t hashmap_str_hash (const char *bytes, size_t len)
+{
+  // 8 bytes at a time, the tail is read as one (zero padded) word.
+  uint64_t hash = len * 0x9E3779B97F4A7C15ULL;
+  size_t i = 0;
+  for (; i + sizeof (uint64_t) <= len; i += sizeof (uint64_t))
+    {
+      uint64_t word;
+      memcpy (&word, bytes + i, sizeof word);
+      hash = (hash ^ word) * 0xBF58476D1CE4E5B9ULL;
+      hash ^= hash >> 31;
+    }
+  if (i < len)
+    {
+      uint64_t word = 0;
+      memcpy (&word, bytes + i, len - i);
+      hash ^= word;
+    }
+  return hashmap_mix (hash);
+}
+
+/**
+ * @return the stored bytes of the key of a node.
+ */
+static char *node_bytes (hashmap_str_node *node)
+{
+  return node->len < HASH_MAP_STR_INLINE ? node->key.inline_bytes
+                                         : node->key.arena.bytes;
+}
+
+/**
+ * Allocates dynamically new byte strings hash map element.
+ * @param value_cpy, value_free copy and free functions for the values (NULL
+ * for storing the values themselves).
+ * @return pointer to dynamically allocated hashmap_str.
+ * @if_fail return NULL.
+ */
+hashmap_str *hashmap_str_alloc (pair_value_cpy value_cpy,
+                                pair_value_free value_free)
+{
+  hashmap_str *map = malloc (sizeof *map);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->buckets = calloc (HASH_MAP_INITIAL_CAP, sizeof (hashmap_str_node *));
+  if (map->buckets == NULL)
+    {
+      free (map);
+      return NULL;
+    }
+  map->size = 0;
+  map->capacity = HASH_MAP_INITIAL_CAP;
+  map->chunks = NULL;
+  map->arena_used = 0;
+  map->dead_bytes = 0;
+  map->value_cpy = value_cpy;
+  map->value_free = value_free;
+  return map;
+}
+
+/**
+ * frees the value of a node, if the map owns it.
+ */
+static void free_value (const hashmap_str *map, hashmap_str_node *node)
+{
+  if (map->value_free != NULL && node->value != NULL)
+    {
+      map->value_free (&node->value);
+    }
+}
+
+/**
+ * Frees a byte strings hash map, its arena and the values in it.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_str.
+ */
+void hashmap_str_free (hashmap_str **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  for (size_t i = 0; i < (*p_map)->capacity; i++)
+    {
+      hashmap_str_node *node = (*p_map)->buckets[i];
+      while (node != NULL)
+        {
+          hashmap_str_node *next = node->next;
+          free_value (*p_map, node);
+          free (node);
+          node = next;
+        }
+    }
+  hashmap_str_chunk *chunk = (*p_map)->chunks;
+  while (chunk != NULL)
+    {
+      hashmap_str_chunk *next = chunk->next;
+      free (chunk);
+      chunk = next;
+    }
+  free ((*p_map)->buckets);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * copies len bytes and a '\0' to the arena of the map (to its first
+ * chunk).
+ * @return the copy, NULL if failed.
+ */
+static char *arena_copy (hashmap_str *map, const char *bytes, size_t len)
+{
+  hashmap_str_chunk *chunk = map->chunks;
+  if (chunk == NULL || chunk->capacity - chunk->used < len + 1)
+    {
+      size_t capacity = len + 1 > HASH_MAP_STR_CHUNK ? len + 1
+                                                     : HASH_MAP_STR_CHUNK;
+      chunk = malloc (sizeof *chunk + capacity);
+      if (chunk == NULL)
+        {
+          return NULL;
+        }
+      chunk->used = 0;
+      chunk->dead = 0;
+      chunk->capacity = capacity;
+      chunk->pinned = 0;
+      chunk->next = map->chunks;
+      map->chunks = chunk;
+    }
+  char *copy = chunk->data + chunk->used;
+  memcpy (copy, bytes, len);
+  copy[len] = '\0';
+  chunk->used += len + 1;
+  map->arena_used += len + 1;
+  return copy;
+}
+
+/**
+ * moves the live keys of the chunks that are not pinned to one new chunk,
+ * and frees those chunks. Nothing is changed if the new chunk can not be
+ * allocated.
+ */
+static void compact_arena (hashmap_str *map)
+{
+  size_t live = 0;
+  for (hashmap_str_chunk *chunk = map->chunks; chunk != NULL;
+       chunk = chunk->next)
+    {
+      live += chunk->pinned ? 0 : chunk->used - chunk->dead;
+    }
+  hashmap_str_chunk *fresh = malloc (sizeof *fresh + live);
+  if (fresh == NULL)
+    {
+      return;
+    }
+  fresh->used = 0;
+  fresh->dead = 0;
+  fresh->capacity = live;
+  fresh->pinned = 0;
+  for (size_t i = 0; i < map->capacity; i++)
+    {
+      for (hashmap_str_node *node = map->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          if (node->len < HASH_MAP_STR_INLINE
+              || node->key.arena.chunk->pinned)
+            {
+              continue;
+            }
+          char *copy = fresh->data + fresh->used;
+          memcpy (copy, node->key.arena.bytes, node->len + 1);
+          fresh->used += node->len + 1;
+          node->key.arena.bytes = copy;
+          node->key.arena.chunk = fresh;
+        }
+    }
+  hashmap_str_chunk **link = &map->chunks;
+  while (*link != NULL)
+    {
+      hashmap_str_chunk *chunk = *link;
+      if (chunk->pinned)
+        {
+          link = &chunk->next;
+          continue;
+        }
+      *link = chunk->next;
+      map->arena_used -= chunk->used;
+      free (chunk);
+    }
+  // fresh is full, so the next key starts a new chunk.
+  fresh->next = map->chunks;
+  map->chunks = fresh;
+  map->arena_used += fresh->used;
+  map->dead_bytes = 0;
+}
+
+/**
+ * gives the space of an erased long key back to the arena: the last key of
+ * a chunk is cut off it, a chunk whose keys were all erased is freed (or
+ * emptied, if keys are appended to it), and the arena is compacted when
+ * the erased keys take too much of it.
+ */
+static void release_key (hashmap_str *map, hashmap_str_node *node)
+{
+  if (node->len < HASH_MAP_STR_INLINE)
+    {
+      return;
+    }
+  hashmap_str_chunk *chunk = node->key.arena.chunk;
+  size_t size = node->len + 1;
+  if (node->key.arena.bytes + size == chunk->data + chunk->used)
+    {
+      chunk->used -= size;
+      map->arena_used -= size;
+    }
+  else
+    {
+      chunk->dead += size;
+      map->dead_bytes += chunk->pinned ? 0 : size;
+    }
+  if (chunk->dead == chunk->used)
+    {
+      map->arena_used -= chunk->used;
+      map->dead_bytes -= chunk->pinned ? 0 : chunk->dead;
+      if (chunk == map->chunks)
+        {
+          chunk->used = 0;
+          chunk->dead = 0;
+          chunk->pinned = 0;
+        }
+      else
+        {
+          hashmap_str_chunk **link = &map->chunks;
+          while (*link != chunk)
+            {
+              link = &(*link)->next;
+            }
+          *link = chunk->next;
+          free (chunk);
+        }
+    }
+  if (map->dead_bytes > HASH_MAP_STR_CHUNK
+      && map->dead_bytes > map->arena_used * HASH_MAP_STR_MAX_DEAD_FACTOR)
+    {
+      compact_arena (map);
+    }
+}
+
+/**
+ * @return the link to the node of the key, NULL if the key is not in the
+ * map.
+ */
+static hashmap_str_node **find_link (const hashmap_str *map, const char *bytes,
+                                     size_t len, size_t hash)
+{
+  size_t ind = hashmap_bucket_index (hash, 0, map->capacity);
+  for (hashmap_str_node **link = &map->buckets[ind]; *link != NULL;
+       link = &(*link)->next)
+    {
+      if ((*link)->hash == hash && (*link)->len == len
+          && (len == 0 || memcmp (node_bytes (*link), bytes, len) == 0))
+        {
+          return link;
+        }
+    }
+  return NULL;
+}
+
+/**
+ * re-links the nodes of the map into new_capacity buckets.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+static int resize_map (hashmap_str *map, size_t new_capacity)
+{
+  hashmap_str_node **new_buckets =
+      calloc (new_capacity, sizeof (hashmap_str_node *));
+  if (new_buckets == NULL)
+    {
+      return 0;
+    }
+  for (size_t i = 0; i < map->capacity; i++)
+    {
+      hashmap_str_node *node = map->buckets[i];
+      while (node != NULL)
+        {
+          hashmap_str_node *next = node->next;
+          size_t ind = hashmap_bucket_index (node->hash, 0, new_capacity);
+          node->next = new_buckets[ind];
+          new_buckets[ind] = node;
+          node = next;
+        }
+    }
+  free (map->buckets);
+  map->buckets = new_buckets;
+  map->capacity = new_capacity;
+  return 1;
+}
+
+/**
+ * inserts a key, which is known not to be in the map, with the given
+ * (already copied) value.
+ * @return the node of the key, NULL if failed.
+ */
+static hashmap_str_node *insert_new (hashmap_str *map, const char *bytes,
+                                     size_t len, size_t hash, valueT value)
+{
+  hashmap_str_node *node = malloc (sizeof *node);
+  if (node == NULL)
+    {
+      return NULL;
+    }
+  if (len < HASH_MAP_STR_INLINE)
+    {
+      if (len > 0)
+        {
+          memcpy (node->key.inline_bytes, bytes, len);
+        }
+      node->key.inline_bytes[len] = '\0';
+    }
+  else
+    {
+      node->key.arena.bytes = arena_copy (map, bytes, len);
+      if (node->key.arena.bytes == NULL)
+        {
+          free (node);
+          return NULL;
+        }
+      node->key.arena.chunk = map->chunks;
+    }
+  size_t ind = hashmap_bucket_index (hash, 0, map->capacity);
+  node->hash = hash;
+  node->len = len;
+  node->value = value;
+  node->next = map->buckets[ind];
+  map->buckets[ind] = node;
+  map->size++;
+  if (map->size / (double) map->capacity > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      resize_map (map, map->capacity * HASH_MAP_GROWTH_FACTOR);
+    }
+  return node;
+}
+
+/**
+ * Inserts a key and a copy of value to the map.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the key (may contain '\0').
+ * @param len the number of bytes in the key.
+ * @param value the value of the key.
+ * @return 1 if the key was inserted, 0 otherwise (e.g. it is in the map).
+ */
+int hashmap_str_insert (hashmap_str *map, const char *bytes, size_t len,
+                        const_valueT value)
+{
+  if (map == NULL || (bytes == NULL && len > 0))
+    {
+      return 0;
+    }
+  size_t hash = hashmap_str_hash (bytes, len);
+  if (find_link (map, bytes, len, hash) != NULL)
+    {
+      return 0;
+    }
+  valueT copy = (valueT) value;
+  if (map->value_cpy != NULL && value != NULL)
+    {
+      copy = map->value_cpy (value);
+    }
+  if (insert_new (map, bytes, len, hash, copy) == NULL)
+    {
+      if (map->value_free != NULL && copy != NULL)
+        {
+          map->value_free (&copy);
+        }
+      return 0;
+    }
+  return 1;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the key.
+ * @param len the number of bytes in the key.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_str_at (const hashmap_str *map, const char *bytes, size_t len)
+{
+  if (map == NULL || (bytes == NULL && len > 0))
+    {
+      return NULL;
+    }
+  hashmap_str_node **link =
+      find_link (map, bytes, len, hashmap_str_hash (bytes, len));
+  return link == NULL ? NULL : (*link)->value;
+}
+
+/**
+ * The function erases the given key and its value.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the key.
+ * @param len the number of bytes in the key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_str_erase (hashmap_str *map, const char *bytes, size_t len)
+{
+  if (map == NULL || (bytes == NULL && len > 0))
+    {
+      return 0;
+    }
+  hashmap_str_node **link =
+      find_link (map, bytes, len, hashmap_str_hash (bytes, len));
+  if (link == NULL)
+    {
+      return 0;
+    }
+  hashmap_str_node *node = *link;
+  *link = node->next;
+  free_value (map, node);
+  release_key (map, node);
+  free (node);
+  map->size--;
+  if (map->size / (double) map->capacity < HASH_MAP_MIN_LOAD_FACTOR
+      && map->capacity > HASH_MAP_INITIAL_CAP)
+    {
+      resize_map (map, map->capacity / HASH_MAP_GROWTH_FACTOR);
+    }
+  return 1;
+}
+
+/**
+ * Returns the stored copy of a string, storing it (with a NULL value) if it
+ * is not in the map, so equal strings get the same pointer and can be
+ * compared by it.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the string.
+ * @param len the number of bytes in the string.
+ * @return the stored bytes, followed by a '\0'. They are valid until the
+ * string is erased from the map.
+ * @if_fail return NULL.
+ */
+const char *hashmap_intern (hashmap_str *map, const char *bytes, size_t len)
+{
+  if (map == NULL || (bytes == NULL && len > 0))
+    {
+      return NULL;
+    }
+  size_t hash = hashmap_str_hash (bytes, len);
+  hashmap_str_node **link = find_link (map, bytes, len, hash);
+  hashmap_str_node *node = link != NULL ? *link
+                                        : insert_new (map, bytes, len, hash,
+                                                      NULL);
+  if (node == NULL)
+    {
+      return NULL;
+    }
+  // the returned bytes are not moved by compactions any more.
+  if (len >= HASH_MAP_STR_INLINE && !node->key.arena.chunk->pinned)
+    {
+      node->key.arena.chunk->pinned = 1;
+      map->dead_bytes -= node->key.arena.chunk->dead;
+    }
+  return node_bytes (node);
+}
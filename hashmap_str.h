@@ -0,0 +1,176 @@
+#ifndef HASHMAP_STR_H_
+#define HASHMAP_STR_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_STR_INLINE
+ * The number of bytes of a key stored in its node (with its terminating
+ * '\0'), longer keys are stored in the arena of the map.
+ */
+#define HASH_MAP_STR_INLINE 16UL
+
+/**
+ * @def HASH_MAP_STR_CHUNK
+ * The number of bytes in a chunk of the arena of a map (a longer key gets a
+ * chunk of its own).
+ */
+#define HASH_MAP_STR_CHUNK 4096UL
+
+/**
+ * @def HASH_MAP_STR_MAX_DEAD_FACTOR
+ * The maximal part of the arena the erased long keys can take (once they
+ * take more than a chunk), above it the live keys are compacted to a new
+ * chunk.
+ */
+#define HASH_MAP_STR_MAX_DEAD_FACTOR 0.5
+
+/**
+ * @struct hashmap_str_chunk
+ * A chunk of the arena of a map, the keys are appended to it one after the
+ * other. A chunk is freed once all its keys are erased, and the keys of
+ * chunks that are not pinned are moved when the arena is compacted.
+ * @param next the chunk allocated before this one, NULL for the first one.
+ * @param used the number of bytes in use (by live and erased keys).
+ * @param dead the number of bytes of erased keys.
+ * @param capacity the number of bytes in data.
+ * @param pinned 1 if hashmap_intern returned a key of the chunk, so its
+ * keys are never moved.
+ * @param data the bytes of the keys.
+ */
+typedef struct hashmap_str_chunk {
+    struct hashmap_str_chunk *next;
+    size_t used;
+    size_t dead;
+    size_t capacity;
+    int pinned;
+    char data[];
+} hashmap_str_chunk;
+
+/**
+ * @struct hashmap_str_node
+ * A key (and its value) stored in the map, linked into the list of its
+ * bucket.
+ * @param next the next node in the bucket, NULL for the last one.
+ * @param hash the hash of the key.
+ * @param len the number of bytes in the key (without the '\0').
+ * @param value the stored value.
+ * @param key the bytes of the key and a '\0' after them, in the node if
+ * len < HASH_MAP_STR_INLINE, in the arena otherwise (with the chunk they
+ * are in).
+ */
+typedef struct hashmap_str_node {
+    struct hashmap_str_node *next;
+    size_t hash;
+    size_t len;
+    valueT value;
+    union {
+        struct {
+            char *bytes;
+            hashmap_str_chunk *chunk;
+        } arena;
+        char inline_bytes[HASH_MAP_STR_INLINE];
+    } key;
+} hashmap_str_node;
+
+/**
+ * @struct hashmap_str
+ * A hash map with byte strings keys: the map hashes and compares the keys
+ * itself (by their lengths, hashes and bytes, with no function pointer),
+ * short keys are stored in their nodes and long keys in an arena of the
+ * map, so no key is allocated by itself. The space of erased long keys is
+ * reclaimed: the last key of a chunk gives its space back to the chunk, a
+ * chunk whose keys were all erased is freed, and once the erased keys take
+ * more than HASH_MAP_STR_MAX_DEAD_FACTOR of the arena the live keys are
+ * compacted. The limit: the keys hashmap_intern returned are not moved, so
+ * the erased keys of their chunks are reclaimed only with the whole chunk.
+ * @param buckets dynamic array of lists of nodes, NULL for empty buckets.
+ * @param size the number of keys stored in the map.
+ * @param capacity the number of buckets, a power of 2.
+ * @param chunks the chunks of the arena, the last allocated one first.
+ * @param arena_used the number of bytes used in all the chunks.
+ * @param dead_bytes the number of bytes of erased keys in the chunks that
+ * are not pinned.
+ * @param value_cpy, value_free copy and free functions for the values (NULL
+ * for storing the values themselves).
+ */
+typedef struct hashmap_str {
+    hashmap_str_node **buckets;
+    size_t size;
+    size_t capacity;
+    hashmap_str_chunk *chunks;
+    size_t arena_used;
+    size_t dead_bytes;
+    pair_value_cpy value_cpy;
+    pair_value_free value_free;
+} hashmap_str;
+
+/**
+ * Hashes a byte string, the hash hashmap_str uses for its keys.
+ * @param bytes the bytes of the string.
+ * @param len the number of bytes.
+ * @return the hash.
+ */
+size_t hashmap_str_hash (const char *bytes, size_t len);
+
+/**
+ * Allocates dynamically new byte strings hash map element.
+ * @param value_cpy, value_free copy and free functions for the values (NULL
+ * for storing the values themselves).
+ * @return pointer to dynamically allocated hashmap_str.
+ * @if_fail return NULL.
+ */
+hashmap_str *hashmap_str_alloc (pair_value_cpy value_cpy,
+                                pair_value_free value_free);
+
+/**
+ * Frees a byte strings hash map, its arena and the values in it.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_str.
+ */
+void hashmap_str_free (hashmap_str **p_map);
+
+/**
+ * Inserts a key and a copy of value to the map.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the key (may contain '\0').
+ * @param len the number of bytes in the key.
+ * @param value the value of the key.
+ * @return 1 if the key was inserted, 0 otherwise (e.g. it is in the map).
+ */
+int hashmap_str_insert (hashmap_str *map, const char *bytes, size_t len,
+                        const_valueT value);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the key.
+ * @param len the number of bytes in the key.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_str_at (const hashmap_str *map, const char *bytes, size_t len);
+
+/**
+ * The function erases the given key and its value.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the key.
+ * @param len the number of bytes in the key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_str_erase (hashmap_str *map, const char *bytes, size_t len);
+
+/**
+ * Returns the stored copy of a string, storing it (with a NULL value) if it
+ * is not in the map, so equal strings get the same pointer and can be
+ * compared by it.
+ * @param map a byte strings hash map.
+ * @param bytes the bytes of the string.
+ * @param len the number of bytes in the string.
+ * @return the stored bytes, followed by a '\0'. They are valid until the
+ * string is erased from the map.
+ * @if_fail return NULL.
+ */
+const char *hashmap_intern (hashmap_str *map, const char *bytes, size_t len);
+
+#endif //HASHMAP_STR_H_
@@ -0,0 +1,351 @@
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#include "hashmap_ttl.h"
+
+/**
+ * the default clock, the monotonic clock in milliseconds.
+ */
+static uint64_t monotonic_ms (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/**
+ * @return the expiry time of an entry that lives ttl ticks from now.
+ */
+static uint64_t expiry_time (uint64_t now, uint64_t ttl)
+{
+  if (ttl == HASH_MAP_TTL_NEVER)
+    {
+      return UINT64_MAX;
+    }
+  // UINT64_MAX is kept for never.
+  return ttl >= UINT64_MAX - now ? UINT64_MAX - 1 : now + ttl;
+}
+
+/**
+ * @return the slot of a time in the given level.
+ */
+static unsigned slot_of (uint64_t time, unsigned level)
+{
+  return (unsigned) (time >> (HASH_MAP_TTL_SLOT_BITS * level))
+         & (HASH_MAP_TTL_SLOTS - 1);
+}
+
+/**
+ * links an entry into the wheel: to the level of the highest bits group
+ * its expiry time differs from the time of the wheel in.
+ */
+static void link_entry (hashmap_ttl *map, hashmap_ttl_entry *entry)
+{
+  entry->prev = NULL;
+  entry->next = NULL;
+  if (entry->expires == UINT64_MAX)
+    {
+      return;
+    }
+  uint64_t diff = entry->expires ^ map->time;
+  entry->level = 0;
+  while (diff >= HASH_MAP_TTL_SLOTS)
+    {
+      diff >>= HASH_MAP_TTL_SLOT_BITS;
+      entry->level++;
+    }
+  entry->slot = slot_of (entry->expires, entry->level);
+  hashmap_ttl_entry **head = &map->slots[entry->level][entry->slot];
+  entry->next = *head;
+  if (*head != NULL)
+    {
+      (*head)->prev = entry;
+    }
+  *head = entry;
+  map->occupied[entry->level] |= (uint64_t) 1 << entry->slot;
+}
+
+/**
+ * unlinks an entry from the wheel.
+ */
+static void unlink_entry (hashmap_ttl *map, hashmap_ttl_entry *entry)
+{
+  if (entry->expires == UINT64_MAX)
+    {
+      return;
+    }
+  hashmap_ttl_entry **head = &map->slots[entry->level][entry->slot];
+  if (entry->prev != NULL)
+    {
+      entry->prev->next = entry->next;
+    }
+  else
+    {
+      *head = entry->next;
+    }
+  if (entry->next != NULL)
+    {
+      entry->next->prev = entry->prev;
+    }
+  if (*head == NULL)
+    {
+      map->occupied[entry->level] &= ~((uint64_t) 1 << entry->slot);
+    }
+}
+
+/**
+ * erases an entry from the map, with its pair (the entry is freed with the
+ * node of the pair).
+ */
+static void erase_entry (hashmap_ttl *map, hashmap_ttl_entry *entry)
+{
+  unlink_entry (map, entry);
+  hashmap_entry_erase (map->map, entry->entry);
+}
+
+/**
+ * @return the first time after the time of the wheel that some slot is
+ * reached at, UINT64_MAX if the wheel is empty.
+ */
+static uint64_t next_event (const hashmap_ttl *map)
+{
+  uint64_t next = UINT64_MAX;
+  for (unsigned level = 0; level < HASH_MAP_TTL_LEVELS; level++)
+    {
+      unsigned shift = HASH_MAP_TTL_SLOT_BITS * level;
+      unsigned cur = slot_of (map->time, level);
+      uint64_t later = cur + 1 >= HASH_MAP_TTL_SLOTS ? 0
+                       : map->occupied[level] & (~(uint64_t) 0 << (cur + 1));
+      if (later == 0)
+        {
+          continue;
+        }
+      // the time with the groups up to this level cleared, and the slot
+      // set in this level.
+      uint64_t base = 0;
+      if (shift + HASH_MAP_TTL_SLOT_BITS < 64)
+        {
+          base = map->time >> (shift + HASH_MAP_TTL_SLOT_BITS)
+                 << (shift + HASH_MAP_TTL_SLOT_BITS);
+        }
+      uint64_t time = base | (uint64_t) __builtin_ctzll (later) << shift;
+      if (time < next)
+        {
+          next = time;
+        }
+    }
+  return next;
+}
+
+/**
+ * Allocates dynamically new hash map with expiring entries.
+ * @param func a function which "hashes" keys.
+ * @param clock the clock of the map, NULL for the monotonic clock in
+ * milliseconds.
+ * @return pointer to dynamically allocated hashmap_ttl.
+ * @if_fail return NULL.
+ */
+hashmap_ttl *hashmap_ttl_alloc (hash_func func, ttl_clock clock)
+{
+  hashmap_ttl *map = calloc (1, sizeof *map);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->map = hashmap_alloc (func);
+  if (map->map == NULL
+      || !hashmap_set_node_extra (map->map, sizeof (hashmap_ttl_entry)))
+    {
+      hashmap_free (&map->map);
+      free (map);
+      return NULL;
+    }
+  map->clock = clock == NULL ? monotonic_ms : clock;
+  map->time = map->clock ();
+  return map;
+}
+
+/**
+ * Frees a hash map with expiring entries, and all the entries in it.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_ttl.
+ */
+void hashmap_ttl_free (hashmap_ttl **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  hashmap_free (&(*p_map)->map);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair which expires ttl ticks from now. An expired
+ * entry of the same key is replaced.
+ * @param map a hash map with expiring entries.
+ * @param in_pair a in_pair the map would contain.
+ * @param ttl the number of ticks the entry lives, HASH_MAP_TTL_NEVER for
+ * not expiring.
+ * @return returns 1 for successful insertion, 0 otherwise (e.g. the key is
+ * in the map).
+ */
+int hashmap_ttl_insert (hashmap_ttl *map, const pair *in_pair, uint64_t ttl)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  hashmap_ttl_expire (map, HASH_MAP_TTL_STEP_WORK);
+  uint64_t now = map->clock ();
+  hashmap_entry found = hashmap_find (map->map, in_pair->key);
+  if (found.pair != NULL)
+    {
+      hashmap_ttl_entry *old = hashmap_entry_extra (found);
+      if (old->expires > now)
+        {
+          return 0;
+        }
+      // the key is not in the map any more, and its hash is still good.
+      erase_entry (map, old);
+      found.pair = NULL;
+    }
+  found = hashmap_entry_insert (map->map, found, in_pair);
+  if (found.pair == NULL)
+    {
+      return 0;
+    }
+  hashmap_ttl_entry *entry = hashmap_entry_extra (found);
+  entry->entry = found;
+  entry->expires = expiry_time (now, ttl);
+  link_entry (map, entry);
+  return 1;
+}
+
+/**
+ * @return the entry of key if it has not expired, NULL otherwise (an
+ * expired entry is erased on the way).
+ */
+static hashmap_ttl_entry *find_live (hashmap_ttl *map, const_keyT key)
+{
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  hashmap_entry found = hashmap_find (map->map, key);
+  if (found.pair == NULL)
+    {
+      return NULL;
+    }
+  hashmap_ttl_entry *entry = hashmap_entry_extra (found);
+  if (entry->expires <= map->clock ())
+    {
+      erase_entry (map, entry);
+      return NULL;
+    }
+  return entry;
+}
+
+/**
+ * The function returns the value associated with the given key, if it has
+ * not expired (an expired entry is erased on the way).
+ * @param map a hash map with expiring entries.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_ttl_at (hashmap_ttl *map, const_keyT key)
+{
+  hashmap_ttl_entry *entry = find_live (map, key);
+  return entry == NULL ? NULL : entry->entry.pair->value;
+}
+
+/**
+ * Sets the entry of the given key to expire ttl ticks from now.
+ * @param map a hash map with expiring entries.
+ * @param key the key of the entry.
+ * @param ttl the number of ticks the entry lives, HASH_MAP_TTL_NEVER for
+ * not expiring.
+ * @return 1 if the key is in the map (and has not expired), 0 otherwise.
+ */
+int hashmap_ttl_refresh (hashmap_ttl *map, const_keyT key, uint64_t ttl)
+{
+  hashmap_ttl_entry *entry = find_live (map, key);
+  if (entry == NULL)
+    {
+      return 0;
+    }
+  unlink_entry (map, entry);
+  entry->expires = expiry_time (map->clock (), ttl);
+  link_entry (map, entry);
+  return 1;
+}
+
+/**
+ * The function erases the entry associated with key.
+ * @param map a hash map with expiring entries.
+ * @param key a key of the entry to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_ttl_erase (hashmap_ttl *map, const_keyT key)
+{
+  hashmap_ttl_entry *entry = find_live (map, key);
+  if (entry == NULL)
+    {
+      return 0;
+    }
+  erase_entry (map, entry);
+  return 1;
+}
+
+/**
+ * Reclaims the expired entries, up to max_work entries reclaimed or moved
+ * down the wheel. The next call goes on from where this one stopped.
+ * @param map a hash map with expiring entries.
+ * @param max_work the maximal number of entries to handle.
+ * @return the number of reclaimed entries.
+ */
+size_t hashmap_ttl_expire (hashmap_ttl *map, size_t max_work)
+{
+  if (map == NULL)
+    {
+      return 0;
+    }
+  uint64_t now = map->clock ();
+  size_t work = 0;
+  size_t reclaimed = 0;
+  while (work < max_work)
+    {
+      // the slots the wheel has reached in the upper levels are moved
+      // down, the entries in them differ from the time in lower bits only.
+      for (unsigned level = HASH_MAP_TTL_LEVELS - 1; level > 0; level--)
+        {
+          hashmap_ttl_entry **head =
+              &map->slots[level][slot_of (map->time, level)];
+          for (; *head != NULL && work < max_work; work++)
+            {
+              hashmap_ttl_entry *entry = *head;
+              unlink_entry (map, entry);
+              link_entry (map, entry);
+            }
+        }
+      // the entries in the reached slot of level 0 expire exactly now.
+      hashmap_ttl_entry **head = &map->slots[0][slot_of (map->time, 0)];
+      for (; *head != NULL && work < max_work; work++, reclaimed++)
+        {
+          erase_entry (map, *head);
+        }
+      if (*head != NULL || work >= max_work)
+        {
+          break;
+        }
+      // skip to the next slot with entries, but not after now.
+      uint64_t next = next_event (map);
+      if (next > now)
+        {
+          map->time = now;
+          break;
+        }
+      map->time = next;
+    }
+  return reclaimed;
+}
@@ -0,0 +1,160 @@
+#ifndef HASHMAP_TTL_H_
+#define HASHMAP_TTL_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/**
+ * @def HASH_MAP_TTL_SLOT_BITS
+ * log2 of the number of slots in every level of the timer wheel.
+ */
+#define HASH_MAP_TTL_SLOT_BITS 6
+
+/**
+ * @def HASH_MAP_TTL_SLOTS
+ * The number of slots in every level of the timer wheel.
+ */
+#define HASH_MAP_TTL_SLOTS (1 << HASH_MAP_TTL_SLOT_BITS)
+
+/**
+ * @def HASH_MAP_TTL_LEVELS
+ * The number of levels of the timer wheel, enough for any 64 bits expiry
+ * time (so no entry waits in an overflow list).
+ */
+#define HASH_MAP_TTL_LEVELS 11
+
+/**
+ * @def HASH_MAP_TTL_STEP_WORK
+ * The number of entries an insert expires (or moves down the wheel) on its
+ * way, so the expired entries are reclaimed even if
+ * hashmap_ttl_expire is never called.
+ */
+#define HASH_MAP_TTL_STEP_WORK 16UL
+
+/**
+ * @def HASH_MAP_TTL_NEVER
+ * The ttl of entries which do not expire.
+ */
+#define HASH_MAP_TTL_NEVER 0
+
+/**
+ * @typedef ttl_clock
+ * A function that returns the current time, in ticks of any unit
+ * (the ttl of the entries is in the same unit). It may not go back.
+ */
+typedef uint64_t (*ttl_clock) (void);
+
+/**
+ * @struct hashmap_ttl_entry
+ * The place of a pair of a hashmap_ttl in the timer wheel. It is kept in
+ * the extra bytes of the node of the pair (see hashmap_set_node_extra), so
+ * a stored pair is one allocation.
+ * @param prev, next the neighbours of the entry in its slot of the wheel
+ * (prev is NULL for the first one).
+ * @param entry handle to the pair of the entry in the map, so an expiry
+ * needs no lookup.
+ * @param expires the time the entry expires at, UINT64_MAX if never (and
+ * then the entry is not in the wheel).
+ * @param level, slot the slot of the wheel the entry is in.
+ */
+typedef struct hashmap_ttl_entry {
+    struct hashmap_ttl_entry *prev;
+    struct hashmap_ttl_entry *next;
+    hashmap_entry entry;
+    uint64_t expires;
+    unsigned level;
+    unsigned slot;
+} hashmap_ttl_entry;
+
+/**
+ * @struct hashmap_ttl
+ * A hash map whose entries expire. An expired entry is not found any more,
+ * and is reclaimed (with its key_free and value_free) by a hierarchical
+ * timer wheel, a bounded number of entries at a time.
+ * An entry is kept in the level of the highest HASH_MAP_TTL_SLOT_BITS bits
+ * group its expiry time differs from the time of the wheel in, so the wheel
+ * moves an entry down at most HASH_MAP_TTL_LEVELS times, and time with no
+ * expiring entries is skipped (with the occupied bitmaps).
+ * @param map the hash map of the pairs, its nodes have a hashmap_ttl_entry
+ * as their extra bytes.
+ * @param slots the lists of entries of every slot of every level.
+ * @param occupied for every level, a bit for every non empty slot.
+ * @param time the time of the wheel, all the entries before it were
+ * reclaimed.
+ * @param clock the clock of the map.
+ */
+typedef struct hashmap_ttl {
+    hashmap *map;
+    hashmap_ttl_entry *slots[HASH_MAP_TTL_LEVELS][HASH_MAP_TTL_SLOTS];
+    uint64_t occupied[HASH_MAP_TTL_LEVELS];
+    uint64_t time;
+    ttl_clock clock;
+} hashmap_ttl;
+
+/**
+ * Allocates dynamically new hash map with expiring entries.
+ * @param func a function which "hashes" keys.
+ * @param clock the clock of the map, NULL for the monotonic clock in
+ * milliseconds.
+ * @return pointer to dynamically allocated hashmap_ttl.
+ * @if_fail return NULL.
+ */
+hashmap_ttl *hashmap_ttl_alloc (hash_func func, ttl_clock clock);
+
+/**
+ * Frees a hash map with expiring entries, and all the entries in it.
+ * @param p_map pointer to dynamically allocated pointer to hashmap_ttl.
+ */
+void hashmap_ttl_free (hashmap_ttl **p_map);
+
+/**
+ * Inserts a copy of in_pair which expires ttl ticks from now. An expired
+ * entry of the same key is replaced.
+ * @param map a hash map with expiring entries.
+ * @param in_pair a in_pair the map would contain.
+ * @param ttl the number of ticks the entry lives, HASH_MAP_TTL_NEVER for
+ * not expiring.
+ * @return returns 1 for successful insertion, 0 otherwise (e.g. the key is
+ * in the map).
+ */
+int hashmap_ttl_insert (hashmap_ttl *map, const pair *in_pair, uint64_t ttl);
+
+/**
+ * The function returns the value associated with the given key, if it has
+ * not expired (an expired entry is erased on the way).
+ * @param map a hash map with expiring entries.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT hashmap_ttl_at (hashmap_ttl *map, const_keyT key);
+
+/**
+ * Sets the entry of the given key to expire ttl ticks from now.
+ * @param map a hash map with expiring entries.
+ * @param key the key of the entry.
+ * @param ttl the number of ticks the entry lives, HASH_MAP_TTL_NEVER for
+ * not expiring.
+ * @return 1 if the key is in the map (and has not expired), 0 otherwise.
+ */
+int hashmap_ttl_refresh (hashmap_ttl *map, const_keyT key, uint64_t ttl);
+
+/**
+ * The function erases the entry associated with key.
+ * @param map a hash map with expiring entries.
+ * @param key a key of the entry to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_ttl_erase (hashmap_ttl *map, const_keyT key);
+
+/**
+ * Reclaims the expired entries, up to max_work entries reclaimed or moved
+ * down the wheel. The next call goes on from where this one stopped.
+ * @param map a hash map with expiring entries.
+ * @param max_work the maximal number of entries to handle.
+ * @return the number of reclaimed entries.
+ */
+size_t hashmap_ttl_expire (hashmap_ttl *map, size_t max_work);
+
+#endif //HASHMAP_TTL_H_
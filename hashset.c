@@ -0,0 +1,325 @@
+#include "hashset.h"
+
+/**
+ * Allocates dynamically new hash set element.
+ * @param func a function which "hashes" keys.
+ * @param key_cpy, key_cmp, key_free copy, compare and free functions for
+ * the keys.
+ * @return pointer to dynamically allocated hashset.
+ * @if_fail return NULL.
+ */
+hashset *hashset_alloc (hash_func func, pair_key_cpy key_cpy,
+                        pair_key_cmp key_cmp, pair_key_free key_free)
+{
+  if (func == NULL || key_cpy == NULL || key_cmp == NULL || key_free == NULL)
+    {
+      return NULL;
+    }
+  hashset *set = malloc (sizeof *set);
+  if (set == NULL)
+    {
+      return NULL;
+    }
+  set->buckets = calloc (HASH_MAP_INITIAL_CAP, sizeof (hashset_node *));
+  if (set->buckets == NULL)
+    {
+      free (set);
+      return NULL;
+    }
+  set->size = 0;
+  set->capacity = HASH_MAP_INITIAL_CAP;
+  set->hash_func = func;
+  set->key_cpy = key_cpy;
+  set->key_cmp = key_cmp;
+  set->key_free = key_free;
+  return set;
+}
+
+/**
+ * Frees a hash set and the keys in it.
+ * @param p_set pointer to dynamically allocated pointer to hashset.
+ */
+void hashset_free (hashset **p_set)
+{
+  if (p_set == NULL || *p_set == NULL)
+    {
+      return;
+    }
+  for (size_t i = 0; i < (*p_set)->capacity; i++)
+    {
+      hashset_node *node = (*p_set)->buckets[i];
+      while (node != NULL)
+        {
+          hashset_node *next = node->next;
+          (*p_set)->key_free (&node->key);
+          free (node);
+          node = next;
+        }
+    }
+  free ((*p_set)->buckets);
+  free (*p_set);
+  *p_set = NULL;
+}
+
+/**
+ * @return the link to the node of key, NULL if the key is not in the set.
+ */
+static hashset_node **find_link (const hashset *set, const_keyT key,
+                                 size_t hash)
+{
+  size_t ind = hashmap_bucket_index (hash, 0, set->capacity);
+  for (hashset_node **link = &set->buckets[ind]; *link != NULL;
+       link = &(*link)->next)
+    {
+      if ((*link)->hash == hash && set->key_cmp ((*link)->key, key))
+        {
+          return link;
+        }
+    }
+  return NULL;
+}
+
+/**
+ * @return the hash of a key of src, for looking it up in set (the stored
+ * hash if the sets hash the same way).
+ */
+static size_t hash_for (const hashset *set, const hashset *src,
+                        const hashset_node *node)
+{
+  return set->hash_func == src->hash_func ? node->hash
+                                          : set->hash_func (node->key);
+}
+
+/**
+ * re-links the nodes of the set into new_capacity buckets.
+ * @return returns 1 for successful, 0 otherwise.
+ */
+static int resize_set (hashset *set, size_t new_capacity)
+{
+  hashset_node **new_buckets = calloc (new_capacity, sizeof (hashset_node *));
+  if (new_buckets == NULL)
+    {
+      return 0;
+    }
+  for (size_t i = 0; i < set->capacity; i++)
+    {
+      hashset_node *node = set->buckets[i];
+      while (node != NULL)
+        {
+          hashset_node *next = node->next;
+          size_t ind = hashmap_bucket_index (node->hash, 0, new_capacity);
+          node->next = new_buckets[ind];
+          new_buckets[ind] = node;
+          node = next;
+        }
+    }
+  free (set->buckets);
+  set->buckets = new_buckets;
+  set->capacity = new_capacity;
+  return 1;
+}
+
+/**
+ * inserts a copy of key, which is known not to be in the set.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+static int insert_new (hashset *set, const_keyT key, size_t hash)
+{
+  hashset_node *node = malloc (sizeof *node);
+  if (node == NULL)
+    {
+      return 0;
+    }
+  node->key = set->key_cpy (key);
+  if (node->key == NULL)
+    {
+      free (node);
+      return 0;
+    }
+  size_t ind = hashmap_bucket_index (hash, 0, set->capacity);
+  node->hash = hash;
+  node->next = set->buckets[ind];
+  set->buckets[ind] = node;
+  set->size++;
+  if (set->size / (double) set->capacity > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      resize_set (set, set->capacity * HASH_MAP_GROWTH_FACTOR);
+    }
+  return 1;
+}
+
+/**
+ * unlinks and frees the node of link, without re-sizing the set.
+ */
+static void erase_link (hashset *set, hashset_node **link)
+{
+  hashset_node *node = *link;
+  *link = node->next;
+  set->key_free (&node->key);
+  free (node);
+  set->size--;
+}
+
+/**
+ * shrinks the set to the smallest capacity that holds its keys.
+ */
+static void shrink_set (hashset *set)
+{
+  size_t new_capacity = HASH_MAP_INITIAL_CAP;
+  while (set->size / (double) new_capacity > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      new_capacity *= HASH_MAP_GROWTH_FACTOR;
+    }
+  if (new_capacity < set->capacity)
+    {
+      resize_set (set, new_capacity);
+    }
+}
+
+/**
+ * Inserts a copy of key to the hash set.
+ * @param set a hash set.
+ * @param key the key to insert.
+ * @return 1 if the key was inserted, 0 otherwise (e.g. it is in the set).
+ */
+int hashset_insert (hashset *set, const_keyT key)
+{
+  if (set == NULL || key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = set->hash_func (key);
+  if (find_link (set, key, hash) != NULL)
+    {
+      return 0;
+    }
+  return insert_new (set, key, hash);
+}
+
+/**
+ * Checks if a key is in the hash set.
+ * @param set a hash set.
+ * @param key the key to be checked.
+ * @return 1 if the key is in the set, 0 otherwise.
+ */
+int hashset_contains (const hashset *set, const_keyT key)
+{
+  if (set == NULL || key == NULL)
+    {
+      return 0;
+    }
+  return find_link (set, key, set->hash_func (key)) != NULL;
+}
+
+/**
+ * Erases a key from the hash set.
+ * @param set a hash set.
+ * @param key the key to erase.
+ * @return 1 if the key was erased, 0 otherwise (e.g. it is not in the set).
+ */
+int hashset_erase (hashset *set, const_keyT key)
+{
+  if (set == NULL || key == NULL)
+    {
+      return 0;
+    }
+  hashset_node **link = find_link (set, key, set->hash_func (key));
+  if (link == NULL)
+    {
+      return 0;
+    }
+  erase_link (set, link);
+  if (set->size / (double) set->capacity < HASH_MAP_MIN_LOAD_FACTOR
+      && set->capacity > HASH_MAP_INITIAL_CAP)
+    {
+      resize_set (set, set->capacity / HASH_MAP_GROWTH_FACTOR);
+    }
+  return 1;
+}
+
+/**
+ * Inserts all the keys of src into dst. When the sets have the same
+ * hash_func, the stored hashes of src are used, so no key is hashed again.
+ * @param dst the hash set to insert into.
+ * @param src the hash set to insert from, it is not changed.
+ * @return 1 if all the keys were inserted successfully, 0 otherwise.
+ */
+int hashset_union (hashset *dst, const hashset *src)
+{
+  if (dst == NULL || src == NULL)
+    {
+      return 0;
+    }
+  int res = 1;
+  for (size_t i = 0; i < src->capacity; i++)
+    {
+      for (const hashset_node *node = src->buckets[i]; node != NULL;
+           node = node->next)
+        {
+          size_t hash = hash_for (dst, src, node);
+          if (find_link (dst, node->key, hash) == NULL
+              && !insert_new (dst, node->key, hash))
+            {
+              res = 0;
+            }
+        }
+    }
+  return res;
+}
+
+/**
+ * erases from dst the keys whose being in src is equal to erase_found.
+ * @return the number of erased keys.
+ */
+static size_t erase_by (hashset *dst, const hashset *src, int erase_found)
+{
+  if (dst == NULL || src == NULL)
+    {
+      return 0;
+    }
+  size_t erased = 0;
+  for (size_t i = 0; i < dst->capacity; i++)
+    {
+      hashset_node **link = &dst->buckets[i];
+      while (*link != NULL)
+        {
+          int found = find_link (src, (*link)->key,
+                                 hash_for (src, dst, *link)) != NULL;
+          if (found == erase_found)
+            {
+              erase_link (dst, link);
+              erased++;
+            }
+          else
+            {
+              link = &(*link)->next;
+            }
+        }
+    }
+  shrink_set (dst);
+  return erased;
+}
+
+/**
+ * Erases from dst all the keys which are not in src, and then shrinks dst
+ * once (instead of once for every erase).
+ * @param dst the hash set to erase from.
+ * @param src the hash set to check in, it is not changed.
+ * @return the number of erased keys.
+ */
+size_t hashset_intersection (hashset *dst, const hashset *src)
+{
+  return erase_by (dst, src, 0);
+}
+
+/**
+ * Erases from dst all the keys which are in src, and then shrinks dst
+ * once (instead of once for every erase).
+ * @param dst the hash set to erase from.
+ * @param src the hash set to check in, it is not changed.
+ * @return the number of erased keys.
+ */
+size_t hashset_difference (hashset *dst, const hashset *src)
+{
+  return erase_by (dst, src, 1);
+}
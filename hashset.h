@@ -0,0 +1,110 @@
+#ifndef HASHSET_H_
+#define HASHSET_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * @struct hashset_node
+ * A key stored in the hash set, linked into the list of its bucket.
+ * @param next the next node in the bucket, NULL for the last one.
+ * @param hash the value hash_func returned for the key.
+ * @param key the stored key (a copy).
+ */
+typedef struct hashset_node {
+    struct hashset_node *next;
+    size_t hash;
+    keyT key;
+} hashset_node;
+
+/**
+ * @struct hashset
+ * A hash set: the buckets of a hashmap (with the same capacity, growth and
+ * load factors), but every node holds only a key, and the key functions
+ * are kept once in the set instead of in every pair.
+ * @param buckets dynamic array of lists of nodes, NULL for empty buckets.
+ * @param size the number of keys stored in the set.
+ * @param capacity the number of buckets, a power of 2.
+ * @param hash_func a function which "hashes" keys.
+ * @param key_cpy, key_cmp, key_free copy, compare and free functions for
+ * the keys.
+ */
+typedef struct hashset {
+    hashset_node **buckets;
+    size_t size;
+    size_t capacity;
+    hash_func hash_func;
+    pair_key_cpy key_cpy;
+    pair_key_cmp key_cmp;
+    pair_key_free key_free;
+} hashset;
+
+/**
+ * Allocates dynamically new hash set element.
+ * @param func a function which "hashes" keys.
+ * @param key_cpy, key_cmp, key_free copy, compare and free functions for
+ * the keys.
+ * @return pointer to dynamically allocated hashset.
+ * @if_fail return NULL.
+ */
+hashset *hashset_alloc (hash_func func, pair_key_cpy key_cpy,
+                        pair_key_cmp key_cmp, pair_key_free key_free);
+
+/**
+ * Frees a hash set and the keys in it.
+ * @param p_set pointer to dynamically allocated pointer to hashset.
+ */
+void hashset_free (hashset **p_set);
+
+/**
+ * Inserts a copy of key to the hash set.
+ * @param set a hash set.
+ * @param key the key to insert.
+ * @return 1 if the key was inserted, 0 otherwise (e.g. it is in the set).
+ */
+int hashset_insert (hashset *set, const_keyT key);
+
+/**
+ * Checks if a key is in the hash set.
+ * @param set a hash set.
+ * @param key the key to be checked.
+ * @return 1 if the key is in the set, 0 otherwise.
+ */
+int hashset_contains (const hashset *set, const_keyT key);
+
+/**
+ * Erases a key from the hash set.
+ * @param set a hash set.
+ * @param key the key to erase.
+ * @return 1 if the key was erased, 0 otherwise (e.g. it is not in the set).
+ */
+int hashset_erase (hashset *set, const_keyT key);
+
+/**
+ * Inserts all the keys of src into dst. When the sets have the same
+ * hash_func, the stored hashes of src are used, so no key is hashed again.
+ * @param dst the hash set to insert into.
+ * @param src the hash set to insert from, it is not changed.
+ * @return 1 if all the keys were inserted successfully, 0 otherwise.
+ */
+int hashset_union (hashset *dst, const hashset *src);
+
+/**
+ * Erases from dst all the keys which are not in src, and then shrinks dst
+ * once (instead of once for every erase).
+ * @param dst the hash set to erase from.
+ * @param src the hash set to check in, it is not changed.
+ * @return the number of erased keys.
+ */
+size_t hashset_intersection (hashset *dst, const hashset *src);
+
+/**
+ * Erases from dst all the keys which are in src, and then shrinks dst
+ * once (instead of once for every erase).
+ * @param dst the hash set to erase from.
+ * @param src the hash set to check in, it is not changed.
+ * @return the number of erased keys.
+ */
+size_t hashset_difference (hashset *dst, const hashset *src);
+
+#endif //HASHSET_H_
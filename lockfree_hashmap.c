@@ -0,0 +1,698 @@
+#include "lockfree_hashmap.h"
+
+/**
+ * @def ERASED
+ * Tags a slot whose pair was erased.
+ */
+#define ERASED ((uintptr_t) 1)
+
+/**
+ * @def FROZEN
+ * Tags a slot whose pair is being copied to the next table, the slot can
+ * not be changed anymore.
+ */
+#define FROZEN ((uintptr_t) 2)
+
+/**
+ * @def MOVED
+ * Tags a slot that was migrated to the next table (an empty slot is
+ * migrated to MOVED alone).
+ */
+#define MOVED ((uintptr_t) 4)
+
+/**
+ * @def RETRY
+ * Returned by the table operations when the operation has to be done again
+ * on the next table.
+ */
+#define RETRY (-1)
+
+/**
+ * @return the pair a slot points to, without the tags.
+ */
+static pair *untag (uintptr_t slot)
+{
+  return (pair *) (slot & ~(ERASED | FROZEN | MOVED));
+}
+
+/**
+ * @return the current state of the slot.
+ */
+static uintptr_t load_slot (lockfree_table *table, size_t i)
+{
+  return __atomic_load_n (&table->slots[i], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * changes the slot from *expected to desired, if no other thread changed
+ * it before.
+ * @return 1 if the slot was changed, otherwise 0 and *expected is set to
+ * the current state of the slot.
+ */
+static int cas_slot (lockfree_table *table, size_t i, uintptr_t *expected,
+                     uintptr_t desired)
+{
+  return __atomic_compare_exchange_n (&table->slots[i], expected, desired, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * allocates a table with capacity empty slots.
+ * @return the table, NULL if failed.
+ */
+static lockfree_table *table_alloc (size_t capacity)
+{
+  lockfree_table *table = calloc (1, sizeof *table);
+  if (table == NULL)
+    {
+      return NULL;
+    }
+  table->capacity = capacity;
+  table->slots = calloc (capacity, sizeof (uintptr_t));
+  table->hashes = calloc (capacity, sizeof (size_t));
+  if (table->slots == NULL || table->hashes == NULL)
+    {
+      free (table->slots);
+      free (table->hashes);
+      free (table);
+      return NULL;
+    }
+  return table;
+}
+
+/**
+ * frees a table and the pairs erased in it, and if free_live is 1 the
+ * pairs which are still in it too (the pairs of moved slots are freed in
+ * the table they were moved to).
+ */
+static void table_free (lockfree_table *table, int free_live)
+{
+  for (size_t i = 0; i < table->capacity; i++)
+    {
+      uintptr_t slot = table->slots[i];
+      pair *cur_pair = untag (slot);
+      if (cur_pair != NULL
+          && ((slot & ERASED) || (free_live && !(slot & MOVED))))
+        {
+          pair_free ((void **) &cur_pair);
+        }
+    }
+  free (table->slots);
+  free (table->hashes);
+  free (table);
+}
+
+/**
+ * starts an operation on the map: counts it in the current epoch, so the
+ * tables it may read are not freed until it ends.
+ * @return the epoch of the operation, for end_op.
+ */
+static size_t start_op (lockfree_hashmap *map)
+{
+  for (;;)
+    {
+      size_t epoch = __atomic_load_n (&map->epoch, __ATOMIC_SEQ_CST);
+      size_t *active = &map->active[epoch % LOCKFREE_HASH_MAP_EPOCHS];
+      __atomic_fetch_add (active, 1, __ATOMIC_SEQ_CST);
+      // counted in an epoch that already ended does not protect anything.
+      if (__atomic_load_n (&map->epoch, __ATOMIC_SEQ_CST) == epoch)
+        {
+          return epoch;
+        }
+      __atomic_fetch_sub (active, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * pushes a retired table to the list of the epoch it was retired in.
+ */
+static void push_retired (lockfree_hashmap *map, lockfree_table *table)
+{
+  lockfree_table **limbo =
+      &map->limbo[table->retired_epoch % LOCKFREE_HASH_MAP_EPOCHS];
+  table->retired = __atomic_load_n (limbo, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n (limbo, &table->retired, table, 1,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+/**
+ * retires a table no new operation can find (map->table moved past it), it
+ * is freed once the operations that may still read it are done.
+ */
+static void retire_table (lockfree_hashmap *map, lockfree_table *table)
+{
+  table->retired_epoch = __atomic_load_n (&map->epoch, __ATOMIC_SEQ_CST);
+  push_retired (map, table);
+}
+
+/**
+ * advances the epoch if there are retired tables and no operation runs in
+ * the epoch before the current one, and frees the tables retired two
+ * epochs ago or more (no operation which started before they were retired
+ * is running).
+ */
+static void reclaim (lockfree_hashmap *map)
+{
+  int retired = 0;
+  for (size_t e = 0; e < LOCKFREE_HASH_MAP_EPOCHS; e++)
+    {
+      retired = retired
+                || __atomic_load_n (&map->limbo[e], __ATOMIC_RELAXED) != NULL;
+    }
+  size_t epoch = __atomic_load_n (&map->epoch, __ATOMIC_SEQ_CST);
+  size_t before = (epoch + LOCKFREE_HASH_MAP_EPOCHS - 1)
+                  % LOCKFREE_HASH_MAP_EPOCHS;
+  if (!retired
+      || __atomic_load_n (&map->active[before], __ATOMIC_SEQ_CST) != 0
+      || !__atomic_compare_exchange_n (&map->epoch, &epoch, epoch + 1, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    {
+      return;
+    }
+  // the list of the new epoch holds the tables retired three epochs ago,
+  // and maybe some retired just now, which go back to it.
+  lockfree_table *table = __atomic_exchange_n (
+      &map->limbo[(epoch + 1) % LOCKFREE_HASH_MAP_EPOCHS], NULL,
+      __ATOMIC_ACQUIRE);
+  while (table != NULL)
+    {
+      lockfree_table *next = table->retired;
+      if (table->retired_epoch + 2 <= epoch + 1)
+        {
+          table_free (table, 0);
+        }
+      else
+        {
+          push_retired (map, table);
+        }
+      table = next;
+    }
+}
+
+/**
+ * ends an operation started by start_op, and frees what it can.
+ */
+static void end_op (lockfree_hashmap *map, size_t epoch)
+{
+  __atomic_fetch_sub (&map->active[epoch % LOCKFREE_HASH_MAP_EPOCHS], 1,
+                      __ATOMIC_SEQ_CST);
+  reclaim (map);
+}
+
+/**
+ * @return 1 if the (not empty) slot i holds a pair with the given key.
+ */
+static int same_key (lockfree_table *table, size_t i, uintptr_t slot,
+                     const_keyT key, size_t hash)
+{
+  // the hash is written after the slot is claimed, so 0 may mean it was
+  // not written yet.
+  size_t slot_hash = __atomic_load_n (&table->hashes[i], __ATOMIC_ACQUIRE);
+  const pair *cur_pair = untag (slot);
+  return (slot_hash == 0 || slot_hash == hash)
+         && cur_pair->key_cmp (cur_pair->key, key);
+}
+
+/**
+ * puts a pair of the migrated table in the next table. Only migrated pairs
+ * are put in a table before its migration is done, so the keys are
+ * different and two threads copying the same pair find each other's copy.
+ */
+static void copy_in (lockfree_table *table, pair *cur_pair, size_t hash)
+{
+  size_t mask = table->capacity - 1;
+  for (size_t i = hashmap_mix (hash) & mask, n = 0; n < table->capacity;
+       i = (i + 1) & mask, n++)
+    {
+      uintptr_t slot = 0;
+      if (cas_slot (table, i, &slot, (uintptr_t) cur_pair))
+        {
+          __atomic_store_n (&table->hashes[i], hash, __ATOMIC_RELEASE);
+          __atomic_fetch_add (&table->used, 1, __ATOMIC_RELAXED);
+          return;
+        }
+      if (untag (slot) == cur_pair)
+        {
+          return;
+        }
+    }
+}
+
+/**
+ * migrates slot i of the table to the next table: freezes the slot, copies
+ * its pair (if it is not erased) and marks the slot as moved. Any number of
+ * threads can migrate the same slot, the pair is copied once.
+ */
+static void migrate_slot (lockfree_hashmap *map, lockfree_table *table,
+                          size_t i)
+{
+  uintptr_t slot = load_slot (table, i);
+  while (!(slot & MOVED))
+    {
+      if (slot & FROZEN)
+        {
+          pair *cur_pair = untag (slot);
+          size_t hash = __atomic_load_n (&table->hashes[i], __ATOMIC_ACQUIRE);
+          if (hash == 0)
+            {
+              hash = map->hash_func (cur_pair->key);
+            }
+          copy_in (__atomic_load_n (&table->next, __ATOMIC_ACQUIRE), cur_pair,
+                   hash);
+          uintptr_t moved = (slot & ~FROZEN) | MOVED;
+          if (cas_slot (table, i, &slot, moved))
+            {
+              __atomic_fetch_add (&table->migrated, 1, __ATOMIC_RELEASE);
+              slot = moved;
+            }
+          continue;
+        }
+      // empty and erased slots have nothing to copy.
+      uintptr_t frozen = slot == 0 || (slot & ERASED) ? slot | MOVED
+                                                       : slot | FROZEN;
+      if (cas_slot (table, i, &slot, frozen))
+        {
+          if (frozen & MOVED)
+            {
+              __atomic_fetch_add (&table->migrated, 1, __ATOMIC_RELEASE);
+            }
+          slot = frozen;
+        }
+    }
+}
+
+/**
+ * helps the migration of the table to its next table until it is done: the
+ * thread takes chunks of slots that no thread took yet, and when there are
+ * none it migrates the slots that are still not moved (a thread which took
+ * them may be stopped).
+ * @return the next table.
+ */
+static lockfree_table *help_migrate (lockfree_hashmap *map,
+                                     lockfree_table *table)
+{
+  lockfree_table *next = __atomic_load_n (&table->next, __ATOMIC_ACQUIRE);
+  while (__atomic_load_n (&table->next_chunk, __ATOMIC_RELAXED)
+         < table->capacity)
+    {
+      size_t first = __atomic_fetch_add (&table->next_chunk,
+                                         LOCKFREE_HASH_MAP_MIGRATE_CHUNK,
+                                         __ATOMIC_RELAXED);
+      for (size_t i = first; i < table->capacity
+                             && i < first + LOCKFREE_HASH_MAP_MIGRATE_CHUNK;
+           i++)
+        {
+          migrate_slot (map, table, i);
+        }
+    }
+  if (__atomic_load_n (&table->migrated, __ATOMIC_ACQUIRE) < table->capacity)
+    {
+      for (size_t i = 0; i < table->capacity; i++)
+        {
+          migrate_slot (map, table, i);
+        }
+    }
+  lockfree_table *expected = table;
+  // sequentially consistent, so the epoch retire_table reads is not older
+  // than the table change.
+  if (__atomic_compare_exchange_n (&map->table, &expected, next, 0,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+    {
+      // no operation that starts from now on can find the table.
+      retire_table (map, table);
+    }
+  return next;
+}
+
+/**
+ * starts the migration of the table to a new one (twice bigger, unless
+ * most of the used slots are erased pairs), and helps it.
+ * @return 1 for success, 0 if the new table could not be allocated.
+ */
+static int start_migrate (lockfree_hashmap *map, lockfree_table *table)
+{
+  lockfree_table *next = __atomic_load_n (&table->next, __ATOMIC_ACQUIRE);
+  if (next == NULL)
+    {
+      // every slot is copied at most once, so the new table can hold all
+      // the copies even if it has the same capacity.
+      size_t size = __atomic_load_n (&map->size, __ATOMIC_RELAXED);
+      size_t capacity = size * 8 < table->capacity
+                        ? table->capacity
+                        : table->capacity * HASH_MAP_GROWTH_FACTOR;
+      lockfree_table *new_table = table_alloc (capacity);
+      if (new_table == NULL)
+        {
+          return 0;
+        }
+      if (!__atomic_compare_exchange_n (&table->next, &next, new_table, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+          // another thread started the migration first.
+          free (new_table->slots);
+          free (new_table->hashes);
+          free (new_table);
+        }
+    }
+  help_migrate (map, table);
+  return 1;
+}
+
+/**
+ * @return the current table of the map, after helping the migrations that
+ * are not done yet.
+ */
+static lockfree_table *current_table (lockfree_hashmap *map)
+{
+  lockfree_table *table = __atomic_load_n (&map->table, __ATOMIC_ACQUIRE);
+  while (__atomic_load_n (&table->next, __ATOMIC_ACQUIRE) != NULL)
+    {
+      table = help_migrate (map, table);
+    }
+  return table;
+}
+
+/**
+ * inserts the pair to the table, if its key is not there.
+ * @return 1 if inserted, 0 if the key exists or the insertion failed,
+ * RETRY if it should be done on the next table.
+ */
+static int table_insert (lockfree_hashmap *map, lockfree_table *table,
+                         pair *new_pair, size_t hash)
+{
+  if (__atomic_load_n (&table->used, __ATOMIC_RELAXED)
+      >= table->capacity * LOCKFREE_HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      return start_migrate (map, table) ? RETRY : 0;
+    }
+  size_t mask = table->capacity - 1;
+  for (size_t i = hashmap_mix (hash) & mask, n = 0; n < table->capacity;
+       i = (i + 1) & mask, n++)
+    {
+      uintptr_t slot = load_slot (table, i);
+      if (slot == 0 && cas_slot (table, i, &slot, (uintptr_t) new_pair))
+        {
+          __atomic_store_n (&table->hashes[i], hash, __ATOMIC_RELEASE);
+          __atomic_fetch_add (&table->used, 1, __ATOMIC_RELAXED);
+          __atomic_fetch_add (&map->size, 1, __ATOMIC_RELAXED);
+          return 1;
+        }
+      // the slot is taken (maybe by another thread just now).
+      if (slot & (FROZEN | MOVED))
+        {
+          help_migrate (map, table);
+          return RETRY;
+        }
+      if (!(slot & ERASED) && same_key (table, i, slot, new_pair->key, hash))
+        {
+          return 0;
+        }
+    }
+  return start_migrate (map, table) ? RETRY : 0;
+}
+
+/**
+ * finds the pair of the key in the table.
+ * @return 1 if found (and sets *found), 0 if not, RETRY if it should be
+ * looked up in the next table.
+ */
+static int table_at (lockfree_hashmap *map, lockfree_table *table,
+                     const_keyT key, size_t hash, const pair **found)
+{
+  size_t mask = table->capacity - 1;
+  for (size_t i = hashmap_mix (hash) & mask, n = 0; n < table->capacity;
+       i = (i + 1) & mask, n++)
+    {
+      uintptr_t slot = load_slot (table, i);
+      if (slot == 0)
+        {
+          return 0;
+        }
+      if (slot & MOVED)
+        {
+          help_migrate (map, table);
+          return RETRY;
+        }
+      // a frozen pair is still valid, it is the same pair in the next table.
+      if (!(slot & ERASED) && same_key (table, i, slot, key, hash))
+        {
+          *found = untag (slot);
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/**
+ * marks the pair of the key in the table as erased.
+ * @return 1 if erased, 0 if the key is not in the table, RETRY if it
+ * should be erased from the next table.
+ */
+static int table_erase (lockfree_hashmap *map, lockfree_table *table,
+                        const_keyT key, size_t hash)
+{
+  size_t mask = table->capacity - 1;
+  for (size_t i = hashmap_mix (hash) & mask, n = 0; n < table->capacity;
+       i = (i + 1) & mask, n++)
+    {
+      uintptr_t slot = load_slot (table, i);
+      // a failed compare-and-swap reloads the slot, which is checked again.
+      while (slot != 0 && !(slot & (FROZEN | MOVED | ERASED))
+             && same_key (table, i, slot, key, hash))
+        {
+          if (cas_slot (table, i, &slot, slot | ERASED))
+            {
+              __atomic_fetch_sub (&map->size, 1, __ATOMIC_RELAXED);
+              return 1;
+            }
+        }
+      if (slot == 0)
+        {
+          return 0;
+        }
+      if (slot & (FROZEN | MOVED))
+        {
+          help_migrate (map, table);
+          return RETRY;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Allocates dynamically new lock-free hash map element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated lockfree_hashmap.
+ * @if_fail return NULL.
+ */
+lockfree_hashmap *lockfree_hashmap_alloc (hash_func func)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  lockfree_hashmap *map = malloc (sizeof *map);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->table = table_alloc (LOCKFREE_HASH_MAP_INITIAL_CAP);
+  if (map->table == NULL)
+    {
+      free (map);
+      return NULL;
+    }
+  map->size = 0;
+  map->hash_func = func;
+  map->epoch = 0;
+  for (size_t e = 0; e < LOCKFREE_HASH_MAP_EPOCHS; e++)
+    {
+      map->active[e] = 0;
+      map->limbo[e] = NULL;
+    }
+  return map;
+}
+
+/**
+ * Frees a lock-free hash map, its tables and all the pairs it stored
+ * (including the erased ones that were not freed yet). No other thread may
+ * use the map while it is freed.
+ * @param p_map pointer to dynamically allocated pointer to lockfree_hashmap.
+ */
+void lockfree_hashmap_free (lockfree_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  // the current table may still be chained to migrated tables, whose last
+  // table holds the pairs.
+  lockfree_table *table = (*p_map)->table;
+  while (table != NULL)
+    {
+      lockfree_table *next = table->next;
+      table_free (table, next == NULL);
+      table = next;
+    }
+  for (size_t e = 0; e < LOCKFREE_HASH_MAP_EPOCHS; e++)
+    {
+      table = (*p_map)->limbo[e];
+      while (table != NULL)
+        {
+          lockfree_table *next = table->retired;
+          table_free (table, 0);
+          table = next;
+        }
+    }
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair to the lock-free hash map, if its key is not
+ * in the map. Safe to call from many threads at once.
+ * @param map the lock-free hash map to be inserted with new element.
+ * @param in_pair a in_pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int lockfree_hashmap_insert (lockfree_hashmap *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = map->hash_func (in_pair->key);
+  pair *new_pair = pair_copy (in_pair);
+  if (new_pair == NULL)
+    {
+      return 0;
+    }
+  size_t epoch = start_op (map);
+  int res;
+  do
+    {
+      res = table_insert (map, current_table (map), new_pair, hash);
+    }
+  while (res == RETRY);
+  end_op (map, epoch);
+  if (!res)
+    {
+      // the copy was not published, so no other thread can see it.
+      pair_free ((void **) &new_pair);
+    }
+  return res;
+}
+
+/**
+ * looks the key up and returns its value, or a copy of it if copy is 1
+ * (made while the operation still keeps the pair from being freed).
+ */
+static valueT find_value (lockfree_hashmap *map, const_keyT key, int copy)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  size_t hash = map->hash_func (key);
+  const pair *found = NULL;
+  size_t epoch = start_op (map);
+  while (table_at (map, current_table (map), key, hash, &found) == RETRY)
+    {
+    }
+  valueT value = NULL;
+  if (found != NULL)
+    {
+      value = copy ? found->value_cpy (found->value) : found->value;
+    }
+  end_op (map, epoch);
+  return value;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * Safe to call from many threads at once.
+ * @param map a lock-free hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself, not a copy of it: it is valid until the key is erased,
+ * see lockfree_hashmap_get for keys other threads erase).
+ */
+valueT lockfree_hashmap_at (lockfree_hashmap *map, const_keyT key)
+{
+  return find_value (map, key, 0);
+}
+
+/**
+ * Returns a copy of the value associated with the given key, which stays
+ * valid when another thread erases the key right after.
+ * Safe to call from many threads at once.
+ * @param map a lock-free hash map.
+ * @param key the key to be checked.
+ * @return a copy (made by the value_cpy of the pair) of the value
+ * associated with key if exists, NULL otherwise. The caller frees it with
+ * the value_free of the pair.
+ */
+valueT lockfree_hashmap_get (lockfree_hashmap *map, const_keyT key)
+{
+  return find_value (map, key, 1);
+}
+
+/**
+ * The function marks the pair associated with key as erased (it is freed
+ * with its table, after the table is migrated). Safe to call from many
+ * threads at once.
+ * @param map a lock-free hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int lockfree_hashmap_erase (lockfree_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = map->hash_func (key);
+  size_t epoch = start_op (map);
+  int res;
+  do
+    {
+      res = table_erase (map, current_table (map), key, hash);
+    }
+  while (res == RETRY);
+  end_op (map, epoch);
+  return res;
+}
+
+/**
+ * Returns the number of pairs in the lock-free hash map.
+ * @param map a lock-free hash map.
+ * @return the number of pairs (0 if map is NULL).
+ */
+size_t lockfree_hashmap_size (lockfree_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return 0;
+    }
+  return __atomic_load_n (&map->size, __ATOMIC_RELAXED);
+}
+
+/**
+ * This function returns the load factor of the lock-free hash map.
+ * @param map a lock-free hash map.
+ * @return the map's load factor, -1 if the function failed.
+ */
+double lockfree_hashmap_get_load_factor (lockfree_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return -1;
+    }
+  size_t epoch = start_op (map);
+  lockfree_table *table = __atomic_load_n (&map->table, __ATOMIC_ACQUIRE);
+  double load_factor = lockfree_hashmap_size (map) / (double) table->capacity;
+  end_op (map, epoch);
+  return load_factor;
+}
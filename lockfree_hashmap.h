@@ -0,0 +1,169 @@
+#ifndef LOCKFREE_HASHMAP_H_
+#define LOCKFREE_HASHMAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/**
+ * @def LOCKFREE_HASH_MAP_INITIAL_CAP
+ * The initial number of slots of the lock-free hash map.
+ */
+#define LOCKFREE_HASH_MAP_INITIAL_CAP 16UL
+
+/**
+ * @def LOCKFREE_HASH_MAP_MAX_LOAD_FACTOR
+ * The maximal part of the slots that can be used (also by erased pairs),
+ * above it the pairs are migrated to a new table.
+ */
+#define LOCKFREE_HASH_MAP_MAX_LOAD_FACTOR 0.5
+
+/**
+ * @def LOCKFREE_HASH_MAP_MIGRATE_CHUNK
+ * The number of slots a thread takes at once when it helps a migration.
+ */
+#define LOCKFREE_HASH_MAP_MIGRATE_CHUNK 256UL
+
+/**
+ * @def LOCKFREE_HASH_MAP_EPOCHS
+ * The number of epochs the map tells apart to reclaim its old tables (an
+ * operation sees at most the epoch it started in and the next one, and a
+ * third one is being freed).
+ */
+#define LOCKFREE_HASH_MAP_EPOCHS 3
+
+/**
+ * @struct lockfree_table
+ * An open addressing (linear probing) table of the lock-free hash map.
+ * A slot is claimed once, by a compare-and-swap from empty to the pair, and
+ * is never emptied again: an erased pair is only marked as erased. So all
+ * the threads see the pairs of a key in the same order, and a table which
+ * gets too full is migrated to a new one (next), by all the threads that
+ * use it.
+ * @param slots array of capacity pair pointers, tagged with the state of
+ * the slot in their low bits.
+ * @param hashes the hashes of the pairs in slots (0 until it is written).
+ * @param capacity the number of slots, a power of 2.
+ * @param used the number of claimed slots.
+ * @param next_chunk the first slot that no thread took for migration yet.
+ * @param migrated the number of slots that were migrated to next.
+ * @param next the table the pairs are migrated to, NULL if none.
+ * @param retired the next table in the list of retired tables.
+ * @param retired_epoch the epoch of the map when the table was retired.
+ */
+typedef struct lockfree_table {
+    uintptr_t *slots;
+    size_t *hashes;
+    size_t capacity;
+    size_t used;
+    size_t next_chunk;
+    size_t migrated;
+    struct lockfree_table *next;
+    struct lockfree_table *retired;
+    size_t retired_epoch;
+} lockfree_table;
+
+/**
+ * @struct lockfree_hashmap
+ * A hash map which threads can insert to, look up and erase from at the
+ * same time, without locks: a thread never waits for another one, it helps
+ * it instead.
+ * Memory is reclaimed by epochs: every operation counts itself in the
+ * epoch it started in, a table that was migrated is retired, and it is
+ * freed (with the pairs erased in it) once the epoch advanced twice, so no
+ * operation that could still read it is running. An erased pair stays in
+ * its slot until its table is migrated (tombstones fill the table, so a
+ * churning map migrates regularly), so the memory of the map is bounded by
+ * its tables. The limit: a thread stopped in the middle of an operation
+ * stops the epoch, and nothing is freed until it goes on.
+ * @param table the current table, the newer ones are chained by their next.
+ * @param size the number of elements (pairs) stored in the map.
+ * @param hash_func a function which "hashes" keys.
+ * @param epoch the current epoch.
+ * @param active for every epoch (modulo LOCKFREE_HASH_MAP_EPOCHS), the
+ * number of operations running in it.
+ * @param limbo for every epoch (modulo LOCKFREE_HASH_MAP_EPOCHS), the list
+ * of tables retired in it, linked by their retired.
+ */
+typedef struct lockfree_hashmap {
+    lockfree_table *table;
+    size_t size;
+    hash_func hash_func;
+    size_t epoch;
+    size_t active[LOCKFREE_HASH_MAP_EPOCHS];
+    lockfree_table *limbo[LOCKFREE_HASH_MAP_EPOCHS];
+} lockfree_hashmap;
+
+/**
+ * Allocates dynamically new lock-free hash map element.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated lockfree_hashmap.
+ * @if_fail return NULL.
+ */
+lockfree_hashmap *lockfree_hashmap_alloc (hash_func func);
+
+/**
+ * Frees a lock-free hash map, its tables and all the pairs it stored
+ * (including the erased ones that were not freed yet). No other thread may
+ * use the map while it is freed.
+ * @param p_map pointer to dynamically allocated pointer to lockfree_hashmap.
+ */
+void lockfree_hashmap_free (lockfree_hashmap **p_map);
+
+/**
+ * Inserts a copy of in_pair to the lock-free hash map, if its key is not
+ * in the map. Safe to call from many threads at once.
+ * @param map the lock-free hash map to be inserted with new element.
+ * @param in_pair a in_pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int lockfree_hashmap_insert (lockfree_hashmap *map, const pair *in_pair);
+
+/**
+ * The function returns the value associated with the given key.
+ * Safe to call from many threads at once.
+ * @param map a lock-free hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself, not a copy of it: it is valid until the key is erased,
+ * see lockfree_hashmap_get for keys other threads erase).
+ */
+valueT lockfree_hashmap_at (lockfree_hashmap *map, const_keyT key);
+
+/**
+ * Returns a copy of the value associated with the given key, which stays
+ * valid when another thread erases the key right after.
+ * Safe to call from many threads at once.
+ * @param map a lock-free hash map.
+ * @param key the key to be checked.
+ * @return a copy (made by the value_cpy of the pair) of the value
+ * associated with key if exists, NULL otherwise. The caller frees it with
+ * the value_free of the pair.
+ */
+valueT lockfree_hashmap_get (lockfree_hashmap *map, const_keyT key);
+
+/**
+ * The function marks the pair associated with key as erased (it is freed
+ * with its table, after the table is migrated). Safe to call from many
+ * threads at once.
+ * @param map a lock-free hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int lockfree_hashmap_erase (lockfree_hashmap *map, const_keyT key);
+
+/**
+ * Returns the number of pairs in the lock-free hash map.
+ * @param map a lock-free hash map.
+ * @return the number of pairs (0 if map is NULL).
+ */
+size_t lockfree_hashmap_size (lockfree_hashmap *map);
+
+/**
+ * This function returns the load factor of the lock-free hash map.
+ * @param map a lock-free hash map.
+ * @return the map's load factor, -1 if the function failed.
+ */
+double lockfree_hashmap_get_load_factor (lockfree_hashmap *map);
+
+#endif //LOCKFREE_HASHMAP_H_
@@ -14,7 +14,29 @@ pair *pair_alloc (
     const pair_key_cmp key_cmp, const pair_value_cmp value_cmp,
     const pair_key_free key_free, const pair_value_free value_free)
 {
-  pair *p = malloc (sizeof (pair));
+  return pair_alloc_with_allocator (key, value, key_cpy, value_cpy, key_cmp,
+                                    value_cmp, key_free, value_free, NULL);
+}
+
+/**
+ * Allocates dynamically a new pair with the given allocator (the key and
+ * the value are still copied by key_cpy and value_cpy).
+ * @param key, value - the key and value.
+ * @param key_cpy, value_cpy - copy functions for key and value.
+ * @param key_cmp, value_cmp - compare functions for key and value.
+ * @param key_free, value_free - free functions for key and value.
+ * @param alloc - the allocator of the pair, NULL for malloc. It must live
+ * as long as the pair (and its copies).
+ * @return dynamically allocated pair.
+ */
+pair *pair_alloc_with_allocator (
+    const_keyT key, const_valueT value,
+    const pair_key_cpy key_cpy, const pair_value_cpy value_cpy,
+    const pair_key_cmp key_cmp, const pair_value_cmp value_cmp,
+    const pair_key_free key_free, const pair_value_free value_free,
+    const allocator *alloc)
+{
+  pair *p = allocator_alloc (alloc, sizeof (pair));
   if (p == NULL){
     return NULL;
   }
@@ -26,11 +48,13 @@ pair *pair_alloc (
   p->value_cmp = value_cmp;
   p->key_free = key_free;
   p->value_free = value_free;
+  p->allocator = alloc;
   return p;
 }
 
 /**
- * Creates a new (dynamically allocated) copy of the given old_pair.
+ * Creates a new (dynamically allocated) copy of the given old_pair, with
+ * the allocator of old_pair.
  * @param old_pair old_pair to be copied.
  * @return new dynamically allocated old_pair if succeeded, NULL otherwise.
  */
@@ -41,10 +65,10 @@ void *pair_copy (const void *p)
       return NULL;
     }
   const pair *old_pair = (const pair *) p;
-  pair *new_pair = pair_alloc (old_pair->key, old_pair->value,
-                               old_pair->key_cpy, old_pair->value_cpy,
-                               old_pair->key_cmp, old_pair->value_cmp,
-                               old_pair->key_free, old_pair->value_free);
+  pair *new_pair = pair_alloc_with_allocator (
+      old_pair->key, old_pair->value, old_pair->key_cpy, old_pair->value_cpy,
+      old_pair->key_cmp, old_pair->value_cmp, old_pair->key_free,
+      old_pair->value_free, old_pair->allocator);
   return new_pair;
 }
 
@@ -64,6 +88,28 @@ int pair_cmp (const void *p1, const void *p2)
   return key_cmp && val_cmp;
 }
 
+/**
+ * The value_cpy of pairs whose value is owned by the structure that stores
+ * them (e.g. the runs of hashmap_multi): the value was already allocated,
+ * so it is kept as is. Only the value_free of such pairs is their own.
+ * @param value the value.
+ * @return value itself.
+ */
+valueT pair_value_keep (const_valueT value)
+{
+  return (valueT) value;
+}
+
+/**
+ * The value_cmp of pairs whose value is owned (see pair_value_keep).
+ * @param value1, value2 the values.
+ * @return 1 if they are the same value, 0 else.
+ */
+int pair_value_same (const_valueT value1, const_valueT value2)
+{
+  return value1 == value2;
+}
+
 /**
  * This function frees a pair and everything it allocated dynamically.
  * @param p_pair pointer to dynamically allocated pair to be freed.
@@ -78,6 +124,6 @@ void pair_free (void ** p)
   pair **p_pair = (pair **) p;
   (*p_pair)->key_free (&(*p_pair)->key);
   (*p_pair)->value_free (&(*p_pair)->value);
-  free (*p_pair);
+  allocator_free ((*p_pair)->allocator, *p_pair, sizeof (pair));
   *p_pair = NULL;
 }
@@ -2,6 +2,7 @@
 #define PAIR_H_
 
 #include <stdlib.h>
+#include "allocator.h"
 
 /**
  * @typedef keyT, valueT, const_keyT, const_valueT
@@ -39,6 +40,8 @@ typedef void (*pair_value_free) (valueT *);
  * @param key_cpy, value_cpy - copy functions for key and value.
  * @param key_cmp, value_cmp - compare functions for key and value.
  * @param key_free, value_free - free functions for key and value.
+ * @param allocator - the allocator the pair itself was allocated with
+ * (NULL for malloc), its copies are allocated with it too.
  */
 typedef struct pair {
     keyT key;
@@ -49,6 +52,7 @@ typedef struct pair {
     pair_value_cmp value_cmp;
     pair_key_free key_free;
     pair_value_free value_free;
+    const allocator *allocator;
 } pair;
 
 /**
@@ -66,7 +70,26 @@ pair *pair_alloc (
     pair_key_free key_free, pair_value_free value_free);
 
 /**
- * Creates a new (dynamically allocated) copy of the given old_pair.
+ * Allocates dynamically a new pair with the given allocator (the key and
+ * the value are still copied by key_cpy and value_cpy).
+ * @param key, value - the key and value.
+ * @param key_cpy, value_cpy - copy functions for key and value.
+ * @param key_cmp, value_cmp - compare functions for key and value.
+ * @param key_free, value_free - free functions for key and value.
+ * @param alloc - the allocator of the pair, NULL for malloc. It must live
+ * as long as the pair (and its copies).
+ * @return dynamically allocated pair.
+ */
+pair *pair_alloc_with_allocator (
+    const_keyT key, const_valueT value,
+    pair_key_cpy key_cpy, pair_value_cpy value_cpy,
+    pair_key_cmp key_cmp, pair_value_cmp value_cmp,
+    pair_key_free key_free, pair_value_free value_free,
+    const allocator *alloc);
+
+/**
+ * Creates a new (dynamically allocated) copy of the given old_pair, with
+ * the allocator of old_pair.
  * @param old_pair old_pair to be copied.
  * @return new dynamically allocated old_pair if succeeded, NULL otherwise.
  */
@@ -80,6 +103,22 @@ void *pair_copy (const void *p);
  */
 int pair_cmp(const void *p1, const void *p2);
 
+/**
+ * The value_cpy of pairs whose value is owned by the structure that stores
+ * them (e.g. the runs of hashmap_multi): the value was already allocated,
+ * so it is kept as is. Only the value_free of such pairs is their own.
+ * @param value the value.
+ * @return value itself.
+ */
+valueT pair_value_keep (const_valueT value);
+
+/**
+ * The value_cmp of pairs whose value is owned (see pair_value_keep).
+ * @param value1, value2 the values.
+ * @return 1 if they are the same value, 0 else.
+ */
+int pair_value_same (const_valueT value1, const_valueT value2);
+
 /**
  * This function frees a pair and everything it allocated dynamically.
  * @param p_pair pointer to dynamically allocated pair to be freed.
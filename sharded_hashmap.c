@@ -0,0 +1,329 @@
+#include "sharded_hashmap.h"
+
+/**
+ * Allocates dynamically new sharded hash map element.
+ * @param func a function which "hashes" keys.
+ * @param n_shards the number of shards, rounded up to a power of 2
+ * (0 for SHARDED_HASH_MAP_DEFAULT_SHARDS).
+ * @return pointer to dynamically allocated sharded_hashmap.
+ * @if_fail return NULL.
+ */
+sharded_hashmap *sharded_hashmap_alloc (hash_func func, size_t n_shards)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  if (n_shards == 0)
+    {
+      n_shards = SHARDED_HASH_MAP_DEFAULT_SHARDS;
+    }
+  sharded_hashmap *map = malloc (sizeof *map);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->n_shards = 1;
+  map->shard_bits = 0;
+  while (map->n_shards < n_shards)
+    {
+      map->n_shards *= 2;
+      map->shard_bits++;
+    }
+  map->hash_func = func;
+  map->shards = calloc (map->n_shards, sizeof (hashmap_shard));
+  if (map->shards == NULL)
+    {
+      free (map);
+      return NULL;
+    }
+  for (size_t i = 0; i < map->n_shards; i++)
+    {
+      map->shards[i].map = hashmap_alloc (func);
+      if (map->shards[i].map == NULL
+          || pthread_mutex_init (&map->shards[i].lock, NULL) != 0)
+        {
+          hashmap_free (&map->shards[i].map);
+          // free the shards that were already created.
+          map->n_shards = i;
+          sharded_hashmap_free (&map);
+          return NULL;
+        }
+    }
+  return map;
+}
+
+/**
+ * Frees a sharded hash map and the elements it allocated.
+ * No other thread may use the map while it is freed.
+ * @param p_map pointer to dynamically allocated pointer to sharded_hashmap.
+ */
+void sharded_hashmap_free (sharded_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  for (size_t i = 0; i < (*p_map)->n_shards; i++)
+    {
+      hashmap_free (&(*p_map)->shards[i].map);
+      pthread_mutex_destroy (&(*p_map)->shards[i].lock);
+    }
+  free ((*p_map)->shards);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Returns the shard a key belongs to.
+ * @param map a sharded hash map.
+ * @param key a key.
+ * @return the shard of the key, NULL if failed.
+ */
+hashmap_shard *sharded_hashmap_shard (const sharded_hashmap *map,
+                                      const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  if (map->shard_bits == 0)
+    {
+      return &map->shards[0];
+    }
+  // the hash maps of the shards use the low bits of the hash, so the
+  // shard is chosen by the high bits.
+  size_t hash = hashmap_mix (map->hash_func (key));
+  return &map->shards[hash >> (sizeof (size_t) * 8 - map->shard_bits)];
+}
+
+/**
+ * Inserts a copy of in_pair to the sharded hash map (see hashmap_insert).
+ * @param map the sharded hash map to be inserted with new element.
+ * @param in_pair a in_pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int sharded_hashmap_insert (sharded_hashmap *map, const pair *in_pair)
+{
+  if (in_pair == NULL)
+    {
+      return 0;
+    }
+  hashmap_shard *shard = sharded_hashmap_shard (map, in_pair->key);
+  if (shard == NULL)
+    {
+      return 0;
+    }
+  pthread_mutex_lock (&shard->lock);
+  int res = hashmap_insert (shard->map, in_pair);
+  pthread_mutex_unlock (&shard->lock);
+  return res;
+}
+
+/**
+ * Returns a copy of the value associated with the given key.
+ * @param map a sharded hash map.
+ * @param key the key to be checked.
+ * @return a copy (made by the value_cpy of the pair) of the value
+ * associated with key if exists, NULL otherwise. The caller frees it with
+ * the value_free of the pair.
+ */
+valueT sharded_hashmap_get (sharded_hashmap *map, const_keyT key)
+{
+  hashmap_shard *shard = sharded_hashmap_shard (map, key);
+  if (shard == NULL)
+    {
+      return NULL;
+    }
+  valueT value = NULL;
+  pthread_mutex_lock (&shard->lock);
+  hashmap_entry entry = hashmap_find (shard->map, key);
+  if (entry.pair != NULL)
+    {
+      value = entry.pair->value_cpy (entry.pair->value);
+    }
+  pthread_mutex_unlock (&shard->lock);
+  return value;
+}
+
+/**
+ * Modifies the value associated with the given key in-place, while the
+ * shard of the key is locked.
+ * @param map a sharded hash map.
+ * @param key the key of the value to be modified.
+ * @param val_func a function that modifies valueT, in-place.
+ * @return 1 if the key is in the map, 0 otherwise.
+ */
+int sharded_hashmap_update (sharded_hashmap *map, const_keyT key,
+                            valueT_func val_func)
+{
+  hashmap_shard *shard = sharded_hashmap_shard (map, key);
+  if (shard == NULL || val_func == NULL)
+    {
+      return 0;
+    }
+  pthread_mutex_lock (&shard->lock);
+  valueT value = hashmap_at (shard->map, key);
+  if (value != NULL)
+    {
+      val_func (value);
+    }
+  pthread_mutex_unlock (&shard->lock);
+  return value != NULL;
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a sharded hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int sharded_hashmap_erase (sharded_hashmap *map, const_keyT key)
+{
+  hashmap_shard *shard = sharded_hashmap_shard (map, key);
+  if (shard == NULL)
+    {
+      return 0;
+    }
+  pthread_mutex_lock (&shard->lock);
+  int res = hashmap_erase (shard->map, key);
+  pthread_mutex_unlock (&shard->lock);
+  return res;
+}
+
+/**
+ * merges the pairs of src grouped by shard, so every shard is locked only
+ * once. If move_src is src, the merged pairs are erased from it.
+ * @return 1 if all the pairs were merged successfully, 0 otherwise.
+ */
+static int merge_by_shard (sharded_hashmap *map, const hashmap *src,
+                           valueT_combine combine, hashmap *move_src)
+{
+  // group the pairs by shard (counting sort), starts[i] is the first pair
+  // of shard i.
+  size_t n = src->size;
+  size_t *starts = calloc (map->n_shards + 1, sizeof (size_t));
+  const pair **pairs = malloc ((n + 1) * sizeof (pair *));
+  hashmap_shard **shards = malloc ((n + 1) * sizeof (hashmap_shard *));
+  int grouped = starts != NULL && pairs != NULL && shards != NULL;
+  for (size_t i = 0, k = 0; grouped && i < src->capacity; i++)
+    {
+      for (const hashmap_node *node = src->buckets[i]; node != NULL;
+           node = node->next, k++)
+        {
+          shards[k] = sharded_hashmap_shard (map, node->pair.key);
+          starts[shards[k] - map->shards + 1]++;
+        }
+    }
+  for (size_t i = 0; grouped && i < map->n_shards; i++)
+    {
+      starts[i + 1] += starts[i];
+    }
+  for (size_t i = 0, k = 0; grouped && i < src->capacity; i++)
+    {
+      for (const hashmap_node *node = src->buckets[i]; node != NULL;
+           node = node->next, k++)
+        {
+          pairs[starts[shards[k] - map->shards]++] = &node->pair;
+        }
+    }
+  // starts[i] is now the end of shard i, so shard i is
+  // [starts[i - 1], starts[i]).
+  int res = grouped;
+  for (size_t i = 0; grouped && i < map->n_shards; i++)
+    {
+      size_t first = i == 0 ? 0 : starts[i - 1];
+      if (first == starts[i])
+        {
+          continue;
+        }
+      pthread_mutex_lock (&map->shards[i].lock);
+      for (size_t k = first; k < starts[i]; k++)
+        {
+          if (hashmap_upsert (map->shards[i].map, pairs[k], combine).pair
+              == NULL)
+            {
+              res = 0;
+              // kept in move_src, to be merged again.
+              pairs[k] = NULL;
+            }
+        }
+      pthread_mutex_unlock (&map->shards[i].lock);
+    }
+  if (move_src != NULL && res)
+    {
+      hashmap_clear (move_src);
+    }
+  else if (move_src != NULL && grouped)
+    {
+      // the nodes are not moved by the erases, and a key is read before
+      // its node is freed.
+      for (size_t k = 0; k < n; k++)
+        {
+          if (pairs[k] != NULL)
+            {
+              hashmap_erase (move_src, pairs[k]->key);
+            }
+        }
+    }
+  free (shards);
+  free (pairs);
+  free (starts);
+  return res;
+}
+
+/**
+ * Merges all the pairs of src into the sharded hash map (see hashmap_merge).
+ * The pairs of src are grouped by shard first, so every shard is locked
+ * only once.
+ * @param map the sharded hash map to merge into.
+ * @param src the hash map to merge from, it is not changed.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged successfully, 0 otherwise.
+ */
+int sharded_hashmap_merge (sharded_hashmap *map, const hashmap *src,
+                           valueT_combine combine)
+{
+  if (map == NULL || src == NULL || combine == NULL)
+    {
+      return 0;
+    }
+  return merge_by_shard (map, src, combine, NULL);
+}
+
+/**
+ * Merges all the pairs of src into the sharded hash map like
+ * sharded_hashmap_merge, and erases the merged pairs from src. If some pair
+ * fails, src keeps exactly the pairs that were not merged (see
+ * hashmap_merge_move).
+ * @param map the sharded hash map to merge into.
+ * @param src the hash map to merge from.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged (and src is empty), 0 otherwise.
+ */
+int sharded_hashmap_merge_move (sharded_hashmap *map, hashmap *src,
+                                valueT_combine combine)
+{
+  if (map == NULL || src == NULL || combine == NULL)
+    {
+      return 0;
+    }
+  return merge_by_shard (map, src, combine, src);
+}
+
+/**
+ * Returns the number of pairs in all the shards.
+ * @param map a sharded hash map.
+ * @return the number of pairs (0 if map is NULL).
+ */
+size_t sharded_hashmap_size (sharded_hashmap *map)
+{
+  size_t size = 0;
+  for (size_t i = 0; map != NULL && i < map->n_shards; i++)
+    {
+      pthread_mutex_lock (&map->shards[i].lock);
+      size += map->shards[i].map->size;
+      pthread_mutex_unlock (&map->shards[i].lock);
+    }
+  return size;
+}
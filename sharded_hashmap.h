@@ -0,0 +1,139 @@
+#ifndef SHARDED_HASHMAP_H_
+#define SHARDED_HASHMAP_H_
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "hashmap.h"
+
+/**
+ * @def SHARDED_HASH_MAP_DEFAULT_SHARDS
+ * The number of shards used when 0 shards are requested.
+ */
+#define SHARDED_HASH_MAP_DEFAULT_SHARDS 16UL
+
+/**
+ * @struct hashmap_shard
+ * @param lock protects the map of the shard.
+ * @param map an independent hash map, which is re-sized on its own.
+ */
+typedef struct hashmap_shard {
+    pthread_mutex_t lock;
+    hashmap *map;
+} hashmap_shard;
+
+/**
+ * @struct sharded_hashmap
+ * A hash map which can be shared between threads: the keys are split
+ * between n_shards independent hash maps by the high bits of their
+ * (mixed) hash, each with its own lock. So threads working on different
+ * shards do not wait for each other, and a re-size blocks only one shard.
+ * @param shards array of n_shards shards.
+ * @param n_shards the number of shards, a power of 2.
+ * @param shard_bits log2 of n_shards.
+ * @param hash_func a function which "hashes" keys.
+ */
+typedef struct sharded_hashmap {
+    hashmap_shard *shards;
+    size_t n_shards;
+    unsigned shard_bits;
+    hash_func hash_func;
+} sharded_hashmap;
+
+/**
+ * Allocates dynamically new sharded hash map element.
+ * @param func a function which "hashes" keys.
+ * @param n_shards the number of shards, rounded up to a power of 2
+ * (0 for SHARDED_HASH_MAP_DEFAULT_SHARDS).
+ * @return pointer to dynamically allocated sharded_hashmap.
+ * @if_fail return NULL.
+ */
+sharded_hashmap *sharded_hashmap_alloc (hash_func func, size_t n_shards);
+
+/**
+ * Frees a sharded hash map and the elements it allocated.
+ * No other thread may use the map while it is freed.
+ * @param p_map pointer to dynamically allocated pointer to sharded_hashmap.
+ */
+void sharded_hashmap_free (sharded_hashmap **p_map);
+
+/**
+ * Returns the shard a key belongs to.
+ * @param map a sharded hash map.
+ * @param key a key.
+ * @return the shard of the key, NULL if failed.
+ */
+hashmap_shard *sharded_hashmap_shard (const sharded_hashmap *map,
+                                      const_keyT key);
+
+/**
+ * Inserts a copy of in_pair to the sharded hash map (see hashmap_insert).
+ * @param map the sharded hash map to be inserted with new element.
+ * @param in_pair a in_pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int sharded_hashmap_insert (sharded_hashmap *map, const pair *in_pair);
+
+/**
+ * Returns a copy of the value associated with the given key.
+ * The stored value itself is not returned, since another thread may
+ * erase it right after the shard is unlocked.
+ * @param map a sharded hash map.
+ * @param key the key to be checked.
+ * @return a copy (made by the value_cpy of the pair) of the value
+ * associated with key if exists, NULL otherwise. The caller frees it with
+ * the value_free of the pair.
+ */
+valueT sharded_hashmap_get (sharded_hashmap *map, const_keyT key);
+
+/**
+ * Modifies the value associated with the given key in-place, while the
+ * shard of the key is locked.
+ * @param map a sharded hash map.
+ * @param key the key of the value to be modified.
+ * @param val_func a function that modifies valueT, in-place.
+ * @return 1 if the key is in the map, 0 otherwise.
+ */
+int sharded_hashmap_update (sharded_hashmap *map, const_keyT key,
+                            valueT_func val_func);
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a sharded hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int sharded_hashmap_erase (sharded_hashmap *map, const_keyT key);
+
+/**
+ * Merges all the pairs of src into the sharded hash map (see hashmap_merge).
+ * The pairs of src are grouped by shard first, so every shard is locked
+ * only once.
+ * @param map the sharded hash map to merge into.
+ * @param src the hash map to merge from, it is not changed.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged successfully, 0 otherwise.
+ */
+int sharded_hashmap_merge (sharded_hashmap *map, const hashmap *src,
+                           valueT_combine combine);
+
+/**
+ * Merges all the pairs of src into the sharded hash map like
+ * sharded_hashmap_merge, and erases the merged pairs from src. If some pair
+ * fails, src keeps exactly the pairs that were not merged (see
+ * hashmap_merge_move).
+ * @param map the sharded hash map to merge into.
+ * @param src the hash map to merge from.
+ * @param combine a function which combines a value into the stored value.
+ * @return 1 if all the pairs were merged (and src is empty), 0 otherwise.
+ */
+int sharded_hashmap_merge_move (sharded_hashmap *map, hashmap *src,
+                                valueT_combine combine);
+
+/**
+ * Returns the number of pairs in all the shards.
+ * @param map a sharded hash map.
+ * @return the number of pairs (0 if map is NULL).
+ */
+size_t sharded_hashmap_size (sharded_hashmap *map);
+
+#endif //SHARDED_HASHMAP_H_
@@ -42,6 +42,16 @@ int int_key_cmp (const_keyT key_1, const_keyT key_2)
   return *(int *) key_1 == *(int *) key_2;
 }
 
+/**
+ * Orders the int keys of the pairs.
+ */
+int int_key_order (const_keyT key_1, const_keyT key_2)
+{
+  int a = *(int *) key_1;
+  int b = *(int *) key_2;
+  return (a > b) - (a < b);
+}
+
 /**
  * Compares the int value of the pair.
  */
@@ -83,6 +93,24 @@ void int_value_free (valueT *val)
     }
 }
 
+/**
+ * @return the number of bytes of the char key of the pair.
+ */
+size_t char_key_size (const void *key)
+{
+  (void) key;
+  return sizeof (char);
+}
+
+/**
+ * @return the number of bytes of the int value of the pair.
+ */
+size_t int_value_size (const void *value)
+{
+  (void) value;
+  return sizeof (int);
+}
+
 /**
  * @param elem pointer to a char (keyT of pair_char_int)
  * @return 1 if the char represents a digit, else - 0
@@ -122,5 +150,26 @@ void double_value (valueT elem)
   *((int *) elem) *= 2;
 }
 
+/**
+ * adds an integer to the integer pointed to by the given pointer
+ * @param elem pointer to an integer (the stored value)
+ * @param other pointer to the integer to add
+ */
+void add_value (valueT elem, const_valueT other)
+{
+  *((int *) elem) += *((const int *) other);
+}
+
+/**
+ * A copy function which fails, as if it could not allocate the copy.
+ * @param value the value to copy (ignored).
+ * @return NULL.
+ */
+void *failing_value_cpy (const_valueT value)
+{
+  (void) value;
+  return NULL;
+}
+
 
 #endif //_TEST_PAIRS_H_
@@ -1,3 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "test_suite.h"
 #include "hash_funcs.h"
 #include "test_pairs.h"
@@ -76,7 +81,7 @@ void test_key_null ()
 {
   int val = 2;
   pair null_pair = {NULL, &val, char_key_cpy, int_value_cpy, char_key_cmp,
-                    int_value_cmp, char_key_free, int_value_free};
+                    int_value_cmp, char_key_free, int_value_free, NULL};
 
   // Create hash-map and inserts elements into it, using pair_char_int.h
   hashmap *map = hashmap_alloc (hash_char);
@@ -130,13 +135,11 @@ void test_insert_to_same_vec ()
     {
       if (k == 12)
         {
-          assert(map->buckets[0]->size == 12);
-          assert(map->buckets[0]->capacity == 16);
+          assert(hashmap_bucket_size (map, 0) == 12);
         }
       hashmap_insert (map, pairs[k]);
     }
-  assert(map->buckets[0]->size == 13);
-  assert(map->buckets[0]->capacity == 32);
+  assert(hashmap_bucket_size (map, 0) == 13);
   assert(map->size == 13);
   assert(map->capacity == 32);
   hashmap_free (&map);
@@ -202,34 +205,34 @@ void test_rehash_map(){
   for (int k = 0; k < 13; ++k)
     {
       if (k == 12){
-        assert(map->buckets[0]->size == 1);
-        assert(map->buckets[1]->size == 1);
-        assert(map->buckets[6]->size == 1);
-        assert(map->buckets[7]->size == 1);
-        assert(map->buckets[8]->size == 1);
-        assert(map->buckets[9]->size == 1);
-        assert(map->buckets[10]->size == 1);
-        assert(map->buckets[11]->size == 1);
-        assert(map->buckets[12]->size == 1);
-        assert(map->buckets[13]->size == 1);
-        assert(map->buckets[14]->size == 1);
-        assert(map->buckets[15]->size == 1);
+        assert(hashmap_bucket_size (map, 0) == 1);
+        assert(hashmap_bucket_size (map, 1) == 1);
+        assert(hashmap_bucket_size (map, 6) == 1);
+        assert(hashmap_bucket_size (map, 7) == 1);
+        assert(hashmap_bucket_size (map, 8) == 1);
+        assert(hashmap_bucket_size (map, 9) == 1);
+        assert(hashmap_bucket_size (map, 10) == 1);
+        assert(hashmap_bucket_size (map, 11) == 1);
+        assert(hashmap_bucket_size (map, 12) == 1);
+        assert(hashmap_bucket_size (map, 13) == 1);
+        assert(hashmap_bucket_size (map, 14) == 1);
+        assert(hashmap_bucket_size (map, 15) == 1);
       }
       hashmap_insert (map, pairs[k]);
     }
-  assert(map->buckets[6]->size == 1);
-  assert(map->buckets[7]->size == 1);
-  assert(map->buckets[8]->size == 1);
-  assert(map->buckets[9]->size == 1);
-  assert(map->buckets[10]->size == 1);
-  assert(map->buckets[11]->size == 1);
-  assert(map->buckets[12]->size == 1);
-  assert(map->buckets[13]->size == 1);
-  assert(map->buckets[14]->size == 1);
-  assert(map->buckets[15]->size == 1);
-  assert(map->buckets[16]->size == 1);
-  assert(map->buckets[17]->size == 1);
-  assert(map->buckets[18]->size == 1);
+  assert(hashmap_bucket_size (map, 6) == 1);
+  assert(hashmap_bucket_size (map, 7) == 1);
+  assert(hashmap_bucket_size (map, 8) == 1);
+  assert(hashmap_bucket_size (map, 9) == 1);
+  assert(hashmap_bucket_size (map, 10) == 1);
+  assert(hashmap_bucket_size (map, 11) == 1);
+  assert(hashmap_bucket_size (map, 12) == 1);
+  assert(hashmap_bucket_size (map, 13) == 1);
+  assert(hashmap_bucket_size (map, 14) == 1);
+  assert(hashmap_bucket_size (map, 15) == 1);
+  assert(hashmap_bucket_size (map, 16) == 1);
+  assert(hashmap_bucket_size (map, 17) == 1);
+  assert(hashmap_bucket_size (map, 18) == 1);
 
   assert(map->size == 13 && map->capacity == 32);
   hashmap_free (&map);
@@ -265,7 +268,7 @@ void test_insert_pairs_to_different_vectors ()
   assert(map->size == 16 && map->capacity == 32);
   for (int k = 0; k < 16; ++k)
     {
-      assert(map->buckets[k]->size == 1);
+      assert(hashmap_bucket_size (map, k) == 1);
     }
   hashmap_free (&map);
   for (int k = 0; k < 16; k++)
@@ -483,15 +486,14 @@ void test_erase_exist_key ()
     {
       hashmap_insert (map, pairs[k]);
     }
-  assert(map->buckets[0]->size == 2);
+  assert(hashmap_bucket_size (map, 0) == 2);
   assert(hashmap_erase (map, &new_key) == 1);
-  assert(map->buckets[0]->size == 1);
-  assert(map->buckets[0]->capacity == 8);
+  assert(hashmap_bucket_size (map, 0) == 1);
   assert(map->capacity == 16);
   char key = (char) 0;
   assert(hashmap_erase (map, &key) == 1);
-  assert(map->buckets[0]->size == 0);
-  assert(map->buckets[0]->capacity == 4);
+  // the emptied bucket is not kept.
+  assert(map->buckets[0] == NULL);
   for (int k = 0; k < 11; ++k)
     {
       pair_free ((void **) &pairs[k]);
@@ -896,3 +898,2696 @@ void test_hash_map_apply_if ()
   test_apply_on_value ();
   test_apply_change_items ();
 }
+
+void test_find_returns_stored_entry ()
+{
+  pair *pairs[10];
+  for (int j = 0; j < 10; ++j)
+    {
+      char key = (char) (j);
+      int value = j;
+      pairs[j] = pair_alloc (&key, &value, char_key_cpy, int_value_cpy,
+                             char_key_cmp,
+                             int_value_cmp, char_key_free, int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  hashmap *map = hashmap_alloc (hash_char);
+  if (map == NULL){return;}
+  for (int k = 0; k < 9; ++k)
+    {
+      hashmap_insert (map, pairs[k]);
+    }
+  for (int k = 0; k < 9; ++k)
+    {
+      hashmap_entry entry = hashmap_find (map, pairs[k]->key);
+      assert(entry.pair != NULL);
+      assert(*(char *) entry.pair->key == (char) k);
+      assert(entry.pair->value == hashmap_at (map, pairs[k]->key));
+      assert(entry.hash == hash_char (pairs[k]->key));
+    }
+  // update through the handle, and check the map sees it.
+  hashmap_entry entry = hashmap_find (map, pairs[4]->key);
+  *(int *) entry.pair->value = 40;
+  assert(*(int *) hashmap_at (map, pairs[4]->key) == 40);
+  assert(hashmap_find (map, pairs[9]->key).pair == NULL);
+  assert(hashmap_find (map, NULL).pair == NULL);
+  for (int k = 0; k < 10; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+  hashmap_free (&map);
+}
+
+void test_entry_stays_valid ()
+{
+  pair *pairs[6];
+  for (int j = 0; j < 6; ++j)
+    {
+      char key = (char) (j);
+      int value = j;
+      pairs[j] = pair_alloc (&key, &value, char_key_cpy, int_value_cpy,
+                             char_key_cmp,
+                             int_value_cmp, char_key_free, int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  // all the pairs in the same bucket, so erasing shifts the others.
+  hashmap *map = hashmap_alloc (hash_zero);
+  if (map == NULL){return;}
+  for (int k = 0; k < 6; ++k)
+    {
+      hashmap_insert (map, pairs[k]);
+    }
+  hashmap_entry entry = hashmap_find (map, pairs[5]->key);
+  assert(hashmap_erase (map, pairs[0]->key) == 1);
+  assert(map->capacity == 16);
+  assert(entry.pair == hashmap_find (map, pairs[5]->key).pair);
+  assert(hashmap_entry_erase (map, entry) == 1);
+  assert(hashmap_at (map, pairs[5]->key) == NULL);
+  assert(map->size == 4);
+  assert(hashmap_entry_erase (map, hashmap_find (map, pairs[5]->key)) == 0);
+  assert(hashmap_entry_erase (NULL, entry) == 0);
+  for (int k = 0; k < 6; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks the hashmap_find and hashmap_entry_erase functions of
+ * the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_find (void)
+{
+  test_find_returns_stored_entry ();
+  test_entry_stays_valid ();
+}
+
+void test_view_of_saved_map ()
+{
+  pair *pairs[30];
+  for (int j = 0; j < 30; ++j)
+    {
+      char key = (char) (j);
+      int value = j * 3;
+      pairs[j] = pair_alloc (&key, &value, char_key_cpy, int_value_cpy,
+                             char_key_cmp,
+                             int_value_cmp, char_key_free, int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  hashmap *map = hashmap_alloc (hash_char);
+  if (map == NULL){return;}
+  for (int k = 0; k < 25; ++k)
+    {
+      hashmap_insert (map, pairs[k]);
+    }
+  const char *path = "test_hash_map_view.snapshot";
+  assert(hashmap_save (map, path, char_key_size, int_value_size) == 1);
+  hashmap_view *view = hashmap_view_open (path, hash_char, char_key_cmp);
+  assert(view != NULL);
+  assert(view->size == 25 && view->capacity == map->capacity);
+  for (int k = 0; k < 25; ++k)
+    {
+      assert(*(const int *) hashmap_view_at (view, pairs[k]->key) == k * 3);
+    }
+  for (int k = 25; k < 30; ++k)
+    {
+      assert(hashmap_view_at (view, pairs[k]->key) == NULL);
+    }
+  assert(hashmap_view_at (view, NULL) == NULL);
+  hashmap_view_close (&view);
+  assert(view == NULL);
+  remove (path);
+  for (int k = 0; k < 30; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+  hashmap_free (&map);
+}
+
+void test_view_bad_file ()
+{
+  assert(hashmap_save (NULL, "x", char_key_size, int_value_size) == 0);
+  assert(hashmap_view_open ("test_hash_map_view.missing", hash_char,
+                            char_key_cmp) == NULL);
+  const char *path = "test_hash_map_view.snapshot";
+  hashmap *map = hashmap_alloc (hash_char);
+  if (map == NULL){return;}
+  assert(hashmap_save (map, path, char_key_size, int_value_size) == 1);
+  hashmap_view *view = hashmap_view_open (path, hash_char, char_key_cmp);
+  assert(view != NULL && view->size == 0);
+  char key = 'a';
+  assert(hashmap_view_at (view, &key) == NULL);
+  hashmap_view_close (&view);
+  // a file which is not a snapshot.
+  FILE *file = fopen (path, "wb");
+  assert(file != NULL);
+  fputs ("not a hash map snapshot file", file);
+  fclose (file);
+  assert(hashmap_view_open (path, hash_char, char_key_cmp) == NULL);
+  remove (path);
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks the hashmap_save and hashmap_view functions of the
+ * hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_view (void)
+{
+  test_view_of_saved_map ();
+  test_view_bad_file ();
+}
+
+void test_dump_and_load ()
+{
+  pair *pairs[200];
+  for (int j = 0; j < 200; ++j)
+    {
+      int key = j * 7;
+      int value = j;
+      pairs[j] = pair_alloc (&key, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int k = 0; k < 200; ++k)
+    {
+      hashmap_insert (map, pairs[k]);
+    }
+  FILE *file = tmpfile ();
+  assert(file != NULL);
+  int fd = fileno (file);
+  assert(hashmap_dump (map, fd, int_value_size, int_value_size) == 1);
+
+  hashmap *loaded = hashmap_alloc (hash_int);
+  if (loaded == NULL){return;}
+  assert(lseek (fd, 0, SEEK_SET) == 0);
+  assert(hashmap_load (loaded, fd, pairs[0]) == 1);
+  // the table was sized once from the header.
+  assert(loaded->size == 200 && loaded->capacity == map->capacity);
+  for (int k = 0; k < 200; ++k)
+    {
+      assert(*(int *) hashmap_at (loaded, pairs[k]->key) == k);
+    }
+  // corrupt one byte of the payload, the checksum should catch it.
+  assert(lseek (fd, 40, SEEK_SET) == 40);
+  char byte = 0x7f;
+  assert(write (fd, &byte, 1) == 1);
+  hashmap *corrupted = hashmap_alloc (hash_int);
+  if (corrupted == NULL){return;}
+  assert(lseek (fd, 0, SEEK_SET) == 0);
+  assert(hashmap_load (corrupted, fd, pairs[0]) == 0);
+  assert(hashmap_load (corrupted, fd, NULL) == 0);
+  // a count the file cannot hold is rejected before anything is reserved.
+  uint64_t count = UINT64_MAX;
+  assert(pwrite (fd, &count, sizeof count, sizeof (uint64_t))
+         == sizeof count);
+  hashmap *huge = hashmap_alloc (hash_int);
+  if (huge == NULL){return;}
+  assert(lseek (fd, 0, SEEK_SET) == 0);
+  assert(hashmap_load (huge, fd, pairs[0]) == 0);
+  assert(huge->size == 0 && huge->capacity == HASH_MAP_INITIAL_CAP);
+  hashmap_free (&huge);
+  fclose (file);
+  for (int k = 0; k < 200; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+  hashmap_free (&corrupted);
+  hashmap_free (&loaded);
+  hashmap_free (&map);
+}
+
+void test_reserve ()
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  assert(hashmap_reserve (map, 12) == 1 && map->capacity == 16);
+  assert(hashmap_reserve (map, 13) == 1 && map->capacity == 32);
+  assert(hashmap_reserve (map, 100) == 1 && map->capacity == 256);
+  assert(hashmap_reserve (NULL, 1) == 0);
+  // no capacity holds so many pairs, and the map is left as it was.
+  assert(hashmap_reserve (map, SIZE_MAX) == 0 && map->capacity == 256);
+  assert(hashmap_reserve (map, SIZE_MAX / 2) == 0 && map->capacity == 256);
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks the hashmap_dump, hashmap_load and hashmap_reserve
+ * functions of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_dump (void)
+{
+  test_reserve ();
+  test_dump_and_load ();
+}
+
+void test_freeze_map ()
+{
+  pair *pairs[1000];
+  for (int j = 0; j < 1000; ++j)
+    {
+      int key = j * 13;
+      int value = j;
+      pairs[j] = pair_alloc (&key, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int k = 0; k < 900; ++k)
+    {
+      hashmap_insert (map, pairs[k]);
+    }
+  frozen_hashmap *frozen = hashmap_freeze (map);
+  assert(frozen != NULL && frozen->size == 900);
+  // the frozen map does not depend on the original one.
+  hashmap_free (&map);
+  for (int k = 0; k < 900; ++k)
+    {
+      assert(*(int *) frozen_hashmap_at (frozen, pairs[k]->key) == k);
+    }
+  for (int k = 900; k < 1000; ++k)
+    {
+      assert(frozen_hashmap_at (frozen, pairs[k]->key) == NULL);
+    }
+  frozen_hashmap_free (&frozen);
+  assert(frozen == NULL);
+  for (int k = 0; k < 1000; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+}
+
+void test_freeze_empty_and_colliding ()
+{
+  hashmap *map = hashmap_alloc (hash_zero);
+  if (map == NULL){return;}
+  frozen_hashmap *frozen = hashmap_freeze (map);
+  assert(frozen != NULL);
+  int key = 3;
+  assert(frozen_hashmap_at (frozen, &key) == NULL);
+  frozen_hashmap_free (&frozen);
+  // hash_zero gives all the keys the same hash, so no perfect hash exists.
+  pair *pairs[2];
+  for (int j = 0; j < 2; ++j)
+    {
+      int value = j;
+      pairs[j] = pair_alloc (&j, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+      hashmap_insert (map, pairs[j]);
+    }
+  assert(hashmap_freeze (map) == NULL);
+  assert(hashmap_freeze (NULL) == NULL);
+  for (int k = 0; k < 2; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+  hashmap_free (&map);
+}
+
+void test_freeze_failed_copy ()
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int key = 0; key < 100; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  // the freeze fails, and frees the pairs it copied before.
+  int key = 50;
+  hashmap_find (map, &key).pair->value_cpy = failing_value_cpy;
+  assert(hashmap_freeze (map) == NULL);
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks the hashmap_freeze function and the frozen_hashmap
+ * of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_freeze (void)
+{
+  test_freeze_map ();
+  test_freeze_empty_and_colliding ();
+  test_freeze_failed_copy ();
+}
+
+void test_cuckoo_insert_at_erase ()
+{
+  pair *pairs[500];
+  for (int j = 0; j < 500; ++j)
+    {
+      int key = j * 5;
+      int value = j;
+      pairs[j] = pair_alloc (&key, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  cuckoo_hashmap *map = cuckoo_hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int k = 0; k < 400; ++k)
+    {
+      assert(cuckoo_hashmap_insert (map, pairs[k]) == 1);
+      assert(cuckoo_hashmap_get_load_factor (map) <= 0.9);
+    }
+  assert(cuckoo_hashmap_insert (map, pairs[0]) == 0);
+  assert(map->size == 400);
+  for (int k = 0; k < 400; ++k)
+    {
+      assert(*(int *) cuckoo_hashmap_at (map, pairs[k]->key) == k);
+    }
+  for (int k = 400; k < 500; ++k)
+    {
+      assert(cuckoo_hashmap_at (map, pairs[k]->key) == NULL);
+    }
+  for (int k = 0; k < 400; k += 2)
+    {
+      assert(cuckoo_hashmap_erase (map, pairs[k]->key) == 1);
+    }
+  assert(cuckoo_hashmap_erase (map, pairs[0]->key) == 0);
+  assert(map->size == 200);
+  for (int k = 1; k < 400; k += 2)
+    {
+      assert(*(int *) cuckoo_hashmap_at (map, pairs[k]->key) == k);
+      assert(cuckoo_hashmap_at (map, pairs[k - 1]->key) == NULL);
+    }
+  cuckoo_hashmap_free (&map);
+  assert(map == NULL);
+  for (int k = 0; k < 500; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+}
+
+void test_cuckoo_same_hash ()
+{
+  pair *pairs[20];
+  for (int j = 0; j < 20; ++j)
+    {
+      int value = j;
+      pairs[j] = pair_alloc (&j, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  // all the keys have the same hash, so they share the same two buckets and
+  // the stash.
+  cuckoo_hashmap *map = cuckoo_hashmap_alloc (hash_zero);
+  if (map == NULL){return;}
+  size_t max_same_hash = 2 * CUCKOO_HASH_MAP_SLOTS + CUCKOO_HASH_MAP_STASH_SIZE;
+  for (size_t k = 0; k < max_same_hash; ++k)
+    {
+      assert(cuckoo_hashmap_insert (map, pairs[k]) == 1);
+    }
+  assert(map->stash_size == CUCKOO_HASH_MAP_STASH_SIZE);
+  // no place is left, the map stays as it was.
+  assert(cuckoo_hashmap_insert (map, pairs[max_same_hash]) == 0);
+  assert(map->size == max_same_hash);
+  for (size_t k = 0; k < max_same_hash; ++k)
+    {
+      assert(*(int *) cuckoo_hashmap_at (map, pairs[k]->key) == (int) k);
+    }
+  // erasing from a bucket makes room for a pair from the stash.
+  assert(cuckoo_hashmap_erase (map, pairs[0]->key) == 1);
+  assert(map->stash_size == CUCKOO_HASH_MAP_STASH_SIZE - 1);
+  assert(cuckoo_hashmap_insert (map, pairs[max_same_hash]) == 1);
+  assert(cuckoo_hashmap_insert (NULL, pairs[0]) == 0);
+  assert(cuckoo_hashmap_alloc (NULL) == NULL);
+  cuckoo_hashmap_free (&map);
+  for (int k = 0; k < 20; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+}
+
+/**
+ * This function checks the cuckoo_hashmap of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_cuckoo_hash_map (void)
+{
+  test_cuckoo_insert_at_erase ();
+  test_cuckoo_same_hash ();
+}
+
+/**
+ * @return 1 if the int key is even.
+ */
+int is_even_key (const_keyT elem)
+{
+  return *(const int *) elem % 2 == 0;
+}
+
+void test_sorted_bucket ()
+{
+  pair *pairs[40];
+  for (int j = 0; j < 40; ++j)
+    {
+      // insert in a mixed order.
+      int key = (j * 17) % 40;
+      int value = key;
+      pairs[j] = pair_alloc (&key, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  // all the keys have the same hash, so they all get to the same bucket.
+  hashmap *map = hashmap_alloc_seeded (hash_zero, int_key_order);
+  if (map == NULL){return;}
+  assert(map->seed != 0);
+  for (int k = 0; k < 30; ++k)
+    {
+      assert(hashmap_insert (map, pairs[k]) == 1);
+    }
+  assert(hashmap_insert (map, pairs[3]) == 0);
+  size_t ind = hashmap_bucket_index (0, map->seed, map->capacity);
+  assert(hashmap_bucket_size (map, ind) == 30);
+  // the big bucket is indexed, and its list is in the order of the index.
+  assert(map->sorted[ind] != NULL && map->sorted[ind]->count == 30);
+  size_t pos = 0;
+  for (hashmap_node *node = map->buckets[ind]; node->next != NULL;
+       node = node->next)
+    {
+      assert(node == map->sorted[ind]->nodes[pos++]);
+      assert(int_key_order (node->pair.key, node->next->pair.key) < 0);
+    }
+  for (int k = 0; k < 40; ++k)
+    {
+      int *value = hashmap_at (map, pairs[k]->key);
+      assert(k < 30 ? *value == *(int *) pairs[k]->key : value == NULL);
+    }
+  for (int k = 0; k < 25; ++k)
+    {
+      assert(hashmap_erase (map, pairs[k]->key) == 1);
+      assert(hashmap_at (map, pairs[k]->key) == NULL);
+    }
+  assert(map->size == 5);
+  ind = hashmap_bucket_index (0, map->seed, map->capacity);
+  assert(map->sorted[ind] == NULL);
+  for (int k = 25; k < 30; ++k)
+    {
+      assert(*(int *) hashmap_at (map, pairs[k]->key)
+             == *(int *) pairs[k]->key);
+    }
+  // many equal hashes: the index grows, and is kept through re-sizes and
+  // erases.
+  for (int key = 100; key < 2100; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  ind = hashmap_bucket_index (0, map->seed, map->capacity);
+  assert(map->sorted[ind] != NULL && map->sorted[ind]->count == 2005);
+  for (int key = 100; key < 2100; key += 3)
+    {
+      assert(hashmap_erase (map, &key) == 1);
+      assert(hashmap_at (map, &key) == NULL);
+    }
+  assert(hashmap_erase_if (map, is_even_key) > 0);
+  for (int key = 100; key < 2100; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert((key - 100) % 3 == 0 || key % 2 == 0 ? value == NULL
+                                                  : *value == key);
+    }
+  ind = hashmap_bucket_index (0, map->seed, map->capacity);
+  assert(map->sorted[ind]->count == map->size);
+  hashmap_free (&map);
+  for (int k = 0; k < 40; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+}
+
+void test_seeded_spreads_keys ()
+{
+  pair *pairs[12];
+  for (int j = 0; j < 12; ++j)
+    {
+      // without a seed, all these keys get to bucket 0.
+      int key = j * 1024;
+      int value = j;
+      pairs[j] = pair_alloc (&key, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  hashmap *map = hashmap_alloc_seeded (hash_int, NULL);
+  hashmap *other = hashmap_alloc_seeded (hash_int, NULL);
+  if (map == NULL || other == NULL){return;}
+  assert(map->seed != other->seed);
+  for (int k = 0; k < 12; ++k)
+    {
+      hashmap_insert (map, pairs[k]);
+    }
+  size_t max_bucket = 0;
+  for (size_t i = 0; i < map->capacity; ++i)
+    {
+      if (hashmap_bucket_size (map, i) > max_bucket)
+        {
+          max_bucket = hashmap_bucket_size (map, i);
+        }
+    }
+  assert(max_bucket < 12);
+  for (int k = 0; k < 12; ++k)
+    {
+      assert(*(int *) hashmap_at (map, pairs[k]->key) == k);
+    }
+  // a snapshot of a seeded map finds the keys in the same buckets.
+  const char *path = "test_hash_map_view.snapshot";
+  assert(hashmap_save (map, path, int_value_size, int_value_size) == 1);
+  hashmap_view *view = hashmap_view_open (path, hash_int, int_key_cmp);
+  assert(view != NULL && view->seed == map->seed);
+  for (int k = 0; k < 12; ++k)
+    {
+      assert(*(const int *) hashmap_view_at (view, pairs[k]->key) == k);
+    }
+  hashmap_view_close (&view);
+  remove (path);
+  hashmap_free (&other);
+  hashmap_free (&map);
+  for (int k = 0; k < 12; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+}
+
+/**
+ * This function checks the hashmap_alloc_seeded function of the hashmap
+ * library (seeded hashes and sorted buckets).
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_seeded (void)
+{
+  test_sorted_bucket ();
+  test_seeded_spreads_keys ();
+}
+
+void test_sharded_single_thread ()
+{
+  pair *pairs[100];
+  for (int j = 0; j < 100; ++j)
+    {
+      int value = j;
+      pairs[j] = pair_alloc (&j, &value, int_key_cpy, int_value_cpy,
+                             int_key_cmp, int_value_cmp, int_key_free,
+                             int_value_free);
+      if ((pairs[j]) == NULL){return;}
+    }
+  sharded_hashmap *map = sharded_hashmap_alloc (hash_int, 5);
+  if (map == NULL){return;}
+  assert(map->n_shards == 8 && map->shard_bits == 3);
+  for (int k = 0; k < 80; ++k)
+    {
+      assert(sharded_hashmap_insert (map, pairs[k]) == 1);
+    }
+  assert(sharded_hashmap_insert (map, pairs[0]) == 0);
+  assert(sharded_hashmap_size (map) == 80);
+  size_t used_shards = 0;
+  for (size_t i = 0; i < map->n_shards; ++i)
+    {
+      used_shards += map->shards[i].map->size > 0;
+    }
+  assert(used_shards > 1);
+  for (int k = 0; k < 100; ++k)
+    {
+      int *value = sharded_hashmap_get (map, pairs[k]->key);
+      assert(k < 80 ? *value == k : value == NULL);
+      int_value_free ((valueT *) &value);
+    }
+  assert(sharded_hashmap_update (map, pairs[7]->key, double_value) == 1);
+  assert(sharded_hashmap_update (map, pairs[90]->key, double_value) == 0);
+  int *value = sharded_hashmap_get (map, pairs[7]->key);
+  assert(*value == 14);
+  int_value_free ((valueT *) &value);
+  for (int k = 0; k < 40; ++k)
+    {
+      assert(sharded_hashmap_erase (map, pairs[k]->key) == 1);
+    }
+  assert(sharded_hashmap_erase (map, pairs[0]->key) == 0);
+  assert(sharded_hashmap_size (map) == 40);
+  sharded_hashmap_free (&map);
+  assert(map == NULL);
+  assert(sharded_hashmap_alloc (NULL, 4) == NULL);
+  for (int k = 0; k < 100; ++k)
+    {
+      pair_free ((void **) &pairs[k]);
+    }
+}
+
+/**
+ * @struct sharded_test_args
+ * The arguments of a thread in test_sharded_threads.
+ */
+typedef struct sharded_test_args {
+    sharded_hashmap *map;
+    int first;
+    int count;
+} sharded_test_args;
+
+/**
+ * inserts count keys starting at first, and erases the odd ones.
+ */
+void *sharded_test_thread (void *arg)
+{
+  sharded_test_args *args = arg;
+  for (int key = args->first; key < args->first + args->count; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(sharded_hashmap_insert (args->map, &in_pair) == 1);
+    }
+  for (int key = args->first + 1; key < args->first + args->count; key += 2)
+    {
+      assert(sharded_hashmap_erase (args->map, &key) == 1);
+    }
+  return NULL;
+}
+
+void test_sharded_threads ()
+{
+  sharded_hashmap *map = sharded_hashmap_alloc (hash_int, 0);
+  if (map == NULL){return;}
+  pthread_t threads[4];
+  sharded_test_args args[4];
+  for (int i = 0; i < 4; ++i)
+    {
+      args[i] = (sharded_test_args) {map, i * 2000, 2000};
+      assert(pthread_create (&threads[i], NULL, sharded_test_thread,
+                             &args[i]) == 0);
+    }
+  for (int i = 0; i < 4; ++i)
+    {
+      pthread_join (threads[i], NULL);
+    }
+  assert(sharded_hashmap_size (map) == 4000);
+  for (int key = 0; key < 8000; ++key)
+    {
+      int *value = sharded_hashmap_get (map, &key);
+      assert(key % 2 == 0 ? *value == key : value == NULL);
+      int_value_free ((valueT *) &value);
+    }
+  sharded_hashmap_free (&map);
+}
+
+/**
+ * This function checks the sharded_hashmap of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_sharded_hash_map (void)
+{
+  test_sharded_single_thread ();
+  test_sharded_threads ();
+}
+
+void test_merge ()
+{
+  hashmap *dst = hashmap_alloc (hash_int);
+  hashmap *src = hashmap_alloc (hash_int);
+  if (dst == NULL || src == NULL){return;}
+  for (int j = 0; j < 60; ++j)
+    {
+      int value = 1;
+      pair in_pair = {&j, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      if (j < 40)
+        {
+          assert(hashmap_upsert (dst, &in_pair, add_value).pair != NULL);
+        }
+      if (j >= 20)
+        {
+          assert(hashmap_upsert (src, &in_pair, add_value).pair != NULL);
+          assert(hashmap_upsert (src, &in_pair, add_value).pair != NULL);
+        }
+    }
+  assert(dst->size == 40 && src->size == 40);
+  assert(hashmap_merge (dst, src, add_value) == 1);
+  assert(dst->size == 60 && src->size == 40);
+  for (int k = 0; k < 60; ++k)
+    {
+      int *value = hashmap_at (dst, &k);
+      assert(*value == (k < 20 ? 1 : k < 40 ? 3 : 2));
+    }
+  size_t capacity = src->capacity;
+  hashmap_clear (src);
+  assert(src->size == 0 && src->capacity == capacity);
+  int key = 30;
+  assert(hashmap_at (src, &key) == NULL);
+  assert(hashmap_merge (dst, src, add_value) == 1);
+  assert(dst->size == 60);
+  assert(hashmap_merge (dst, src, NULL) == 0);
+  hashmap_free (&src);
+  hashmap_free (&dst);
+}
+
+void test_upsert ()
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  int key = 7;
+  int value = 1;
+  pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  hashmap_entry entry = hashmap_upsert (map, &in_pair, add_value);
+  assert(entry.pair != NULL && *(int *) entry.pair->value == 1);
+  // the stored value is changed in place, the handle stays valid.
+  for (int i = 0; i < 99; ++i)
+    {
+      assert(hashmap_upsert (map, &in_pair, add_value).pair == entry.pair);
+    }
+  assert(*(int *) entry.pair->value == 100 && map->size == 1);
+  assert(hashmap_update (map, &key, double_value) == 1);
+  assert(*(int *) hashmap_at (map, &key) == 200);
+  // without a merge function the stored value is replaced by a copy.
+  value = 5;
+  assert(hashmap_upsert (map, &in_pair, NULL).pair == entry.pair);
+  assert(*(int *) entry.pair->value == 5 && entry.pair->value != &value);
+  int missing = 8;
+  assert(hashmap_update (map, &missing, double_value) == 0);
+  assert(hashmap_update (map, &key, NULL) == 0);
+  assert(hashmap_upsert (NULL, &in_pair, NULL).pair == NULL);
+  assert(map->size == 1);
+  // a failed copy is not stored, and the stored value is kept.
+  pair failing_pair = {&missing, &value, int_key_cpy, failing_value_cpy,
+                       int_key_cmp, int_value_cmp, int_key_free,
+                       int_value_free, NULL};
+  assert(hashmap_upsert (map, &failing_pair, NULL).pair == NULL);
+  assert(map->size == 1 && hashmap_at (map, &missing) == NULL);
+  entry.pair->value_cpy = failing_value_cpy;
+  assert(hashmap_upsert (map, &in_pair, NULL).pair == NULL);
+  assert(*(int *) hashmap_at (map, &key) == 5);
+  hashmap_free (&map);
+}
+
+void test_stage_single_thread ()
+{
+  hashmap *shared = hashmap_alloc (hash_int);
+  if (shared == NULL){return;}
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  hashmap_stage *stage = hashmap_stage_alloc (shared, &lock, add_value, 10);
+  if (stage == NULL){return;}
+  int value = 1;
+  for (int k = 0; k < 9; ++k)
+    {
+      pair in_pair = {&k, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_stage_insert (stage, &in_pair) == 1);
+      assert(hashmap_stage_insert (stage, &in_pair) == 1);
+    }
+  // the same keys are combined in the stage, nothing is merged yet.
+  assert(stage->local->size == 9 && shared->size == 0);
+  int key = 9;
+  pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  assert(hashmap_stage_insert (stage, &in_pair) == 1);
+  assert(stage->local->size == 0 && shared->size == 10);
+  assert(*(int *) hashmap_at (shared, &key) == 1);
+  key = 0;
+  assert(*(int *) hashmap_at (shared, &key) == 2);
+  assert(hashmap_stage_insert (stage, &in_pair) == 1);
+  hashmap_stage_free (&stage);
+  assert(stage == NULL);
+  assert(*(int *) hashmap_at (shared, &key) == 3);
+  assert(hashmap_stage_alloc (shared, NULL, add_value, 0) == NULL);
+  assert(hashmap_stage_alloc (shared, &lock, NULL, 0) == NULL);
+  hashmap_free (&shared);
+}
+
+/**
+ * an allocator whose ctx is the number of allocations left, after them it
+ * fails.
+ */
+void *limited_alloc (size_t size, void *ctx)
+{
+  size_t *left = ctx;
+  if (*left == 0)
+    {
+      return NULL;
+    }
+  --*left;
+  return malloc (size);
+}
+
+void *limited_realloc (void *ptr, size_t old_size, size_t new_size, void *ctx)
+{
+  (void) old_size;
+  (void) ctx;
+  return realloc (ptr, new_size);
+}
+
+void limited_free (void *ptr, size_t size, void *ctx)
+{
+  (void) size;
+  (void) ctx;
+  free (ptr);
+}
+
+void test_stage_failed_flush ()
+{
+  // the map, its buckets and 5 nodes.
+  size_t left = 2 + 5;
+  allocator alloc = {limited_alloc, limited_realloc, limited_free, &left};
+  hashmap *shared = hashmap_alloc_with_allocator (hash_int, &alloc);
+  if (shared == NULL){return;}
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  hashmap_stage *stage = hashmap_stage_alloc (shared, &lock, add_value, 100);
+  if (stage == NULL){return;}
+  int value = 1;
+  for (int k = 0; k < 10; ++k)
+    {
+      pair in_pair = {&k, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_stage_insert (stage, &in_pair) == 1);
+    }
+  // the stage keeps the pairs that were not merged, and only them.
+  assert(hashmap_stage_flush (stage) == 0);
+  assert(shared->size == 5 && stage->local->size == 5);
+  left = 100;
+  assert(hashmap_stage_flush (stage) == 1);
+  assert(shared->size == 10 && stage->local->size == 0);
+  for (int k = 0; k < 10; ++k)
+    {
+      assert(*(int *) hashmap_at (shared, &k) == 1);
+    }
+  // pairs a failed merge left are lost with the stage, and reported.
+  int key = 10;
+  pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  assert(hashmap_stage_insert (stage, &in_pair) == 1);
+  left = 0;
+  assert(hashmap_stage_free (&stage) == 0);
+  assert(stage == NULL && shared->size == 10);
+  hashmap_free (&shared);
+  // a failed merge at max_size still stages the pair: it is counted once.
+  left = 2 + 2;
+  shared = hashmap_alloc_with_allocator (hash_int, &alloc);
+  if (shared == NULL){return;}
+  stage = hashmap_stage_alloc (shared, &lock, add_value, 3);
+  if (stage == NULL){return;}
+  for (int k = 0; k < 3; ++k)
+    {
+      pair k_pair = {&k, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                     int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_stage_insert (stage, &k_pair) == 1);
+    }
+  assert(shared->size == 2 && stage->local->size == 1);
+  left = 100;
+  assert(hashmap_stage_flush (stage) == 1);
+  for (int k = 0; k < 3; ++k)
+    {
+      assert(*(int *) hashmap_at (shared, &k) == 1);
+    }
+  assert(hashmap_stage_free (&stage) == 1);
+  hashmap_free (&shared);
+}
+
+/**
+ * @struct stage_test_args
+ * The arguments of a thread in test_stage_threads.
+ */
+typedef struct stage_test_args {
+    hashmap *shared;
+    pthread_mutex_t *lock;
+    sharded_hashmap *sharded;
+} stage_test_args;
+
+/**
+ * counts every key of [0, 1000) three times, through a stage.
+ */
+void *stage_test_thread (void *arg)
+{
+  stage_test_args *args = arg;
+  hashmap_stage *stage = args->sharded != NULL
+                         ? hashmap_stage_alloc_sharded (args->sharded,
+                                                        add_value, 64)
+                         : hashmap_stage_alloc (args->shared, args->lock,
+                                                add_value, 64);
+  assert(stage != NULL);
+  int value = 1;
+  for (int i = 0; i < 3000; ++i)
+    {
+      int key = (i * 7) % 1000;
+      pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_stage_insert (stage, &in_pair) == 1);
+    }
+  hashmap_stage_free (&stage);
+  return NULL;
+}
+
+void test_stage_threads ()
+{
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  hashmap *shared = hashmap_alloc (hash_int);
+  sharded_hashmap *sharded = sharded_hashmap_alloc (hash_int, 4);
+  if (shared == NULL || sharded == NULL){return;}
+  pthread_t threads[8];
+  stage_test_args args[8];
+  for (int i = 0; i < 8; ++i)
+    {
+      args[i] = (stage_test_args) {shared, &lock, i % 2 ? sharded : NULL};
+      assert(pthread_create (&threads[i], NULL, stage_test_thread,
+                             &args[i]) == 0);
+    }
+  for (int i = 0; i < 8; ++i)
+    {
+      pthread_join (threads[i], NULL);
+    }
+  assert(shared->size == 1000 && sharded_hashmap_size (sharded) == 1000);
+  for (int key = 0; key < 1000; ++key)
+    {
+      assert(*(int *) hashmap_at (shared, &key) == 12);
+      int *value = sharded_hashmap_get (sharded, &key);
+      assert(*value == 12);
+      int_value_free ((valueT *) &value);
+    }
+  sharded_hashmap_free (&sharded);
+  hashmap_free (&shared);
+}
+
+/**
+ * This function checks the hashmap_merge, hashmap_upsert and hashmap_update
+ * functions and the hashmap_stage of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_stage (void)
+{
+  test_merge ();
+  test_upsert ();
+  test_stage_single_thread ();
+  test_stage_failed_flush ();
+  test_stage_threads ();
+}
+
+void test_lockfree_single_thread ()
+{
+  lockfree_hashmap *map = lockfree_hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int key = 0; key < 1000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(lockfree_hashmap_insert (map, &in_pair) == 1);
+      assert(lockfree_hashmap_insert (map, &in_pair) == 0);
+    }
+  assert(lockfree_hashmap_size (map) == 1000);
+  assert(map->table->capacity >= 2000);
+  double load_factor = lockfree_hashmap_get_load_factor (map);
+  assert(load_factor > 0 && load_factor <= LOCKFREE_HASH_MAP_MAX_LOAD_FACTOR);
+  for (int key = 0; key < 1100; ++key)
+    {
+      int *value = lockfree_hashmap_at (map, &key);
+      assert(key < 1000 ? *value == key : value == NULL);
+    }
+  for (int key = 0; key < 1000; key += 2)
+    {
+      assert(lockfree_hashmap_erase (map, &key) == 1);
+      assert(lockfree_hashmap_erase (map, &key) == 0);
+      assert(lockfree_hashmap_at (map, &key) == NULL);
+    }
+  assert(lockfree_hashmap_size (map) == 500);
+  // an erased key can be inserted again, with a new value.
+  int key = 10, value = 7;
+  pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  assert(lockfree_hashmap_insert (map, &in_pair) == 1);
+  assert(*(int *) lockfree_hashmap_at (map, &key) == 7);
+  assert(lockfree_hashmap_size (map) == 501);
+  lockfree_hashmap_free (&map);
+  assert(map == NULL);
+  assert(lockfree_hashmap_alloc (NULL) == NULL);
+  assert(lockfree_hashmap_get_load_factor (NULL) == -1);
+}
+
+/**
+ * @struct lockfree_test_args
+ * The arguments of a thread in test_lockfree_threads.
+ */
+typedef struct lockfree_test_args {
+    lockfree_hashmap *map;
+    int first;
+    int count;
+    int erase;
+    int done;
+} lockfree_test_args;
+
+/**
+ * inserts count keys starting at first and checks them, or erases the odd
+ * ones of them. Other threads do the same to the same keys, done counts the
+ * insertions (or erasures) this thread did.
+ */
+void *lockfree_test_thread (void *arg)
+{
+  lockfree_test_args *args = arg;
+  for (int key = args->first; key < args->first + args->count; ++key)
+    {
+      if (args->erase)
+        {
+          args->done += key % 2 && lockfree_hashmap_erase (args->map, &key);
+          assert(key % 2 == 0 || lockfree_hashmap_at (args->map, &key) == NULL);
+          continue;
+        }
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      args->done += lockfree_hashmap_insert (args->map, &in_pair);
+      assert(*(int *) lockfree_hashmap_at (args->map, &key) == key);
+    }
+  return NULL;
+}
+
+/**
+ * runs 8 threads, every range of keys is used by two of them.
+ * @return the number of insertions (or erasures) the threads did.
+ */
+int run_lockfree_threads (lockfree_hashmap *map, int erase)
+{
+  pthread_t threads[8];
+  lockfree_test_args args[8];
+  for (int i = 0; i < 8; ++i)
+    {
+      args[i] = (lockfree_test_args) {map, (i / 2) * 5000, 5000, erase, 0};
+      assert(pthread_create (&threads[i], NULL, lockfree_test_thread,
+                             &args[i]) == 0);
+    }
+  int done = 0;
+  for (int i = 0; i < 8; ++i)
+    {
+      pthread_join (threads[i], NULL);
+      done += args[i].done;
+    }
+  return done;
+}
+
+void test_lockfree_threads ()
+{
+  lockfree_hashmap *map = lockfree_hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  assert(run_lockfree_threads (map, 0) == 20000);
+  assert(lockfree_hashmap_size (map) == 20000);
+  assert(run_lockfree_threads (map, 1) == 10000);
+  assert(lockfree_hashmap_size (map) == 10000);
+  for (int key = 0; key < 20000; ++key)
+    {
+      int *value = lockfree_hashmap_at (map, &key);
+      assert(key % 2 == 0 ? *value == key : value == NULL);
+    }
+  lockfree_hashmap_free (&map);
+}
+
+/**
+ * inserts, reads and erases the same count keys starting at first again and
+ * again (another thread does the same to them), so the map migrates its
+ * tables all the time.
+ */
+void *lockfree_churn_thread (void *arg)
+{
+  lockfree_test_args *args = arg;
+  for (int round = 0; round < 200; ++round)
+    {
+      for (int key = args->first; key < args->first + args->count; ++key)
+        {
+          pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                          int_value_cmp, int_key_free, int_value_free, NULL};
+          lockfree_hashmap_insert (args->map, &in_pair);
+          int *value = lockfree_hashmap_get (args->map, &key);
+          assert(value == NULL || *value == key);
+          int_value_free ((valueT *) &value);
+          args->done += lockfree_hashmap_erase (args->map, &key);
+        }
+    }
+  return NULL;
+}
+
+void test_lockfree_reclaim ()
+{
+  lockfree_hashmap *map = lockfree_hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  pthread_t threads[8];
+  lockfree_test_args args[8];
+  for (int i = 0; i < 8; ++i)
+    {
+      args[i] = (lockfree_test_args) {map, (i / 2) * 50, 50, 1, 0};
+      assert(pthread_create (&threads[i], NULL, lockfree_churn_thread,
+                             &args[i]) == 0);
+    }
+  for (int i = 0; i < 8; ++i)
+    {
+      pthread_join (threads[i], NULL);
+    }
+  assert(lockfree_hashmap_size (map) == 0);
+  // with no other thread running, a few operations free all the retired
+  // tables.
+  int key = 0;
+  for (int i = 0; i < 2 * LOCKFREE_HASH_MAP_EPOCHS; ++i)
+    {
+      assert(lockfree_hashmap_at (map, &key) == NULL);
+    }
+  assert(map->table->next == NULL);
+  for (int e = 0; e < LOCKFREE_HASH_MAP_EPOCHS; ++e)
+    {
+      assert(map->limbo[e] == NULL);
+    }
+  lockfree_hashmap_free (&map);
+}
+
+/**
+ * This function checks the lockfree_hashmap of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_lockfree_hash_map (void)
+{
+  test_lockfree_single_thread ();
+  test_lockfree_threads ();
+  test_lockfree_reclaim ();
+}
+
+/**
+ * a hash that gives the same hash to every 16 following keys, so the
+ * buckets of a seeded map get sorted.
+ */
+size_t hash_int_sixteenth (const_keyT elem)
+{
+  return *((const int *) elem) / 16;
+}
+
+/**
+ * inserts the keys [0, n) to the map, checks them and erases all the keys
+ * except of the first 100, and shrinks the map.
+ */
+void check_parallel_rehash (hashmap *map, int n)
+{
+  for (int key = 0; key < n; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  assert(map->size == (size_t) n);
+  assert(hashmap_get_load_factor (map) <= HASH_MAP_MAX_LOAD_FACTOR);
+  for (int key = 0; key < n + 100; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert(key < n ? *value == key : value == NULL);
+    }
+  for (size_t i = 0; map->key_order != NULL && i < map->capacity; ++i)
+    {
+      for (hashmap_node *node = map->buckets[i];
+           node != NULL && node->next != NULL; node = node->next)
+        {
+          assert(int_key_order (node->pair.key, node->next->pair.key) < 0);
+        }
+    }
+  assert(hashmap_reserve (map, (size_t) n) == 1);
+  assert(hashmap_get_load_factor (map) <= HASH_MAP_MAX_LOAD_FACTOR / 2);
+  for (int key = 100; key < n; ++key)
+    {
+      hashmap_entry entry = hashmap_find (map, &key);
+      assert(hashmap_entry_erase (map, entry) == 1);
+    }
+  assert(hashmap_shrink (map) == 1);
+  assert(map->capacity == 256 && map->size == 100);
+  for (int key = 0; key < 200; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert(key < 100 ? *value == key : value == NULL);
+    }
+}
+
+void test_parallel_rehash_same_layout ()
+{
+  hashmap *serial = hashmap_alloc (hash_int);
+  hashmap *parallel = hashmap_alloc (hash_int);
+  if (serial == NULL || parallel == NULL){return;}
+  hashmap_set_rehash_threads (parallel, 3);
+  assert(parallel->rehash_threads == 3);
+  for (int key = 0; key < 100000; ++key)
+    {
+      // keys that differ in high bits, so the buckets have many pairs.
+      int scattered = (key * 7919) % 1000003;
+      pair in_pair = {&scattered, &key, int_key_cpy, int_value_cpy,
+                      int_key_cmp, int_value_cmp, int_key_free,
+                      int_value_free, NULL};
+      assert(hashmap_insert (serial, &in_pair) == 1);
+      assert(hashmap_insert (parallel, &in_pair) == 1);
+    }
+  // the parallel re-size gives the order a re-size in one thread gives.
+  assert(serial->capacity == parallel->capacity);
+  for (size_t i = 0; i < serial->capacity; ++i)
+    {
+      hashmap_node *node1 = serial->buckets[i];
+      hashmap_node *node2 = parallel->buckets[i];
+      for (; node1 != NULL && node2 != NULL;
+           node1 = node1->next, node2 = node2->next)
+        {
+          assert(pair_cmp (&node1->pair, &node2->pair));
+        }
+      assert(node1 == NULL && node2 == NULL);
+    }
+  hashmap_set_rehash_threads (parallel, 0);
+  assert(parallel->rehash_threads == 1);
+  hashmap_free (&parallel);
+  hashmap_free (&serial);
+}
+
+/**
+ * This function checks the parallel re-size (hashmap_set_rehash_threads)
+ * and the hashmap_shrink function of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_parallel_rehash (void)
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  hashmap_set_rehash_threads (map, 4);
+  check_parallel_rehash (map, 200000);
+  hashmap_free (&map);
+  map = hashmap_alloc_seeded (hash_int_sixteenth, int_key_order);
+  if (map == NULL){return;}
+  hashmap_set_rehash_threads (map, 5);
+  check_parallel_rehash (map, 100000);
+  hashmap_free (&map);
+  test_parallel_rehash_same_layout ();
+  assert(hashmap_shrink (NULL) == 0);
+}
+
+/**
+ * @struct counting_policy
+ * Counts the arrays an array policy allocated and did not free yet.
+ */
+typedef struct counting_policy {
+    size_t arrays;
+    size_t bytes;
+} counting_policy;
+
+void *counting_alloc (size_t size, void *ctx)
+{
+  counting_policy *counts = ctx;
+  counts->arrays++;
+  counts->bytes += size;
+  return calloc (1, size);
+}
+
+void counting_free (void *array, size_t size, void *ctx)
+{
+  counting_policy *counts = ctx;
+  counts->arrays--;
+  counts->bytes -= size;
+  free (array);
+}
+
+void test_counting_array_policy ()
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int key = 0; key < 10; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  counting_policy counts = {0, 0};
+  hashmap_array_policy policy = {counting_alloc, counting_free, &counts};
+  assert(hashmap_set_array_policy (map, &policy) == 1);
+  assert(counts.arrays == 1 && counts.bytes == 16 * sizeof (hashmap_node *));
+  for (int key = 10; key < 1000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  // the re-sizes allocate with the policy, and free the old arrays with it.
+  assert(counts.arrays == 1 && counts.bytes == map->capacity
+                                               * sizeof (hashmap_node *));
+  for (int key = 0; key < 1000; ++key)
+    {
+      assert(*(int *) hashmap_at (map, &key) == key);
+    }
+  hashmap_array_policy bad_policy = {counting_alloc, NULL, &counts};
+  assert(hashmap_set_array_policy (map, &bad_policy) == 0);
+  assert(hashmap_set_array_policy (map, NULL) == 1);
+  assert(counts.arrays == 0 && counts.bytes == 0);
+  assert(hashmap_set_array_policy (map, &policy) == 1);
+  hashmap_free (&map);
+  assert(counts.arrays == 0 && counts.bytes == 0);
+}
+
+void test_mmap_array_policy ()
+{
+  hashmap_mmap_options options[3] = {
+      {HASH_MAP_NO_HUGE_PAGES, HASH_MAP_NUMA_DEFAULT, 0, NULL},
+      {HASH_MAP_TRANSPARENT_HUGE_PAGES, HASH_MAP_NUMA_INTERLEAVE, 1, NULL},
+      {HASH_MAP_EXPLICIT_HUGE_PAGES, HASH_MAP_NUMA_BIND, 1, NULL}};
+  for (int i = 0; i < 3; ++i)
+    {
+      hashmap *map = hashmap_alloc (hash_int);
+      if (map == NULL){return;}
+      hashmap_array_policy policy = hashmap_mmap_policy (&options[i]);
+      assert(hashmap_set_array_policy (map, &policy) == 1);
+      // big enough for the buckets array to be mapped.
+      for (int key = 0; key < 200000; ++key)
+        {
+          pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                          int_value_cmp, int_key_free, int_value_free, NULL};
+          assert(hashmap_insert (map, &in_pair) == 1);
+        }
+      assert(map->capacity * sizeof (hashmap_node *) >= HASH_MAP_MMAP_MIN_SIZE);
+      for (int key = 0; key < 200000; key += 7)
+        {
+          assert(*(int *) hashmap_at (map, &key) == key);
+        }
+      hashmap_free (&map);
+    }
+}
+
+/**
+ * This function checks the hashmap_set_array_policy function and the mmap
+ * array policy of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_array_policy (void)
+{
+  test_counting_array_policy ();
+  test_mmap_array_policy ();
+}
+
+/**
+ * @struct tracking_allocator
+ * Counts the allocations and the bytes that were not freed yet.
+ */
+typedef struct tracking_allocator {
+    size_t allocations;
+    size_t bytes;
+} tracking_allocator;
+
+void *tracking_alloc (size_t size, void *ctx)
+{
+  tracking_allocator *tracker = ctx;
+  tracker->allocations++;
+  tracker->bytes += size;
+  return malloc (size);
+}
+
+void *tracking_realloc (void *ptr, size_t old_size, size_t new_size,
+                        void *ctx)
+{
+  tracking_allocator *tracker = ctx;
+  void *new_ptr = realloc (ptr, new_size);
+  if (new_ptr != NULL)
+    {
+      tracker->bytes += new_size - old_size;
+    }
+  return new_ptr;
+}
+
+void tracking_free (void *ptr, size_t size, void *ctx)
+{
+  tracking_allocator *tracker = ctx;
+  tracker->allocations--;
+  tracker->bytes -= size;
+  free (ptr);
+}
+
+/**
+ * @struct bump_allocator
+ * Allocates from one buffer, and frees everything at once.
+ */
+typedef struct bump_allocator {
+    char *buffer;
+    size_t used;
+    size_t size;
+} bump_allocator;
+
+void *bump_alloc (size_t size, void *ctx)
+{
+  bump_allocator *bump = ctx;
+  size = (size + 15) / 16 * 16;
+  if (bump->size - bump->used < size)
+    {
+      return NULL;
+    }
+  bump->used += size;
+  return bump->buffer + bump->used - size;
+}
+
+void *bump_realloc (void *ptr, size_t old_size, size_t new_size, void *ctx)
+{
+  void *new_ptr = bump_alloc (new_size, ctx);
+  if (new_ptr != NULL)
+    {
+      memcpy (new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    }
+  return new_ptr;
+}
+
+void bump_free (void *ptr, size_t size, void *ctx)
+{
+  (void) ptr;
+  (void) size;
+  (void) ctx;
+}
+
+void test_tracking_allocator ()
+{
+  tracking_allocator tracker = {0, 0};
+  allocator alloc = {tracking_alloc, tracking_realloc, tracking_free,
+                     &tracker};
+  hashmap *map = hashmap_alloc_with_allocator (hash_int, &alloc);
+  if (map == NULL){return;}
+  assert(map->allocator == &alloc && tracker.allocations == 2);
+  for (int key = 0; key < 1000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  // the map, the buckets array and a node for every pair.
+  assert(tracker.allocations == 2 + 1000);
+  for (int key = 0; key < 1000; ++key)
+    {
+      hashmap_entry entry = hashmap_find (map, &key);
+      assert(entry.pair->allocator == &alloc);
+      assert(*(int *) entry.pair->value == key);
+    }
+  for (int key = 0; key < 900; ++key)
+    {
+      assert(hashmap_erase (map, &key) == 1);
+    }
+  hashmap_free (&map);
+  assert(tracker.allocations == 0 && tracker.bytes == 0);
+
+  int key = 1;
+  pair *tracked = pair_alloc_with_allocator (&key, &key, int_key_cpy,
+                                             int_value_cpy, int_key_cmp,
+                                             int_value_cmp, int_key_free,
+                                             int_value_free, &alloc);
+  if (tracked == NULL){return;}
+  pair *copy = pair_copy (tracked);
+  assert(copy != NULL && copy->allocator == &alloc);
+  assert(tracker.allocations == 2 && tracker.bytes == 2 * sizeof (pair));
+  pair_free ((void **) &copy);
+  pair_free ((void **) &tracked);
+  vector *vec = vector_alloc_with_allocator (pair_copy, pair_cmp, pair_free,
+                                             &alloc);
+  if (vec == NULL){return;}
+  assert(tracker.allocations == 2);
+  vector_free (&vec);
+  assert(tracker.allocations == 0 && tracker.bytes == 0);
+}
+
+void test_bump_allocator ()
+{
+  bump_allocator bump = {malloc (1 << 20), 0, 1 << 20};
+  if (bump.buffer == NULL){return;}
+  allocator alloc = {bump_alloc, bump_realloc, bump_free, &bump};
+  hashmap *map = hashmap_alloc_with_allocator (hash_int, &alloc);
+  if (map == NULL){return;}
+  for (int key = 0; key < 500; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  assert(bump.used > 500 * sizeof (pair));
+  for (int key = 0; key < 500; ++key)
+    {
+      assert(*(int *) hashmap_at (map, &key) == key);
+    }
+  // frees the keys and the values, the memory of the map goes with the
+  // buffer.
+  hashmap_free (&map);
+  free (bump.buffer);
+}
+
+/**
+ * This function checks the allocators of the hashmap library (the
+ * hashmap_alloc_with_allocator, vector_alloc_with_allocator and
+ * pair_alloc_with_allocator functions).
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_allocator (void)
+{
+  test_tracking_allocator ();
+  test_bump_allocator ();
+}
+
+/**
+ * puts the pair (key, value) of ints to the cache.
+ */
+int cache_put_int (hashmap_cache *cache, int key, int value)
+{
+  pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  return hashmap_cache_put (cache, &in_pair);
+}
+
+/**
+ * charges an int value its own value in bytes.
+ */
+size_t int_value_charge (const_valueT value)
+{
+  return (size_t) *(const int *) value;
+}
+
+void test_cache_eviction (int policy)
+{
+  hashmap_cache *cache = hashmap_cache_alloc (hash_int, policy, 3, 0, NULL);
+  if (cache == NULL){return;}
+  for (int key = 1; key <= 3; ++key)
+    {
+      assert(cache_put_int (cache, key, key * 10) == 1);
+    }
+  int key = 1;
+  assert(*(int *) hashmap_cache_get (cache, &key) == 10);
+  // 2 is the least recently used, and for CLOCK the first one without a
+  // second chance.
+  assert(cache_put_int (cache, 4, 40) == 1);
+  assert(cache->map->size == 3 && cache->evictions == 1);
+  key = 2;
+  assert(hashmap_cache_get (cache, &key) == NULL);
+  // replacing a value evicts nothing.
+  assert(cache_put_int (cache, 3, 33) == 1);
+  assert(cache->map->size == 3 && cache->evictions == 1);
+  // putting back the value get returned replaces it with a copy of itself.
+  key = 3;
+  pair in_pair = {&key, hashmap_cache_get (cache, &key), int_key_cpy,
+                  int_value_cpy, int_key_cmp, int_value_cmp, int_key_free,
+                  int_value_free, NULL};
+  assert(hashmap_cache_put (cache, &in_pair) == 1);
+  assert(*(int *) hashmap_cache_get (cache, &key) == 33);
+  for (key = 1; key <= 4; ++key)
+    {
+      int *value = hashmap_cache_get (cache, &key);
+      assert(key == 2 ? value == NULL : *value == (key == 3 ? 33 : key * 10));
+    }
+  assert(hashmap_cache_erase (cache, &key) == 0);
+  key = 4;
+  assert(hashmap_cache_erase (cache, &key) == 1);
+  assert(cache->map->size == 2);
+  // many evictions, while the map of the cache grows and shrinks.
+  for (key = 0; key < 1000; ++key)
+    {
+      assert(cache_put_int (cache, key, key) == 1);
+    }
+  assert(cache->map->size == 3);
+  for (key = 997; key < 1000; ++key)
+    {
+      assert(*(int *) hashmap_cache_get (cache, &key) == key);
+    }
+  hashmap_cache_free (&cache);
+  assert(cache == NULL);
+}
+
+void test_cache_bytes ()
+{
+  hashmap_cache *cache = hashmap_cache_alloc (hash_int, HASH_MAP_CACHE_LRU,
+                                              0, 10, int_value_charge);
+  if (cache == NULL){return;}
+  assert(cache_put_int (cache, 1, 4) == 1);
+  assert(cache_put_int (cache, 2, 4) == 1);
+  assert(cache->bytes == 8);
+  assert(cache_put_int (cache, 3, 5) == 1);
+  assert(cache->bytes == 9 && cache->map->size == 2);
+  // a value bigger than the whole cache is not cached.
+  assert(cache_put_int (cache, 4, 11) == 0);
+  assert(cache->bytes == 9 && cache->map->size == 2);
+  // a new entry that alone fills the cache evicts all the others.
+  assert(cache_put_int (cache, 2, 10) == 1);
+  assert(cache->bytes == 10 && cache->map->size == 1);
+  // the entries are in the extra bytes of the nodes, which are fixed once
+  // the map has pairs.
+  assert(hashmap_set_node_extra (cache->map, 0) == 0);
+  hashmap_entry missing = {NULL, 0};
+  assert(hashmap_entry_extra (missing) == NULL);
+  hashmap_cache_free (&cache);
+  assert(hashmap_cache_alloc (hash_int, 7, 1, 0, NULL) == NULL);
+}
+
+/**
+ * This function checks the hashmap_cache of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_cache (void)
+{
+  test_cache_eviction (HASH_MAP_CACHE_LRU);
+  test_cache_eviction (HASH_MAP_CACHE_CLOCK);
+  test_cache_bytes ();
+}
+
+/**
+ * the time of ttl_test_clock.
+ */
+static uint64_t ttl_test_now = 1000;
+
+uint64_t ttl_test_clock (void)
+{
+  return ttl_test_now;
+}
+
+/**
+ * inserts the pair (key, key) of ints with the given ttl.
+ */
+int ttl_insert_int (hashmap_ttl *map, int key, uint64_t ttl)
+{
+  pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  return hashmap_ttl_insert (map, &in_pair, ttl);
+}
+
+void test_ttl_lazy_and_bounded ()
+{
+  ttl_test_now = 1000;
+  hashmap_ttl *map = hashmap_ttl_alloc (hash_int, ttl_test_clock);
+  if (map == NULL){return;}
+  for (int key = 0; key < 100; ++key)
+    {
+      assert(ttl_insert_int (map, key, (uint64_t) key + 1) == 1);
+    }
+  assert(ttl_insert_int (map, 5, 10) == 0);
+  int key = 99;
+  assert(*(int *) hashmap_ttl_at (map, &key) == 99);
+  ttl_test_now += 50;
+  // an expired entry is not found, and is erased by the lookup.
+  key = 10;
+  assert(hashmap_ttl_at (map, &key) == NULL);
+  assert(map->map->size == 99);
+  key = 50;
+  assert(*(int *) hashmap_ttl_at (map, &key) == 50);
+  // the wheel reclaims the rest in bounded steps.
+  assert(hashmap_ttl_expire (map, 20) <= 20);
+  size_t reclaimed = 99 - map->map->size;
+  while (map->map->size > 50)
+    {
+      reclaimed += hashmap_ttl_expire (map, 20);
+    }
+  assert(reclaimed == 49 && map->map->size == 50);
+  assert(hashmap_ttl_expire (map, 20) == 0);
+  // refreshing, and replacing an expired entry.
+  key = 60;
+  assert(hashmap_ttl_refresh (map, &key, 1000) == 1);
+  key = 61;
+  assert(hashmap_ttl_refresh (map, &key, HASH_MAP_TTL_NEVER) == 1);
+  key = 62;
+  assert(hashmap_ttl_erase (map, &key) == 1);
+  assert(hashmap_ttl_erase (map, &key) == 0);
+  ttl_test_now += 100;
+  hashmap_ttl_expire (map, 1000);
+  assert(map->map->size == 2);
+  assert(ttl_insert_int (map, 60, 5) == 0);
+  ttl_test_now += 1000;
+  assert(ttl_insert_int (map, 60, 5) == 1);
+  key = 61;
+  assert(*(int *) hashmap_ttl_at (map, &key) == 61);
+  hashmap_ttl_free (&map);
+  assert(map == NULL);
+}
+
+void test_ttl_wheel_levels ()
+{
+  ttl_test_now = 12345;
+  hashmap_ttl *map = hashmap_ttl_alloc (hash_int, ttl_test_clock);
+  if (map == NULL){return;}
+  uint64_t start = ttl_test_now;
+  // the ttls are spread over all the levels of the wheel.
+  for (int k = 0; k < 50; ++k)
+    {
+      assert(ttl_insert_int (map, k, (uint64_t) 1 << k) == 1);
+    }
+  for (int k = 0; k < 50; ++k)
+    {
+      ttl_test_now = start + ((uint64_t) 1 << k) - 1;
+      hashmap_ttl_expire (map, 10000);
+      assert(map->map->size == 50 - (size_t) k);
+      ttl_test_now++;
+      hashmap_ttl_expire (map, 10000);
+      assert(map->map->size == 49 - (size_t) k);
+    }
+
+  // random ttls and random jumps of the clock, against a plain count.
+  uint64_t expires[2000];
+  srand (7);
+  for (int key = 0; key < 2000; ++key)
+    {
+      uint64_t ttl = 1 + (uint64_t) rand () % (1 << 20);
+      expires[key] = ttl_test_now + ttl;
+      assert(ttl_insert_int (map, key, ttl) == 1);
+    }
+  while (map->map->size > 0)
+    {
+      ttl_test_now += (uint64_t) rand () % 5000;
+      size_t live = 0;
+      for (int key = 0; key < 2000; ++key)
+        {
+          live += expires[key] > ttl_test_now;
+        }
+      // every step of 64 entries makes progress.
+      for (int steps = 0; map->map->size != live; ++steps)
+        {
+          assert(steps < 2000);
+          hashmap_ttl_expire (map, 64);
+        }
+      assert(hashmap_ttl_expire (map, 1000000) == 0);
+      assert(map->map->size == live);
+    }
+  hashmap_ttl_free (&map);
+}
+
+void test_ttl_default_clock ()
+{
+  hashmap_ttl *map = hashmap_ttl_alloc (hash_int, NULL);
+  if (map == NULL){return;}
+  assert(ttl_insert_int (map, 1, 1000000) == 1);
+  assert(ttl_insert_int (map, 2, HASH_MAP_TTL_NEVER) == 1);
+  assert(ttl_insert_int (map, 3, UINT64_MAX) == 1);
+  for (int key = 1; key <= 3; ++key)
+    {
+      assert(*(int *) hashmap_ttl_at (map, &key) == key);
+    }
+  assert(hashmap_ttl_expire (map, 100) == 0);
+  hashmap_ttl_free (&map);
+}
+
+/**
+ * This function checks the hashmap_ttl of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_ttl (void)
+{
+  test_ttl_lazy_and_bounded ();
+  test_ttl_wheel_levels ();
+  test_ttl_default_clock ();
+}
+
+/**
+ * allocates a set of the ints in [first, last).
+ */
+hashset *int_set (int first, int last)
+{
+  hashset *set = hashset_alloc (hash_int, int_key_cpy, int_key_cmp,
+                                int_key_free);
+  for (int key = first; set != NULL && key < last; ++key)
+    {
+      assert(hashset_insert (set, &key) == 1);
+    }
+  return set;
+}
+
+void test_set_insert_contains_erase ()
+{
+  hashset *set = int_set (0, 1000);
+  if (set == NULL){return;}
+  assert(set->size == 1000);
+  assert(set->size / (double) set->capacity <= HASH_MAP_MAX_LOAD_FACTOR);
+  int key = 7;
+  assert(hashset_insert (set, &key) == 0);
+  assert(hashset_insert (set, NULL) == 0);
+  for (key = 0; key < 1100; ++key)
+    {
+      assert(hashset_contains (set, &key) == (key < 1000));
+    }
+  for (key = 0; key < 990; ++key)
+    {
+      assert(hashset_erase (set, &key) == 1);
+    }
+  assert(hashset_erase (set, &key) == 1);
+  assert(hashset_erase (set, &key) == 0);
+  assert(set->size == 9 && set->capacity == 32);
+  for (key = 0; key < 1000; ++key)
+    {
+      assert(hashset_contains (set, &key) == (key > 990));
+    }
+  // a key whose copy failed is not stored.
+  set->key_cpy = failing_value_cpy;
+  key = 2000;
+  assert(hashset_insert (set, &key) == 0);
+  assert(hashset_contains (set, &key) == 0 && set->size == 9);
+  hashset_free (&set);
+  assert(set == NULL);
+  assert(hashset_alloc (hash_int, NULL, int_key_cmp, int_key_free) == NULL);
+}
+
+void test_set_operations ()
+{
+  hashset *a = int_set (0, 600);
+  hashset *b = int_set (400, 1000);
+  if (a == NULL || b == NULL){return;}
+  // a = [0, 1000)
+  assert(hashset_union (a, b) == 1);
+  assert(a->size == 1000 && b->size == 600);
+  // a = [400, 1000)
+  hashset *c = int_set (400, 2000);
+  if (c == NULL){return;}
+  assert(hashset_intersection (c, a) == 1000);
+  assert(c->size == 600);
+  // a = [0, 400)
+  assert(hashset_difference (a, c) == 600);
+  assert(a->size == 400);
+  for (int key = 0; key < 2000; ++key)
+    {
+      assert(hashset_contains (a, &key) == (key < 400));
+      assert(hashset_contains (c, &key) == (key >= 400 && key < 1000));
+    }
+  // the shrink after the bulk erase.
+  assert(c->capacity == 1024 && a->capacity == 1024);
+  // a set with another hash function, so the keys are hashed again.
+  hashset *d = hashset_alloc (hash_int_sixteenth, int_key_cpy, int_key_cmp,
+                              int_key_free);
+  if (d == NULL){return;}
+  assert(hashset_union (d, a) == 1 && d->size == 400);
+  assert(hashset_intersection (a, d) == 0);
+  assert(hashset_difference (d, d) == 400 && d->size == 0);
+  assert(hashset_union (NULL, a) == 0);
+  hashset_free (&d);
+  hashset_free (&c);
+  hashset_free (&b);
+  hashset_free (&a);
+}
+
+/**
+ * This function checks the hashset of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_set (void)
+{
+  test_set_insert_contains_erase ();
+  test_set_operations ();
+}
+
+void test_multi_insert_and_range ()
+{
+  hashmap_multi *map = hashmap_multi_alloc (hash_int);
+  if (map == NULL){return;}
+  // key k gets the values k, k + 100, k + 200, ... (k + 1 values).
+  for (int round = 0; round < 50; ++round)
+    {
+      for (int key = round; key < 50; ++key)
+        {
+          int value = key + 100 * round;
+          pair in_pair = {&key, &value, int_key_cpy, int_value_cpy,
+                          int_key_cmp, int_value_cmp, int_key_free,
+                          int_value_free, NULL};
+          assert(hashmap_multi_insert (map, &in_pair).pair != NULL);
+        }
+    }
+  assert(map->map->size == 50 && map->size == 50 * 51 / 2);
+  for (int key = 0; key < 60; ++key)
+    {
+      hashmap_multi_range range = hashmap_multi_equal_range (map, &key);
+      assert(range.count == (key < 50 ? (size_t) key + 1 : 0));
+      for (size_t i = 0; i < range.count; ++i)
+        {
+          assert(*(int *) range.values[i] == key + 100 * (int) i);
+        }
+    }
+  int key = 10;
+  assert(hashmap_multi_erase (map, &key) == 11);
+  assert(hashmap_multi_erase (map, &key) == 0);
+  assert(map->map->size == 49 && map->size == 50 * 51 / 2 - 11);
+  hashmap_multi_free (&map);
+  assert(map == NULL);
+}
+
+void test_multi_append ()
+{
+  hashmap_multi *map = hashmap_multi_alloc (hash_int);
+  if (map == NULL){return;}
+  int key = 3;
+  int value = 0;
+  pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  hashmap_entry entry = hashmap_multi_insert (map, &in_pair);
+  if (entry.pair == NULL){return;}
+  // the handle stays good while other keys are inserted (and the map
+  // grows).
+  for (int other = 100; other < 1000; ++other)
+    {
+      in_pair.key = &other;
+      assert(hashmap_multi_insert (map, &in_pair).pair != NULL);
+      assert(hashmap_multi_append (map, entry, &other) == 1);
+    }
+  hashmap_multi_range range = hashmap_multi_equal_range (map, &key);
+  assert(range.count == 901);
+  for (size_t i = 1; i < range.count; ++i)
+    {
+      assert(*(int *) range.values[i] == 99 + (int) i);
+    }
+  assert(hashmap_multi_find (map, &key).pair == entry.pair);
+  assert(hashmap_multi_append (map, hashmap_multi_find (map, &value), &key)
+         == 0);
+  hashmap_multi_free (&map);
+}
+
+/**
+ * This function checks the hashmap_multi of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_multi (void)
+{
+  test_multi_insert_and_range ();
+  test_multi_append ();
+}
+
+/**
+ * @return the number of bits set in the filter of the map.
+ */
+static size_t filter_bits (const hashmap *map)
+{
+  size_t bits = 0;
+  for (size_t i = 0; i < map->filter_blocks * HASH_MAP_FILTER_BLOCK_WORDS;
+       ++i)
+    {
+      bits += (size_t) __builtin_popcountll (map->filter[i]);
+    }
+  return bits;
+}
+
+/**
+ * inserts the keys [first, last) to the map, with the key as the value.
+ */
+static void filter_insert (hashmap *map, int first, int last)
+{
+  for (int key = first; key < last; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+}
+
+void test_filter_lookups ()
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  filter_insert (map, 0, 100);
+  assert(hashmap_set_filter (map, 1) == 1);
+  assert(map->filter != NULL && map->filter_blocks >= 1);
+  assert(filter_bits (map) > 0
+         && filter_bits (map) <= HASH_MAP_FILTER_HASHES * 100);
+  // the map grows, and the filter is re-built for the new capacity.
+  filter_insert (map, 100, 5000);
+  assert(map->filter_blocks == map->capacity
+                               * HASH_MAP_FILTER_BITS_PER_BUCKET
+                               / (HASH_MAP_FILTER_BLOCK_WORDS * 64));
+  for (int key = -5000; key < 10000; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert(key >= 0 && key < 5000 ? *value == key : value == NULL);
+      hashmap_entry entry = hashmap_find (map, &key);
+      assert((entry.pair != NULL) == (key >= 0 && key < 5000));
+    }
+  // erased keys stay in the filter until it is re-built by a re-size.
+  size_t bits = filter_bits (map);
+  for (int key = 100; key < 5000; ++key)
+    {
+      assert(hashmap_erase (map, &key) == 1);
+    }
+  assert(hashmap_shrink (map) == 1);
+  assert(filter_bits (map) < bits);
+  for (int key = 0; key < 5000; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert(key < 100 ? *value == key : value == NULL);
+    }
+  hashmap_clear (map);
+  assert(map->filter != NULL && filter_bits (map) == 0);
+  filter_insert (map, 0, 10);
+  assert(hashmap_set_filter (map, 0) == 1);
+  assert(map->filter == NULL && map->filter_blocks == 0);
+  for (int key = 0; key < 20; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert(key < 10 ? *value == key : value == NULL);
+    }
+  assert(hashmap_set_filter (NULL, 1) == 0);
+  hashmap_free (&map);
+
+  // a filter that can not be built leaves the old one.
+  size_t left = 3;
+  allocator alloc = {limited_alloc, limited_realloc, limited_free, &left};
+  map = hashmap_alloc_with_allocator (hash_int, &alloc);
+  if (map == NULL){return;}
+  assert(hashmap_set_filter (map, 1) == 1);
+  uint64_t *filter = map->filter;
+  assert(hashmap_set_filter (map, 1) == 0);
+  assert(map->filter == filter && map->filter_blocks > 0);
+  hashmap_free (&map);
+}
+
+void test_filter_parallel_rehash ()
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  hashmap_set_rehash_threads (map, 4);
+  assert(hashmap_set_filter (map, 1) == 1);
+  filter_insert (map, 0, 100000);
+  for (int key = 0; key < 200000; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert(key < 100000 ? *value == key : value == NULL);
+    }
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks the filter of the keys (hashmap_set_filter) of the
+ * hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_filter (void)
+{
+  test_filter_lookups ();
+  test_filter_parallel_rehash ();
+}
+
+void test_str_insert_and_at ()
+{
+  hashmap_str *map = hashmap_str_alloc (int_value_cpy, int_value_free);
+  if (map == NULL){return;}
+  char key[64];
+  // short keys are stored in the nodes, long ones in the arena.
+  for (int i = 0; i < 2000; ++i)
+    {
+      int len = sprintf (key, i % 2 ? "tenant-%d" : "https://example.com/%d/"
+                                                   "path", i);
+      assert(hashmap_str_insert (map, key, (size_t) len, &i) == 1);
+      assert(hashmap_str_insert (map, key, (size_t) len, &i) == 0);
+    }
+  assert(map->size == 2000 && map->chunks != NULL);
+  for (int i = 0; i < 2000; ++i)
+    {
+      int len = sprintf (key, i % 2 ? "tenant-%d" : "https://example.com/%d/"
+                                                   "path", i);
+      int *value = hashmap_str_at (map, key, (size_t) len);
+      assert(value != NULL && *value == i);
+      // a prefix of a key is a different key.
+      assert(i % 2 || hashmap_str_at (map, key, (size_t) len - 1) == NULL);
+    }
+  // the keys are bytes, not C strings.
+  int zero = 0;
+  assert(hashmap_str_insert (map, "a\0b", 3, &zero) == 1);
+  assert(hashmap_str_insert (map, "a\0c", 3, &zero) == 1);
+  assert(hashmap_str_insert (map, "", 0, &zero) == 1);
+  assert(hashmap_str_at (map, "a", 1) == NULL);
+  assert(*(int *) hashmap_str_at (map, "", 0) == 0);
+  for (int i = 0; i < 2000; ++i)
+    {
+      int len = sprintf (key, i % 2 ? "tenant-%d" : "https://example.com/%d/"
+                                                   "path", i);
+      assert(hashmap_str_erase (map, key, (size_t) len) == 1);
+      assert(hashmap_str_erase (map, key, (size_t) len) == 0);
+    }
+  assert(map->size == 3 && map->capacity == HASH_MAP_INITIAL_CAP);
+  // the chunks of the erased long keys were freed.
+  assert(map->arena_used == 0 && map->dead_bytes == 0);
+  assert(map->chunks == NULL || map->chunks->next == NULL);
+  // erasing 3 of every 4 long keys leaves no chunk empty, so the arena is
+  // compacted.
+  for (int i = 0; i < 2000; ++i)
+    {
+      int len = sprintf (key, "https://example.com/%d/path", i);
+      assert(hashmap_str_insert (map, key, (size_t) len, &i) == 1);
+    }
+  size_t arena_used = map->arena_used;
+  for (int i = 0; i < 2000; ++i)
+    {
+      int len = sprintf (key, "https://example.com/%d/path", i);
+      assert(i % 4 == 0 || hashmap_str_erase (map, key, (size_t) len) == 1);
+    }
+  assert(map->arena_used < arena_used / 2);
+  assert(map->dead_bytes <= HASH_MAP_STR_CHUNK
+         || map->dead_bytes <= map->arena_used * HASH_MAP_STR_MAX_DEAD_FACTOR);
+  for (int i = 0; i < 2000; i += 4)
+    {
+      int len = sprintf (key, "https://example.com/%d/path", i);
+      assert(*(int *) hashmap_str_at (map, key, (size_t) len) == i);
+    }
+  assert(hashmap_str_insert (NULL, "a", 1, &zero) == 0);
+  assert(hashmap_str_insert (map, NULL, 1, &zero) == 0);
+  assert(hashmap_str_at (NULL, "a", 1) == NULL);
+  hashmap_str_free (&map);
+  assert(map == NULL);
+}
+
+void test_str_intern ()
+{
+  hashmap_str *map = hashmap_str_alloc (NULL, NULL);
+  if (map == NULL){return;}
+  char key[64];
+  const char *interned[1000];
+  for (int i = 0; i < 1000; ++i)
+    {
+      int len = sprintf (key, i % 3 ? "id%d" : "a rather long string %d", i);
+      interned[i] = hashmap_intern (map, key, (size_t) len);
+      assert(interned[i] != NULL && interned[i] != key);
+      assert(strcmp (interned[i], key) == 0);
+    }
+  // the stored strings do not move when the map grows.
+  for (int i = 0; i < 1000; ++i)
+    {
+      int len = sprintf (key, i % 3 ? "id%d" : "a rather long string %d", i);
+      assert(hashmap_intern (map, key, (size_t) len) == interned[i]);
+      assert(hashmap_str_at (map, key, (size_t) len) == NULL);
+    }
+  assert(map->size == 1000);
+  // the interned strings are not moved when the arena is compacted.
+  for (int i = 0; i < 4000; ++i)
+    {
+      int len = sprintf (key, "a long string which is not interned %d", i);
+      assert(hashmap_str_insert (map, key, (size_t) len, NULL) == 1);
+    }
+  for (int i = 0; i < 4000; ++i)
+    {
+      int len = sprintf (key, "a long string which is not interned %d", i);
+      assert(i % 4 == 0 || hashmap_str_erase (map, key, (size_t) len) == 1);
+    }
+  for (int i = 0; i < 1000; ++i)
+    {
+      int len = sprintf (key, i % 3 ? "id%d" : "a rather long string %d", i);
+      assert(hashmap_intern (map, key, (size_t) len) == interned[i]);
+      assert(strcmp (interned[i], key) == 0);
+    }
+  // the values are stored as they are without value functions.
+  int value = 5;
+  assert(hashmap_str_insert (map, "five", 4, &value) == 1);
+  assert(hashmap_str_at (map, "five", 4) == &value);
+  assert(hashmap_intern (NULL, "a", 1) == NULL);
+  hashmap_str_free (&map);
+}
+
+/**
+ * This function checks the hashmap_str of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_str (void)
+{
+  assert(hashmap_str_hash ("abc", 3) == hashmap_str_hash ("abcd", 3));
+  assert(hashmap_str_hash ("abc", 3) != hashmap_str_hash ("abc", 4));
+  test_str_insert_and_at ();
+  test_str_intern ();
+}
+
+void test_index_ranges ()
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  assert(hashmap_index_alloc (map, NULL) == NULL);
+  hashmap_index *index = hashmap_index_alloc (map, int_key_order);
+  if (index == NULL){hashmap_free (&map); return;}
+  assert(hashmap_index_range_of (index, NULL, NULL).count == 0);
+  // the even keys in [0, 2000), inserted in a scattered order.
+  for (int i = 0; i < 1000; ++i)
+    {
+      int key = (i * 7919) % 1000 * 2;
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  hashmap_index_range all = hashmap_index_range_of (index, NULL, NULL);
+  assert(all.count == 1000);
+  for (size_t i = 0; i < all.count; ++i)
+    {
+      assert(*(int *) all.nodes[i]->pair.key == (int) i * 2);
+    }
+  int key = 501;
+  assert(hashmap_index_lower_bound (index, &key) == 251);
+  key = 500;
+  assert(hashmap_index_lower_bound (index, &key) == 250);
+  key = 5000;
+  assert(hashmap_index_lower_bound (index, &key) == 1000);
+  int low = 101;
+  int high = 111;
+  hashmap_index_range range = hashmap_index_range_of (index, &low, &high);
+  assert(range.count == 5 && *(int *) range.nodes[0]->pair.key == 102);
+  assert(hashmap_index_range_of (index, &high, &low).count == 0);
+  // the index is sorted again after the map changed.
+  for (int erased = 0; erased < 1000; erased += 2)
+    {
+      assert(hashmap_erase (map, &erased) == 1);
+    }
+  key = 1999;
+  pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                  int_value_cmp, int_key_free, int_value_free, NULL};
+  assert(hashmap_insert (map, &in_pair) == 1);
+  all = hashmap_index_range_of (index, NULL, NULL);
+  assert(all.count == 501);
+  assert(*(int *) all.nodes[0]->pair.key == 1000);
+  assert(*(int *) all.nodes[500]->pair.key == 1999);
+  for (size_t i = 1; i < all.count; ++i)
+    {
+      assert(int_key_order (all.nodes[i - 1]->pair.key,
+                            all.nodes[i]->pair.key) < 0);
+    }
+  hashmap_clear (map);
+  assert(hashmap_index_range_of (index, NULL, NULL).count == 0);
+  hashmap_index_free (&index);
+  assert(index == NULL);
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks the hashmap_index of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_index (void)
+{
+  test_index_ranges ();
+  hashmap *map = hashmap_alloc_seeded (hash_int, int_key_order);
+  if (map == NULL){return;}
+  // the key order of the map is used by default.
+  hashmap_index *index = hashmap_index_alloc (map, NULL);
+  assert(index != NULL && index->key_order == int_key_order);
+  assert(hashmap_index_refresh (index) == 1 && index->count == 0);
+  hashmap_index_free (&index);
+  hashmap_free (&map);
+  assert(hashmap_index_refresh (NULL) == 0);
+}
+
+/**
+ * @return dynamic array of n rows, the key of row i is i % modulo and its
+ * value is 1.
+ */
+pair *join_rows (size_t n, int modulo)
+{
+  static int one = 1;
+  pair *rows = malloc (n * sizeof *rows);
+  int *keys = malloc (n * sizeof *keys);
+  if (rows == NULL || keys == NULL){exit (1);}
+  for (size_t i = 0; i < n; ++i)
+    {
+      keys[i] = (int) i % modulo;
+      rows[i] = (pair) {&keys[i], &one, int_key_cpy, int_value_cpy,
+                        int_key_cmp, int_value_cmp, int_key_free,
+                        int_value_free, NULL};
+    }
+  return rows;
+}
+
+/**
+ * frees the rows of join_rows.
+ */
+void free_join_rows (pair *rows)
+{
+  free (rows[0].key);
+  free (rows);
+}
+
+void test_join_matches (size_t threads)
+{
+  // 4 build rows for every key in [0, 5000), and the probe keys are
+  // [0, 10000).
+  pair *build = join_rows (20000, 5000);
+  pair *probe = join_rows (10000, 10000);
+  hashmap_join_result *result = hashmap_join (build, 20000, probe, 10000,
+                                              hash_int, threads);
+  assert(result != NULL && result->count == 20000);
+  int *found = calloc (10000, sizeof *found);
+  if (found == NULL){exit (1);}
+  for (size_t i = 0; i < result->count; ++i)
+    {
+      const hashmap_join_match *match = &result->matches[i];
+      assert(match->build >= build && match->build < build + 20000);
+      assert(match->probe >= probe && match->probe < probe + 10000);
+      int key = *(int *) match->probe->key;
+      assert(*(int *) match->build->key == key);
+      found[key]++;
+    }
+  for (int key = 0; key < 10000; ++key)
+    {
+      assert(found[key] == (key < 5000 ? 4 : 0));
+    }
+  free (found);
+  hashmap_join_result_free (&result);
+  assert(result == NULL);
+  // an empty side gives no matches.
+  result = hashmap_join (build, 20000, NULL, 0, hash_int, threads);
+  assert(result != NULL && result->count == 0);
+  hashmap_join_result_free (&result);
+  free_join_rows (probe);
+  free_join_rows (build);
+}
+
+void test_group_by (size_t threads)
+{
+  pair *rows = join_rows (50000, 1000);
+  hashmap_groups *groups = hashmap_group_by (rows, 50000, hash_int, add_value,
+                                             threads);
+  assert(groups != NULL && groups->size == 1000 && groups->n_maps > 1);
+  for (int key = 0; key < 2000; ++key)
+    {
+      int *sum = hashmap_groups_at (groups, &key);
+      assert(key < 1000 ? sum != NULL && *sum == 50 : sum == NULL);
+    }
+  hashmap_groups_free (&groups);
+  assert(groups == NULL);
+  assert(hashmap_group_by (rows, 50000, hash_int, NULL, threads) == NULL);
+  free_join_rows (rows);
+}
+
+/**
+ * This function checks the hash join and group-by of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_join (void)
+{
+  test_join_matches (1);
+  test_join_matches (4);
+  test_group_by (1);
+  test_group_by (3);
+  assert(hashmap_join (NULL, 1, NULL, 0, hash_int, 1) == NULL);
+}
+
+/**
+ * @return 1 if the int key ends with 0, 1 or 2.
+ */
+int key_ends_below_3 (const_keyT elem)
+{
+  return *(const int *) elem % 10 < 3;
+}
+
+/**
+ * @return 1 if the int value is odd and the int key is not 7.
+ */
+int odd_value_not_7 (const_keyT key, const_valueT value)
+{
+  return *(const int *) value % 2 == 1 && *(const int *) key != 7;
+}
+
+/**
+ * This function checks the hashmap_erase_if and hashmap_erase_if_pair
+ * functions of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_erase_if (void)
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int key = 0; key < 1000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  size_t capacity = map->capacity;
+  // 30% of the keys, the map is not sparse enough to shrink.
+  assert(hashmap_erase_if (map, key_ends_below_3) == 300);
+  assert(map->size == 700 && map->capacity == capacity);
+  for (int key = 0; key < 1000; ++key)
+    {
+      int *value = hashmap_at (map, &key);
+      assert(key % 10 < 3 ? value == NULL : *value == key);
+    }
+  assert(hashmap_erase_if (map, key_ends_below_3) == 0);
+  // the odd keys but 7 are left with the odd values, erasing them leaves
+  // a sparse map, which is re-sized once to the capacity that fits.
+  assert(hashmap_erase_if_pair (map, odd_value_not_7) == 399);
+  assert(map->size == 301 && map->capacity == 512);
+  int seven = 7;
+  assert(*(int *) hashmap_at (map, &seven) == 7);
+  assert(hashmap_erase_if (map, always_true) == 301);
+  assert(map->size == 0 && map->capacity == HASH_MAP_INITIAL_CAP);
+  assert(hashmap_erase_if (NULL, always_true) == 0);
+  assert(hashmap_erase_if (map, NULL) == 0);
+  assert(hashmap_erase_if_pair (map, NULL) == 0);
+  hashmap_free (&map);
+}
+
+/**
+ * @struct sum_acc
+ * The accumulator of sum_pair.
+ */
+typedef struct sum_acc {
+    long sum;
+    size_t count;
+} sum_acc;
+
+/**
+ * adds an int value to a sum_acc, stops at the value -1.
+ */
+int sum_pair (void *acc, const_keyT key, const_valueT value)
+{
+  (void) key;
+  if (*(const int *) value == -1)
+    {
+      return HASH_MAP_STOP;
+    }
+  ((sum_acc *) acc)->sum += *(const int *) value;
+  ((sum_acc *) acc)->count++;
+  return HASH_MAP_CONTINUE;
+}
+
+/**
+ * combines two sum_acc.
+ */
+void combine_sums (void *acc, const void *other)
+{
+  ((sum_acc *) acc)->sum += ((const sum_acc *) other)->sum;
+  ((sum_acc *) acc)->count += ((const sum_acc *) other)->count;
+}
+
+/**
+ * doubles an int value and counts it in ctx, stops after 10 values.
+ */
+int double_ten (const_keyT key, valueT value, void *ctx)
+{
+  (void) key;
+  *(int *) value *= 2;
+  return ++*(int *) ctx == 10 ? HASH_MAP_STOP : HASH_MAP_CONTINUE;
+}
+
+/**
+ * This function checks the hashmap_for_each and hashmap_reduce functions of
+ * the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_for_each (void)
+{
+  hashmap *map = hashmap_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int key = 1; key <= 100000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_insert (map, &in_pair) == 1);
+    }
+  long expected = 100000L * 100001 / 2;
+  for (size_t threads = 0; threads <= 8; threads += 4)
+    {
+      sum_acc acc = {0, 0};
+      assert(hashmap_reduce (map, sum_pair, combine_sums, &acc, sizeof acc,
+                             threads) == 1);
+      assert(acc.sum == expected && acc.count == 100000);
+    }
+  // without a combine function the reduction runs in the calling thread.
+  sum_acc acc = {0, 0};
+  assert(hashmap_reduce (map, sum_pair, NULL, &acc, sizeof acc, 4) == 1);
+  assert(acc.sum == expected && acc.count == 100000);
+  int counted = 0;
+  assert(hashmap_for_each (map, double_ten, &counted) == 10);
+  assert(counted == 10);
+  acc = (sum_acc) {0, 0};
+  assert(hashmap_reduce (map, sum_pair, combine_sums, &acc, sizeof acc, 1)
+         == 1);
+  assert(acc.sum > expected && acc.count == 100000);
+  // a reduction stops in all the threads.
+  int key = 5000;
+  *(int *) hashmap_at (map, &key) = -1;
+  acc = (sum_acc) {0, 0};
+  assert(hashmap_reduce (map, sum_pair, combine_sums, &acc, sizeof acc, 4)
+         == 0);
+  assert(acc.count < 100000);
+  assert(hashmap_reduce (NULL, sum_pair, NULL, &acc, sizeof acc, 1) == 0);
+  assert(hashmap_for_each (map, NULL, NULL) == 0);
+  hashmap_free (&map);
+}
+
+/**
+ * adds an int value to the long in ctx.
+ */
+int sum_value (const_keyT key, valueT value, void *ctx)
+{
+  (void) key;
+  *(long *) ctx += *(int *) value;
+  return HASH_MAP_CONTINUE;
+}
+
+/**
+ * the number of copies counted_value_cpy makes before it fails.
+ */
+static int copies_left = 0;
+
+/**
+ * copies an int value while copies_left is positive, fails after.
+ */
+void *counted_value_cpy (const_valueT value)
+{
+  if (copies_left == 0)
+    {
+      return NULL;
+    }
+  copies_left--;
+  return int_value_cpy (value);
+}
+
+/**
+ * a snapshot and the sum of its values, for cow_test_thread.
+ */
+typedef struct cow_test_arg {
+    hashmap_snapshot *snapshot;
+    long sum;
+} cow_test_arg;
+
+/**
+ * sums the values of a snapshot again and again, checks they do not change
+ * and releases it.
+ */
+void *cow_test_thread (void *arg)
+{
+  cow_test_arg *test_arg = arg;
+  for (int round = 0; round < 20; ++round)
+    {
+      long sum = 0;
+      assert(hashmap_snapshot_for_each (test_arg->snapshot, sum_value, &sum)
+             == 1000);
+      assert(sum == test_arg->sum);
+    }
+  hashmap_snapshot_release (&test_arg->snapshot);
+  return NULL;
+}
+
+/**
+ * This function checks the hashmap_cow and hashmap_snapshot functions of the
+ * hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_cow (void)
+{
+  hashmap_cow *map = hashmap_cow_alloc (hash_int);
+  if (map == NULL){return;}
+  for (int key = 0; key < 1000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_cow_insert (map, &in_pair) == 1);
+      assert(hashmap_cow_insert (map, &in_pair) == 0);
+    }
+  assert(map->table->size == 1000);
+  hashmap_snapshot *snapshot = hashmap_cow_snapshot (map);
+  assert(snapshot != NULL);
+  // the writes after the snapshot are not seen by it.
+  for (int key = 0; key < 1000; key += 2)
+    {
+      assert(hashmap_cow_erase (map, &key) == 1);
+      assert(hashmap_cow_erase (map, &key) == 0);
+    }
+  for (int key = 1; key < 1000; key += 2)
+    {
+      int value = -key;
+      pair in_pair = {&key, &value, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_cow_replace (map, &in_pair) == 1);
+    }
+  hashmap_snapshot *second = hashmap_cow_snapshot (map);
+  // the inserts resize the map twice.
+  for (int key = 1000; key < 4000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_cow_insert (map, &in_pair) == 1);
+    }
+  assert(map->table->size == 3500 && map->table->capacity == 8192);
+  for (int key = 0; key < 4000; ++key)
+    {
+      int *value = hashmap_snapshot_at (snapshot, &key);
+      assert(key < 1000 ? *value == key : value == NULL);
+      value = hashmap_snapshot_at (second, &key);
+      assert(key % 2 == 0 && key < 1000 ? value == NULL
+             : key < 1000 ? *value == -key : value == NULL);
+      value = hashmap_cow_at (map, &key);
+      assert(key % 2 == 0 && key < 1000 ? value == NULL
+             : key < 1000 ? *value == -key : *value == key);
+    }
+  long sum = 0;
+  assert(hashmap_snapshot_for_each (snapshot, sum_value, &sum) == 1000);
+  assert(sum == 999L * 1000 / 2);
+  assert(snapshot->table->capacity == 2048);
+  hashmap_snapshot_release (&snapshot);
+  assert(snapshot == NULL);
+  // the erases shrink the map, and the second snapshot outlives the map.
+  for (int key = 0; key < 4000; ++key)
+    {
+      hashmap_cow_erase (map, &key);
+    }
+  assert(map->table->size == 0 && map->table->capacity == HASH_MAP_INITIAL_CAP);
+  hashmap_cow_free (&map);
+  assert(map == NULL);
+  sum = 0;
+  assert(hashmap_snapshot_for_each (second, sum_value, &sum) == 500);
+  assert(sum == -(500L * 500));
+  hashmap_snapshot_release (&second);
+
+  // readers in other threads see their snapshots while the map is written.
+  map = hashmap_cow_alloc (hash_int);
+  for (int key = 0; key < 1000; ++key)
+    {
+      pair in_pair = {&key, &key, int_key_cpy, int_value_cpy, int_key_cmp,
+                      int_value_cmp, int_key_free, int_value_free, NULL};
+      assert(hashmap_cow_insert (map, &in_pair) == 1);
+    }
+  cow_test_arg args[4];
+  pthread_t threads[4];
+  for (int i = 0; i < 4; ++i)
+    {
+      args[i].snapshot = hashmap_cow_snapshot (map);
+      args[i].sum = 0;
+      hashmap_snapshot_for_each (args[i].snapshot, sum_value, &args[i].sum);
+      assert(pthread_create (&threads[i], NULL, cow_test_thread, &args[i])
+             == 0);
+      for (int key = i * 250; key < (i + 1) * 250; ++key)
+        {
+          int value = key + 1;
+          pair in_pair = {&key, &value, int_key_cpy, int_value_cpy,
+                          int_key_cmp, int_value_cmp, int_key_free,
+                          int_value_free, NULL};
+          assert(hashmap_cow_replace (map, &in_pair) == 1);
+        }
+    }
+  for (int i = 0; i < 4; ++i)
+    {
+      pthread_join (threads[i], NULL);
+      assert(args[i].sum == 999L * 1000 / 2 + i * 250);
+    }
+  sum = 0;
+  assert(hashmap_snapshot_for_each (NULL, sum_value, &sum) == 0);
+  assert(hashmap_cow_insert (map, NULL) == 0 && hashmap_cow_at (map, NULL)
+         == NULL);
+  // a failed copy is not stored, and a replaced value is kept.
+  int key = 5000;
+  int value = 1;
+  pair failing_pair = {&key, &value, int_key_cpy, failing_value_cpy,
+                       int_key_cmp, int_value_cmp, int_key_free,
+                       int_value_free, NULL};
+  assert(hashmap_cow_insert (map, &failing_pair) == 0);
+  assert(hashmap_cow_at (map, &key) == NULL);
+  pair counted_pair = {&key, &value, int_key_cpy, counted_value_cpy,
+                       int_key_cmp, int_value_cmp, int_key_free,
+                       int_value_free, NULL};
+  copies_left = 1;
+  assert(hashmap_cow_insert (map, &counted_pair) == 1);
+  value = 2;
+  assert(hashmap_cow_replace (map, &counted_pair) == 0);
+  assert(*(int *) hashmap_cow_at (map, &key) == 1);
+  hashmap_cow_free (&map);
+}
@@ -2,6 +2,22 @@
 #define TESTSUITE_H_
 
 #include "hashmap.h"
+#include "vector.h"
+#include "hashmap_file.h"
+#include "frozen_hashmap.h"
+#include "cuckoo_hashmap.h"
+#include "sharded_hashmap.h"
+#include "hashmap_stage.h"
+#include "lockfree_hashmap.h"
+#include "hashmap_mmap.h"
+#include "hashmap_cache.h"
+#include "hashmap_ttl.h"
+#include "hashset.h"
+#include "hashmap_multi.h"
+#include "hashmap_str.h"
+#include "hashmap_index.h"
+#include "hashmap_join.h"
+#include "hashmap_cow.h"
 #include <stdlib.h>
 #include <assert.h>
 
@@ -35,4 +51,155 @@ void test_hash_map_get_load_factor(void);
  */
 void test_hash_map_apply_if();
 
+/**
+ * This function checks the hashmap_find and hashmap_entry_erase functions of
+ * the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_find(void);
+
+/**
+ * This function checks the hashmap_save and hashmap_view functions of the
+ * hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_view(void);
+
+/**
+ * This function checks the hashmap_dump, hashmap_load and hashmap_reserve
+ * functions of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_dump(void);
+
+/**
+ * This function checks the hashmap_freeze function and the frozen_hashmap
+ * of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_freeze(void);
+
+/**
+ * This function checks the cuckoo_hashmap of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_cuckoo_hash_map(void);
+
+/**
+ * This function checks the hashmap_alloc_seeded function of the hashmap
+ * library (seeded hashes and sorted buckets).
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_seeded(void);
+
+/**
+ * This function checks the sharded_hashmap of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_sharded_hash_map(void);
+
+/**
+ * This function checks the hashmap_merge, hashmap_upsert and hashmap_update
+ * functions and the hashmap_stage of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_stage(void);
+
+/**
+ * This function checks the lockfree_hashmap of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_lockfree_hash_map(void);
+
+/**
+ * This function checks the parallel re-size (hashmap_set_rehash_threads)
+ * and the hashmap_shrink function of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_parallel_rehash(void);
+
+/**
+ * This function checks the hashmap_set_array_policy function and the mmap
+ * array policy of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_array_policy(void);
+
+/**
+ * This function checks the allocators of the hashmap library (the
+ * hashmap_alloc_with_allocator, vector_alloc_with_allocator and
+ * pair_alloc_with_allocator functions).
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_allocator(void);
+
+/**
+ * This function checks the hashmap_cache of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_cache(void);
+
+/**
+ * This function checks the hashmap_ttl of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_ttl(void);
+
+/**
+ * This function checks the hashset of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_set(void);
+
+/**
+ * This function checks the hashmap_multi of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_multi(void);
+
+/**
+ * This function checks the filter of the keys of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_filter(void);
+
+/**
+ * This function checks the hashmap_str of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_str(void);
+
+/**
+ * This function checks the hashmap_index of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_index(void);
+
+/**
+ * This function checks the hash join and group-by of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_join(void);
+
+/**
+ * This function checks the hashmap_erase_if functions of the hashmap
+ * library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_erase_if(void);
+
+/**
+ * This function checks the hashmap_for_each and hashmap_reduce functions of
+ * the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_for_each(void);
+
+/**
+ * This function checks the hashmap_cow and hashmap_snapshot functions of the
+ * hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_cow(void);
+
 #endif //TESTSUITE_H_
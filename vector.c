@@ -13,6 +13,28 @@
 vector *
 vector_alloc (vector_elem_cpy elem_copy_func, vector_elem_cmp elem_cmp_func,
               vector_elem_free elem_free_func)
+{
+  return vector_alloc_with_allocator (elem_copy_func, elem_cmp_func,
+                                      elem_free_func, NULL);
+}
+
+/**
+ * Dynamically allocates a new vector with the given allocator.
+ * @param elem_copy_func func which copies the element stored in the vector
+ * (returns dynamically allocated copy).
+ * @param elem_cmp_func func which is used to compare elements stored in the
+ * vector.
+ * @param elem_free_func func which frees elements stored in the vector.
+ * @param alloc the allocator of the vector, NULL for malloc. It must live
+ * as long as the vector.
+ * @return pointer to dynamically allocated vector.
+ * @if_fail return NULL.
+ */
+vector *
+vector_alloc_with_allocator (vector_elem_cpy elem_copy_func,
+                             vector_elem_cmp elem_cmp_func,
+                             vector_elem_free elem_free_func,
+                             const allocator *alloc)
 {
   if (elem_cmp_func == NULL || elem_copy_func == NULL || \
                                                      elem_free_func == NULL)
@@ -20,22 +42,23 @@ vector_alloc (vector_elem_cpy elem_copy_func, vector_elem_cmp elem_cmp_func,
       return NULL;
     }
 
-  vector *v = malloc (sizeof *v);
+  vector *v = allocator_alloc (alloc, sizeof *v);
   if (v == NULL)
     {
       return NULL;
     }
   v->capacity = VECTOR_INITIAL_CAP;
   v->size = 0;
-  v->data = calloc (v->capacity, sizeof (void *));
+  v->data = allocator_calloc (alloc, v->capacity, sizeof (void *));
   if (v->data == NULL)
     {
-      free (v);
+      allocator_free (alloc, v, sizeof *v);
       return NULL;
     }
   v->elem_copy_func = elem_copy_func;
   v->elem_cmp_func = elem_cmp_func;
   v->elem_free_func = elem_free_func;
+  v->allocator = alloc;
 
   return v;
 }
@@ -52,8 +75,9 @@ void vector_free (vector **p_vector)
         {
           (*p_vector)->elem_free_func (&((*p_vector)->data)[i]);
         }
-      free ((*p_vector)->data);
-      free (*p_vector);
+      allocator_free ((*p_vector)->allocator, (*p_vector)->data,
+                      (*p_vector)->capacity * sizeof (void *));
+      allocator_free ((*p_vector)->allocator, *p_vector, sizeof (vector));
       *p_vector = NULL;
     }
 
@@ -125,9 +149,10 @@ int vector_push_back (vector *vector, const void *value)
   // check if the load factor of the vector is too big.
   if (vector_get_load_factor (vector) > VECTOR_MAX_LOAD_FACTOR)
     {
-      void **tmp = realloc (vector->data,
-                            vector->capacity * VECTOR_GROWTH_FACTOR * \
-                            sizeof (void *));
+      void **tmp = allocator_realloc (vector->allocator, vector->data,
+                                      vector->capacity * sizeof (void *),
+                                      vector->capacity * VECTOR_GROWTH_FACTOR
+                                      * sizeof (void *));
       if (tmp == NULL)
         {
           return 0;
@@ -183,9 +208,10 @@ int vector_erase (vector *vector, size_t ind)
   // check if the load factor of the vector is too small.
   if (vector_get_load_factor (vector) < VECTOR_MIN_LOAD_FACTOR)
     {
-      void **tmp = realloc (vector->data,
-                            vector->capacity / VECTOR_GROWTH_FACTOR * \
-                            sizeof (void *));
+      void **tmp = allocator_realloc (vector->allocator, vector->data,
+                                      vector->capacity * sizeof (void *),
+                                      vector->capacity / VECTOR_GROWTH_FACTOR
+                                      * sizeof (void *));
       if (tmp == NULL)
         {
           return 0;
@@ -2,6 +2,7 @@
 #define VECTOR_H_
 
 #include <stdlib.h>
+#include "allocator.h"
 
 /**
  * @def VECTOR_INITIAL_CAP
@@ -61,6 +62,8 @@ typedef void (*vector_elem_free)(void **);
  * stored in the vector.
  * @param elem_free_func - a function which frees the elements stored
  * in the vector.
+ * @param allocator - the allocator of the vector and its data (NULL for
+ * malloc), the elements are allocated by elem_copy_func.
  */
 typedef struct vector {
   size_t capacity;
@@ -69,6 +72,7 @@ typedef struct vector {
   vector_elem_cpy elem_copy_func;
   vector_elem_cmp elem_cmp_func;
   vector_elem_free elem_free_func;
+  const allocator *allocator;
 } vector;
 
 /**
@@ -83,6 +87,22 @@ typedef struct vector {
 vector *vector_alloc(vector_elem_cpy elem_copy_func, vector_elem_cmp elem_cmp_func,
                      vector_elem_free elem_free_func);
 
+/**
+ * Dynamically allocates a new vector with the given allocator.
+ * @param elem_copy_func func which copies the element stored in the vector (returns
+ * dynamically allocated copy).
+ * @param elem_cmp_func func which is used to compare elements stored in the vector.
+ * @param elem_free_func func which frees elements stored in the vector.
+ * @param alloc the allocator of the vector, NULL for malloc. It must live
+ * as long as the vector.
+ * @return pointer to dynamically allocated vector.
+ * @if_fail return NULL.
+ */
+vector *vector_alloc_with_allocator(vector_elem_cpy elem_copy_func,
+                                    vector_elem_cmp elem_cmp_func,
+                                    vector_elem_free elem_free_func,
+                                    const allocator *alloc);
+
 /**
  * Frees a vector and the elements the vector itself allocated.
  * @param p_vector pointer to dynamically allocated pointer to vector.